@@ -0,0 +1,502 @@
+#include "bake.h"
+#include "fileSystem.h"
+#include "frame.h"
+#include "globals.h"
+#include "hash.h"
+#include "jobs.h"
+#include "layers.h"
+#include "library.h"
+#include "raycast.h"
+#include "renderList.h"
+#include "vectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#define BAKE_VERSION 2
+#define BAKE_RAYS 32 // Per vertex
+#define BAKE_RAY_LENGTH 8.0f // Meters, what's further doesn't occlude
+#define BAKE_RAY_BIAS 0.01f // Off the surface, so rays don't hit where they start
+#define BAKE_OPEN_SKY (5.0f / 6.0f) // What an upward vertex with nothing around gets, before scaling to 1
+#define BAKE_REGION_SIZE 32.0f // Meters, on x and y
+#define BAKE_TILE_VERTICES 1024
+#define BAKE_FRAME_BUDGET 0.03 // Seconds of baking per frame
+
+// An item as it was when the bake started
+struct BakeItem
+{
+    uint64_t key;
+    uint64_t modelId;
+    mat4 world;
+    float bounds[6];
+};
+
+struct BakeTile
+{
+    uint32_t item;
+    uint32_t first;
+    uint32_t count;
+};
+
+static std::unordered_map<uint64_t, std::vector<uint8_t>> results; // By item key
+static std::unordered_map<uint64_t, uint64_t> regionHashes; // As of the last bake
+static uint64_t revision = 0;
+static bool isSaveDirty = false;
+static std::string savedFilename; // Map the sidecar was last read or written for
+
+static GLuint buffer = 0;
+static size_t bufferBytes = 0;
+static uint64_t bufferRevision = 0;
+static std::unordered_map<uint64_t, int64_t> bufferOffsets;
+static std::vector<int64_t> itemOffsets;
+static uint64_t itemRevisions[3] = { 0, 0, 0 };
+static bool isItemsBuilt = false;
+
+static bool isBaking = false;
+static std::vector<BakeItem> items;
+static std::vector<BakeTile> tiles;
+static size_t nextTile = 0;
+static std::unordered_map<uint64_t, uint64_t> newRegionHashes;
+static std::unordered_map<uint64_t, std::vector<uint8_t>> staging; // Items partly baked
+static float directions[BAKE_RAYS][3]; // Cosine weighted around +z
+
+static uint64_t getItemKey(uint64_t modelId, const mat4& world)
+{
+    float matrix[4][4];
+    mat4_store(world, matrix);
+    return hash_bytes(hash_bytes(HASH_SEED, &modelId, sizeof(modelId)), matrix, sizeof(matrix));
+}
+
+// Regions the bounds reach, grown by margin
+static void forEachRegion(const float bounds[6], float margin, const std::function<void(uint64_t region)>& fn)
+{
+    auto x0 = (int32_t)std::floor((bounds[0] - margin) / BAKE_REGION_SIZE);
+    auto y0 = (int32_t)std::floor((bounds[1] - margin) / BAKE_REGION_SIZE);
+    auto x1 = (int32_t)std::floor((bounds[3] + margin) / BAKE_REGION_SIZE);
+    auto y1 = (int32_t)std::floor((bounds[4] + margin) / BAKE_REGION_SIZE);
+    for (auto y = y0; y <= y1; ++y)
+    {
+        for (auto x = x0; x <= x1; ++x)
+        {
+            fn(((uint64_t)(uint32_t)x << 32) | (uint64_t)(uint32_t)y);
+        }
+    }
+}
+
+// Hammersley points, projected up onto the hemisphere
+static void initDirections()
+{
+    for (int i = 0; i < BAKE_RAYS; ++i)
+    {
+        uint32_t bits = (uint32_t)i;
+        bits = (bits << 16) | (bits >> 16);
+        bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+        bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+        bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+        bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+        auto u = ((float)i + 0.5f) / BAKE_RAYS;
+        auto v = (float)bits * 2.3283064365386963e-10f;
+        auto r = std::sqrt(u);
+        auto angle = 6.2831853f * v;
+        directions[i][0] = r * std::cos(angle);
+        directions[i][1] = r * std::sin(angle);
+        directions[i][2] = std::sqrt(std::max(0.0f, 1.0f - u));
+    }
+}
+
+void bake_load()
+{
+    if (isBaking) frame_endContinuous(FrameReason::JobProgress);
+    isBaking = false;
+    items.clear();
+    tiles.clear();
+    staging.clear();
+    results.clear();
+    regionHashes.clear();
+    isSaveDirty = false;
+    savedFilename = document.filename;
+    ++revision;
+    if (document.filename.empty()) return;
+
+    MappedFile file;
+    if (!fileSystem_map(document.filename + BAKE_SIDECAR_EXTENSION, &file)) return; // Never baked
+
+    auto pData = file.pData;
+    auto pEnd = file.pData + file.size;
+    auto read = [&](void* pOut, size_t size)
+    {
+        if ((size_t)(pEnd - pData) < size) return false;
+        memcpy(pOut, pData, size);
+        pData += size;
+        return true;
+    };
+
+    // Anything off and it is baked again, the sidecar is only a cache
+    char magic[4];
+    uint32_t version = 0, regionCount = 0, resultCount = 0;
+    auto isValid = read(magic, 4) && !memcmp(magic, "BAKE", 4) &&
+        read(&version, sizeof(version)) && version == BAKE_VERSION &&
+        read(&regionCount, sizeof(regionCount)) && read(&resultCount, sizeof(resultCount));
+    for (uint32_t i = 0; isValid && i < regionCount; ++i)
+    {
+        uint64_t region, regionHash;
+        isValid = read(&region, sizeof(region)) && read(&regionHash, sizeof(regionHash));
+        if (isValid) regionHashes[region] = regionHash;
+    }
+    for (uint32_t i = 0; isValid && i < resultCount; ++i)
+    {
+        uint64_t key;
+        uint32_t count;
+        isValid = read(&key, sizeof(key)) && read(&count, sizeof(count)) && (size_t)(pEnd - pData) >= count;
+        if (!isValid) break;
+        results[key].assign(pData, pData + count);
+        pData += count;
+    }
+    if (!isValid)
+    {
+        results.clear();
+        regionHashes.clear();
+    }
+    fileSystem_unmap(&file);
+}
+
+void bake_save()
+{
+    // Also after a Save As, so the new map has its sidecar
+    if (document.filename.empty()) return;
+    if (!isSaveDirty && (document.filename == savedFilename || results.empty())) return;
+    isSaveDirty = false;
+
+    auto filename = document.filename + BAKE_SIDECAR_EXTENSION;
+    auto tempFilename = filename + ".tmp";
+    {
+        std::ofstream file(tempFilename, std::ios::binary);
+        uint32_t version = BAKE_VERSION;
+        uint32_t regionCount = (uint32_t)regionHashes.size();
+        uint32_t resultCount = (uint32_t)results.size();
+        file.write("BAKE", 4);
+        file.write((const char*)&version, sizeof(version));
+        file.write((const char*)&regionCount, sizeof(regionCount));
+        file.write((const char*)&resultCount, sizeof(resultCount));
+        for (const auto& kv : regionHashes)
+        {
+            file.write((const char*)&kv.first, sizeof(kv.first));
+            file.write((const char*)&kv.second, sizeof(kv.second));
+        }
+        for (const auto& kv : results)
+        {
+            uint32_t count = (uint32_t)kv.second.size();
+            file.write((const char*)&kv.first, sizeof(kv.first));
+            file.write((const char*)&count, sizeof(count));
+            file.write((const char*)kv.second.data(), count);
+        }
+        if (!file.good())
+        {
+            // Only baked again next time
+            fprintf(stderr, "Failed to write the bake: %s\n", tempFilename.c_str());
+            return;
+        }
+    }
+    if (!fileSystem_sync(tempFilename) || !fileSystem_replace(tempFilename, filename))
+    {
+        fprintf(stderr, "Failed to write the bake: %s\n", filename.c_str());
+        return;
+    }
+    savedFilename = document.filename;
+}
+
+void bake_start()
+{
+    if (isBaking) return;
+    initDirections();
+
+    // Items with their regions, what can be seen from a region is in its hash
+    const double worldOrigin[3] = { 0.0, 0.0, 0.0 };
+    const auto& renderItems = renderList_getItems();
+    auto pWorldMatrices = renderList_getEyeMatrices(worldOrigin);
+    std::vector<float> itemBounds;
+    renderList_getEyeBounds(worldOrigin, itemBounds);
+    items.clear();
+    newRegionHashes.clear();
+
+    // Rays go through the hidden layers, so showing or hiding one changes
+    // what its regions see
+    auto visibleMask = layers_getVisibleMask();
+    std::vector<uint8_t> itemVisibility(renderItems.size(), 1);
+    for (const auto& batch : renderList_getBatches())
+    {
+        auto isVisible = (uint8_t)((visibleMask >> batch.layer) & 1);
+        std::fill_n(itemVisibility.begin() + batch.first, batch.count, isVisible);
+    }
+
+    std::unordered_set<uint64_t> keys;
+    for (size_t i = 0; i < renderItems.size(); ++i)
+    {
+        auto model = library_getModel(renderItems[i].modelId);
+        BakeItem item;
+        item.modelId = renderItems[i].modelId;
+        item.world = pWorldMatrices[i];
+        item.key = getItemKey(item.modelId, item.world);
+        memcpy(item.bounds, &itemBounds[i * 6], sizeof(item.bounds));
+        keys.insert(item.key);
+
+        // Streamed in or out and shown or hidden change it too. Summed, so
+        // the order doesn't matter and duplicates don't cancel out.
+        const uint8_t state[2] = { (uint8_t)(model.pVertices ? 1 : 0), itemVisibility[i] };
+        auto contribution = hash_bytes(item.key, state, sizeof(state));
+        forEachRegion(item.bounds, BAKE_RAY_LENGTH, [&](uint64_t region) { newRegionHashes[region] += contribution; });
+        items.push_back(item);
+    }
+
+    std::unordered_set<uint64_t> dirtyRegions;
+    for (const auto& kv : newRegionHashes)
+    {
+        auto it = regionHashes.find(kv.first);
+        if (it == regionHashes.end() || it->second != kv.second) dirtyRegions.insert(kv.first);
+    }
+
+    // Results of items gone, moved or of another model
+    for (auto it = results.begin(); it != results.end();)
+    {
+        if (keys.count(it->first)) ++it;
+        else it = results.erase(it);
+    }
+
+    // Items without a result or in a region that changed, cut in tiles
+    tiles.clear();
+    std::unordered_set<uint64_t> queued;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        const auto& item = items[i];
+        auto model = library_getModel(item.modelId);
+        if (!model.pVertices) continue;
+        auto vertexCount = (uint32_t)(model.pVertices->positions.size() / 3);
+        if (!vertexCount || !queued.insert(item.key).second) continue;
+        auto it = results.find(item.key);
+        auto isDirty = it == results.end() || it->second.size() != vertexCount;
+        if (!isDirty) forEachRegion(item.bounds, 0.0f, [&](uint64_t region) { if (dirtyRegions.count(region)) isDirty = true; });
+        if (!isDirty) continue;
+        for (uint32_t first = 0; first < vertexCount; first += BAKE_TILE_VERTICES)
+        {
+            tiles.push_back({ (uint32_t)i, first, std::min((uint32_t)BAKE_TILE_VERTICES, vertexCount - first) });
+        }
+    }
+
+    ++revision;
+    isSaveDirty = true;
+    nextTile = 0;
+    isBaking = true;
+    frame_beginContinuous(FrameReason::JobProgress);
+}
+
+static void bakeTile(const BakeTile& tile, std::vector<RaycastRay>& rays)
+{
+    const auto& item = items[tile.item];
+    auto model = library_getModel(item.modelId);
+    if (!model.pVertices)
+    {
+        // Streamed out meanwhile, it has no result so the next bake does it
+        staging.erase(item.key);
+        return;
+    }
+    auto vertexCount = (uint32_t)(model.pVertices->positions.size() / 3);
+    const auto& positions = model.pVertices->positions;
+    const auto& normals = model.pVertices->normals;
+
+    // Normals go through the inverse transpose, so they stay perpendicular
+    // with non uniform scales. Its rows are the inverse's columns.
+    mat4 inverse;
+    if (!mat4_inverseAffine(item.world, inverse)) inverse = item.world; // Flattened, its normals mean little anyway
+    float normalRows[4][4];
+    mat4_store(inverse, normalRows);
+
+    rays.resize((size_t)tile.count * BAKE_RAYS);
+    jobs_parallelFor(tile.count, 64, [&](size_t begin, size_t end)
+    {
+        for (auto v = begin; v < end; ++v)
+        {
+            auto index = tile.first + v;
+            float position[4], normal[4];
+            float4_store(position, mat4_transformPoint(item.world, float4_set(positions[index * 3], positions[index * 3 + 1], positions[index * 3 + 2], 1.0f)));
+            auto pNormal = &normals[index * 3];
+            for (int j = 0; j < 3; ++j)
+            {
+                normal[j] = normalRows[j][0] * pNormal[0] + normalRows[j][1] * pNormal[1] + normalRows[j][2] * pNormal[2];
+            }
+            auto length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            if (length > 0.0f)
+            {
+                for (int k = 0; k < 3; ++k) normal[k] /= length;
+            }
+            else
+            {
+                normal[0] = 0.0f;
+                normal[1] = 0.0f;
+                normal[2] = 1.0f;
+            }
+
+            // Any tangent will do, the directions are spread evenly
+            float tangent[3], bitangent[3];
+            if (std::fabs(normal[2]) < 0.9f)
+            {
+                tangent[0] = normal[1];
+                tangent[1] = -normal[0];
+                tangent[2] = 0.0f;
+            }
+            else
+            {
+                tangent[0] = 0.0f;
+                tangent[1] = normal[2];
+                tangent[2] = -normal[1];
+            }
+            length = std::sqrt(tangent[0] * tangent[0] + tangent[1] * tangent[1] + tangent[2] * tangent[2]);
+            for (int k = 0; k < 3; ++k) tangent[k] /= length;
+            bitangent[0] = normal[1] * tangent[2] - normal[2] * tangent[1];
+            bitangent[1] = normal[2] * tangent[0] - normal[0] * tangent[2];
+            bitangent[2] = normal[0] * tangent[1] - normal[1] * tangent[0];
+
+            for (int r = 0; r < BAKE_RAYS; ++r)
+            {
+                auto& ray = rays[v * BAKE_RAYS + r];
+                const auto pDirection = directions[r];
+                for (int k = 0; k < 3; ++k)
+                {
+                    ray.origin[k] = position[k] + normal[k] * BAKE_RAY_BIAS;
+                    ray.dir[k] = tangent[k] * pDirection[0] + bitangent[k] * pDirection[1] + normal[k] * pDirection[2];
+                }
+                ray.t = BAKE_RAY_LENGTH;
+                ray.ignore = RAYCAST_NONE;
+            }
+        }
+    });
+    raycast_castBatch(rays.data(), rays.size());
+
+    // Rays that got out see the sky, brighter upward
+    auto& lights = staging[item.key];
+    lights.resize(vertexCount);
+    for (uint32_t v = 0; v < tile.count; ++v)
+    {
+        auto sky = 0.0f;
+        for (int r = 0; r < BAKE_RAYS; ++r)
+        {
+            const auto& ray = rays[v * BAKE_RAYS + r];
+            if (ray.entity == RAYCAST_NONE) sky += 0.5f + 0.5f * ray.dir[2];
+        }
+        auto light = std::min(1.0f, sky / (BAKE_RAYS * BAKE_OPEN_SKY));
+        lights[tile.first + v] = (uint8_t)(light * 255.0f + 0.5f);
+    }
+
+    if (tile.first + tile.count == vertexCount)
+    {
+        results[item.key] = std::move(lights);
+        staging.erase(item.key);
+        ++revision;
+    }
+}
+
+void bake_update()
+{
+    if (!isBaking) return;
+
+    std::vector<RaycastRay> rays;
+    auto startTime = frame_getTime();
+    while (nextTile < tiles.size() && frame_getTime() - startTime < BAKE_FRAME_BUDGET)
+    {
+        bakeTile(tiles[nextTile++], rays);
+    }
+    if (nextTile < tiles.size()) return;
+
+    // Regions are clean as of when the bake started
+    regionHashes.swap(newRegionHashes);
+    newRegionHashes.clear();
+    items.clear();
+    tiles.clear();
+    staging.clear();
+    isBaking = false;
+    ++revision;
+    isSaveDirty = true;
+    frame_endContinuous(FrameReason::JobProgress);
+    bake_save();
+}
+
+bool bake_isBusy()
+{
+    return isBaking;
+}
+
+float bake_getProgress()
+{
+    return tiles.empty() ? 1.0f : (float)nextTile / (float)tiles.size();
+}
+
+static void updateBuffer()
+{
+    if (buffer && bufferRevision == revision) return;
+    bufferRevision = revision;
+
+    std::vector<uint8_t> data;
+    bufferOffsets.clear();
+    for (const auto& kv : results)
+    {
+        bufferOffsets[kv.first] = (int64_t)data.size();
+        data.insert(data.end(), kv.second.begin(), kv.second.end());
+    }
+    if (!buffer) glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, data.size(), data.empty() ? nullptr : (const GLvoid*)data.data(), GL_STATIC_DRAW);
+    bufferBytes = data.size();
+}
+
+const int64_t* bake_getItemOffsets()
+{
+    updateBuffer();
+
+    const uint64_t revisions[3] = {
+        entities_getRevision(document.entities),
+        library_getResidency(),
+        revision
+    };
+    if (isItemsBuilt && !memcmp(revisions, itemRevisions, sizeof(revisions))) return itemOffsets.data();
+    memcpy(itemRevisions, revisions, sizeof(revisions));
+    isItemsBuilt = true;
+
+    // A result only counts for the model as it is now
+    const double worldOrigin[3] = { 0.0, 0.0, 0.0 };
+    const auto& renderItems = renderList_getItems();
+    auto pWorldMatrices = renderList_getEyeMatrices(worldOrigin);
+    itemOffsets.assign(renderItems.size(), -1);
+    for (size_t i = 0; i < renderItems.size(); ++i)
+    {
+        auto key = getItemKey(renderItems[i].modelId, pWorldMatrices[i]);
+        auto it = bufferOffsets.find(key);
+        if (it == bufferOffsets.end()) continue;
+        auto model = library_getModel(renderItems[i].modelId);
+        if (!model.pVertices || results[key].size() * 3 != model.pVertices->positions.size()) continue;
+        itemOffsets[i] = it->second;
+    }
+    return itemOffsets.data();
+}
+
+GLuint bake_getBuffer()
+{
+    updateBuffer();
+    return buffer;
+}
+
+void bake_getMemoryUsage(size_t* pGpu, size_t* pCpu)
+{
+    *pGpu = bufferBytes;
+    *pCpu = 0;
+    for (const auto& kv : results)
+    {
+        *pCpu += kv.second.size();
+    }
+}
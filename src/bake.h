@@ -0,0 +1,40 @@
+#ifndef BAKE_H_INCLUDED
+#define BAKE_H_INCLUDED
+
+#include <GL/gl3w.h>
+
+#include <cinttypes>
+#include <cstddef>
+
+#define BAKE_SIDECAR_EXTENSION ".bake" // Next to the map
+
+// Sky light baked per vertex for every render item: the share of the sky a
+// vertex sees, rays that escape counting more the more upward they go, so
+// it holds the ambient occlusion too.
+//
+// Baking traces rays from the vertices through raycast, tiles of vertices
+// at a time over all the cores, within a frame budget so the editor stays
+// responsive. Only what changed is baked again: the world is cut in
+// regions, whose hash covers the items that reach it or their rays could.
+// Items touching a region whose hash changed since the last bake are baked
+// again, and so are those without a result yet.
+//
+// Results are found by a hash of the item's model and world matrix, so
+// they stay with what they were baked for across edits and sessions.
+// Models that aren't streamed in aren't baked nor occlude, their regions
+// are baked again once they are.
+void bake_load(); // With the map, from its sidecar
+void bake_save(); // To the sidecar if it changed, done when a bake ends
+void bake_start(); // Bakes what changed
+void bake_update(); // Once per frame, on the main thread
+bool bake_isBusy();
+float bake_getProgress(); // 0 to 1
+
+// For drawing, per render item the byte offset of its model's first vertex
+// in the buffer, or -1 if it has no result. Light is one normalized byte
+// per vertex. Before renderList_getEyeMatrices, which this can recompute.
+const int64_t* bake_getItemOffsets();
+GLuint bake_getBuffer();
+void bake_getMemoryUsage(size_t* pGpu, size_t* pCpu); // Bytes of the buffer and of the results
+
+#endif
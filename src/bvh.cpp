@@ -0,0 +1,638 @@
+#include "bvh.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BVH_SSE2
+#include <emmintrin.h>
+#endif
+
+#define BVH_BIN_COUNT 16
+#define BVH_LEAF_SIZE 4 // Always a leaf at this size
+#define BVH_MAX_LEAF_SIZE 16 // Up to this size, a leaf if SAH says splitting doesn't pay
+#define BVH_MAX_DEPTH 64 // Bounds the traversal stacks
+#define BVH_PARALLEL_SIZE 4096 // Subtrees this big are built on the job threads
+#define BVH_SCAN_GRAIN 32768 // Primitives per job when scanning big nodes
+
+struct BvhBounds
+{
+    float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    void grow(const float* pMin, const float* pMax)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            min[a] = std::min(min[a], pMin[a]);
+            max[a] = std::max(max[a], pMax[a]);
+        }
+    }
+
+    void grow(const BvhBounds& other)
+    {
+        grow(other.min, other.max);
+    }
+
+    // Half the surface area, all SAH needs
+    float getArea() const
+    {
+        auto dx = max[0] - min[0];
+        auto dy = max[1] - min[1];
+        auto dz = max[2] - min[2];
+        if (dx < 0) return 0;
+        return dx * dy + dy * dz + dz * dx;
+    }
+};
+
+struct BvhBin
+{
+    BvhBounds bounds;
+    uint32_t count = 0;
+};
+
+struct NodeScan
+{
+    BvhBounds bounds;
+    BvhBounds centroidBounds;
+};
+
+struct BinScan
+{
+    BvhBin bins[3][BVH_BIN_COUNT];
+};
+
+// Primitives are partitioned by value so scans over a node read memory in
+// order
+struct BuildPrimitive
+{
+    float min[3];
+    uint32_t index;
+    float max[3];
+    float unused;
+
+    float getCentroid(int a) const
+    {
+        return (min[a] + max[a]) * 0.5f;
+    }
+};
+
+struct BuildContext
+{
+    BuildPrimitive* pPrimitives;
+    BvhNode* pNodes;
+    std::atomic<uint32_t> nodeCount;
+};
+
+// Runs scanRange over [begin, end), big ranges are split across the job
+// threads and their partial results merged.
+template<typename T, typename ScanRange, typename Merge>
+static T scanPrimitives(uint32_t begin, uint32_t end, ScanRange scanRange, Merge merge)
+{
+    auto count = (size_t)(end - begin);
+    if (count <= BVH_SCAN_GRAIN)
+    {
+        T result;
+        scanRange(result, begin, end);
+        return result;
+    }
+
+    std::vector<T> partials((count + BVH_SCAN_GRAIN - 1) / BVH_SCAN_GRAIN);
+    jobs_parallelFor(count, BVH_SCAN_GRAIN, [&](size_t rangeBegin, size_t rangeEnd)
+    {
+        scanRange(partials[rangeBegin / BVH_SCAN_GRAIN], begin + (uint32_t)rangeBegin, begin + (uint32_t)rangeEnd);
+    });
+    for (size_t i = 1; i < partials.size(); ++i) merge(partials[0], partials[i]);
+    return partials[0];
+}
+
+// The scans are plain loops over locals, they are the hot part of the build
+static void scanBounds(const BuildPrimitive* pPrimitives, uint32_t begin, uint32_t end, NodeScan& out)
+{
+    BvhBounds bounds = out.bounds;
+    BvhBounds centroidBounds = out.centroidBounds;
+    for (auto i = begin; i < end; ++i)
+    {
+        const auto& primitive = pPrimitives[i];
+        for (int a = 0; a < 3; ++a)
+        {
+            auto centroid = primitive.getCentroid(a);
+            bounds.min[a] = std::min(bounds.min[a], primitive.min[a]);
+            bounds.max[a] = std::max(bounds.max[a], primitive.max[a]);
+            centroidBounds.min[a] = std::min(centroidBounds.min[a], centroid);
+            centroidBounds.max[a] = std::max(centroidBounds.max[a], centroid);
+        }
+    }
+    out.bounds = bounds;
+    out.centroidBounds = centroidBounds;
+}
+
+static int getBin(const BuildPrimitive& primitive, int a, float offset, float scale)
+{
+    return std::min(BVH_BIN_COUNT - 1, (int)((primitive.getCentroid(a) - offset) * scale));
+}
+
+static void scanBins(const BuildPrimitive* pPrimitives, uint32_t begin, uint32_t end, const float offsetsIn[3], const float scalesIn[3], BinScan& out)
+{
+    const float offsets[3] = { offsetsIn[0], offsetsIn[1], offsetsIn[2] };
+    const float scales[3] = { scalesIn[0], scalesIn[1], scalesIn[2] };
+    for (auto i = begin; i < end; ++i)
+    {
+        const auto& primitive = pPrimitives[i];
+        for (int a = 0; a < 3; ++a)
+        {
+            auto& bin = out.bins[a][getBin(primitive, a, offsets[a], scales[a])];
+            for (int k = 0; k < 3; ++k)
+            {
+                bin.bounds.min[k] = std::min(bin.bounds.min[k], primitive.min[k]);
+                bin.bounds.max[k] = std::max(bin.bounds.max[k], primitive.max[k]);
+            }
+            ++bin.count;
+        }
+    }
+}
+
+static void buildNode(BuildContext& ctx, uint32_t nodeIndex, uint32_t begin, uint32_t end, int depth)
+{
+    auto& node = ctx.pNodes[nodeIndex];
+    auto count = end - begin;
+
+    auto scan = scanPrimitives<NodeScan>(begin, end,
+        [&](NodeScan& result, uint32_t rangeBegin, uint32_t rangeEnd)
+        {
+            scanBounds(ctx.pPrimitives, rangeBegin, rangeEnd, result);
+        },
+        [](NodeScan& result, const NodeScan& other)
+        {
+            result.bounds.grow(other.bounds);
+            result.centroidBounds.grow(other.centroidBounds);
+        });
+
+    memcpy(node.min, scan.bounds.min, sizeof(node.min));
+    memcpy(node.max, scan.bounds.max, sizeof(node.max));
+    node.first = begin;
+    node.count = count;
+    if (count <= BVH_LEAF_SIZE || depth >= BVH_MAX_DEPTH) return;
+
+    // Bin the centroids along each axis
+    const auto& centroidBounds = scan.centroidBounds;
+    float scales[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        auto extent = centroidBounds.max[a] - centroidBounds.min[a];
+        scales[a] = extent > 0 ? (float)BVH_BIN_COUNT / extent : 0;
+    }
+    auto binScan = scanPrimitives<BinScan>(begin, end,
+        [&](BinScan& result, uint32_t rangeBegin, uint32_t rangeEnd)
+        {
+            scanBins(ctx.pPrimitives, rangeBegin, rangeEnd, centroidBounds.min, scales, result);
+        },
+        [](BinScan& result, const BinScan& other)
+        {
+            for (int a = 0; a < 3; ++a)
+            {
+                for (int b = 0; b < BVH_BIN_COUNT; ++b)
+                {
+                    result.bins[a][b].bounds.grow(other.bins[a][b].bounds);
+                    result.bins[a][b].count += other.bins[a][b].count;
+                }
+            }
+        });
+
+    // Cheapest split between bins, sweeping from both ends
+    auto bestCost = FLT_MAX;
+    auto bestAxis = -1;
+    auto bestSplit = 0;
+    for (int a = 0; a < 3; ++a)
+    {
+        if (!scales[a]) continue;
+        const auto& bins = binScan.bins[a];
+
+        float leftAreas[BVH_BIN_COUNT];
+        uint32_t leftCounts[BVH_BIN_COUNT];
+        BvhBounds left;
+        uint32_t leftCount = 0;
+        for (int b = 0; b < BVH_BIN_COUNT - 1; ++b)
+        {
+            left.grow(bins[b].bounds);
+            leftCount += bins[b].count;
+            leftAreas[b] = left.getArea();
+            leftCounts[b] = leftCount;
+        }
+
+        BvhBounds right;
+        uint32_t rightCount = 0;
+        for (int b = BVH_BIN_COUNT - 1; b > 0; --b)
+        {
+            right.grow(bins[b].bounds);
+            rightCount += bins[b].count;
+            if (!leftCounts[b - 1] || !rightCount) continue;
+            auto cost = leftAreas[b - 1] * leftCounts[b - 1] + right.getArea() * rightCount;
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = a;
+                bestSplit = b;
+            }
+        }
+    }
+
+    // Traversing a node costs about as much as testing a primitive
+    auto area = scan.bounds.getArea();
+    if (count <= BVH_MAX_LEAF_SIZE && (bestAxis < 0 || area + bestCost >= area * count)) return;
+
+    uint32_t mid;
+    if (bestAxis >= 0)
+    {
+        auto pMid = std::partition(ctx.pPrimitives + begin, ctx.pPrimitives + end, [&](const BuildPrimitive& primitive)
+        {
+            return getBin(primitive, bestAxis, centroidBounds.min[bestAxis], scales[bestAxis]) < bestSplit;
+        });
+        mid = (uint32_t)(pMid - ctx.pPrimitives);
+    }
+    else
+    {
+        // All centroids in the same spot, any halves will do
+        mid = begin + count / 2;
+    }
+
+    auto left = ctx.nodeCount.fetch_add(2);
+    node.first = left;
+    node.count = 0;
+    if (count >= BVH_PARALLEL_SIZE)
+    {
+        jobs_parallelFor(2, 1, [&](size_t first, size_t last)
+        {
+            for (auto child = first; child < last; ++child)
+            {
+                if (child == 0) buildNode(ctx, left, begin, mid, depth + 1);
+                else buildNode(ctx, left + 1, mid, end, depth + 1);
+            }
+        });
+    }
+    else
+    {
+        buildNode(ctx, left, begin, mid, depth + 1);
+        buildNode(ctx, left + 1, mid, end, depth + 1);
+    }
+}
+
+void bvh_build(Bvh& bvh, const float* pBounds, size_t count)
+{
+    bvh.nodes.clear();
+    bvh.primitives.clear();
+    if (!count) return;
+
+    std::vector<BuildPrimitive> primitives(count);
+    jobs_parallelFor(count, BVH_SCAN_GRAIN, [&](size_t begin, size_t end)
+    {
+        for (auto i = begin; i < end; ++i)
+        {
+            auto& primitive = primitives[i];
+            memcpy(primitive.min, pBounds + i * 6, sizeof(primitive.min));
+            memcpy(primitive.max, pBounds + i * 6 + 3, sizeof(primitive.max));
+            primitive.index = (uint32_t)i;
+        }
+    });
+
+    // A binary tree with at least one primitive per leaf
+    bvh.nodes.resize(count * 2);
+    BuildContext ctx;
+    ctx.pPrimitives = primitives.data();
+    ctx.pNodes = bvh.nodes.data();
+    ctx.nodeCount = 1;
+
+    buildNode(ctx, 0, 0, (uint32_t)count, 0);
+
+    bvh.nodes.resize(ctx.nodeCount);
+    bvh.nodes.shrink_to_fit();
+    bvh.primitives.resize(count);
+    for (size_t i = 0; i < count; ++i) bvh.primitives[i] = primitives[i].index;
+}
+
+void bvh_buildMesh(MeshBvh& mesh, const float* pTriangles, size_t triangleCount)
+{
+    std::vector<float> bounds(triangleCount * 6);
+    jobs_parallelFor(triangleCount, BVH_SCAN_GRAIN, [&](size_t begin, size_t end)
+    {
+        for (auto i = begin; i < end; ++i)
+        {
+            auto pTriangle = pTriangles + i * 9;
+            for (int a = 0; a < 3; ++a)
+            {
+                bounds[i * 6 + a] = std::min(std::min(pTriangle[a], pTriangle[3 + a]), pTriangle[6 + a]);
+                bounds[i * 6 + 3 + a] = std::max(std::max(pTriangle[a], pTriangle[3 + a]), pTriangle[6 + a]);
+            }
+        }
+    });
+    bvh_build(mesh.bvh, bounds.data(), triangleCount);
+
+    // Store in leaf order with the edges ready for intersection
+    mesh.triangles.resize(triangleCount * 9);
+    for (size_t i = 0; i < triangleCount; ++i)
+    {
+        auto pSrc = pTriangles + mesh.bvh.primitives[i] * 9;
+        auto pDst = &mesh.triangles[i * 9];
+        for (int a = 0; a < 3; ++a)
+        {
+            pDst[a] = pSrc[a];
+            pDst[3 + a] = pSrc[3 + a] - pSrc[a];
+            pDst[6 + a] = pSrc[6 + a] - pSrc[a];
+        }
+    }
+    mesh.bvh.primitives.clear();
+    mesh.bvh.primitives.shrink_to_fit();
+}
+
+// 1 / d without infinities, they turn into NaNs against flat boxes
+static float getInverse(float d)
+{
+    return std::fabs(d) > 1e-20f ? 1.0f / d : std::copysign(1e20f, d);
+}
+
+// Distance where the ray enters the box, FLT_MAX if it misses it before t
+static float intersectBox(const BvhNode& node, const float origin[3], const float inv[3], float t)
+{
+    auto tMin = 0.0f;
+    auto tMax = t;
+    for (int a = 0; a < 3; ++a)
+    {
+        auto t0 = (node.min[a] - origin[a]) * inv[a];
+        auto t1 = (node.max[a] - origin[a]) * inv[a];
+        tMin = std::max(tMin, std::min(t0, t1));
+        tMax = std::min(tMax, std::max(t0, t1));
+    }
+    return tMin <= tMax ? tMin : FLT_MAX;
+}
+
+// Calls visit with leaf slots, nearest child first
+template<typename Visit>
+static void traverse(const Bvh& bvh, const float origin[3], const float dir[3], float* pT, Visit visit)
+{
+    if (bvh.nodes.empty()) return;
+
+    const float inv[3] = { getInverse(dir[0]), getInverse(dir[1]), getInverse(dir[2]) };
+    auto pNodes = bvh.nodes.data();
+    if (intersectBox(pNodes[0], origin, inv, *pT) == FLT_MAX) return;
+
+    uint32_t stack[BVH_MAX_DEPTH + 1];
+    float stackDistances[BVH_MAX_DEPTH + 1];
+    int stackSize = 0;
+    auto pNode = pNodes;
+    while (true)
+    {
+        if (pNode->count)
+        {
+            for (uint32_t i = 0; i < pNode->count; ++i) visit(pNode->first + i);
+        }
+        else
+        {
+            auto nearIndex = pNode->first;
+            auto farIndex = nearIndex + 1;
+            auto nearDistance = intersectBox(pNodes[nearIndex], origin, inv, *pT);
+            auto farDistance = intersectBox(pNodes[farIndex], origin, inv, *pT);
+            if (farDistance < nearDistance)
+            {
+                std::swap(nearIndex, farIndex);
+                std::swap(nearDistance, farDistance);
+            }
+            if (nearDistance != FLT_MAX)
+            {
+                if (farDistance != FLT_MAX)
+                {
+                    stack[stackSize] = farIndex;
+                    stackDistances[stackSize] = farDistance;
+                    ++stackSize;
+                }
+                pNode = pNodes + nearIndex;
+                continue;
+            }
+        }
+
+        // Skip nodes that a closer hit has put out of reach
+        while (true)
+        {
+            if (!stackSize) return;
+            --stackSize;
+            if (stackDistances[stackSize] <= *pT)
+            {
+                pNode = pNodes + stack[stackSize];
+                break;
+            }
+        }
+    }
+}
+
+// Double sided Möller-Trumbore against v0, e1, e2
+static bool intersectTriangle(const float* pTriangle, const float origin[3], const float dir[3], float* pT)
+{
+    auto pV0 = pTriangle;
+    auto pE1 = pTriangle + 3;
+    auto pE2 = pTriangle + 6;
+
+    const float p[3] = {
+        dir[1] * pE2[2] - dir[2] * pE2[1],
+        dir[2] * pE2[0] - dir[0] * pE2[2],
+        dir[0] * pE2[1] - dir[1] * pE2[0]
+    };
+    auto det = pE1[0] * p[0] + pE1[1] * p[1] + pE1[2] * p[2];
+    if (std::fabs(det) < 1e-20f) return false;
+    auto inv = 1.0f / det;
+
+    const float s[3] = { origin[0] - pV0[0], origin[1] - pV0[1], origin[2] - pV0[2] };
+    auto u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+    if (u < 0 || u > 1) return false;
+
+    const float q[3] = {
+        s[1] * pE1[2] - s[2] * pE1[1],
+        s[2] * pE1[0] - s[0] * pE1[2],
+        s[0] * pE1[1] - s[1] * pE1[0]
+    };
+    auto v = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) * inv;
+    if (v < 0 || u + v > 1) return false;
+
+    auto t = (pE2[0] * q[0] + pE2[1] * q[1] + pE2[2] * q[2]) * inv;
+    if (t < 0 || t >= *pT) return false;
+    *pT = t;
+    return true;
+}
+
+#if defined(BVH_SSE2)
+// Rays of the packet that reach the box before their t
+static int intersectBox4(const BvhNode& node, const __m128 origin[3], const __m128 inv[3], __m128 t)
+{
+    auto tMin = _mm_setzero_ps();
+    auto tMax = t;
+    for (int a = 0; a < 3; ++a)
+    {
+        auto t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min[a]), origin[a]), inv[a]);
+        auto t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max[a]), origin[a]), inv[a]);
+        tMin = _mm_max_ps(tMin, _mm_min_ps(t0, t1));
+        tMax = _mm_min_ps(tMax, _mm_max_ps(t0, t1));
+    }
+    return _mm_movemask_ps(_mm_cmple_ps(tMin, tMax));
+}
+
+// One triangle against the packet, same math as intersectTriangle
+static void intersectTriangle4(const float* pTriangle, uint32_t id, const __m128 origin[3], const __m128 dir[3], BvhRay4& rays, int mask)
+{
+    __m128 v0[3], e1[3], e2[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        v0[a] = _mm_set1_ps(pTriangle[a]);
+        e1[a] = _mm_set1_ps(pTriangle[3 + a]);
+        e2[a] = _mm_set1_ps(pTriangle[6 + a]);
+    }
+
+    auto px = _mm_sub_ps(_mm_mul_ps(dir[1], e2[2]), _mm_mul_ps(dir[2], e2[1]));
+    auto py = _mm_sub_ps(_mm_mul_ps(dir[2], e2[0]), _mm_mul_ps(dir[0], e2[2]));
+    auto pz = _mm_sub_ps(_mm_mul_ps(dir[0], e2[1]), _mm_mul_ps(dir[1], e2[0]));
+    auto det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1[0], px), _mm_mul_ps(e1[1], py)), _mm_mul_ps(e1[2], pz));
+    auto absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+    auto valid = _mm_cmpge_ps(absDet, _mm_set1_ps(1e-20f));
+    auto inv = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    auto sx = _mm_sub_ps(origin[0], v0[0]);
+    auto sy = _mm_sub_ps(origin[1], v0[1]);
+    auto sz = _mm_sub_ps(origin[2], v0[2]);
+    auto u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv);
+
+    auto qx = _mm_sub_ps(_mm_mul_ps(sy, e1[2]), _mm_mul_ps(sz, e1[1]));
+    auto qy = _mm_sub_ps(_mm_mul_ps(sz, e1[0]), _mm_mul_ps(sx, e1[2]));
+    auto qz = _mm_sub_ps(_mm_mul_ps(sx, e1[1]), _mm_mul_ps(sy, e1[0]));
+    auto v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dir[0], qx), _mm_mul_ps(dir[1], qy)), _mm_mul_ps(dir[2], qz)), inv);
+    auto t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], qx), _mm_mul_ps(e2[1], qy)), _mm_mul_ps(e2[2], qz)), inv);
+
+    auto zero = _mm_setzero_ps();
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+    valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(t, zero));
+    valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_loadu_ps(rays.t)));
+    auto hitMask = _mm_movemask_ps(valid) & mask;
+    if (!hitMask) return;
+
+    float ts[4];
+    _mm_storeu_ps(ts, t);
+    for (int k = 0; k < 4; ++k)
+    {
+        if (!(hitMask & (1 << k))) continue;
+        rays.t[k] = ts[k];
+        rays.hit[k] = id;
+    }
+}
+
+// Walks the tree once for the whole packet, visit gets the rays that reach
+// each leaf. Children are ordered along the first ray.
+template<typename Visit>
+static void traverse4(const Bvh& bvh, BvhRay4& rays, int mask, Visit visit)
+{
+    if (bvh.nodes.empty() || !mask) return;
+
+    __m128 origin[3], inv[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        origin[a] = _mm_loadu_ps(rays.origin[a]);
+        inv[a] = _mm_setr_ps(getInverse(rays.dir[a][0]), getInverse(rays.dir[a][1]), getInverse(rays.dir[a][2]), getInverse(rays.dir[a][3]));
+    }
+    auto lead = 0;
+    while (!(mask & (1 << lead))) ++lead;
+
+    auto pNodes = bvh.nodes.data();
+    uint32_t stack[BVH_MAX_DEPTH + 2];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize)
+    {
+        const auto& node = pNodes[stack[--stackSize]];
+        auto nodeMask = intersectBox4(node, origin, inv, _mm_loadu_ps(rays.t)) & mask;
+        if (!nodeMask) continue;
+
+        if (node.count)
+        {
+            for (uint32_t i = 0; i < node.count; ++i) visit(node.first + i, nodeMask);
+            continue;
+        }
+
+        // Push the far child first
+        const auto& left = pNodes[node.first];
+        const auto& right = pNodes[node.first + 1];
+        auto along = 0.0f;
+        for (int a = 0; a < 3; ++a)
+        {
+            along += (right.min[a] + right.max[a] - left.min[a] - left.max[a]) * rays.dir[a][lead];
+        }
+        auto isRightNear = along < 0;
+        stack[stackSize++] = isRightNear ? node.first : node.first + 1;
+        stack[stackSize++] = isRightNear ? node.first + 1 : node.first;
+    }
+}
+#else
+// One ray at a time
+template<typename Visit>
+static void traverse4(const Bvh& bvh, BvhRay4& rays, int mask, Visit visit)
+{
+    for (int k = 0; k < 4; ++k)
+    {
+        if (!(mask & (1 << k))) continue;
+        const float origin[3] = { rays.origin[0][k], rays.origin[1][k], rays.origin[2][k] };
+        const float dir[3] = { rays.dir[0][k], rays.dir[1][k], rays.dir[2][k] };
+        traverse(bvh, origin, dir, &rays.t[k], [&](uint32_t slot) { visit(slot, 1 << k); });
+    }
+}
+#endif
+
+uint32_t bvh_intersectMesh(const MeshBvh& mesh, const float origin[3], const float dir[3], float* pT)
+{
+    auto hit = (uint32_t)BVH_NONE;
+    auto pTriangles = mesh.triangles.data();
+    traverse(mesh.bvh, origin, dir, pT, [&](uint32_t slot)
+    {
+        if (intersectTriangle(pTriangles + slot * 9, origin, dir, pT)) hit = slot;
+    });
+    return hit;
+}
+
+void bvh_intersectMesh4(const MeshBvh& mesh, BvhRay4& rays, int mask)
+{
+    auto pTriangles = mesh.triangles.data();
+#if defined(BVH_SSE2)
+    __m128 origin[3], dir[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        origin[a] = _mm_loadu_ps(rays.origin[a]);
+        dir[a] = _mm_loadu_ps(rays.dir[a]);
+    }
+    traverse4(mesh.bvh, rays, mask, [&](uint32_t slot, int slotMask)
+    {
+        intersectTriangle4(pTriangles + slot * 9, slot, origin, dir, rays, slotMask);
+    });
+#else
+    traverse4(mesh.bvh, rays, mask, [&](uint32_t slot, int slotMask)
+    {
+        for (int k = 0; k < 4; ++k)
+        {
+            if (!(slotMask & (1 << k))) continue;
+            const float origin[3] = { rays.origin[0][k], rays.origin[1][k], rays.origin[2][k] };
+            const float dir[3] = { rays.dir[0][k], rays.dir[1][k], rays.dir[2][k] };
+            if (intersectTriangle(pTriangles + slot * 9, origin, dir, &rays.t[k])) rays.hit[k] = slot;
+        }
+    });
+#endif
+}
+
+void bvh_traverse(const Bvh& bvh, const float origin[3], const float dir[3], float* pT,
+                  const std::function<void(uint32_t primitive)>& visit)
+{
+    traverse(bvh, origin, dir, pT, [&](uint32_t slot) { visit(bvh.primitives[slot]); });
+}
+
+void bvh_traverse4(const Bvh& bvh, BvhRay4& rays, int mask,
+                   const std::function<void(uint32_t primitive, int mask)>& visit)
+{
+    traverse4(bvh, rays, mask, [&](uint32_t slot, int slotMask) { visit(bvh.primitives[slot], slotMask); });
+}
@@ -0,0 +1,65 @@
+#ifndef BVH_H_INCLUDED
+#define BVH_H_INCLUDED
+
+#include <cinttypes>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#define BVH_NONE 0xFFFFFFFF
+
+// Interior nodes have count 0 and their children at first and first + 1.
+// Leaves hold count primitives starting at first.
+struct BvhNode
+{
+    float min[3];
+    uint32_t first;
+    float max[3];
+    uint32_t count;
+};
+
+struct Bvh
+{
+    std::vector<BvhNode> nodes; // Root first, empty if there are no primitives
+    std::vector<uint32_t> primitives; // Primitive indices in leaf order
+};
+
+// Triangles, reordered into leaf order
+struct MeshBvh
+{
+    Bvh bvh; // Leaves point straight into triangles, primitives is empty
+    std::vector<float> triangles; // v0, v1 - v0, v2 - v0
+};
+
+// Four rays side by side, for packet queries
+struct BvhRay4
+{
+    float origin[3][4];
+    float dir[3][4];
+    float t[4]; // In: max distance, out: closest hit
+    uint32_t hit[4]; // Out: primitive hit, left alone on a miss
+};
+
+// Binned SAH build. Bounds are min xyz, max xyz for each primitive. Big
+// subtrees are built on the job threads.
+void bvh_build(Bvh& bvh, const float* pBounds, size_t count);
+
+// Triangles are v0, v1, v2 xyz
+void bvh_buildMesh(MeshBvh& mesh, const float* pTriangles, size_t triangleCount);
+
+// Closest triangle closer than *pT, which is shortened on a hit. Returns the
+// triangle in leaf order, or BVH_NONE. Triangles are double sided.
+uint32_t bvh_intersectMesh(const MeshBvh& mesh, const float origin[3], const float dir[3], float* pT);
+void bvh_intersectMesh4(const MeshBvh& mesh, BvhRay4& rays, int mask);
+
+// Calls visit for each primitive whose bounds the ray reaches before *pT,
+// nearest nodes first. visit tests the primitive and shortens *pT on a hit.
+void bvh_traverse(const Bvh& bvh, const float origin[3], const float dir[3], float* pT,
+                  const std::function<void(uint32_t primitive)>& visit);
+
+// Same for the rays of mask. visit gets the rays that reach the primitive and
+// shortens their t on hits.
+void bvh_traverse4(const Bvh& bvh, BvhRay4& rays, int mask,
+                   const std::function<void(uint32_t primitive, int mask)>& visit);
+
+#endif
@@ -1,4 +1,7 @@
+#include "config.h"
 #include "globals.h"
+#include "library.h"
+#include "undo.h"
 
 #include <json/json.h>
 #include <fstream>
@@ -12,37 +15,42 @@
 #include <Windows.h>
 #include <Shlobj.h>
 
-static std::string getFilename()
+std::string config_getDirectory()
 {
     TCHAR szPath[MAX_PATH];
     if (SUCCEEDED(SHGetFolderPath(NULL, CSIDL_APPDATA, NULL, 0, szPath)))
     {
-        std::string filename = szPath;
-        filename += "\\Mapped";
+        std::string directory = szPath;
+        directory += "\\Mapped";
 
-        DWORD dwAttrib = GetFileAttributes(filename.c_str());
+        DWORD dwAttrib = GetFileAttributes(directory.c_str());
         if (dwAttrib == INVALID_FILE_ATTRIBUTES || !(dwAttrib & FILE_ATTRIBUTE_DIRECTORY))
         {
-            CreateDirectory(filename.c_str(), NULL);
+            CreateDirectory(directory.c_str(), NULL);
         }
 
-        std::replace(filename.begin(), filename.end(), '\\', '/');
-        return filename + "/config.json";
+        std::replace(directory.begin(), directory.end(), '\\', '/');
+        return directory + "/";
     }
     else
     {
         // Try local..
-        return "./config.json";
+        return "./";
     }
 }
 #else
-static std::string getFilename()
+std::string config_getDirectory()
 {
     // Try local..
-    return "./config.json";
+    return "./";
 }
 #endif
 
+static std::string getFilename()
+{
+    return config_getDirectory() + "config.json";
+}
+
 void config_load()
 {
     auto filename = getFilename();
@@ -81,6 +89,22 @@ void config_load()
         SDL_SetWindowSize(pWindow, w, h);
     }
     if (config["window"]["maximized"].asBool()) SDL_MaximizeWindow(pWindow);
+
+    // Undo history cap
+    if (config["undo"]["memoryBudgetMB"].isNumeric())
+    {
+        undo_setMemoryBudget((size_t)config["undo"]["memoryBudgetMB"].asUInt64() * 1024 * 1024);
+    }
+
+    // Models streamed in at once
+    if (config["library"]["memoryBudgetMB"].isNumeric())
+    {
+        library_setMemoryBudget((size_t)config["library"]["memoryBudgetMB"].asUInt64() * 1024 * 1024);
+    }
+    if (config["library"]["cacheBudgetMB"].isNumeric())
+    {
+        library_setCacheBudget((size_t)config["library"]["cacheBudgetMB"].asUInt64() * 1024 * 1024);
+    }
 }
 
 void config_save()
@@ -113,10 +137,21 @@ void config_save()
     window["width"] = w;
     window["height"] = h;
 
+    // Undo
+    Json::Value undo;
+    undo["memoryBudgetMB"] = (Json::UInt64)(undo_getMemoryBudget() / (1024 * 1024));
+
+    // Library
+    Json::Value library;
+    library["memoryBudgetMB"] = (Json::UInt64)(library_getMemoryBudget() / (1024 * 1024));
+    library["cacheBudgetMB"] = (Json::UInt64)(library_getCacheBudget() / (1024 * 1024));
+
     // Configs
     Json::Value config;
     config["recents"] = recents;
     config["window"] = window;
+    config["undo"] = undo;
+    config["library"] = library;
 
     std::ofstream file(filename);
     if (!file.is_open())
@@ -1,7 +1,10 @@
 #ifndef CONFIG_H_INCLUDED
 #define CONFIG_H_INCLUDED
 
+#include <string>
+
 void config_load();
 void config_save();
+std::string config_getDirectory(); // With a trailing slash, for what goes next to the config
 
 #endif
@@ -0,0 +1,815 @@
+#include "cook.h"
+#include "bvh.h"
+#include "entities.h"
+#include "fileSystem.h"
+#include "globals.h"
+#include "hash.h"
+#include "jobs.h"
+#include "library.h"
+#include "transforms.h"
+#include "vectorMath.h"
+
+#include <stb_image.h>
+#include <tinyfiledialogs.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+#define COOK_MIP_ALIGNMENT 16
+
+// A model as it goes in the package, parsed or copied from the previous one
+struct CookedMesh
+{
+    std::vector<CookVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::string texture; // Relative to the map, empty without one
+    float bounds[6]; // min xyz, max xyz
+};
+
+struct CookedModel
+{
+    uint64_t id;
+    std::string filename;
+    float scale;
+    uint64_t key = 0;
+    std::vector<CookedMesh> meshes;
+    float bounds[6] = { 0, 0, 0, 0, 0, 0 };
+    std::vector<uint32_t> placements;
+    bool isCached = false;
+    std::string error;
+};
+
+struct CookedTexture
+{
+    std::string name; // Relative to the map
+    uint64_t key = 0;
+    uint32_t format = COOK_FORMAT_BC1;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t mipCount = 0;
+    std::vector<uint8_t> data;
+    bool isCached = false;
+    bool isMissing = false;
+};
+
+// An instance before it's grouped by model
+struct Placement
+{
+    mat4 world; // Translation from the entity's origin
+    const double* pOrigin;
+    uint32_t id;
+    uint32_t layer;
+};
+
+// The package being replaced, what didn't change is copied from it
+struct Previous
+{
+    MappedFile file;
+    const CookVertex* pVertices = nullptr;
+    size_t vertexCount = 0;
+    const uint32_t* pIndices = nullptr;
+    size_t indexCount = 0;
+    const CookMesh* pMeshes = nullptr;
+    size_t meshCount = 0;
+    const CookTexture* pTextures = nullptr;
+    size_t textureCount = 0;
+    const uint8_t* pTextureData = nullptr;
+    size_t textureDataSize = 0;
+    const char* pStrings = nullptr;
+    size_t stringsSize = 0;
+    std::unordered_map<uint64_t, const CookModel*> models; // By key
+    std::unordered_map<uint64_t, const CookTexture*> textures;
+};
+
+static bool hashFile(const std::string& path, uint64_t* pKey)
+{
+    MappedFile file;
+    if (!fileSystem_map(path, &file)) return false;
+    uint32_t version = COOK_VERSION;
+    *pKey = hash_bytes(hash_bytes(HASH_SEED, &version, sizeof(version)), file.pData, file.size);
+    fileSystem_unmap(&file);
+    return true;
+}
+
+static std::string getRelative(const std::string& path, const std::string& directory)
+{
+    if (path.compare(0, directory.size(), directory) == 0) return path.substr(directory.size());
+    return path;
+}
+
+static std::string getAbsolute(const std::string& name, const std::string& directory)
+{
+    auto isAbsolute = (!name.empty() && (name[0] == '/' || name[0] == '\\')) || (name.size() > 1 && name[1] == ':');
+    return isAbsolute ? name : directory + name;
+}
+
+template <typename T>
+static bool getSection(const MappedFile& file, const CookHeader& header, int section, const T** ppOut, size_t* pCount)
+{
+    const auto& range = header.sections[section];
+    if (range.offset > file.size || range.size > file.size - range.offset || range.offset % COOK_ALIGNMENT || range.size % sizeof(T)) return false;
+    *ppOut = (const T*)(file.pData + range.offset);
+    *pCount = (size_t)(range.size / sizeof(T));
+    return true;
+}
+
+// Nothing is cached if it's missing or from another version
+static void openPrevious(const std::string& filename, Previous& previous)
+{
+    if (!fileSystem_map(filename, &previous.file)) return;
+
+    auto& file = previous.file;
+    auto pHeader = (const CookHeader*)file.pData;
+    const CookModel* pModels = nullptr;
+    size_t modelCount = 0;
+    auto isValid = file.size >= sizeof(CookHeader) &&
+        !memcmp(pHeader->magic, "MPAK", 4) && pHeader->version == COOK_VERSION && pHeader->sectionCount == COOK_SECTION_COUNT &&
+        getSection(file, *pHeader, COOK_SECTION_VERTICES, &previous.pVertices, &previous.vertexCount) &&
+        getSection(file, *pHeader, COOK_SECTION_INDICES, &previous.pIndices, &previous.indexCount) &&
+        getSection(file, *pHeader, COOK_SECTION_MESHES, &previous.pMeshes, &previous.meshCount) &&
+        getSection(file, *pHeader, COOK_SECTION_MODELS, &pModels, &modelCount) &&
+        getSection(file, *pHeader, COOK_SECTION_TEXTURES, &previous.pTextures, &previous.textureCount) &&
+        getSection(file, *pHeader, COOK_SECTION_TEXTURE_DATA, &previous.pTextureData, &previous.textureDataSize) &&
+        getSection(file, *pHeader, COOK_SECTION_STRINGS, &previous.pStrings, &previous.stringsSize);
+    if (!isValid)
+    {
+        fileSystem_unmap(&file);
+        previous = Previous();
+        return;
+    }
+
+    for (size_t i = 0; i < modelCount; ++i) previous.models[pModels[i].key] = pModels + i;
+    for (size_t i = 0; i < previous.textureCount; ++i) previous.textures[previous.pTextures[i].key] = previous.pTextures + i;
+}
+
+static bool getPreviousString(const Previous& previous, uint32_t offset, std::string* pOut)
+{
+    if (offset >= previous.stringsSize) return false;
+    auto pString = previous.pStrings + offset;
+    auto pEnd = (const char*)memchr(pString, 0, previous.stringsSize - offset);
+    if (!pEnd) return false;
+    pOut->assign(pString, pEnd);
+    return true;
+}
+
+static bool copyModel(const Previous& previous, const CookModel& previousModel, CookedModel& model)
+{
+    if (previousModel.firstMesh > previous.meshCount || previousModel.meshCount > previous.meshCount - previousModel.firstMesh) return false;
+
+    model.meshes.resize(previousModel.meshCount);
+    for (uint32_t i = 0; i < previousModel.meshCount; ++i)
+    {
+        const auto& previousMesh = previous.pMeshes[previousModel.firstMesh + i];
+        auto& mesh = model.meshes[i];
+        if (previousMesh.firstVertex > previous.vertexCount || previousMesh.vertexCount > previous.vertexCount - previousMesh.firstVertex ||
+            previousMesh.firstIndex > previous.indexCount || previousMesh.indexCount > previous.indexCount - previousMesh.firstIndex)
+        {
+            return false;
+        }
+        auto pVertices = previous.pVertices + previousMesh.firstVertex;
+        auto pIndices = previous.pIndices + previousMesh.firstIndex;
+        mesh.vertices.assign(pVertices, pVertices + previousMesh.vertexCount);
+        mesh.indices.assign(pIndices, pIndices + previousMesh.indexCount);
+        memcpy(mesh.bounds, previousMesh.min, sizeof(float) * 3);
+        memcpy(mesh.bounds + 3, previousMesh.max, sizeof(float) * 3);
+        if (previousMesh.texture != COOK_NONE)
+        {
+            // By name, its content is checked on its own
+            if (previousMesh.texture >= previous.textureCount) return false;
+            if (!getPreviousString(previous, previous.pTextures[previousMesh.texture].name, &mesh.texture)) return false;
+        }
+    }
+    memcpy(model.bounds, previousModel.min, sizeof(float) * 3);
+    memcpy(model.bounds + 3, previousModel.max, sizeof(float) * 3);
+    return true;
+}
+
+static void convertModel(const LoadedModel& loaded, const std::string& directory, CookedModel& model)
+{
+    model.meshes.resize(loaded.meshes.size());
+    for (size_t i = 0; i < loaded.meshes.size(); ++i)
+    {
+        const auto& loadedMesh = loaded.meshes[i];
+        auto& mesh = model.meshes[i];
+
+        auto imageIndex = loadedMesh.materialIndex < (int)loaded.materialImages.size() ? loaded.materialImages[loadedMesh.materialIndex] : -1;
+        if (imageIndex >= 0) mesh.texture = getRelative(loaded.images[imageIndex].path, directory);
+
+        mesh.indices = loadedMesh.indices;
+        mesh.vertices.resize(loadedMesh.vertices.size());
+        for (int j = 0; j < 3; ++j)
+        {
+            mesh.bounds[j] = FLT_MAX;
+            mesh.bounds[j + 3] = -FLT_MAX;
+        }
+        for (size_t v = 0; v < loadedMesh.vertices.size(); ++v)
+        {
+            const auto& from = loadedMesh.vertices[v];
+            auto& to = mesh.vertices[v];
+            for (int j = 0; j < 3; ++j)
+            {
+                to.position[j] = from.position[j];
+                to.normal[j] = (int16_t)std::round(std::max(-1.0f, std::min(1.0f, from.normal[j])) * 32767.0f);
+                mesh.bounds[j] = std::min(mesh.bounds[j], from.position[j]);
+                mesh.bounds[j + 3] = std::max(mesh.bounds[j + 3], from.position[j]);
+            }
+            to.normal[3] = 0;
+            for (int j = 0; j < 4; ++j)
+            {
+                to.color[j] = (uint8_t)std::round(std::max(0.0f, std::min(1.0f, from.color[j])) * 255.0f);
+            }
+            to.uv[0] = from.uv[0];
+            to.uv[1] = from.uv[1];
+        }
+    }
+}
+
+static void cookModel(const Previous& previous, const std::string& directory, CookedModel& model)
+{
+    auto path = directory + model.filename;
+    if (!hashFile(path, &model.key))
+    {
+        model.error = "Failed to open model:\n" + model.filename;
+        return;
+    }
+    model.key = hash_bytes(model.key, &model.scale, sizeof(model.scale));
+
+    auto it = previous.models.find(model.key);
+    if (it != previous.models.end() && copyModel(previous, *it->second, model))
+    {
+        model.isCached = true;
+        return;
+    }
+
+    model.meshes.clear();
+    auto loaded = library_parseModelFile(path, model.scale);
+    if (!loaded.error.empty())
+    {
+        model.error = loaded.error;
+        return;
+    }
+    convertModel(loaded, directory, model);
+
+    for (int j = 0; j < 3; ++j)
+    {
+        model.bounds[j] = model.meshes.empty() ? 0.0f : FLT_MAX;
+        model.bounds[j + 3] = model.meshes.empty() ? 0.0f : -FLT_MAX;
+    }
+    for (const auto& mesh : model.meshes)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            model.bounds[j] = std::min(model.bounds[j], mesh.bounds[j]);
+            model.bounds[j + 3] = std::max(model.bounds[j + 3], mesh.bounds[j + 3]);
+        }
+    }
+}
+
+static uint16_t toRgb565(const int color[3])
+{
+    auto r = std::max(0, std::min(31, (color[0] * 31 + 127) / 255));
+    auto g = std::max(0, std::min(63, (color[1] * 63 + 127) / 255));
+    auto b = std::max(0, std::min(31, (color[2] * 31 + 127) / 255));
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void fromRgb565(uint16_t packed, int color[3])
+{
+    auto r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// Endpoints on the diagonal of the colors' box that follows how red and
+// blue vary with green, inset so the palette's ends aren't wasted on outliers
+static void compressBlock(const uint8_t pixels[16][4], uint8_t out[8])
+{
+    int minColor[3] = { 255, 255, 255 }, maxColor[3] = { 0, 0, 0 };
+    int mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            minColor[c] = std::min(minColor[c], (int)pixels[i][c]);
+            maxColor[c] = std::max(maxColor[c], (int)pixels[i][c]);
+            mean[c] += pixels[i][c];
+        }
+    }
+    int covarianceRG = 0, covarianceBG = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        auto g = pixels[i][1] * 16 - mean[1];
+        covarianceRG += (pixels[i][0] * 16 - mean[0]) * g;
+        covarianceBG += (pixels[i][2] * 16 - mean[2]) * g;
+    }
+    if (covarianceRG < 0) std::swap(minColor[0], maxColor[0]);
+    if (covarianceBG < 0) std::swap(minColor[2], maxColor[2]);
+    for (int c = 0; c < 3; ++c)
+    {
+        auto inset = (maxColor[c] - minColor[c]) / 16;
+        maxColor[c] -= inset;
+        minColor[c] += inset;
+    }
+
+    auto color0 = toRgb565(maxColor);
+    auto color1 = toRgb565(minColor);
+    if (color0 < color1) std::swap(color0, color1);
+    out[0] = (uint8_t)color0;
+    out[1] = (uint8_t)(color0 >> 8);
+    out[2] = (uint8_t)color1;
+    out[3] = (uint8_t)(color1 >> 8);
+
+    // Equal endpoints would be the 3 colors mode, index 0 is right for all
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        int palette[4][3];
+        fromRgb565(color0, palette[0]);
+        fromRgb565(color1, palette[1]);
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = 0, bestDistance = INT32_MAX;
+            for (int p = 0; p < 4; ++p)
+            {
+                auto dr = pixels[i][0] - palette[p][0], dg = pixels[i][1] - palette[p][1], db = pixels[i][2] - palette[p][2];
+                auto distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance)
+                {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+            indices |= (uint32_t)best << (i * 2);
+        }
+    }
+    for (int i = 0; i < 4; ++i) out[4 + i] = (uint8_t)(indices >> (i * 8));
+}
+
+static void appendMip(const std::vector<uint8_t>& pixels, int w, int h, uint32_t format, std::vector<uint8_t>& data)
+{
+    data.resize((data.size() + COOK_MIP_ALIGNMENT - 1) / COOK_MIP_ALIGNMENT * COOK_MIP_ALIGNMENT, 0);
+    if (format == COOK_FORMAT_RGBA8)
+    {
+        data.insert(data.end(), pixels.begin(), pixels.end());
+        return;
+    }
+
+    // Edge blocks repeat the last row and column
+    for (int by = 0; by < h; by += 4)
+    {
+        for (int bx = 0; bx < w; bx += 4)
+        {
+            uint8_t block[16][4];
+            for (int y = 0; y < 4; ++y)
+            {
+                for (int x = 0; x < 4; ++x)
+                {
+                    auto px = std::min(bx + x, w - 1), py = std::min(by + y, h - 1);
+                    memcpy(block[y * 4 + x], &pixels[((size_t)py * w + px) * 4], 4);
+                }
+            }
+            uint8_t out[8];
+            compressBlock(block, out);
+            data.insert(data.end(), out, out + 8);
+        }
+    }
+}
+
+static void compressTexture(const uint8_t* pPixels, int w, int h, CookedTexture& texture)
+{
+    texture.width = (uint32_t)w;
+    texture.height = (uint32_t)h;
+    texture.format = COOK_FORMAT_BC1;
+    auto pixelCount = (size_t)w * h;
+    for (size_t i = 0; i < pixelCount; ++i)
+    {
+        if (pPixels[i * 4 + 3] < 255)
+        {
+            texture.format = COOK_FORMAT_RGBA8;
+            break;
+        }
+    }
+
+    // Box filtered mips, odd sizes drop their last row or column
+    std::vector<uint8_t> pixels(pPixels, pPixels + pixelCount * 4);
+    std::vector<uint8_t> next;
+    texture.data.clear();
+    texture.mipCount = 0;
+    while (true)
+    {
+        appendMip(pixels, w, h, texture.format, texture.data);
+        ++texture.mipCount;
+        if (w == 1 && h == 1) break;
+
+        auto nextW = std::max(1, w / 2), nextH = std::max(1, h / 2);
+        next.resize((size_t)nextW * nextH * 4);
+        for (int y = 0; y < nextH; ++y)
+        {
+            auto y0 = std::min(y * 2, h - 1), y1 = std::min(y * 2 + 1, h - 1);
+            for (int x = 0; x < nextW; ++x)
+            {
+                auto x0 = std::min(x * 2, w - 1), x1 = std::min(x * 2 + 1, w - 1);
+                for (int c = 0; c < 4; ++c)
+                {
+                    auto sum = pixels[((size_t)y0 * w + x0) * 4 + c] + pixels[((size_t)y0 * w + x1) * 4 + c] +
+                        pixels[((size_t)y1 * w + x0) * 4 + c] + pixels[((size_t)y1 * w + x1) * 4 + c];
+                    next[((size_t)y * nextW + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+                }
+            }
+        }
+        pixels.swap(next);
+        w = nextW;
+        h = nextH;
+    }
+}
+
+static void cookTexture(const Previous& previous, const std::string& directory, CookedTexture& texture)
+{
+    auto path = getAbsolute(texture.name, directory);
+    if (!hashFile(path, &texture.key))
+    {
+        texture.key = 0;
+        texture.isMissing = true;
+        return;
+    }
+
+    auto it = previous.textures.find(texture.key);
+    if (it != previous.textures.end())
+    {
+        const auto& previousTexture = *it->second;
+        if (previousTexture.offset <= previous.textureDataSize && previousTexture.size <= previous.textureDataSize - previousTexture.offset)
+        {
+            auto pData = previous.pTextureData + previousTexture.offset;
+            texture.format = previousTexture.format;
+            texture.width = previousTexture.width;
+            texture.height = previousTexture.height;
+            texture.mipCount = previousTexture.mipCount;
+            texture.data.assign(pData, pData + previousTexture.size);
+            texture.isCached = true;
+            return;
+        }
+    }
+
+    int w, h, bpp;
+    auto pPixels = stbi_load(path.c_str(), &w, &h, &bpp, 4);
+    if (!pPixels)
+    {
+        texture.isMissing = true;
+        return;
+    }
+    compressTexture(pPixels, w, h, texture);
+    stbi_image_free(pPixels);
+}
+
+static uint32_t addString(std::string& strings, const std::string& s)
+{
+    auto offset = (uint32_t)strings.size();
+    strings += s;
+    strings += '\0';
+    return offset;
+}
+
+static bool writePackage(const std::string& filename, CookHeader& header, const void* const* ppSections)
+{
+    uint64_t offset = sizeof(CookHeader);
+    for (int i = 0; i < COOK_SECTION_COUNT; ++i)
+    {
+        offset = (offset + COOK_ALIGNMENT - 1) / COOK_ALIGNMENT * COOK_ALIGNMENT;
+        header.sections[i].offset = offset;
+        offset += header.sections[i].size;
+    }
+
+    auto tempFilename = filename + ".tmp";
+    {
+        std::ofstream file(tempFilename, std::ios::binary);
+        file.write((const char*)&header, sizeof(header));
+        uint64_t position = sizeof(header);
+        static const char PADDING[COOK_ALIGNMENT] = {};
+        for (int i = 0; i < COOK_SECTION_COUNT; ++i)
+        {
+            file.write(PADDING, (std::streamsize)(header.sections[i].offset - position));
+            file.write((const char*)ppSections[i], (std::streamsize)header.sections[i].size);
+            position = header.sections[i].offset + header.sections[i].size;
+        }
+        if (!file.good()) return false;
+    }
+    return fileSystem_sync(tempFilename) && fileSystem_replace(tempFilename, filename);
+}
+
+bool cook_run(const std::string& filename, std::string& error)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    if (document.filename.empty())
+    {
+        error = "Save the map first, what it uses is found from where it is.";
+        return false;
+    }
+    auto directory = document.filename.substr(0, document.filename.find_last_of("/\\") + 1);
+
+    // Placements, prefabs expanded like the render list, but of every
+    // model whether it's streamed in or not
+    std::vector<CookedModel> models;
+    std::vector<Placement> placements;
+    std::unordered_map<uint64_t, uint32_t> modelIndices;
+    auto pWorldMatrices = transforms_getWorldMatrices();
+    auto pWorldPositions = transforms_getWorldPositions();
+    auto place = [&](uint64_t modelId, const mat4& world, uint32_t entity, uint32_t id, uint32_t layer)
+    {
+        auto it = modelIndices.find(modelId);
+        if (it == modelIndices.end())
+        {
+            CookedModel model;
+            model.id = modelId;
+            if (!library_getModelFile(modelId, &model.filename, &model.scale)) return;
+            it = modelIndices.insert({ modelId, (uint32_t)models.size() }).first;
+            models.push_back(std::move(model));
+        }
+        models[it->second].placements.push_back((uint32_t)placements.size());
+        Placement placement;
+        placement.world = world;
+        placement.pOrigin = pWorldPositions + entity * 3;
+        placement.id = id;
+        placement.layer = layer;
+        placements.push_back(placement);
+    };
+    const auto& entities = document.entities;
+    uint32_t index = 0;
+    for (size_t c = 0; c < entities_getChunkCount(entities); ++c)
+    {
+        const auto& chunk = entities_getChunk(entities, c);
+        for (uint32_t i = 0; i < chunk.count; ++i, ++index)
+        {
+            if (chunk.flags[i] & ENTITY_FLAG_RAW) continue;
+
+            auto world = pWorldMatrices[index];
+            world.cols[3] = float4_set(0.0f, 0.0f, 0.0f, 1.0f);
+            auto pPrefab = library_getPrefab(chunk.modelIds[i]);
+            if (!pPrefab)
+            {
+                place(chunk.modelIds[i], world, index, chunk.ids[i], chunk.layers[i]);
+                continue;
+            }
+            for (const auto& part : pPrefab->parts) place(part.modelId, mat4_mul(part.local, world), index, chunk.ids[i], chunk.layers[i]);
+        }
+    }
+
+    // Models then their textures, an asset per job
+    Previous previous;
+    openPrevious(filename, previous);
+    jobs_parallelFor(models.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (auto i = begin; i < end; ++i) cookModel(previous, directory, models[i]);
+    });
+    for (const auto& model : models)
+    {
+        if (!model.error.empty())
+        {
+            fileSystem_unmap(&previous.file);
+            error = model.error;
+            return false;
+        }
+    }
+
+    std::vector<CookedTexture> textures;
+    std::unordered_map<std::string, uint32_t> textureIndices;
+    for (const auto& model : models)
+    {
+        for (const auto& mesh : model.meshes)
+        {
+            if (mesh.texture.empty() || textureIndices.count(mesh.texture)) continue;
+            textureIndices[mesh.texture] = (uint32_t)textures.size();
+            CookedTexture texture;
+            texture.name = mesh.texture;
+            textures.push_back(std::move(texture));
+        }
+    }
+    jobs_parallelFor(textures.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (auto i = begin; i < end; ++i) cookTexture(previous, directory, textures[i]);
+    });
+    fileSystem_unmap(&previous.file);
+
+    // Sections
+    std::vector<CookVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<CookMesh> meshes;
+    std::vector<CookModel> cookModels;
+    std::vector<CookTexture> cookTextures;
+    std::vector<uint8_t> textureData;
+    std::vector<CookInstance> instances;
+    std::vector<CookDraw> draws;
+    std::string strings;
+
+    // Missing textures keep their entry so meshes copied next time still
+    // point at them, without mips
+    int missingCount = 0, cachedTextureCount = 0;
+    for (const auto& texture : textures)
+    {
+        if (texture.isMissing)
+        {
+            fprintf(stderr, "Cook: missing texture %s\n", texture.name.c_str());
+            ++missingCount;
+        }
+        cachedTextureCount += texture.isCached ? 1 : 0;
+        textureData.resize((textureData.size() + COOK_MIP_ALIGNMENT - 1) / COOK_MIP_ALIGNMENT * COOK_MIP_ALIGNMENT, 0);
+        CookTexture cookTexture = {};
+        cookTexture.key = texture.key;
+        cookTexture.name = addString(strings, texture.name);
+        cookTexture.format = texture.format;
+        cookTexture.width = texture.width;
+        cookTexture.height = texture.height;
+        cookTexture.mipCount = texture.mipCount;
+        cookTexture.offset = textureData.size();
+        cookTexture.size = texture.data.size();
+        textureData.insert(textureData.end(), texture.data.begin(), texture.data.end());
+        cookTextures.push_back(cookTexture);
+    }
+
+    // Meshes with the same vertices and indices share them
+    std::unordered_map<uint64_t, uint32_t> meshDuplicates; // Hash to the first mesh with it
+    std::vector<mat4> bases;
+    std::vector<float> placementBounds;
+    int cachedModelCount = 0;
+    for (auto& model : models)
+    {
+        cachedModelCount += model.isCached ? 1 : 0;
+        CookModel cookModel = {};
+        cookModel.key = model.key;
+        cookModel.name = addString(strings, model.filename);
+        cookModel.firstMesh = (uint32_t)meshes.size();
+        cookModel.meshCount = (uint32_t)model.meshes.size();
+        memcpy(cookModel.min, model.bounds, sizeof(cookModel.min));
+        memcpy(cookModel.max, model.bounds + 3, sizeof(cookModel.max));
+        for (const auto& mesh : model.meshes)
+        {
+            CookMesh cookMesh = {};
+            cookMesh.vertexCount = (uint32_t)mesh.vertices.size();
+            cookMesh.indexCount = (uint32_t)mesh.indices.size();
+            cookMesh.texture = mesh.texture.empty() ? COOK_NONE : textureIndices[mesh.texture];
+            memcpy(cookMesh.min, mesh.bounds, sizeof(cookMesh.min));
+            memcpy(cookMesh.max, mesh.bounds + 3, sizeof(cookMesh.max));
+
+            auto meshHash = hash_bytes(hash_bytes(HASH_SEED, mesh.vertices.data(), mesh.vertices.size() * sizeof(CookVertex)),
+                                 mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+            auto it = meshDuplicates.find(meshHash);
+            if (it != meshDuplicates.end())
+            {
+                const auto& duplicate = meshes[it->second];
+                if (duplicate.vertexCount == cookMesh.vertexCount && duplicate.indexCount == cookMesh.indexCount &&
+                    !memcmp(&vertices[duplicate.firstVertex], mesh.vertices.data(), mesh.vertices.size() * sizeof(CookVertex)) &&
+                    !memcmp(&indices[duplicate.firstIndex], mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t)))
+                {
+                    cookMesh.firstVertex = duplicate.firstVertex;
+                    cookMesh.firstIndex = duplicate.firstIndex;
+                    meshes.push_back(cookMesh);
+                    continue;
+                }
+            }
+            cookMesh.firstVertex = (uint32_t)vertices.size();
+            cookMesh.firstIndex = (uint32_t)indices.size();
+            vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+            meshDuplicates.insert({ meshHash, (uint32_t)meshes.size() });
+            meshes.push_back(cookMesh);
+        }
+
+        // Instances, grouped by model
+        cookModel.firstInstance = (uint32_t)instances.size();
+        cookModel.instanceCount = (uint32_t)model.placements.size();
+        bases.resize(model.placements.size());
+        for (size_t i = 0; i < model.placements.size(); ++i)
+        {
+            bases[i] = placements[model.placements[i]].world;
+            bases[i].cols[3] = float4_set(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+        placementBounds.resize(bases.size() * 6);
+        vectorMath_transformAabbsEach(bases.data(), model.bounds, 0, placementBounds.data(), bases.size());
+        for (size_t i = 0; i < model.placements.size(); ++i)
+        {
+            const auto& placement = placements[model.placements[i]];
+            float matrix[4][4];
+            mat4_store(placement.world, matrix);
+
+            CookInstance instance = {};
+            for (int j = 0; j < 3; ++j)
+            {
+                instance.position[j] = placement.pOrigin[j] + matrix[3][j];
+                memcpy(instance.basis + j * 3, matrix[j], sizeof(float) * 3);
+            }
+            instance.model = (uint32_t)cookModels.size();
+            memcpy(instance.min, &placementBounds[i * 6], sizeof(instance.min));
+            memcpy(instance.max, &placementBounds[i * 6 + 3], sizeof(instance.max));
+            instance.id = placement.id;
+            instance.layer = placement.layer;
+            instances.push_back(instance);
+        }
+        for (uint32_t i = 0; i < cookModel.meshCount; ++i)
+        {
+            const auto& cookMesh = meshes[cookModel.firstMesh + i];
+            draws.push_back({ cookMesh.texture, cookModel.firstMesh + i, cookModel.firstInstance, cookModel.instanceCount });
+        }
+        cookModels.push_back(cookModel);
+    }
+    std::sort(draws.begin(), draws.end(), [](const CookDraw& a, const CookDraw& b)
+    {
+        return a.texture != b.texture ? a.texture < b.texture : a.mesh < b.mesh;
+    });
+
+    // Bounds, and the hierarchy over the instances around their center
+    CookHeader header = {};
+    memcpy(header.magic, "MPAK", 4);
+    header.version = COOK_VERSION;
+    header.sectionCount = COOK_SECTION_COUNT;
+    for (int j = 0; j < 3; ++j)
+    {
+        header.min[j] = instances.empty() ? 0.0 : DBL_MAX;
+        header.max[j] = instances.empty() ? 0.0 : -DBL_MAX;
+    }
+    for (const auto& instance : instances)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            header.min[j] = std::min(header.min[j], instance.position[j] + instance.min[j]);
+            header.max[j] = std::max(header.max[j], instance.position[j] + instance.max[j]);
+        }
+    }
+    for (int j = 0; j < 3; ++j) header.origin[j] = (header.min[j] + header.max[j]) * 0.5;
+
+    std::vector<float> instanceBounds(instances.size() * 6);
+    for (size_t i = 0; i < instances.size(); ++i)
+    {
+        const auto& instance = instances[i];
+        for (int j = 0; j < 3; ++j)
+        {
+            auto offset = (float)(instance.position[j] - header.origin[j]);
+            instanceBounds[i * 6 + j] = offset + instance.min[j];
+            instanceBounds[i * 6 + 3 + j] = offset + instance.max[j];
+        }
+    }
+    Bvh bvh;
+    bvh_build(bvh, instanceBounds.data(), instances.size());
+
+    const void* pSections[COOK_SECTION_COUNT] = {
+        vertices.data(), indices.data(), meshes.data(), cookModels.data(), cookTextures.data(), textureData.data(),
+        instances.data(), draws.data(), bvh.nodes.data(), bvh.primitives.data(), strings.data()
+    };
+    header.sections[COOK_SECTION_VERTICES].size = vertices.size() * sizeof(CookVertex);
+    header.sections[COOK_SECTION_INDICES].size = indices.size() * sizeof(uint32_t);
+    header.sections[COOK_SECTION_MESHES].size = meshes.size() * sizeof(CookMesh);
+    header.sections[COOK_SECTION_MODELS].size = cookModels.size() * sizeof(CookModel);
+    header.sections[COOK_SECTION_TEXTURES].size = cookTextures.size() * sizeof(CookTexture);
+    header.sections[COOK_SECTION_TEXTURE_DATA].size = textureData.size();
+    header.sections[COOK_SECTION_INSTANCES].size = instances.size() * sizeof(CookInstance);
+    header.sections[COOK_SECTION_DRAWS].size = draws.size() * sizeof(CookDraw);
+    header.sections[COOK_SECTION_NODES].size = bvh.nodes.size() * sizeof(BvhNode);
+    header.sections[COOK_SECTION_NODE_INSTANCES].size = bvh.primitives.size() * sizeof(uint32_t);
+    header.sections[COOK_SECTION_STRINGS].size = strings.size();
+    if (!writePackage(filename, header, pSections))
+    {
+        error = "Failed to write the package:\n" + filename;
+        return false;
+    }
+
+    auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    printf("Cooked %s: %i models (%i unchanged), %i textures (%i unchanged, %i missing), %i instances, %.1f MB, in %.0f ms\n",
+           filename.c_str(), (int)models.size(), cachedModelCount, (int)textures.size(), cachedTextureCount, missingCount,
+           (int)instances.size(), (double)(header.sections[COOK_SECTION_COUNT - 1].offset + strings.size()) / (1024.0 * 1024.0), ms);
+    return true;
+}
+
+void cook_export()
+{
+    if (document.filename.empty())
+    {
+        tinyfd_messageBox("Cook Package", "Save the map first, the package is cooked from where it is.", "ok", "warning", 0);
+        return;
+    }
+
+    auto defaultFilename = document.filename;
+    auto dot = defaultFilename.find_last_of('.');
+    if (dot != std::string::npos && dot > defaultFilename.find_last_of("/\\") + 1) defaultFilename.resize(dot);
+    defaultFilename += COOK_PACKAGE_EXTENSION;
+
+    const char* filters[] = { "*" COOK_PACKAGE_EXTENSION };
+    auto ret = tinyfd_saveFileDialog("Cook Package", defaultFilename.c_str(), 1, filters, NULL);
+    if (!ret) return;
+
+    std::string error;
+    if (!cook_run(ret, error))
+    {
+        tinyfd_messageBox("Cook Package", error.c_str(), "ok", "error", 0);
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef COOK_H_INCLUDED
+#define COOK_H_INCLUDED
+
+#include <cinttypes>
+#include <string>
+
+#define COOK_PACKAGE_EXTENSION ".pak" // Next to the map by default
+#define COOK_VERSION 1
+#define COOK_ALIGNMENT 64 // Of every section from the start of the file
+#define COOK_NONE 0xFFFFFFFF
+
+// The map cooked for the game, so it doesn't parse the JSON and the model
+// files at runtime. The package is read with a single mmap and used in
+// place: the header locates the sections, arrays of the structs below or
+// raw GPU data, all little endian.
+//
+// Cooking is incremental: models and textures whose file content didn't
+// change since the previous package at the same path are copied from it,
+// the rest is parsed and compressed over all the cores, an asset per job.
+// Everything the map places is cooked, streamed in or not, hidden layers
+// too.
+bool cook_run(const std::string& filename, std::string& error); // Main thread
+void cook_export(); // Asks where, then cooks
+
+enum CookSection
+{
+    COOK_SECTION_VERTICES, // CookVertex, all the meshes one after the other
+    COOK_SECTION_INDICES, // uint32_t, relative to their mesh's first vertex
+    COOK_SECTION_MESHES, // CookMesh
+    COOK_SECTION_MODELS, // CookModel
+    COOK_SECTION_TEXTURES, // CookTexture
+    COOK_SECTION_TEXTURE_DATA, // Mip chains, see CookTexture
+    COOK_SECTION_INSTANCES, // CookInstance, grouped by model
+    COOK_SECTION_DRAWS, // CookDraw, sorted by texture then mesh
+    COOK_SECTION_NODES, // BvhNode over the instances, bounds relative to the origin
+    COOK_SECTION_NODE_INSTANCES, // uint32_t, instances in leaf order
+    COOK_SECTION_STRINGS, // Null terminated, for the cook and tools
+    COOK_SECTION_COUNT
+};
+
+enum CookFormat
+{
+    COOK_FORMAT_BC1, // DXT1, opaque textures
+    COOK_FORMAT_RGBA8 // Textures with alpha
+};
+
+struct CookRange
+{
+    uint64_t offset; // From the start of the file
+    uint64_t size; // Bytes
+};
+
+struct CookHeader
+{
+    char magic[4]; // "MPAK"
+    uint32_t version; // COOK_VERSION
+    uint32_t sectionCount; // COOK_SECTION_COUNT
+    uint32_t reserved;
+    double origin[3]; // Center of the instances, what the node bounds are relative to
+    double min[3]; // Bounds of all the instances
+    double max[3];
+    CookRange sections[COOK_SECTION_COUNT];
+};
+
+struct CookVertex // 32 bytes
+{
+    float position[3];
+    int16_t normal[4]; // Normalized, w is 0
+    uint8_t color[4]; // Normalized
+    float uv[2];
+};
+
+// Identical meshes of different models share their vertices and indices
+struct CookMesh
+{
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t texture; // COOK_NONE without one
+    float min[3]; // In the model's space
+    float max[3];
+};
+
+struct CookModel
+{
+    uint64_t key; // Of the file's content and scale
+    uint32_t name; // Filename relative to the map, in the strings
+    uint32_t firstMesh;
+    uint32_t meshCount;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+    uint32_t reserved;
+    float min[3];
+    float max[3];
+};
+
+// Mips from the largest down to 1x1, one after the other, each starting
+// on a 16 bytes boundary. BC1 mips are 8 bytes per 4x4 block. No mips if
+// the image couldn't be read, its meshes are drawn without a texture.
+struct CookTexture
+{
+    uint64_t key; // Of the image file's content
+    uint32_t name; // Path relative to the map, in the strings
+    uint32_t format; // CookFormat
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipCount;
+    uint32_t reserved;
+    uint64_t offset; // In the texture data
+    uint64_t size;
+};
+
+// A placed model, an entity or a part of a prefab entity
+struct CookInstance // 96 bytes
+{
+    double position[3]; // World, doubles so far out models don't jitter
+    float basis[9]; // Columns of the rotation and scale
+    uint32_t model;
+    float min[3]; // World bounds, relative to position
+    float max[3];
+    uint32_t id; // The entity's, ENTITY_NO_ID if none
+    uint32_t layer;
+};
+
+// A mesh of a model drawn instanced over the model's instances
+struct CookDraw
+{
+    uint32_t texture; // COOK_NONE without one
+    uint32_t mesh;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+#endif
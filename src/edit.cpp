@@ -0,0 +1,205 @@
+#include "edit.h"
+#include "frame.h"
+#include "globals.h"
+#include "journal.h"
+#include "layers.h"
+#include "undo.h"
+#include "sectors.h"
+#include "selection.h"
+#include "snap.h"
+#include "transforms.h"
+
+#include <memory>
+#include <string.h>
+
+Edit edit_set(EntityField field, const std::vector<uint32_t>& indices, const std::vector<uint8_t>& values)
+{
+    Edit edit;
+    edit.type = EditType::Set;
+    edit.field = field;
+    edit.indices = indices;
+    edit.count = (uint32_t)indices.size();
+    entities_getValues(document.entities, field, indices.data(), indices.size(), edit.before);
+    edit.after = values;
+    return edit;
+}
+
+Edit edit_insert(uint32_t at, uint32_t count, const std::vector<uint8_t>& rows)
+{
+    Edit edit;
+    edit.type = EditType::Insert;
+    edit.first = at;
+    edit.count = count;
+    edit.after = rows;
+    return edit;
+}
+
+Edit edit_erase(uint32_t first, uint32_t count)
+{
+    Edit edit;
+    edit.type = EditType::Erase;
+    edit.first = first;
+    edit.count = count;
+    entities_getRows(document.entities, first, count, edit.before);
+    return edit;
+}
+
+Edit edit_layers(const Json::Value& layers)
+{
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    auto before = Json::writeString(builder, document.json["layers"]);
+    auto after = Json::writeString(builder, layers);
+
+    Edit edit;
+    edit.type = EditType::Layers;
+    edit.before.assign(before.begin(), before.end());
+    edit.after.assign(after.begin(), after.end());
+    return edit;
+}
+
+static bool applyLayers(const std::vector<uint8_t>& values)
+{
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    Json::Value layers;
+    std::string errors;
+    auto pText = (const char*)values.data();
+    if (!reader->parse(pText, pText + values.size(), &layers, &errors) || !(layers.isArray() || layers.isNull())) return false;
+    document.json["layers"] = std::move(layers);
+    return true;
+}
+
+void edit_commit(Edit&& edit, uint32_t mergeKey)
+{
+    if (!edit_applyToDocument(edit, false)) return;
+
+    journal_append(edit, false);
+    undo_record(std::move(edit), mergeKey);
+    document.dirty = true;
+}
+
+bool edit_apply(Entities& entities, const Edit& edit, bool reverse)
+{
+    const auto& values = reverse ? edit.before : edit.after;
+    auto pData = values.data();
+    auto pEnd = values.data() + values.size();
+
+    auto type = edit.type;
+    if (reverse)
+    {
+        if (type == EditType::Insert) type = EditType::Erase;
+        else if (type == EditType::Erase) type = EditType::Insert;
+    }
+
+    switch (type)
+    {
+    case EditType::Set:
+        return entities_setValues(entities, edit.field, edit.indices.data(), edit.indices.size(), &pData, pEnd);
+    case EditType::Insert:
+        return entities_insertRows(entities, edit.first, edit.count, &pData, pEnd);
+    case EditType::Erase:
+        return entities_erase(entities, edit.first, edit.count);
+    case EditType::Layers:
+        return applyLayers(values);
+    }
+    return false;
+}
+
+bool edit_applyToDocument(const Edit& edit, bool reverse)
+{
+    // The entities stay as they are
+    if (edit.type == EditType::Layers)
+    {
+        if (!edit_apply(document.entities, edit, reverse)) return false;
+        layers_onEdit();
+        frame_invalidate(FrameReason::UI);
+        return true;
+    }
+
+    snap_beforeEdit(edit);
+    sectors_beforeEdit(edit);
+    transforms_beforeEdit(edit);
+    if (!edit_apply(document.entities, edit, reverse)) return false;
+    transforms_afterEdit(edit);
+    sectors_afterEdit(edit);
+    snap_afterEdit(edit);
+    frame_invalidate(FrameReason::Entities);
+
+    auto type = edit.type;
+    if (reverse)
+    {
+        if (type == EditType::Insert) type = EditType::Erase;
+        else if (type == EditType::Erase) type = EditType::Insert;
+    }
+    if (type == EditType::Insert) selection_onInsert(edit.first, edit.count);
+    else if (type == EditType::Erase) selection_onErase(edit.first, edit.count);
+    return true;
+}
+
+template<typename T>
+static void write(std::vector<uint8_t>& out, const T& value)
+{
+    auto pValue = (const uint8_t*)&value;
+    out.insert(out.end(), pValue, pValue + sizeof(T));
+}
+
+template<typename T>
+static bool read(const uint8_t** ppData, const uint8_t* pEnd, T* pValue)
+{
+    if ((size_t)(pEnd - *ppData) < sizeof(T)) return false;
+    memcpy(pValue, *ppData, sizeof(T));
+    *ppData += sizeof(T);
+    return true;
+}
+
+// type u8, field u8, first u32, count u32, index count u32, indices,
+// after size u32, after
+void edit_encode(const Edit& edit, bool reverse, std::vector<uint8_t>& out)
+{
+    auto type = edit.type;
+    if (reverse)
+    {
+        if (type == EditType::Insert) type = EditType::Erase;
+        else if (type == EditType::Erase) type = EditType::Insert;
+    }
+    const auto& after = reverse ? edit.before : edit.after;
+
+    write(out, (uint8_t)type);
+    write(out, (uint8_t)edit.field);
+    write(out, edit.first);
+    write(out, edit.count);
+    write(out, (uint32_t)edit.indices.size());
+    if (!edit.indices.empty())
+    {
+        auto pIndices = (const uint8_t*)edit.indices.data();
+        out.insert(out.end(), pIndices, pIndices + sizeof(uint32_t) * edit.indices.size());
+    }
+    if (type == EditType::Erase)
+    {
+        write(out, (uint32_t)0);
+        return;
+    }
+    write(out, (uint32_t)after.size());
+    out.insert(out.end(), after.begin(), after.end());
+}
+
+bool edit_decode(const uint8_t* pData, size_t size, Edit& edit)
+{
+    auto pEnd = pData + size;
+    uint8_t type, field;
+    uint32_t indexCount, afterSize;
+    if (!read(&pData, pEnd, &type) || type > (uint8_t)EditType::Layers) return false;
+    if (!read(&pData, pEnd, &field) || field >= (uint8_t)EntityField::COUNT) return false;
+    if (!read(&pData, pEnd, &edit.first) || !read(&pData, pEnd, &edit.count)) return false;
+    if (!read(&pData, pEnd, &indexCount) || (size_t)(pEnd - pData) / sizeof(uint32_t) < indexCount) return false;
+    edit.type = (EditType)type;
+    edit.field = (EntityField)field;
+    edit.indices.resize(indexCount);
+    if (indexCount) memcpy(edit.indices.data(), pData, sizeof(uint32_t) * indexCount);
+    pData += sizeof(uint32_t) * indexCount;
+    if (!read(&pData, pEnd, &afterSize) || (size_t)(pEnd - pData) != afterSize) return false;
+    edit.after.assign(pData, pEnd);
+    edit.before.clear();
+    return true;
+}
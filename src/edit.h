@@ -0,0 +1,55 @@
+#ifndef EDIT_H_INCLUDED
+#define EDIT_H_INCLUDED
+
+#include "entities.h"
+
+#include <json/json.h>
+
+#include <cinttypes>
+#include <vector>
+
+enum class EditType : uint8_t
+{
+    Set = 0, // field of the entities in indices
+    Insert, // count rows at first
+    Erase, // count rows at first
+    Layers // The document's "layers" array, values are its compact JSON
+};
+
+// A change to the entities. Every document change goes through an edit so it
+// can be journaled and reverted. Values are encoded, see EntityField.
+struct Edit
+{
+    EditType type = EditType::Set;
+    EntityField field = EntityField::Position;
+    uint32_t first = 0;
+    uint32_t count = 0;
+    std::vector<uint32_t> indices;
+    std::vector<uint8_t> before;
+    std::vector<uint8_t> after;
+};
+
+// Builders, they capture what is in the document now so the edit can be
+// reverted later.
+Edit edit_set(EntityField field, const std::vector<uint32_t>& indices, const std::vector<uint8_t>& values);
+Edit edit_insert(uint32_t at, uint32_t count, const std::vector<uint8_t>& rows);
+Edit edit_erase(uint32_t first, uint32_t count);
+Edit edit_layers(const Json::Value& layers);
+
+// Applies to the document, journals it, records it for undo and marks the
+// document dirty. Consecutive edits sharing a non zero mergeKey end up in a
+// single undo step, see undo_newMergeKey.
+void edit_commit(Edit&& edit, uint32_t mergeKey = 0);
+
+// Layers edits go to the document's json, whichever entities are given
+bool edit_apply(Entities& entities, const Edit& edit, bool reverse);
+
+// edit_apply on the document, also keeps the selection on the same entities
+bool edit_applyToDocument(const Edit& edit, bool reverse);
+
+// Compact encoding of the edit, or of its inverse, without the part only
+// needed to revert it. For the journal.
+void edit_encode(const Edit& edit, bool reverse, std::vector<uint8_t>& out);
+bool edit_decode(const uint8_t* pData, size_t size, Edit& edit);
+
+#endif
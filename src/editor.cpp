@@ -1,4 +1,5 @@
 #include "imgui.h"
+#include "bake.h"
 #include "globals.h"
 #include "menuBar.h"
 #include "toolBar.h"
@@ -7,24 +8,135 @@
 #include "layers.h"
 #include "editor.h"
 #include "config.h"
+#include "frame.h"
 #include "library.h"
+#include "mapFile.h"
+#include "memoryPanel.h"
+#include "saveQueue.h"
+#include "journal.h"
+#include "undo.h"
+#include "picking.h"
+#include "selection.h"
+#include "edit.h"
+#include "jobs.h"
+#include "raycast.h"
+#include "sectors.h"
+#include "shaders.h"
+#include "startup.h"
+#include "terrain.h"
+#include "transforms.h"
 
 #include <tinyfiledialogs.h>
+#include <SDL.h>
 
+#include <atomic>
+#include <cfloat>
 #include <stdlib.h>
-#include <fstream>
+#include <string.h>
+#include <thread>
+
+// The map reopened at startup, parsed on its own thread
+struct StartupOpen
+{
+    std::string filename;
+    Json::Value json;
+    Entities entities;
+    std::string error;
+    bool succeeded = false;
+};
+
+static std::thread openWorker;
+static StartupOpen startupOpen;
+static std::atomic<bool> isOpenDone(false);
+static bool isOpening = false;
+static bool isOpenDiscarded = false; // Another map was opened, or the empty one edited or saved, meanwhile
+
+static void newMap();
+static void apply(const std::string& filename, Json::Value& json, Entities& entities);
+
+static void startOpen(const std::string& filename)
+{
+    startupOpen.filename = filename;
+    isOpening = true;
+    openWorker = std::thread([]()
+    {
+        auto phase = startup_beginPhase("Map parse");
+        startupOpen.succeeded = mapFile_load(startupOpen.filename, startupOpen.json, startupOpen.entities, startupOpen.error);
+        startup_endPhase(phase);
+        isOpenDone = true;
+        frame_invalidate(FrameReason::AssetReady);
+    });
+}
+
+static void finishOpen()
+{
+    openWorker.join();
+    isOpening = false;
+
+    // The empty map was edited or saved while this parsed, that work wins
+    // over reopening the last map
+    if (document.dirty || !document.filename.empty()) isOpenDiscarded = true;
+    if (!isOpenDiscarded)
+    {
+        if (startupOpen.succeeded) apply(startupOpen.filename, startupOpen.json, startupOpen.entities);
+        else tinyfd_messageBox("Open", startupOpen.error.c_str(), "ok", "error", 0);
+    }
+    startupOpen = StartupOpen();
+}
 
 void editor_init()
 {
+    auto phase = startup_beginPhase("Jobs and config");
+    jobs_init();
     config_load();
+    startup_endPhase(phase);
+
+    // Parses while the programs build here and the first frames draw with
+    // an empty map
+    if (!recentMaps.empty()) startOpen(recentMaps[0]);
+
+    // All the programs at once, rather than one by one as views first draw
+    phase = startup_beginPhase("Shaders");
+    library_initShaders();
+    picking_initShaders();
+    terrain_initShaders();
+    view_initShaders();
+    shaders_finish();
+    startup_endPhase(phase);
+
+    newMap();
+}
+
+bool editor_isOpening()
+{
+    return isOpening && !isOpenDiscarded && !document.dirty && document.filename.empty();
+}
+
+static void updateShortcuts()
+{
+    auto& io = ImGui::GetIO();
+    if (io.WantCaptureKeyboard) return;
 
-    if (recentMaps.empty())
+    if (io.KeyCtrl && ImGui::IsKeyPressed(SDL_SCANCODE_S, false))
     {
-        editor_new();
+        if (io.KeyShift) editor_saveAs();
+        else editor_save();
+        frame_invalidate(FrameReason::UI);
     }
-    else
+
+    if (io.KeyCtrl && ImGui::IsKeyPressed(SDL_SCANCODE_Z))
+    {
+        if (io.KeyShift) undo_redo();
+        else undo_undo();
+    }
+    if (io.KeyCtrl && ImGui::IsKeyPressed(SDL_SCANCODE_Y))
     {
-        editor_openRecent(recentMaps[0]);
+        undo_redo();
+    }
+
+    if (ImGui::IsKeyPressed(SDL_SCANCODE_END, false))
+    {
+        editor_dropToSurface();
     }
 }
 
@@ -34,11 +146,31 @@ void editor_updateGUI()
     auto& style = ImGui::GetStyle();
     //style.WindowRounding = 0.0f;
 
+    saveQueue_update();
+    if (isOpening && isOpenDone) finishOpen();
+    sectors_update();
+    library_update();
+    bake_update();
+
+    // Startup is over once the map is in, and the models its views want too
+    if (!isOpening && !startup_isLoaded() && library_getPendingCount() == 0)
+    {
+        std::vector<ViewFocus> foci;
+        view_getFoci(foci);
+        if (!foci.empty()) startup_loaded();
+    }
+    picking_update();
+    updateShortcuts();
+
+    // Fold a long journal back into the map
+    if (journal_needsCompaction() && !saveQueue_isBusy()) saveQueue_push(document.filename);
+
     menuBar_updateGUI();
     toolBar_updateGUI();
     properties_updateGUI();
     layers_updateGUI();
     library_updateGUI();
+    memoryPanel_updateGUI();
 
     // Prepare the data
     
@@ -54,6 +186,7 @@ void editor_updateGUI()
         view_updateGUI(ViewType::Left, ViewLayout::Four, 2);
         view_updateGUI(ViewType::Front, ViewLayout::Four, 3);
     }
+    view_update();
 }
 
 void editor_quit()
@@ -63,9 +196,77 @@ void editor_quit()
     done = true;
 }
 
+void editor_shutdown()
+{
+    // Don't leave with a save in flight
+    saveQueue_wait();
+    if (isOpening) openWorker.join();
+    journal_close(false);
+    view_flush();
+    library_shutdown();
+    jobs_shutdown();
+}
+
+void editor_dropToSurface()
+{
+    // Children ride along with their parents
+    std::vector<uint32_t> selected, indices;
+    selection_getIndices(selected);
+    transforms_getTopmost(selected, indices);
+    if (indices.empty()) return;
+
+    // Straight down from each entity's origin, through the entity itself
+    std::vector<uint8_t> positions;
+    entities_getValues(document.entities, EntityField::Position, indices.data(), indices.size(), positions);
+    auto pWorldPositions = transforms_getWorldPositions();
+    std::vector<RaycastRay> rays(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        auto pWorldPosition = &pWorldPositions[indices[i] * 3];
+        auto& ray = rays[i];
+        ray.origin[0] = (float)pWorldPosition[0];
+        ray.origin[1] = (float)pWorldPosition[1];
+        ray.origin[2] = (float)pWorldPosition[2];
+        ray.dir[0] = 0;
+        ray.dir[1] = 0;
+        ray.dir[2] = -1;
+        ray.t = FLT_MAX;
+        ray.ignore = indices[i];
+    }
+    raycast_castBatch(rays.data(), rays.size());
+
+    // Only those that landed somewhere move, in one undo step
+    std::vector<uint32_t> moved;
+    std::vector<uint8_t> values;
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        if (rays[i].entity == RAYCAST_NONE) continue;
+        double position[3];
+        memcpy(position, &positions[i * sizeof(position)], sizeof(position));
+        const double worldDelta[3] = { 0.0, 0.0, -(double)rays[i].t };
+        double delta[3];
+        transforms_worldToParentDelta(indices[i], worldDelta, delta);
+        for (int k = 0; k < 3; ++k) position[k] += delta[k];
+        moved.push_back(indices[i]);
+        values.insert(values.end(), (const uint8_t*)position, (const uint8_t*)position + sizeof(position));
+    }
+    if (moved.empty()) return;
+    edit_commit(edit_set(EntityField::Position, moved, values));
+}
+
 void editor_new()
+{
+    isOpenDiscarded = isOpening;
+    newMap();
+}
+
+static void newMap()
 {
     // Clear
+    view_flush();
+    journal_close(false);
+    undo_clear();
+    selection_clear();
     document = Document();
     document.dirty = false;
 
@@ -131,15 +332,14 @@ void editor_new()
     // model library
     Json::Value library(Json::ValueType::arrayValue);
 
-    // entities
-    Json::Value map(Json::ValueType::arrayValue);
-
     document.json["version"] = MAP_VERSION;
     document.json["editor"] = editor;
     document.json["library"] = library;
-    document.json["map"] = map;
 
     library_load();
+    layers_load();
+    terrain_load();
+    bake_load();
     view_load();
 }
 
@@ -164,34 +364,54 @@ static void addRecent(const std::string& filename)
 
 static void open(const std::string& filename)
 {
-    std::ifstream file(filename);
-    if (!file.is_open())
+    Json::Value json;
+    Entities entities;
+    std::string error;
+    if (!mapFile_load(filename, json, entities, error))
     {
-        tinyfd_messageBox("Open", ("Failed to open file:\n" + filename).c_str(), "ok", "error", 0);
+        tinyfd_messageBox("Open", error.c_str(), "ok", "error", 0);
         return;
     }
-    file >> document.json;
+    isOpenDiscarded = isOpening;
+    apply(filename, json, entities);
+}
+
+static void apply(const std::string& filename, Json::Value& json, Entities& entities)
+{
+    auto phase = startup_beginPhase("Map apply");
+    view_flush();
+    document.json.swap(json);
+    document.entities = std::move(entities);
+    undo_clear();
+    selection_clear();
 
     document.dirty = false;
     document.filename = filename;
 
+    // Brings back edits lost in a crash, if any
+    journal_open(document.filename);
+
     addRecent(document.filename);
 
     library_load();
+    layers_load();
+    terrain_load();
+    bake_load();
     view_load();
+    startup_endPhase(phase);
 }
 
 static void save()
 {
-    std::ofstream file(document.filename);
-    if (!file.is_open())
-    {
-        tinyfd_messageBox("Open", ("Failed to open/create file:\n" + document.filename).c_str(), "ok", "error", 0);
-        return;
-    }
-    file << document.json;
+    document.json["version"] = MAP_VERSION;
 
-    document.dirty = false;
+    // Cameras as the defaults for whoever opens the map next
+    view_toJson(document.json["editor"]["views"]);
+    view_flush();
+
+    // Written in the background, clears the dirty flag once snapshotted
+    saveQueue_push(document.filename);
+    bake_save();
 
     // Add to recent
     addRecent(document.filename);
@@ -208,8 +428,8 @@ void editor_open()
         }
     }
 
-    const char* filters[] = { "*.json" };
-    auto ret = tinyfd_openFileDialog("Open", "", 1, filters, NULL, 0);
+    const char* filters[] = { "*" MAP_JSON_EXTENSION, "*" MAP_BINARY_EXTENSION };
+    auto ret = tinyfd_openFileDialog("Open", "", 2, filters, NULL, 0);
     if (!ret) return;
     open(ret);
 }
@@ -253,14 +473,19 @@ void editor_saveAs()
         }
     }
 
-    const char* filters[] = { "*.json" };
-    auto ret = tinyfd_saveFileDialog("Save As", "untitled.json", 1, filters, NULL);
+    const char* filters[] = { "*" MAP_JSON_EXTENSION, "*" MAP_BINARY_EXTENSION };
+    auto ret = tinyfd_saveFileDialog("Save As", "untitled" MAP_JSON_EXTENSION, 2, filters, NULL);
     if (!ret) return;
+    auto previousFilename = document.filename;
     document.filename = ret;
-    if (document.filename.size() < 5 || document.filename.substr(document.filename.size() - 5) != ".json")
+    if (!mapFile_isBinary(document.filename) &&
+        (document.filename.size() < 5 || document.filename.substr(document.filename.size() - 5) != MAP_JSON_EXTENSION))
     {
-        document.filename += ".json";
+        document.filename += MAP_JSON_EXTENSION;
     }
 
+    // The journal follows the map, once it's saved there
+    if (document.filename != previousFilename) journal_follow(document.filename);
+
     save();
 }
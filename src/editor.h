@@ -7,9 +7,12 @@ void editor_init();
 void editor_new();
 void editor_open();
 void editor_openRecent(const std::string& filename);
+bool editor_isOpening(); // The map reopened at startup is still being parsed
 void editor_save();
 void editor_saveAs();
 void editor_updateGUI();
 void editor_quit();
+void editor_dropToSurface(); // Moves the selected entities down onto what is below them
+void editor_shutdown();
 
 #endif
@@ -0,0 +1,490 @@
+#include "entities.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+
+// Where the fields of an entity are, in a chunk or in a row
+struct EntityRef
+{
+    uint8_t* pFlags;
+    uint64_t* pModelId;
+    double* pPosition;
+    float* pRotation;
+    float* pScale;
+    uint32_t* pId;
+    uint32_t* pParent;
+    uint8_t* pLayer;
+    std::string* pExtras;
+};
+
+static EntityRef getRef(EntityChunk& chunk, uint32_t i)
+{
+    return { &chunk.flags[i], &chunk.modelIds[i], &chunk.positions[i * 3], &chunk.rotations[i * 4],
+             &chunk.scales[i * 3], &chunk.ids[i], &chunk.parents[i], &chunk.layers[i], &chunk.extras[i] };
+}
+
+static EntityRef getRef(EntityRow& row)
+{
+    return { &row.flags, &row.modelId, row.position, row.rotation, row.scale, &row.id, &row.parent, &row.layer, &row.extras };
+}
+
+template<typename T>
+static bool isUnique(const std::shared_ptr<T>& p)
+{
+    if (p.use_count() != 1) return false;
+
+    // Other owners release with a barrier once done reading, match it before
+    // we write.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
+
+static std::atomic<uint64_t> nextRevision(1);
+
+static EntityTable& editTable(Entities& entities)
+{
+    if (!entities.pTable) entities.pTable = std::make_shared<EntityTable>();
+    else if (!isUnique(entities.pTable)) entities.pTable = std::make_shared<EntityTable>(*entities.pTable);
+    entities.pTable->revision = nextRevision++;
+    return *entities.pTable;
+}
+
+static EntityChunk& editChunk(EntityTable& table, size_t chunkIndex)
+{
+    auto& pChunk = table.chunks[chunkIndex];
+    if (!isUnique(pChunk)) pChunk = std::make_shared<EntityChunk>(*pChunk);
+    return *pChunk;
+}
+
+// Chunk holding the entity at index
+static size_t findChunk(const EntityTable& table, size_t index)
+{
+    auto it = std::upper_bound(table.firsts.begin(), table.firsts.end(), index);
+    return (size_t)(it - table.firsts.begin()) - 1;
+}
+
+static void updateFirsts(EntityTable& table, size_t fromChunk)
+{
+    table.firsts.resize(table.chunks.size());
+    size_t first = 0;
+    if (fromChunk > 0 && fromChunk <= table.chunks.size())
+    {
+        first = table.firsts[fromChunk - 1] + table.chunks[fromChunk - 1]->count;
+    }
+    else
+    {
+        fromChunk = 0;
+    }
+    for (size_t i = fromChunk; i < table.chunks.size(); ++i)
+    {
+        table.firsts[i] = first;
+        first += table.chunks[i]->count;
+    }
+    table.count = first;
+}
+
+// Everything but the extras
+static void copyColumns(EntityChunk& dst, uint32_t dstIndex, const EntityChunk& src, uint32_t srcIndex, uint32_t count)
+{
+    memmove(&dst.flags[dstIndex], &src.flags[srcIndex], count);
+    memmove(&dst.modelIds[dstIndex], &src.modelIds[srcIndex], sizeof(uint64_t) * count);
+    memmove(&dst.positions[dstIndex * 3], &src.positions[srcIndex * 3], sizeof(double) * 3 * count);
+    memmove(&dst.rotations[dstIndex * 4], &src.rotations[srcIndex * 4], sizeof(float) * 4 * count);
+    memmove(&dst.scales[dstIndex * 3], &src.scales[srcIndex * 3], sizeof(float) * 3 * count);
+    memmove(&dst.ids[dstIndex], &src.ids[srcIndex], sizeof(uint32_t) * count);
+    memmove(&dst.parents[dstIndex], &src.parents[srcIndex], sizeof(uint32_t) * count);
+    memmove(&dst.layers[dstIndex], &src.layers[srcIndex], count);
+}
+
+static void takeRow(EntityChunk& chunk, uint32_t i, EntityRow& row)
+{
+    row.flags = chunk.flags[i];
+    row.modelId = chunk.modelIds[i];
+    memcpy(row.position, &chunk.positions[i * 3], sizeof(row.position));
+    memcpy(row.rotation, &chunk.rotations[i * 4], sizeof(row.rotation));
+    memcpy(row.scale, &chunk.scales[i * 3], sizeof(row.scale));
+    row.id = chunk.ids[i];
+    row.parent = chunk.parents[i];
+    row.layer = chunk.layers[i];
+    row.extras = std::move(chunk.extras[i]);
+    chunk.extras[i].clear();
+}
+
+// Moves the extras out of the row
+static void pushRow(EntityChunk& chunk, EntityRow& row)
+{
+    auto i = chunk.count++;
+    chunk.flags[i] = row.flags;
+    chunk.modelIds[i] = row.modelId;
+    memcpy(&chunk.positions[i * 3], row.position, sizeof(row.position));
+    memcpy(&chunk.rotations[i * 4], row.rotation, sizeof(row.rotation));
+    memcpy(&chunk.scales[i * 3], row.scale, sizeof(row.scale));
+    chunk.ids[i] = row.id;
+    chunk.parents[i] = row.parent;
+    chunk.layers[i] = row.layer;
+    chunk.extras[i] = std::move(row.extras);
+}
+
+// Folds the next chunk into this one when both fit, keeps edits in the
+// middle from leaving lots of small chunks behind.
+static bool mergeWithNext(EntityTable& table, size_t chunkIndex)
+{
+    if (chunkIndex + 1 >= table.chunks.size()) return false;
+    const auto& next = *table.chunks[chunkIndex + 1];
+    if (table.chunks[chunkIndex]->count + next.count > ENTITY_CHUNK_SIZE) return false;
+
+    auto& chunk = editChunk(table, chunkIndex);
+    copyColumns(chunk, chunk.count, next, 0, next.count);
+    std::copy(next.extras, next.extras + next.count, chunk.extras + chunk.count);
+    chunk.count += next.count;
+    table.chunks.erase(table.chunks.begin() + chunkIndex + 1);
+    return true;
+}
+
+void entities_clear(Entities& entities)
+{
+    entities.pTable.reset();
+}
+
+void entities_reserve(Entities& entities, size_t count)
+{
+    auto& table = editTable(entities);
+    auto chunkCount = (count + ENTITY_CHUNK_SIZE - 1) / ENTITY_CHUNK_SIZE;
+    table.chunks.reserve(chunkCount);
+    table.firsts.reserve(chunkCount);
+}
+
+// Last chunk, with room for at least one more entity
+static EntityChunk& editLastChunk(EntityTable& table)
+{
+    if (table.chunks.empty() || table.chunks.back()->count == ENTITY_CHUNK_SIZE)
+    {
+        table.chunks.push_back(std::make_shared<EntityChunk>());
+        table.firsts.push_back(table.count);
+    }
+    return editChunk(table, table.chunks.size() - 1);
+}
+
+void entities_append(Entities& entities, const EntityRow& row)
+{
+    auto& table = editTable(entities);
+    auto copy = row;
+    pushRow(editLastChunk(table), copy);
+    ++table.count;
+}
+
+void entities_appendColumns(Entities& entities, size_t count, const EntityColumns& columns)
+{
+    static const EntityRow DEFAULTS;
+    auto& table = editTable(entities);
+    size_t done = 0;
+    while (done < count)
+    {
+        auto& chunk = editLastChunk(table);
+        auto n = std::min(count - done, (size_t)(ENTITY_CHUNK_SIZE - chunk.count));
+        auto at = chunk.count;
+        if (columns.pFlags) memcpy(&chunk.flags[at], columns.pFlags + done, n);
+        else std::fill(chunk.flags + at, chunk.flags + at + n, DEFAULTS.flags);
+        if (columns.pModelIds) memcpy(&chunk.modelIds[at], columns.pModelIds + done, sizeof(uint64_t) * n);
+        else std::fill(chunk.modelIds + at, chunk.modelIds + at + n, DEFAULTS.modelId);
+        if (columns.pPositions) memcpy(&chunk.positions[at * 3], columns.pPositions + done * 3, sizeof(double) * 3 * n);
+        else for (size_t i = 0; i < n; ++i) memcpy(&chunk.positions[(at + i) * 3], DEFAULTS.position, sizeof(DEFAULTS.position));
+        if (columns.pRotations) memcpy(&chunk.rotations[at * 4], columns.pRotations + done * 4, sizeof(float) * 4 * n);
+        else for (size_t i = 0; i < n; ++i) memcpy(&chunk.rotations[(at + i) * 4], DEFAULTS.rotation, sizeof(DEFAULTS.rotation));
+        if (columns.pScales) memcpy(&chunk.scales[at * 3], columns.pScales + done * 3, sizeof(float) * 3 * n);
+        else for (size_t i = 0; i < n; ++i) memcpy(&chunk.scales[(at + i) * 3], DEFAULTS.scale, sizeof(DEFAULTS.scale));
+        if (columns.pIds) memcpy(&chunk.ids[at], columns.pIds + done, sizeof(uint32_t) * n);
+        else std::fill(chunk.ids + at, chunk.ids + at + n, DEFAULTS.id);
+        if (columns.pParents) memcpy(&chunk.parents[at], columns.pParents + done, sizeof(uint32_t) * n);
+        else std::fill(chunk.parents + at, chunk.parents + at + n, DEFAULTS.parent);
+        if (columns.pLayers) memcpy(&chunk.layers[at], columns.pLayers + done, n);
+        else std::fill(chunk.layers + at, chunk.layers + at + n, DEFAULTS.layer);
+        chunk.count += (uint32_t)n;
+        table.count += n;
+        done += n;
+    }
+}
+
+size_t entities_count(const Entities& entities)
+{
+    return entities.pTable ? entities.pTable->count : 0;
+}
+
+uint64_t entities_getRevision(const Entities& entities)
+{
+    return entities.pTable ? entities.pTable->revision : 0;
+}
+
+size_t entities_getChunkCount(const Entities& entities)
+{
+    return entities.pTable ? entities.pTable->chunks.size() : 0;
+}
+
+const EntityChunk& entities_getChunk(const Entities& entities, size_t chunkIndex)
+{
+    return *entities.pTable->chunks[chunkIndex];
+}
+
+EntityChunk& entities_editChunk(Entities& entities, size_t chunkIndex)
+{
+    return editChunk(editTable(entities), chunkIndex);
+}
+
+template<typename T>
+static void write(std::vector<uint8_t>& out, const T& value)
+{
+    auto pValue = (const uint8_t*)&value;
+    out.insert(out.end(), pValue, pValue + sizeof(T));
+}
+
+template<typename T>
+static bool read(const uint8_t** ppData, const uint8_t* pEnd, T* pValue)
+{
+    if ((size_t)(pEnd - *ppData) < sizeof(T)) return false;
+    memcpy(pValue, *ppData, sizeof(T));
+    *ppData += sizeof(T);
+    return true;
+}
+
+static void getValue(const EntityChunk& chunk, EntityField field, uint32_t i, std::vector<uint8_t>& out)
+{
+    switch (field)
+    {
+    case EntityField::Flags:
+        write(out, chunk.flags[i]);
+        break;
+    case EntityField::ModelId:
+        write(out, chunk.modelIds[i]);
+        break;
+    case EntityField::Position:
+    {
+        auto pPosition = (const uint8_t*)&chunk.positions[i * 3];
+        out.insert(out.end(), pPosition, pPosition + sizeof(double) * 3);
+        break;
+    }
+    case EntityField::Extras:
+    {
+        const auto& extras = chunk.extras[i];
+        write(out, (uint32_t)extras.size());
+        out.insert(out.end(), extras.begin(), extras.end());
+        break;
+    }
+    case EntityField::Rotation:
+    {
+        auto pRotation = (const uint8_t*)&chunk.rotations[i * 4];
+        out.insert(out.end(), pRotation, pRotation + sizeof(float) * 4);
+        break;
+    }
+    case EntityField::Scale:
+    {
+        auto pScale = (const uint8_t*)&chunk.scales[i * 3];
+        out.insert(out.end(), pScale, pScale + sizeof(float) * 3);
+        break;
+    }
+    case EntityField::Id:
+        write(out, chunk.ids[i]);
+        break;
+    case EntityField::Parent:
+        write(out, chunk.parents[i]);
+        break;
+    case EntityField::Layer:
+        write(out, chunk.layers[i]);
+        break;
+    default:
+        break;
+    }
+}
+
+template<typename T>
+static bool readArray(const uint8_t** ppData, const uint8_t* pEnd, T* pValues, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!read(ppData, pEnd, &pValues[i])) return false;
+    }
+    return true;
+}
+
+static bool setValue(EntityField field, const EntityRef& ref, const uint8_t** ppData, const uint8_t* pEnd)
+{
+    switch (field)
+    {
+    case EntityField::Flags:
+        return read(ppData, pEnd, ref.pFlags);
+    case EntityField::ModelId:
+        return read(ppData, pEnd, ref.pModelId);
+    case EntityField::Position:
+        return readArray(ppData, pEnd, ref.pPosition, 3);
+    case EntityField::Extras:
+    {
+        uint32_t size;
+        if (!read(ppData, pEnd, &size) || (size_t)(pEnd - *ppData) < size) return false;
+        ref.pExtras->assign((const char*)*ppData, size);
+        *ppData += size;
+        return true;
+    }
+    case EntityField::Rotation:
+        return readArray(ppData, pEnd, ref.pRotation, 4);
+    case EntityField::Scale:
+        return readArray(ppData, pEnd, ref.pScale, 3);
+    case EntityField::Id:
+        return read(ppData, pEnd, ref.pId);
+    case EntityField::Parent:
+        return read(ppData, pEnd, ref.pParent);
+    case EntityField::Layer:
+        return read(ppData, pEnd, ref.pLayer) && *ref.pLayer < ENTITY_MAX_LAYERS;
+    default:
+        return false;
+    }
+}
+
+void entities_getValues(const Entities& entities, EntityField field, const uint32_t* pIndices, size_t count, std::vector<uint8_t>& out)
+{
+    if (!entities.pTable) return;
+    const auto& table = *entities.pTable;
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto chunkIndex = findChunk(table, pIndices[i]);
+        getValue(*table.chunks[chunkIndex], field, (uint32_t)(pIndices[i] - table.firsts[chunkIndex]), out);
+    }
+}
+
+bool entities_setValues(Entities& entities, EntityField field, const uint32_t* pIndices, size_t count, const uint8_t** ppData, const uint8_t* pEnd)
+{
+    auto entityCount = entities_count(entities);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (pIndices[i] >= entityCount) return false;
+    }
+    if (!count) return true;
+
+    auto& table = editTable(entities);
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto chunkIndex = findChunk(table, pIndices[i]);
+        auto& chunk = editChunk(table, chunkIndex);
+        auto j = (uint32_t)(pIndices[i] - table.firsts[chunkIndex]);
+        if (!setValue(field, getRef(chunk, j), ppData, pEnd)) return false;
+    }
+    return true;
+}
+
+void entities_getRows(const Entities& entities, uint32_t first, uint32_t count, std::vector<uint8_t>& out)
+{
+    if (!count) return;
+    const auto& table = *entities.pTable;
+    auto chunkIndex = findChunk(table, first);
+    auto j = (uint32_t)(first - table.firsts[chunkIndex]);
+    for (uint32_t i = 0; i < count; ++i, ++j)
+    {
+        if (j == table.chunks[chunkIndex]->count)
+        {
+            ++chunkIndex;
+            j = 0;
+        }
+        for (int field = 0; field < (int)EntityField::COUNT; ++field)
+        {
+            getValue(*table.chunks[chunkIndex], (EntityField)field, j, out);
+        }
+    }
+}
+
+bool entities_insertRows(Entities& entities, uint32_t at, uint32_t count, const uint8_t** ppData, const uint8_t* pEnd)
+{
+    if (at > entities_count(entities)) return false;
+
+    // Decode on the side first so a truncated edit leaves us untouched
+    std::vector<EntityRow> rows(count);
+    for (auto& row : rows)
+    {
+        for (int field = 0; field < (int)EntityField::COUNT; ++field)
+        {
+            if (!setValue((EntityField)field, getRef(row), ppData, pEnd)) return false;
+        }
+    }
+    if (!count) return true;
+
+    auto& table = editTable(entities);
+    if (at == table.count)
+    {
+        for (auto& row : rows)
+        {
+            pushRow(editLastChunk(table), row);
+            ++table.count;
+        }
+        return true;
+    }
+
+    // Split the chunk at the insertion point, then put back the new rows and
+    // what followed them. Only that chunk and the overflow are touched.
+    auto chunkIndex = findChunk(table, at);
+    auto pChunk = &editChunk(table, chunkIndex);
+    auto local = (uint32_t)(at - table.firsts[chunkIndex]);
+    std::vector<EntityRow> tail(pChunk->count - local);
+    for (uint32_t i = local; i < pChunk->count; ++i) takeRow(*pChunk, i, tail[i - local]);
+    pChunk->count = local;
+
+    auto lastIndex = chunkIndex;
+    for (auto pRows : { &rows, &tail })
+    {
+        for (auto& row : *pRows)
+        {
+            if (pChunk->count == ENTITY_CHUNK_SIZE)
+            {
+                ++lastIndex;
+                table.chunks.insert(table.chunks.begin() + lastIndex, std::make_shared<EntityChunk>());
+                pChunk = table.chunks[lastIndex].get();
+            }
+            pushRow(*pChunk, row);
+        }
+    }
+    if (lastIndex > chunkIndex) mergeWithNext(table, lastIndex);
+
+    updateFirsts(table, chunkIndex);
+    return true;
+}
+
+bool entities_erase(Entities& entities, uint32_t first, uint32_t count)
+{
+    if ((size_t)first + count > entities_count(entities)) return false;
+    if (!count) return true;
+
+    auto& table = editTable(entities);
+    auto chunkIndex = findChunk(table, first);
+    auto firstChunkIndex = chunkIndex;
+    auto local = (uint32_t)(first - table.firsts[chunkIndex]);
+    while (count)
+    {
+        auto chunkCount = table.chunks[chunkIndex]->count;
+        auto n = std::min(count, chunkCount - local);
+        if (n == chunkCount)
+        {
+            // Whole chunk, no need to copy it
+            table.chunks.erase(table.chunks.begin() + chunkIndex);
+        }
+        else
+        {
+            auto& chunk = editChunk(table, chunkIndex);
+            auto end = local + n;
+            auto moved = chunk.count - end;
+            copyColumns(chunk, local, chunk, end, moved);
+            std::move(chunk.extras + end, chunk.extras + chunk.count, chunk.extras + local);
+            for (auto i = chunk.count - n; i < chunk.count; ++i) chunk.extras[i].clear();
+            chunk.count -= n;
+            ++chunkIndex;
+        }
+        count -= n;
+        local = 0;
+    }
+
+    // Stitch what is left around the hole
+    auto stitchIndex = firstChunkIndex > 0 ? firstChunkIndex - 1 : 0;
+    for (auto i = stitchIndex; i <= firstChunkIndex && i < table.chunks.size();)
+    {
+        if (!mergeWithNext(table, i)) ++i;
+    }
+
+    updateFirsts(table, stitchIndex);
+    return true;
+}
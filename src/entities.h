@@ -0,0 +1,125 @@
+#ifndef ENTITIES_H_INCLUDED
+#define ENTITIES_H_INCLUDED
+
+#include <cinttypes>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Entity flags
+#define ENTITY_FLAG_RAW 0x01 // Didn't fit the schema, the whole entity is kept in extras
+
+#define ENTITY_CHUNK_SIZE 1024
+#define ENTITY_NO_ID 0 // Entities without an id can't be parents
+#define ENTITY_MAX_LAYERS 64 // Layer states are bits of a uint64_t
+
+// Up to ENTITY_CHUNK_SIZE entities, stored by columns
+struct EntityChunk
+{
+    uint32_t count = 0;
+    uint8_t flags[ENTITY_CHUNK_SIZE];
+    uint64_t modelIds[ENTITY_CHUNK_SIZE];
+    double positions[ENTITY_CHUNK_SIZE * 3]; // x, y, z, relative to the parent
+    float rotations[ENTITY_CHUNK_SIZE * 4]; // Quaternion x, y, z, w
+    float scales[ENTITY_CHUNK_SIZE * 3]; // x, y, z
+    uint32_t ids[ENTITY_CHUNK_SIZE]; // Referenced by parents, ENTITY_NO_ID if none
+    uint32_t parents[ENTITY_CHUNK_SIZE]; // Id of the parent, ENTITY_NO_ID for none
+    uint8_t layers[ENTITY_CHUNK_SIZE]; // Under ENTITY_MAX_LAYERS
+    std::string extras[ENTITY_CHUNK_SIZE]; // Compact JSON object of unknown fields, empty if none
+};
+
+// A single entity, out of the chunks
+struct EntityRow
+{
+    uint8_t flags = 0;
+    uint64_t modelId = 0;
+    double position[3] = { 0, 0, 0 };
+    float rotation[4] = { 0, 0, 0, 1 };
+    float scale[3] = { 1, 1, 1 };
+    uint32_t id = ENTITY_NO_ID;
+    uint32_t parent = ENTITY_NO_ID;
+    uint8_t layer = 0;
+    std::string extras;
+};
+
+struct EntityTable
+{
+    std::vector<std::shared_ptr<EntityChunk>> chunks; // Never empty ones
+    std::vector<size_t> firsts; // Index of the first entity of each chunk
+    size_t count = 0;
+    uint64_t revision = 0; // Changes on every write
+};
+
+// Placed entities. The "map" array of the document lives here instead of in
+// the JSON tree.
+// Copies are O(1) snapshots: the table and its chunks are shared and only
+// copied when written to while shared, so a copy handed to another thread
+// never sees later edits and needs no lock.
+struct Entities
+{
+    std::shared_ptr<EntityTable> pTable;
+};
+
+// Fields that can be edited. Values are encoded as:
+//   Flags:    u8
+//   ModelId:  u64
+//   Position: double[3]
+//   Extras:   u32 size, then the chars
+//   Rotation: float[4]
+//   Scale:    float[3]
+//   Id:       u32
+//   Parent:   u32
+//   Layer:    u8
+// A row is all the fields in that order.
+enum class EntityField : uint8_t
+{
+    Flags = 0,
+    ModelId,
+    Position,
+    Extras,
+    Rotation,
+    Scale,
+    Id,
+    Parent,
+    Layer,
+    COUNT
+};
+
+void entities_clear(Entities& entities);
+void entities_reserve(Entities& entities, size_t count);
+void entities_append(Entities& entities, const EntityRow& row);
+size_t entities_count(const Entities& entities);
+
+// Changes whenever the entities are written to, for caches built from them
+uint64_t entities_getRevision(const Entities& entities);
+
+// Bulk append, extras are left empty. Missing columns (null) get the
+// defaults of EntityRow.
+struct EntityColumns
+{
+    const uint8_t* pFlags = nullptr;
+    const uint64_t* pModelIds = nullptr;
+    const double* pPositions = nullptr;
+    const float* pRotations = nullptr;
+    const float* pScales = nullptr;
+    const uint32_t* pIds = nullptr;
+    const uint32_t* pParents = nullptr;
+    const uint8_t* pLayers = nullptr;
+};
+void entities_appendColumns(Entities& entities, size_t count, const EntityColumns& columns);
+
+// Chunk access, for loops over all entities. Editing a chunk copies it first
+// if it is shared with a snapshot.
+size_t entities_getChunkCount(const Entities& entities);
+const EntityChunk& entities_getChunk(const Entities& entities, size_t chunkIndex);
+EntityChunk& entities_editChunk(Entities& entities, size_t chunkIndex);
+
+// Encoded access, used by edits. Readers append to out, writers return false
+// if the data is truncated or an index is out of range.
+void entities_getValues(const Entities& entities, EntityField field, const uint32_t* pIndices, size_t count, std::vector<uint8_t>& out);
+bool entities_setValues(Entities& entities, EntityField field, const uint32_t* pIndices, size_t count, const uint8_t** ppData, const uint8_t* pEnd);
+void entities_getRows(const Entities& entities, uint32_t first, uint32_t count, std::vector<uint8_t>& out);
+bool entities_insertRows(Entities& entities, uint32_t at, uint32_t count, const uint8_t** ppData, const uint8_t* pEnd);
+bool entities_erase(Entities& entities, uint32_t first, uint32_t count);
+
+#endif
@@ -0,0 +1,336 @@
+#include "entityGrid.h"
+#include "globals.h"
+#include "layers.h"
+#include "transforms.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define ENTITYGRID_POINTS_PER_CELL 4
+#define ENTITYGRID_MAX_CELLS (4 * 1024 * 1024)
+
+// Cells are square and stored by rows, their points packed one after the
+// other (counting sort) so a cell is a contiguous range.
+struct GridPlane
+{
+    bool isBuilt = false;
+    uint64_t revision = 0;
+    float origin[2] = { 0, 0 };
+    float cellSize = 1;
+    float invCellSize = 1;
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> cellStarts; // width * height + 1
+    std::vector<float> points; // a, b
+    std::vector<uint32_t> entities;
+    std::vector<uint8_t> layers;
+    uint64_t layerMask = 0; // Layers with entities in the plane
+};
+
+static GridPlane planes[3]; // XY, XZ, YZ
+
+static int getCellX(const GridPlane& plane, float a)
+{
+    auto x = (int)std::floor((a - plane.origin[0]) * plane.invCellSize);
+    return std::max(0, std::min(plane.width - 1, x));
+}
+
+static int getCellY(const GridPlane& plane, float b)
+{
+    auto y = (int)std::floor((b - plane.origin[1]) * plane.invCellSize);
+    return std::max(0, std::min(plane.height - 1, y));
+}
+
+static void build(GridPlane& plane, int axisA, int axisB)
+{
+    plane.cellStarts.clear();
+    plane.points.clear();
+    plane.entities.clear();
+    plane.layers.clear();
+    plane.layerMask = 0;
+    plane.width = 0;
+    plane.height = 0;
+
+    std::vector<float> points;
+    std::vector<uint32_t> entities;
+    std::vector<uint8_t> layers;
+    const auto& documentEntities = document.entities;
+    points.reserve(entities_count(documentEntities) * 2);
+    entities.reserve(entities_count(documentEntities));
+    auto chunkCount = entities_getChunkCount(documentEntities);
+    auto pWorldPositions = transforms_getWorldPositions();
+    uint32_t index = 0;
+    for (size_t c = 0; c < chunkCount; ++c)
+    {
+        const auto& chunk = entities_getChunk(documentEntities, c);
+        for (uint32_t i = 0; i < chunk.count; ++i, ++index)
+        {
+            if (chunk.flags[i] & ENTITY_FLAG_RAW) continue;
+            points.push_back((float)pWorldPositions[index * 3 + axisA]);
+            points.push_back((float)pWorldPositions[index * 3 + axisB]);
+            entities.push_back(index);
+            layers.push_back(chunk.layers[i]);
+            plane.layerMask |= (uint64_t)1 << chunk.layers[i];
+        }
+    }
+    auto count = entities.size();
+    if (!count) return;
+
+    float min[2] = { points[0], points[1] };
+    float max[2] = { points[0], points[1] };
+    for (size_t i = 1; i < count; ++i)
+    {
+        for (int k = 0; k < 2; ++k)
+        {
+            min[k] = std::min(min[k], points[i * 2 + k]);
+            max[k] = std::max(max[k], points[i * 2 + k]);
+        }
+    }
+
+    // About ENTITYGRID_POINTS_PER_CELL per cell if they were spread evenly.
+    // The second term keeps long thin maps from getting too many cells.
+    auto extentA = (double)max[0] - min[0];
+    auto extentB = (double)max[1] - min[1];
+    auto cellCount = std::min((double)ENTITYGRID_MAX_CELLS, std::max(1.0, (double)count / ENTITYGRID_POINTS_PER_CELL));
+    auto cellSize = std::max(std::sqrt(extentA * extentB / cellCount), std::max(extentA, extentB) / cellCount);
+    if (!(cellSize > 0)) cellSize = 1; // All in the same spot
+
+    plane.origin[0] = min[0];
+    plane.origin[1] = min[1];
+    plane.cellSize = (float)cellSize;
+    plane.invCellSize = (float)(1.0 / cellSize);
+    plane.width = (int)(extentA / cellSize) + 1;
+    plane.height = (int)(extentB / cellSize) + 1;
+
+    std::vector<uint32_t> cells(count);
+    plane.cellStarts.assign((size_t)plane.width * plane.height + 1, 0);
+    for (size_t i = 0; i < count; ++i)
+    {
+        cells[i] = (uint32_t)(getCellY(plane, points[i * 2 + 1]) * plane.width + getCellX(plane, points[i * 2]));
+        ++plane.cellStarts[cells[i] + 1];
+    }
+    for (size_t i = 1; i < plane.cellStarts.size(); ++i) plane.cellStarts[i] += plane.cellStarts[i - 1];
+
+    std::vector<uint32_t> cursors(plane.cellStarts.begin(), plane.cellStarts.end() - 1);
+    plane.points.resize(count * 2);
+    plane.entities.resize(count);
+    plane.layers.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto to = cursors[cells[i]]++;
+        plane.points[to * 2] = points[i * 2];
+        plane.points[to * 2 + 1] = points[i * 2 + 1];
+        plane.entities[to] = entities[i];
+        plane.layers[to] = layers[i];
+    }
+}
+
+static const GridPlane& getPlane(int axisA, int axisB)
+{
+    auto& plane = planes[axisA + axisB - 1];
+    auto revision = entities_getRevision(document.entities);
+    if (!plane.isBuilt || plane.revision != revision)
+    {
+        build(plane, axisA, axisB);
+        plane.isBuilt = true;
+        plane.revision = revision;
+    }
+    return plane;
+}
+
+static bool isSelectable(const GridPlane& plane, uint32_t i, uint64_t layerMask)
+{
+    return (layerMask >> plane.layers[i]) & 1;
+}
+
+static void addCell(const GridPlane& plane, int x, int y, uint64_t layerMask, std::vector<uint32_t>& out)
+{
+    auto cell = y * plane.width + x;
+    if (!(plane.layerMask & ~layerMask))
+    {
+        // Nothing hidden or locked in the plane, the usual case
+        out.insert(out.end(), plane.entities.begin() + plane.cellStarts[cell], plane.entities.begin() + plane.cellStarts[cell + 1]);
+        return;
+    }
+    for (auto i = plane.cellStarts[cell]; i < plane.cellStarts[cell + 1]; ++i)
+    {
+        if (isSelectable(plane, i, layerMask)) out.push_back(plane.entities[i]);
+    }
+}
+
+void entityGrid_queryRect(int axisA, int axisB, const float min[2], const float max[2], std::vector<uint32_t>& out)
+{
+    const auto& plane = getPlane(axisA, axisB);
+    if (!plane.width) return;
+    auto layerMask = layers_getSelectableMask();
+
+    auto x0 = getCellX(plane, min[0]);
+    auto x1 = getCellX(plane, max[0]);
+    auto y0 = getCellY(plane, min[1]);
+    auto y1 = getCellY(plane, max[1]);
+    for (auto y = y0; y <= y1; ++y)
+    {
+        for (auto x = x0; x <= x1; ++x)
+        {
+            // Cells strictly between the corner ones are fully inside
+            if (x > x0 && x < x1 && y > y0 && y < y1)
+            {
+                addCell(plane, x, y, layerMask, out);
+                continue;
+            }
+
+            auto cell = y * plane.width + x;
+            for (auto i = plane.cellStarts[cell]; i < plane.cellStarts[cell + 1]; ++i)
+            {
+                auto a = plane.points[i * 2];
+                auto b = plane.points[i * 2 + 1];
+                if (a >= min[0] && a <= max[0] && b >= min[1] && b <= max[1] && isSelectable(plane, i, layerMask)) out.push_back(plane.entities[i]);
+            }
+        }
+    }
+}
+
+// Even-odd rule, against the edges that may cross the horizontal line at b
+static bool isInsidePolygon(const float* pPoints, size_t pointCount, const std::vector<uint32_t>& edges, float a, float b)
+{
+    auto isInside = false;
+    for (auto i : edges)
+    {
+        auto j = i ? i - 1 : (uint32_t)pointCount - 1;
+        auto ai = pPoints[i * 2], bi = pPoints[i * 2 + 1];
+        auto aj = pPoints[j * 2], bj = pPoints[j * 2 + 1];
+        if ((bi > b) != (bj > b) && a < (aj - ai) * (b - bi) / (bj - bi) + ai) isInside = !isInside;
+    }
+    return isInside;
+}
+
+void entityGrid_queryPolygon(int axisA, int axisB, const float* pPoints, size_t pointCount, std::vector<uint32_t>& out)
+{
+    if (pointCount < 3) return;
+    const auto& plane = getPlane(axisA, axisB);
+    if (!plane.width) return;
+    auto layerMask = layers_getSelectableMask();
+
+    float min[2] = { pPoints[0], pPoints[1] };
+    float max[2] = { pPoints[0], pPoints[1] };
+    for (size_t i = 1; i < pointCount; ++i)
+    {
+        for (int k = 0; k < 2; ++k)
+        {
+            min[k] = std::min(min[k], pPoints[i * 2 + k]);
+            max[k] = std::max(max[k], pPoints[i * 2 + k]);
+        }
+    }
+    auto x0 = getCellX(plane, min[0]);
+    auto x1 = getCellX(plane, max[0]);
+    auto y0 = getCellY(plane, min[1]);
+    auto y1 = getCellY(plane, max[1]);
+    auto rangeWidth = x1 - x0 + 1;
+
+    // Mark the cells the outline goes through, walking each edge in steps
+    // shorter than a cell. The other cells are wholly inside or outside.
+    std::vector<uint8_t> isBoundary((size_t)rangeWidth * (y1 - y0 + 1), 0);
+    for (size_t i = 0, j = pointCount - 1; i < pointCount; j = i++)
+    {
+        auto da = pPoints[i * 2] - pPoints[j * 2];
+        auto db = pPoints[i * 2 + 1] - pPoints[j * 2 + 1];
+        auto steps = (int)(std::max(std::fabs(da), std::fabs(db)) * plane.invCellSize) + 1;
+        for (int s = 0; s < steps; ++s)
+        {
+            float segment[2][2];
+            for (int e = 0; e < 2; ++e)
+            {
+                auto t = (float)(s + e) / (float)steps;
+                segment[e][0] = pPoints[j * 2] + da * t;
+                segment[e][1] = pPoints[j * 2 + 1] + db * t;
+            }
+            auto sx0 = getCellX(plane, std::min(segment[0][0], segment[1][0]));
+            auto sx1 = getCellX(plane, std::max(segment[0][0], segment[1][0]));
+            auto sy0 = getCellY(plane, std::min(segment[0][1], segment[1][1]));
+            auto sy1 = getCellY(plane, std::max(segment[0][1], segment[1][1]));
+            for (auto y = sy0; y <= sy1; ++y)
+            {
+                for (auto x = sx0; x <= sx1; ++x) isBoundary[(y - y0) * rangeWidth + (x - x0)] = 1;
+            }
+        }
+    }
+
+    std::vector<float> crossings;
+    std::vector<uint32_t> rowEdges;
+    for (auto y = y0; y <= y1; ++y)
+    {
+        // Edges spanning part of the row, the only ones its points can cross.
+        // Padded a bit for points rounded into the row.
+        auto rowMin = plane.origin[1] + ((float)y - 0.01f) * plane.cellSize;
+        auto rowMax = plane.origin[1] + ((float)y + 1.01f) * plane.cellSize;
+        rowEdges.clear();
+        for (size_t i = 0, j = pointCount - 1; i < pointCount; j = i++)
+        {
+            auto bi = pPoints[i * 2 + 1], bj = pPoints[j * 2 + 1];
+            if (std::max(bi, bj) >= rowMin && std::min(bi, bj) <= rowMax) rowEdges.push_back((uint32_t)i);
+        }
+
+        // Where the outline crosses the row's center line, for the other cells
+        auto b = plane.origin[1] + ((float)y + 0.5f) * plane.cellSize;
+        crossings.clear();
+        for (size_t i = 0, j = pointCount - 1; i < pointCount; j = i++)
+        {
+            auto ai = pPoints[i * 2], bi = pPoints[i * 2 + 1];
+            auto aj = pPoints[j * 2], bj = pPoints[j * 2 + 1];
+            if ((bi > b) != (bj > b)) crossings.push_back((aj - ai) * (b - bi) / (bj - bi) + ai);
+        }
+        std::sort(crossings.begin(), crossings.end());
+
+        size_t crossed = 0;
+        for (auto x = x0; x <= x1; ++x)
+        {
+            auto cell = y * plane.width + x;
+            if (isBoundary[(y - y0) * rangeWidth + (x - x0)])
+            {
+                for (auto i = plane.cellStarts[cell]; i < plane.cellStarts[cell + 1]; ++i)
+                {
+                    if (!isSelectable(plane, i, layerMask)) continue;
+                    if (isInsidePolygon(pPoints, pointCount, rowEdges, plane.points[i * 2], plane.points[i * 2 + 1])) out.push_back(plane.entities[i]);
+                }
+                continue;
+            }
+
+            auto a = plane.origin[0] + ((float)x + 0.5f) * plane.cellSize;
+            while (crossed < crossings.size() && crossings[crossed] <= a) ++crossed;
+            if (crossed & 1) addCell(plane, x, y, layerMask, out);
+        }
+    }
+}
+
+uint32_t entityGrid_queryNearest(int axisA, int axisB, const float point[2], float radius)
+{
+    const auto& plane = getPlane(axisA, axisB);
+    if (!plane.width) return ENTITYGRID_NONE;
+    auto layerMask = layers_getSelectableMask();
+
+    auto x0 = getCellX(plane, point[0] - radius);
+    auto x1 = getCellX(plane, point[0] + radius);
+    auto y0 = getCellY(plane, point[1] - radius);
+    auto y1 = getCellY(plane, point[1] + radius);
+    auto best = (uint32_t)ENTITYGRID_NONE;
+    auto bestDistance = radius * radius;
+    for (auto y = y0; y <= y1; ++y)
+    {
+        for (auto x = x0; x <= x1; ++x)
+        {
+            auto cell = y * plane.width + x;
+            for (auto i = plane.cellStarts[cell]; i < plane.cellStarts[cell + 1]; ++i)
+            {
+                auto da = plane.points[i * 2] - point[0];
+                auto db = plane.points[i * 2 + 1] - point[1];
+                auto distance = da * da + db * db;
+                if (distance <= bestDistance && isSelectable(plane, i, layerMask))
+                {
+                    bestDistance = distance;
+                    best = plane.entities[i];
+                }
+            }
+        }
+    }
+    return best;
+}
@@ -0,0 +1,22 @@
+#ifndef ENTITYGRID_H_INCLUDED
+#define ENTITYGRID_H_INCLUDED
+
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+#define ENTITYGRID_NONE 0xFFFFFFFF
+
+// Entity positions projected on the plane of two world axes (XY, XZ or YZ),
+// bucketed in a uniform grid for area queries from the 2D views. A plane is
+// rebuilt the first time it is queried after the entities changed.
+// Points are in world units along axisA and axisB, axisA < axisB. Results
+// are entity indices in no particular order, appended to out. Entities on
+// hidden or locked layers are left out.
+void entityGrid_queryRect(int axisA, int axisB, const float min[2], const float max[2], std::vector<uint32_t>& out);
+void entityGrid_queryPolygon(int axisA, int axisB, const float* pPoints, size_t pointCount, std::vector<uint32_t>& out);
+
+// Closest entity within radius of point, or ENTITYGRID_NONE
+uint32_t entityGrid_queryNearest(int axisA, int axisB, const float point[2], float radius);
+
+#endif
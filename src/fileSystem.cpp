@@ -0,0 +1,124 @@
+#include "fileSystem.h"
+
+#include <stdio.h>
+
+#if defined(WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool fileSystem_map(const std::string& filename, MappedFile* pMapped)
+{
+    *pMapped = MappedFile();
+#if defined(WIN32)
+    auto file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    auto mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    auto pData = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!pData)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    pMapped->pData = (const uint8_t*)pData;
+    pMapped->size = (size_t)size.QuadPart;
+    pMapped->file = file;
+    pMapped->mapping = mapping;
+    return true;
+#else
+    auto fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    auto pData = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pData == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+    madvise(pData, (size_t)st.st_size, MADV_SEQUENTIAL);
+    pMapped->pData = (const uint8_t*)pData;
+    pMapped->size = (size_t)st.st_size;
+    pMapped->file = (void*)(intptr_t)(fd + 1);
+    return true;
+#endif
+}
+
+void fileSystem_unmap(MappedFile* pMapped)
+{
+#if defined(WIN32)
+    if (pMapped->pData) UnmapViewOfFile(pMapped->pData);
+    if (pMapped->mapping) CloseHandle((HANDLE)pMapped->mapping);
+    if (pMapped->file) CloseHandle((HANDLE)pMapped->file);
+#else
+    if (pMapped->pData) munmap((void*)pMapped->pData, pMapped->size);
+    if (pMapped->file) close((int)(intptr_t)pMapped->file - 1);
+#endif
+    *pMapped = MappedFile();
+}
+
+bool fileSystem_exists(const std::string& filename)
+{
+#if defined(WIN32)
+    return GetFileAttributesA(filename.c_str()) != INVALID_FILE_ATTRIBUTES;
+#else
+    struct stat st;
+    return stat(filename.c_str(), &st) == 0;
+#endif
+}
+
+bool fileSystem_sync(const std::string& filename)
+{
+#if defined(WIN32)
+    auto file = CreateFileA(filename.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    auto ret = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return ret;
+#else
+    auto fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+    auto ret = fsync(fd) == 0;
+    close(fd);
+    return ret;
+#endif
+}
+
+bool fileSystem_replace(const std::string& from, const std::string& to)
+{
+#if defined(WIN32)
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (rename(from.c_str(), to.c_str()) != 0) return false;
+
+    // Persist the rename itself
+    auto dir = to.substr(0, to.find_last_of('/') + 1);
+    auto fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd != -1)
+    {
+        fsync(fd);
+        close(fd);
+    }
+    return true;
+#endif
+}
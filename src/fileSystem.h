@@ -0,0 +1,27 @@
+#ifndef FILESYSTEM_H_INCLUDED
+#define FILESYSTEM_H_INCLUDED
+
+#include <cinttypes>
+#include <string>
+
+struct MappedFile
+{
+    const uint8_t* pData = nullptr;
+    size_t size = 0;
+    void* file = nullptr; // HANDLE on Windows, fd + 1 elsewhere
+    void* mapping = nullptr;
+};
+
+// Read-only memory mapping of a whole file
+bool fileSystem_map(const std::string& filename, MappedFile* pMapped);
+void fileSystem_unmap(MappedFile* pMapped);
+
+bool fileSystem_exists(const std::string& filename);
+
+// Flushes a closed file's content to disk
+bool fileSystem_sync(const std::string& filename);
+
+// Atomically swaps from in place of to, and makes that durable
+bool fileSystem_replace(const std::string& from, const std::string& to);
+
+#endif
@@ -0,0 +1,192 @@
+#include "frame.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+#define FRAME_STATS_PERIOD 1.0 // Seconds
+#define FRAME_INPUT_FRAMES 2 // ImGui reacts to some input a frame late
+
+struct PendingFrames
+{
+    int count = 0;
+    double dueTime = INFINITY;
+    int continuousCount = 0;
+};
+
+static std::mutex mutex;
+static std::thread::id mainThreadId;
+static Uint32 wakeEventType = (Uint32)-1;
+static PendingFrames pending[(int)FrameReason::COUNT];
+static double lastProgressTime = -INFINITY;
+static bool hasEvent = false;
+
+// Stats
+static double frameStartTime = 0.0;
+static bool isCountedFrame = false;
+static double periodStartTime = 0.0;
+static double periodBusyTime = 0.0;
+static int periodFrameCount = 0;
+static int periodFrameCounts[(int)FrameReason::COUNT] = {};
+static FrameStats stats;
+
+double frame_getTime()
+{
+    static const double frequency = (double)SDL_GetPerformanceFrequency();
+    return (double)SDL_GetPerformanceCounter() / frequency;
+}
+
+void frame_init()
+{
+    mainThreadId = std::this_thread::get_id();
+    wakeEventType = SDL_RegisterEvents(1);
+}
+
+void frame_invalidate(FrameReason reason, int frames)
+{
+    auto now = frame_getTime();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& frame = pending[(int)reason];
+        frame.count = std::max(frame.count, frames);
+        auto dueTime = now;
+        if (reason == FrameReason::JobProgress) dueTime = std::max(now, lastProgressTime + 1.0 / FRAME_PROGRESS_RATE);
+        frame.dueTime = std::min(frame.dueTime, dueTime);
+    }
+
+    // Out of SDL_WaitEvent
+    if (std::this_thread::get_id() != mainThreadId && wakeEventType != (Uint32)-1)
+    {
+        SDL_Event event = {};
+        event.type = wakeEventType;
+        SDL_PushEvent(&event);
+    }
+}
+
+void frame_invalidateIn(FrameReason reason, float seconds)
+{
+    auto dueTime = frame_getTime() + (double)seconds;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& frame = pending[(int)reason];
+    frame.count = std::max(frame.count, 1);
+    frame.dueTime = std::min(frame.dueTime, dueTime);
+}
+
+void frame_beginContinuous(FrameReason reason)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ++pending[(int)reason].continuousCount;
+}
+
+void frame_endContinuous(FrameReason reason)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& frame = pending[(int)reason];
+    frame.continuousCount = std::max(0, frame.continuousCount - 1);
+}
+
+// Closes the stats period and says if the numbers shown changed
+static bool publishStats(double now)
+{
+    auto elapsed = now - periodStartTime;
+    FrameStats newStats;
+    newStats.fps = (float)(periodFrameCount / elapsed);
+    newStats.cpuUsage = (float)std::min(1.0, periodBusyTime / elapsed);
+    std::copy(periodFrameCounts, periodFrameCounts + (int)FrameReason::COUNT, newStats.frameCounts);
+
+    auto isChanged =
+        std::round(newStats.fps) != std::round(stats.fps) ||
+        std::round(newStats.cpuUsage * 1000.0f) != std::round(stats.cpuUsage * 1000.0f);
+    stats = newStats;
+
+    periodStartTime = now;
+    periodBusyTime = 0.0;
+    periodFrameCount = 0;
+    std::fill(periodFrameCounts, periodFrameCounts + (int)FrameReason::COUNT, 0);
+    return isChanged;
+}
+
+// While there were frames, and once more after to show we're idle
+static double getStatsDueTime()
+{
+    if (!periodFrameCount && stats.fps == 0.0f) return INFINITY;
+    return periodStartTime + FRAME_STATS_PERIOD;
+}
+
+bool frame_wait(SDL_Event* pEvent)
+{
+    auto dueTime = getStatsDueTime();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& frame : pending)
+        {
+            if (frame.continuousCount) dueTime = -INFINITY;
+            else if (frame.count) dueTime = std::min(dueTime, frame.dueTime);
+        }
+    }
+
+    auto now = frame_getTime();
+    if (dueTime <= now) return SDL_PollEvent(pEvent) != 0;
+    if (dueTime == INFINITY) return SDL_WaitEvent(pEvent) != 0;
+    return SDL_WaitEventTimeout(pEvent, (int)std::ceil((dueTime - now) * 1000.0)) != 0;
+}
+
+void frame_onEvent(const SDL_Event& event)
+{
+    // Wake ups carry no input, what woke us is already pending
+    if (event.type == wakeEventType) return;
+    hasEvent = true;
+}
+
+bool frame_begin()
+{
+    auto now = frame_getTime();
+    auto isDue = false;
+    isCountedFrame = false;
+    if (hasEvent)
+    {
+        hasEvent = false;
+        frame_invalidate(FrameReason::UI, FRAME_INPUT_FRAMES);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < (int)FrameReason::COUNT; ++i)
+        {
+            auto& frame = pending[i];
+            if (!frame.continuousCount && (!frame.count || frame.dueTime > now)) continue;
+            if (frame.count && frame.dueTime <= now)
+            {
+                // Left over frames are for right after this one
+                if (--frame.count) frame.dueTime = now;
+                else frame.dueTime = INFINITY;
+            }
+            if (i == (int)FrameReason::JobProgress) lastProgressTime = now;
+            ++periodFrameCounts[i];
+            isDue = true;
+        }
+    }
+
+    // Frames only there to show the stats don't count in them
+    if (isDue)
+    {
+        if (!periodFrameCount && stats.fps == 0.0f) periodStartTime = now;
+        ++periodFrameCount;
+        isCountedFrame = true;
+    }
+    if (now >= getStatsDueTime() && publishStats(now)) isDue = true;
+
+    frameStartTime = now;
+    return isDue;
+}
+
+void frame_end()
+{
+    if (isCountedFrame) periodBusyTime += frame_getTime() - frameStartTime;
+}
+
+const FrameStats& frame_getStats()
+{
+    return stats;
+}
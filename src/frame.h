@@ -0,0 +1,52 @@
+#ifndef FRAME_H_INCLUDED
+#define FRAME_H_INCLUDED
+
+#include <SDL.h>
+
+#define FRAME_PROGRESS_RATE 10.0f // Frames per second at most for JobProgress
+
+// Why a frame is drawn
+enum class FrameReason : int
+{
+    UI = 0, // Input, widgets, popups
+    Camera, // A view's camera moved
+    Entities, // The entity set changed
+    AssetReady, // Something finished loading
+    JobProgress, // A background job moved, capped at FRAME_PROGRESS_RATE
+    COUNT
+};
+
+struct FrameStats
+{
+    float fps = 0.0f;
+    float cpuUsage = 0.0f; // Main thread time spent outside of waits, 0 to 1
+    int frameCounts[(int)FrameReason::COUNT] = {}; // Frames each reason asked for
+};
+
+// Frames are only drawn when something asked for one. The main loop sleeps
+// in between, until an event comes or the next frame is due.
+void frame_init(); // After SDL_Init
+
+// Any thread. Wakes up the main loop if called from another one.
+// frames > 1 for what takes ImGui a few frames to settle, like popups.
+void frame_invalidate(FrameReason reason, int frames = 1);
+void frame_invalidateIn(FrameReason reason, float seconds);
+
+// Every frame in between, like while flying a camera
+void frame_beginContinuous(FrameReason reason);
+void frame_endContinuous(FrameReason reason);
+
+// Main loop. wait sleeps until there is an event (returned in pEvent) or a
+// frame is due. begin says if a frame should be drawn and end goes after
+// drawing it, before the swap.
+bool frame_wait(SDL_Event* pEvent);
+void frame_onEvent(const SDL_Event& event);
+bool frame_begin();
+void frame_end();
+
+// Over the last second with frames, or zeros once idle
+const FrameStats& frame_getStats();
+
+double frame_getTime(); // Seconds, from the performance counter
+
+#endif
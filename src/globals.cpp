@@ -3,13 +3,12 @@
 bool isLeftPanelVisible = true;
 bool isRightPanelVisible = true;
 bool isFullView = false;
+bool isMemoryPanelVisible = false;
+bool isHeadless = false;
 
 int width = 1280;
 int height = 720;
 
-int updateNextFrame = 0;
-bool updateEachFrame = false;
-
 std::vector<std::string> recentMaps;
 
 Document document;
@@ -4,7 +4,9 @@
 #define PANEL_WIDTH 240.0f
 #define MAX_RECENT_MAPS 10
 
-#define MAP_VERSION 1
+#define MAP_VERSION 4
+
+#include "entities.h"
 
 #include <json/json.h>
 #include <string>
@@ -12,7 +14,8 @@
 
 struct Document
 {
-    Json::Value json;
+    Json::Value json; // Everything but the "map", see entities
+    Entities entities;
     bool dirty;
     std::string filename;
 };
@@ -20,13 +23,12 @@ struct Document
 extern bool isLeftPanelVisible;
 extern bool isRightPanelVisible;
 extern bool isFullView;
+extern bool isMemoryPanelVisible;
+extern bool isHeadless; // No window, errors go to stderr rather than message boxes
 
 extern int width;
 extern int height;
 
-extern int updateNextFrame;
-extern bool updateEachFrame;
-
 extern std::vector<std::string> recentMaps;
 
 extern Document document;
@@ -0,0 +1,22 @@
+#ifndef HASH_H_INCLUDED
+#define HASH_H_INCLUDED
+
+#include <cinttypes>
+#include <cstddef>
+
+#define HASH_SEED 14695981039346656037ULL
+
+// FNV-1a, for cache keys. Chained by passing a previous result as h, start
+// from HASH_SEED.
+inline uint64_t hash_bytes(uint64_t h, const void* pData, size_t size)
+{
+    auto pBytes = (const uint8_t*)pData;
+    for (size_t i = 0; i < size; ++i)
+    {
+        h ^= pBytes[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+#endif
@@ -0,0 +1,478 @@
+#include "headless.h"
+#include "bake.h"
+#include "cook.h"
+#include "entities.h"
+#include "fileSystem.h"
+#include "globals.h"
+#include "jobs.h"
+#include "layers.h"
+#include "library.h"
+#include "mapFile.h"
+#include "renderList.h"
+#include "shaders.h"
+#include "terrain.h"
+#include "vectorMath.h"
+#include "view.h"
+
+#include <GL/gl3w.h>
+#include <SDL.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#if defined(WIN32)
+#include <windows.h>
+#endif
+
+#define HEADLESS_MAX_PROBLEMS 20 // Listed per map, the rest are only counted
+#define HEADLESS_THUMBNAIL_SIZE 512 // Pixels per side
+#define HEADLESS_THUMBNAIL_MARGIN 1.05f
+
+typedef std::function<bool(const std::string& filename, std::string& report)> MapCommand;
+
+static SDL_Window* pWindow = nullptr;
+static SDL_GLContext context = nullptr;
+
+static void printUsage()
+{
+    printf(
+        "Usage: MapEditor --headless <command> <maps...>\n"
+        "  validate   Checks the maps load and what they use exists\n"
+        "  stats      What the maps hold\n"
+        "  convert    JSON maps to binary and binary maps to JSON, next to them\n"
+        "  cook       Runtime packages, next to the maps\n"
+        "  bake       Sky light of the placed models, into the maps' sidecars\n"
+        "  thumbnail  Top view images of the maps, next to them\n");
+}
+
+static std::string getDirectory(const std::string& filename)
+{
+    return filename.substr(0, filename.find_last_of("/\\") + 1);
+}
+
+static std::string withoutExtension(const std::string& filename)
+{
+    auto dot = filename.find_last_of('.');
+    auto slash = filename.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return filename;
+    return filename.substr(0, dot);
+}
+
+// Every model the map places, prefabs expanded
+static void getUsedModels(const Entities& entities, std::vector<uint64_t>& out)
+{
+    out.clear();
+    for (size_t c = 0; c < entities_getChunkCount(entities); ++c)
+    {
+        const auto& chunk = entities_getChunk(entities, c);
+        for (uint32_t i = 0; i < chunk.count; ++i)
+        {
+            if (chunk.flags[i] & ENTITY_FLAG_RAW) continue;
+            auto pPrefab = library_getPrefab(chunk.modelIds[i]);
+            if (!pPrefab)
+            {
+                out.push_back(chunk.modelIds[i]);
+                continue;
+            }
+            for (const auto& part : pPrefab->parts) out.push_back(part.modelId);
+        }
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+static bool validate(const std::string& filename, std::string& report)
+{
+    Json::Value json;
+    Entities entities;
+    std::string error;
+    if (!mapFile_load(filename, json, entities, error))
+    {
+        report += filename + ": " + error + "\n";
+        return false;
+    }
+
+    int problemCount = 0;
+    auto problem = [&](const std::string& text)
+    {
+        if (problemCount++ < HEADLESS_MAX_PROBLEMS) report += filename + ": " + text + "\n";
+    };
+
+    // Library
+    auto directory = getDirectory(filename);
+    std::unordered_set<uint64_t> modelIds;
+    const auto& jsonLibrary = json["library"];
+    for (const auto& jsonModel : jsonLibrary)
+    {
+        auto id = jsonModel["id"].asUInt64();
+        if (!modelIds.insert(id).second) problem("model " + std::to_string(id) + " is in the library twice");
+        if (jsonModel.isMember("prefab")) continue;
+        auto modelFilename = jsonModel["filename"].asString();
+        if (modelFilename.empty()) problem("model " + std::to_string(id) + " has no file");
+        else if (!fileSystem_exists(directory + modelFilename)) problem("model " + std::to_string(id) + " file is missing: " + modelFilename);
+    }
+    for (const auto& jsonModel : jsonLibrary)
+    {
+        for (const auto& jsonPart : jsonModel["prefab"])
+        {
+            auto partId = jsonPart["modelId"].asUInt64();
+            if (!modelIds.count(partId))
+            {
+                problem("prefab " + std::to_string(jsonModel["id"].asUInt64()) + " uses unknown model " + std::to_string(partId));
+            }
+        }
+    }
+
+    // Entities
+    std::unordered_set<uint32_t> ids;
+    for (size_t c = 0; c < entities_getChunkCount(entities); ++c)
+    {
+        const auto& chunk = entities_getChunk(entities, c);
+        for (uint32_t i = 0; i < chunk.count; ++i)
+        {
+            if (chunk.flags[i] & ENTITY_FLAG_RAW) continue;
+            if (chunk.ids[i] != ENTITY_NO_ID && !ids.insert(chunk.ids[i]).second) problem("entity id " + std::to_string(chunk.ids[i]) + " is used twice");
+        }
+    }
+    uint32_t index = 0;
+    for (size_t c = 0; c < entities_getChunkCount(entities); ++c)
+    {
+        const auto& chunk = entities_getChunk(entities, c);
+        for (uint32_t i = 0; i < chunk.count; ++i, ++index)
+        {
+            if (chunk.flags[i] & ENTITY_FLAG_RAW) continue;
+            if (!modelIds.count(chunk.modelIds[i]))
+            {
+                problem("entity " + std::to_string(index) + " uses unknown model " + std::to_string(chunk.modelIds[i]));
+            }
+            if (chunk.parents[i] != ENTITY_NO_ID && !ids.count(chunk.parents[i]))
+            {
+                problem("entity " + std::to_string(index) + " has a missing parent " + std::to_string(chunk.parents[i]));
+            }
+        }
+    }
+
+    if (problemCount > HEADLESS_MAX_PROBLEMS) report += filename + ": ...\n";
+    report += filename + ": " + (problemCount ? std::to_string(problemCount) + " problems" : std::string("OK")) + "\n";
+    return problemCount == 0;
+}
+
+static bool stats(const std::string& filename, std::string& report)
+{
+    Json::Value json;
+    Entities entities;
+    std::string error;
+    if (!mapFile_load(filename, json, entities, error))
+    {
+        report += filename + ": " + error + "\n";
+        return false;
+    }
+
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    auto bytes = (double)file.tellg();
+
+    size_t entityCount = 0, rawCount = 0, parentedCount = 0;
+    uint64_t layerMask = 0;
+    std::unordered_set<uint64_t> usedModels;
+    for (size_t c = 0; c < entities_getChunkCount(entities); ++c)
+    {
+        const auto& chunk = entities_getChunk(entities, c);
+        entityCount += chunk.count;
+        for (uint32_t i = 0; i < chunk.count; ++i)
+        {
+            if (chunk.flags[i] & ENTITY_FLAG_RAW)
+            {
+                ++rawCount;
+                continue;
+            }
+            usedModels.insert(chunk.modelIds[i]);
+            layerMask |= (uint64_t)1 << chunk.layers[i];
+            if (chunk.parents[i] != ENTITY_NO_ID) ++parentedCount;
+        }
+    }
+    int modelCount = 0, prefabCount = 0, layerCount = 0;
+    for (const auto& jsonModel : json["library"])
+    {
+        if (jsonModel.isMember("prefab")) ++prefabCount;
+        else ++modelCount;
+    }
+    for (; layerMask; layerMask &= layerMask - 1) ++layerCount;
+
+    char line[512];
+    snprintf(line, sizeof(line), "%s: %.1f MB %s, %i entities (%i parented, %i raw) on %i layers, %i models and %i prefabs of which %i placed\n",
+             filename.c_str(), bytes / (1024.0 * 1024.0), mapFile_isBinary(filename) ? "binary" : "JSON",
+             (int)entityCount, (int)parentedCount, (int)rawCount, layerCount, modelCount, prefabCount, (int)usedModels.size());
+    report += line;
+    return true;
+}
+
+static bool convert(const std::string& filename, std::string& report)
+{
+    Json::Value json;
+    Entities entities;
+    std::string error;
+    auto target = withoutExtension(filename) + (mapFile_isBinary(filename) ? MAP_JSON_EXTENSION : MAP_BINARY_EXTENSION);
+    if (!mapFile_load(filename, json, entities, error) || !mapFile_save(target, json, entities, error))
+    {
+        report += filename + ": " + error + "\n";
+        return false;
+    }
+    report += filename + ": converted to " + target + "\n";
+    return true;
+}
+
+// The maps at once over the job threads, reports printed in order
+static int runEach(const std::vector<std::string>& filenames, const MapCommand& command)
+{
+    std::vector<std::string> reports(filenames.size());
+    std::vector<char> succeeded(filenames.size(), 0);
+    jobs_parallelFor(filenames.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (auto i = begin; i < end; ++i) succeeded[i] = command(filenames[i], reports[i]) ? 1 : 0;
+    });
+
+    auto result = 0;
+    for (size_t i = 0; i < filenames.size(); ++i)
+    {
+        fputs(reports[i].c_str(), stdout);
+        if (!succeeded[i]) result = 1;
+    }
+    return result;
+}
+
+// Streams in every model the map places, whatever the budget
+static void streamAll()
+{
+    std::vector<uint64_t> modelIds;
+    getUsedModels(document.entities, modelIds);
+    std::vector<float> distances(modelIds.size(), 0.0f);
+    library_setMemoryBudget(SIZE_MAX);
+    library_setWanted(modelIds.data(), distances.data(), modelIds.size());
+    while (library_getPendingCount() > 0)
+    {
+        library_update();
+        SDL_Delay(1);
+    }
+}
+
+static bool cook(const std::string& filename, std::string& report)
+{
+    std::string error;
+    if (!cook_run(withoutExtension(filename) + COOK_PACKAGE_EXTENSION, error))
+    {
+        report += filename + ": " + error + "\n";
+        return false;
+    }
+    return true;
+}
+
+static bool bake(const std::string& filename, std::string& report)
+{
+    streamAll();
+    bake_start();
+    while (bake_isBusy()) bake_update();
+    report += filename + ": baked\n";
+    return true;
+}
+
+// Uncompressed 32 bits, rows bottom up like glReadPixels gives them
+static bool writeTga(const std::string& filename, int size, const std::vector<uint8_t>& bgra)
+{
+    uint8_t header[18] = {};
+    header[2] = 2; // Uncompressed true color
+    header[12] = (uint8_t)size;
+    header[13] = (uint8_t)(size >> 8);
+    header[14] = (uint8_t)size;
+    header[15] = (uint8_t)(size >> 8);
+    header[16] = 32;
+    header[17] = 8; // Alpha bits
+    std::ofstream file(filename, std::ios::binary);
+    file.write((const char*)header, sizeof(header));
+    file.write((const char*)bgra.data(), (std::streamsize)bgra.size());
+    return file.good();
+}
+
+static bool thumbnail(const std::string& filename, std::string& report)
+{
+    streamAll();
+
+    // Square around everything placed
+    const auto& items = renderList_getItems();
+    if (items.empty())
+    {
+        report += filename + ": nothing to draw\n";
+        return true;
+    }
+    const double worldOrigin[3] = { 0.0, 0.0, 0.0 };
+    std::vector<float> itemBounds;
+    renderList_getEyeBounds(worldOrigin, itemBounds);
+    float bounds[6] = { FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            bounds[j] = std::min(bounds[j], itemBounds[i * 6 + j]);
+            bounds[j + 3] = std::max(bounds[j + 3], itemBounds[i * 6 + j + 3]);
+        }
+    }
+    const double center[2] = { (bounds[0] + bounds[3]) * 0.5, (bounds[1] + bounds[4]) * 0.5 };
+    auto halfSize = std::max(1.0f, std::max(bounds[3] - bounds[0], bounds[4] - bounds[1]) * 0.5f * HEADLESS_THUMBNAIL_MARGIN);
+
+    // Offscreen target
+    const int size = HEADLESS_THUMBNAIL_SIZE;
+    GLuint framebuffer, renderbuffers[2];
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size, size);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+
+    glViewport(0, 0, size, size);
+    glClearColor(0.45f, 0.55f, 0.60f, 1.00f);
+    glClearDepthf(1.0f);
+    glDepthMask(GL_TRUE);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    view_drawTop(center, halfSize, size);
+
+    std::vector<uint8_t> pixels((size_t)size * size * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, size, size, GL_BGRA, GL_UNSIGNED_BYTE, pixels.data());
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(2, renderbuffers);
+
+    auto target = withoutExtension(filename) + ".tga";
+    if (!writeTga(target, size, pixels))
+    {
+        report += filename + ": failed to write " + target + "\n";
+        return false;
+    }
+    report += filename + ": drawn to " + target + "\n";
+    return true;
+}
+
+static bool createContext()
+{
+    // A hidden window's context, or the offscreen driver's without a display
+    if (SDL_Init(SDL_INIT_TIMER) != 0 || (SDL_VideoInit(nullptr) != 0 && SDL_VideoInit("offscreen") != 0))
+    {
+        fprintf(stderr, "No GL context: %s\n", SDL_GetError());
+        return false;
+    }
+
+    // Same versions as the editor's window
+#if __APPLE__
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
+#else
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
+#endif
+    pWindow = SDL_CreateWindow("Map Editor", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 16, 16, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    context = pWindow ? SDL_GL_CreateContext(pWindow) : nullptr;
+    if (!context || gl3wInit() != 0)
+    {
+        fprintf(stderr, "No GL context: %s\n", SDL_GetError());
+        return false;
+    }
+
+    library_initShaders();
+    terrain_initShaders();
+    shaders_finish();
+    return true;
+}
+
+static void destroyContext()
+{
+    if (context) SDL_GL_DeleteContext(context);
+    if (pWindow) SDL_DestroyWindow(pWindow);
+    context = nullptr;
+    pWindow = nullptr;
+    SDL_VideoQuit();
+    SDL_Quit();
+}
+
+// One map after the other in the editor's document
+static int runInDocument(const std::vector<std::string>& filenames, bool isUsingGL, const MapCommand& command)
+{
+    auto result = 0;
+    for (const auto& filename : filenames)
+    {
+        Json::Value json;
+        Entities entities;
+        std::string error;
+        if (!mapFile_load(filename, json, entities, error))
+        {
+            printf("%s: %s\n", filename.c_str(), error.c_str());
+            result = 1;
+            continue;
+        }
+        document.json.swap(json);
+        document.entities = std::move(entities);
+        document.filename = filename;
+        document.dirty = false;
+        library_load();
+        layers_load();
+        bake_load();
+        if (isUsingGL) terrain_load();
+
+        std::string report;
+        if (!command(filename, report)) result = 1;
+        fputs(report.c_str(), stdout);
+    }
+    return result;
+}
+
+int headless_run(int argc, char** argv)
+{
+#if defined(WIN32)
+    // A GUI program has no console of its own, use the caller's
+    if (AttachConsole(ATTACH_PARENT_PROCESS))
+    {
+        freopen("CONOUT$", "w", stdout);
+        freopen("CONOUT$", "w", stderr);
+    }
+#endif
+    isHeadless = true;
+    if (argc < 2)
+    {
+        printUsage();
+        return 2;
+    }
+    std::string command = argv[0];
+    std::vector<std::string> filenames(argv + 1, argv + argc);
+
+    jobs_init();
+    auto isUsingGL = command == "bake" || command == "thumbnail";
+    auto result = 2;
+    if (isUsingGL && !createContext()) result = 1;
+    else if (command == "validate") result = runEach(filenames, validate);
+    else if (command == "stats") result = runEach(filenames, stats);
+    else if (command == "convert") result = runEach(filenames, convert);
+    else if (command == "cook") result = runInDocument(filenames, false, cook);
+    else if (command == "bake") result = runInDocument(filenames, true, bake);
+    else if (command == "thumbnail") result = runInDocument(filenames, true, thumbnail);
+    else printUsage();
+    library_shutdown();
+    if (isUsingGL) destroyContext();
+    jobs_shutdown();
+    fflush(stdout);
+    return result;
+}
@@ -0,0 +1,14 @@
+#ifndef HEADLESS_H_INCLUDED
+#define HEADLESS_H_INCLUDED
+
+// MapEditor --headless <command> <maps...>, for batch jobs without a
+// display. Commands that only read the maps run them in parallel. Those
+// that need the library, the document or GL go through the editor's
+// modules, which hold one map at a time, so maps are done one after the
+// other and each spreads its own work over the job threads. GL comes from
+// a hidden window, or SDL's offscreen driver without a display.
+// Returns the process exit code: 0 if every map went fine, 1 if one
+// failed, 2 for a bad command line.
+int headless_run(int argc, char** argv); // Arguments after --headless
+
+#endif
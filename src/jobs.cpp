@@ -0,0 +1,106 @@
+#include "jobs.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct JobRange
+{
+    const std::function<void(size_t, size_t)>* pFn;
+    size_t begin;
+    size_t end;
+    size_t* pRemaining; // Guarded by the mutex
+};
+
+static std::vector<std::thread> workers;
+static std::mutex mutex;
+static std::condition_variable wakeCondition; // Work queued or quitting
+static std::condition_variable doneCondition; // A range finished
+static std::deque<JobRange> queue;
+static bool isQuitting = false;
+
+// Pops and runs one range, the lock is held on entry and exit
+static bool runOne(std::unique_lock<std::mutex>& lock)
+{
+    if (queue.empty()) return false;
+    auto range = queue.front();
+    queue.pop_front();
+
+    lock.unlock();
+    (*range.pFn)(range.begin, range.end);
+    lock.lock();
+
+    if (--*range.pRemaining == 0) doneCondition.notify_all();
+    return true;
+}
+
+static void workerMain()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wakeCondition.wait(lock, [] { return isQuitting || !queue.empty(); });
+        if (isQuitting) return;
+        runOne(lock);
+    }
+}
+
+void jobs_init()
+{
+    if (!workers.empty()) return;
+
+    auto count = (int)std::thread::hardware_concurrency() - 1;
+    isQuitting = false;
+    for (int i = 0; i < count; ++i)
+    {
+        workers.push_back(std::thread(workerMain));
+    }
+}
+
+void jobs_shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isQuitting = true;
+    }
+    wakeCondition.notify_all();
+    for (auto& worker : workers) worker.join();
+    workers.clear();
+}
+
+int jobs_getThreadCount()
+{
+    return (int)workers.size() + 1;
+}
+
+void jobs_parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+{
+    if (!count) return;
+    grain = std::max(grain, (size_t)1);
+    auto rangeCount = (count + grain - 1) / grain;
+    if (workers.empty() || rangeCount == 1)
+    {
+        fn(0, count);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t remaining = rangeCount;
+    for (size_t i = 0; i < rangeCount; ++i)
+    {
+        queue.push_back({ &fn, i * grain, std::min(count, (i + 1) * grain), &remaining });
+    }
+    wakeCondition.notify_all();
+
+    // Help out until our ranges are done, they might be running elsewhere
+    while (remaining)
+    {
+        if (!runOne(lock))
+        {
+            doneCondition.wait(lock, [&] { return !remaining || !queue.empty(); });
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef JOBS_H_INCLUDED
+#define JOBS_H_INCLUDED
+
+#include <cstddef>
+#include <functional>
+
+// Worker threads for data parallel loops. A thread waiting on its loop runs
+// queued ranges meanwhile, so loops can be nested.
+// Without jobs_init, loops run on the calling thread.
+void jobs_init(); // One worker per core, minus the calling thread
+void jobs_shutdown();
+int jobs_getThreadCount(); // Workers plus the calling thread
+
+// Calls fn(begin, end) on ranges of about grain items covering [0, count),
+// returns once they are all done.
+void jobs_parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+#endif
@@ -0,0 +1,333 @@
+#include "journal.h"
+#include "globals.h"
+#include "fileSystem.h"
+
+#include <tinyfiledialogs.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// File layout:
+//   JournalHeader
+//   Records: JournalRecord, then size bytes of encoded edit
+// A torn record at the end (crash mid-append) fails its CRC and ends replay.
+#define JOURNAL_MAGIC 0x4A50414D // "MAPJ"
+#define JOURNAL_VERSION 3
+
+struct JournalHeader
+{
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct JournalRecord
+{
+    uint32_t size;
+    uint32_t crc; // Of sequence and the encoded edit
+    uint64_t sequence;
+};
+
+static FILE* pFile = nullptr;
+static std::string filename;
+static std::string journalFilename;
+static std::string nextFilename; // Map it moves to once saved, see journal_follow
+static uint64_t sequence = 0;
+static uint64_t fileSize = 0;
+static uint64_t generation = 0; // Changes every time the file is rewritten
+static bool isCompactionHeld = false;
+static std::vector<uint8_t> scratch;
+
+static uint32_t crc32(uint32_t crc, const uint8_t* pData, size_t size)
+{
+    static uint32_t table[256];
+    static bool tableReady = false;
+    if (!tableReady)
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            auto c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        tableReady = true;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = table[(crc ^ pData[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t recordCrc(uint64_t recordSequence, const uint8_t* pData, size_t size)
+{
+    auto crc = crc32(0, (const uint8_t*)&recordSequence, sizeof(uint64_t));
+    return crc32(crc, pData, size);
+}
+
+static uint64_t getDocumentSequence()
+{
+    return document.json["editor"]["journalSequence"].asUInt64();
+}
+
+// Replaces the journal with a header followed by records, then reopens it
+// for appending.
+static bool rewrite(const uint8_t* pRecords, size_t size)
+{
+    if (pFile)
+    {
+        fclose(pFile);
+        pFile = nullptr;
+    }
+
+    auto tmpFilename = journalFilename + ".tmp";
+    auto pTmpFile = fopen(tmpFilename.c_str(), "wb");
+    if (!pTmpFile) return false;
+    JournalHeader header = { JOURNAL_MAGIC, JOURNAL_VERSION };
+    auto ok = fwrite(&header, sizeof(header), 1, pTmpFile) == 1;
+    if (size) ok = ok && fwrite(pRecords, size, 1, pTmpFile) == 1;
+    ok = fclose(pTmpFile) == 0 && ok;
+    if (!ok || !fileSystem_sync(tmpFilename) || !fileSystem_replace(tmpFilename, journalFilename))
+    {
+        remove(tmpFilename.c_str());
+        return false;
+    }
+
+    pFile = fopen(journalFilename.c_str(), "ab");
+    fileSize = sizeof(JournalHeader) + size;
+    ++generation;
+    return pFile != nullptr;
+}
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& out, uint64_t offset)
+{
+    out.clear();
+    auto pIn = fopen(path.c_str(), "rb");
+    if (!pIn) return false;
+    if (offset && fseek(pIn, (long)offset, SEEK_SET) != 0)
+    {
+        fclose(pIn);
+        return false;
+    }
+    uint8_t buf[64 * 1024];
+    size_t read;
+    while ((read = fread(buf, 1, sizeof(buf), pIn)) > 0) out.insert(out.end(), buf, buf + read);
+    fclose(pIn);
+    return true;
+}
+
+// Valid records past afterSequence, stops on the first torn or corrupted one
+static void scanRecords(const std::vector<uint8_t>& data, uint64_t afterSequence, std::vector<size_t>& offsets)
+{
+    JournalHeader header;
+    if (data.size() < sizeof(header)) return;
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != JOURNAL_MAGIC || header.version != JOURNAL_VERSION) return;
+
+    auto expected = afterSequence + 1;
+    size_t offset = sizeof(header);
+    while (data.size() - offset >= sizeof(JournalRecord))
+    {
+        JournalRecord record;
+        memcpy(&record, data.data() + offset, sizeof(record));
+        if (data.size() - offset - sizeof(record) < record.size) break;
+        auto pPayload = data.data() + offset + sizeof(record);
+        if (recordCrc(record.sequence, pPayload, record.size) != record.crc) break;
+
+        if (record.sequence > afterSequence)
+        {
+            // A gap means these records don't apply on top of the map we have
+            if (record.sequence != expected) break;
+            offsets.push_back(offset);
+            ++expected;
+        }
+        offset += sizeof(record) + record.size;
+    }
+}
+
+void journal_open(const std::string& mapFilename)
+{
+    journal_close(false);
+    if (mapFilename.empty()) return;
+
+    filename = mapFilename;
+    journalFilename = mapFilename + ".journal";
+    sequence = getDocumentSequence();
+
+    std::vector<uint8_t> data;
+    std::vector<size_t> offsets;
+    if (readFile(journalFilename, data, 0)) scanRecords(data, sequence, offsets);
+
+    // Recovery, only costs the edits made since the last save
+    std::vector<uint8_t> kept;
+    if (!offsets.empty())
+    {
+        auto message = std::to_string(offsets.size()) + " unsaved edits were found for this map.\nRecover them?";
+        if (tinyfd_messageBox("Recover", message.c_str(), "yesno", "question", 1) == 1)
+        {
+            for (auto offset : offsets)
+            {
+                JournalRecord record;
+                memcpy(&record, data.data() + offset, sizeof(record));
+                Edit edit;
+                if (!edit_decode(data.data() + offset + sizeof(record), record.size, edit) ||
+                    !edit_apply(document.entities, edit, false))
+                {
+                    tinyfd_messageBox("Recover", "The journal doesn't match this map, recovery stopped.", "ok", "warning", 0);
+                    break;
+                }
+                auto recordSize = sizeof(record) + record.size;
+                kept.insert(kept.end(), data.data() + offset, data.data() + offset + recordSize);
+                sequence = record.sequence;
+                document.dirty = true;
+            }
+        }
+    }
+
+    if (!rewrite(kept.data(), kept.size()))
+    {
+        tinyfd_messageBox("Journal", ("Failed to create journal:\n" + journalFilename).c_str(), "ok", "warning", 0);
+    }
+}
+
+void journal_start(const std::string& mapFilename)
+{
+    journal_close(false);
+    if (mapFilename.empty()) return;
+
+    filename = mapFilename;
+    journalFilename = mapFilename + ".journal";
+    if (!rewrite(nullptr, 0))
+    {
+        tinyfd_messageBox("Journal", ("Failed to create journal:\n" + journalFilename).c_str(), "ok", "warning", 0);
+    }
+}
+
+void journal_close(bool discard)
+{
+    if (pFile)
+    {
+        fclose(pFile);
+        pFile = nullptr;
+    }
+    if (discard && !journalFilename.empty()) remove(journalFilename.c_str());
+    ++generation;
+    filename.clear();
+    journalFilename.clear();
+    nextFilename.clear();
+    fileSize = 0;
+    isCompactionHeld = false;
+}
+
+void journal_append(const Edit& edit, bool reverse)
+{
+    if (!pFile) return;
+
+    ++sequence;
+    scratch.resize(sizeof(JournalRecord));
+    edit_encode(edit, reverse, scratch);
+
+    JournalRecord record;
+    record.size = (uint32_t)(scratch.size() - sizeof(JournalRecord));
+    record.sequence = sequence;
+    record.crc = recordCrc(sequence, scratch.data() + sizeof(JournalRecord), record.size);
+    memcpy(scratch.data(), &record, sizeof(record));
+
+    // Cheap: into the OS cache, survives us crashing
+    fwrite(scratch.data(), scratch.size(), 1, pFile);
+    fflush(pFile);
+    fileSize += scratch.size();
+    isCompactionHeld = false;
+}
+
+void journal_follow(const std::string& mapFilename)
+{
+    if (mapFilename == filename)
+    {
+        nextFilename.clear();
+        return;
+    }
+
+    // Nothing to keep for recovery yet
+    if (!pFile)
+    {
+        journal_start(mapFilename);
+        return;
+    }
+    nextFilename = mapFilename;
+}
+
+bool journal_needsCompaction()
+{
+    return pFile && fileSize > JOURNAL_COMPACT_SIZE && !isCompactionHeld;
+}
+
+void journal_holdCompaction()
+{
+    isCompactionHeld = true;
+}
+
+JournalMark journal_mark()
+{
+    document.json["editor"]["journalSequence"] = (Json::UInt64)sequence;
+
+    JournalMark mark;
+    mark.sequence = sequence;
+    mark.offset = fileSize;
+    mark.generation = generation;
+    return mark;
+}
+
+// The records past the saved sequence go to the new map's journal, the old
+// one is only removed once they are there
+static void moveTo(const JournalMark& mark)
+{
+    fflush(pFile);
+    std::vector<uint8_t> data;
+    std::vector<size_t> offsets;
+    if (!readFile(journalFilename, data, 0))
+    {
+        isCompactionHeld = true;
+        tinyfd_messageBox("Journal", ("Failed to read journal:\n" + journalFilename).c_str(), "ok", "warning", 0);
+        return;
+    }
+    scanRecords(data, mark.sequence, offsets);
+    std::vector<uint8_t> kept;
+    for (auto offset : offsets)
+    {
+        JournalRecord record;
+        memcpy(&record, data.data() + offset, sizeof(record));
+        kept.insert(kept.end(), data.data() + offset, data.data() + offset + sizeof(record) + record.size);
+    }
+
+    auto oldJournalFilename = journalFilename;
+    filename = nextFilename;
+    journalFilename = filename + ".journal";
+    nextFilename.clear();
+    if (!rewrite(kept.data(), kept.size()))
+    {
+        tinyfd_messageBox("Journal", ("Failed to create journal:\n" + journalFilename + "\nThe previous one is kept:\n" + oldJournalFilename).c_str(), "ok", "warning", 0);
+        return;
+    }
+    remove(oldJournalFilename.c_str());
+}
+
+void journal_compact(const std::string& mapFilename, const JournalMark& mark)
+{
+    if (!pFile) return;
+    isCompactionHeld = false;
+    if (!nextFilename.empty() && mapFilename == nextFilename)
+    {
+        moveTo(mark);
+        return;
+    }
+    if (mapFilename != filename || !mark.offset || mark.generation != generation) return;
+
+    // Keep what was appended since the mark
+    fflush(pFile);
+    std::vector<uint8_t> tail;
+    if (!readFile(journalFilename, tail, mark.offset) || !rewrite(tail.data(), tail.size()))
+    {
+        isCompactionHeld = true;
+        tinyfd_messageBox("Journal", ("Failed to compact journal:\n" + journalFilename).c_str(), "ok", "warning", 0);
+    }
+}
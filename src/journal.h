@@ -0,0 +1,45 @@
+#ifndef JOURNAL_H_INCLUDED
+#define JOURNAL_H_INCLUDED
+
+#include "edit.h"
+
+#include <cinttypes>
+#include <string>
+
+// Past this size the journal asks for a compaction (a full background save)
+#define JOURNAL_COMPACT_SIZE (8 * 1024 * 1024)
+
+// Append-only log of the edits made since the map was last saved, kept next
+// to the map file as <map>.journal. Every record carries a sequence number,
+// saved maps remember the last sequence they contain in
+// editor.journalSequence, so replaying after a crash only needs the records
+// past it.
+struct JournalMark
+{
+    uint64_t sequence = 0;
+    uint64_t offset = 0;
+    uint64_t generation = 0; // Of the journal file the offset is in
+};
+
+void journal_open(const std::string& mapFilename); // Offers to recover edits left from a crash
+void journal_start(const std::string& mapFilename); // Starts fresh, dropping anything already there
+void journal_close(bool discard);
+void journal_append(const Edit& edit, bool reverse);
+
+// Save As: the journal stays the old map's until a save of the new one is on
+// disk, then moves to it with whatever is past that save
+void journal_follow(const std::string& mapFilename);
+
+// False after a compaction failed, until the next edit or a save succeeds,
+// so a failing save isn't retried every frame
+bool journal_needsCompaction();
+void journal_holdCompaction();
+
+// Compaction: mark when the document is snapshotted for saving, then once
+// that save is safely on disk, drop everything up to the mark. Skipped if
+// the journal was rewritten since the mark, its offset means nothing then.
+// Also where the journal moves after journal_follow.
+JournalMark journal_mark();
+void journal_compact(const std::string& mapFilename, const JournalMark& mark);
+
+#endif
@@ -0,0 +1,783 @@
+#include "jsonReader.h"
+
+#include <locale.h>
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSONREADER_SSE2
+#include <emmintrin.h>
+#endif
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// Bump allocator for unescaped strings and number slices. It's reset after
+// each entity so memory stays flat no matter how big the map is.
+struct Arena
+{
+    std::vector<char*> blocks;
+    size_t blockIndex = 0;
+    size_t blockUsed = 0;
+    std::vector<char*> bigAllocs;
+
+    ~Arena()
+    {
+        for (auto pBlock : blocks) delete[] pBlock;
+        for (auto pAlloc : bigAllocs) delete[] pAlloc;
+    }
+
+    char* alloc(size_t size)
+    {
+        if (size > ARENA_BLOCK_SIZE)
+        {
+            bigAllocs.push_back(new char[size]);
+            return bigAllocs.back();
+        }
+        if (blocks.empty() || blockUsed + size > ARENA_BLOCK_SIZE)
+        {
+            if (!blocks.empty()) ++blockIndex;
+            if (blockIndex >= blocks.size()) blocks.push_back(new char[ARENA_BLOCK_SIZE]);
+            blockUsed = 0;
+        }
+        auto pRet = blocks[blockIndex] + blockUsed;
+        blockUsed += size;
+        return pRet;
+    }
+
+    void reset()
+    {
+        blockIndex = 0;
+        blockUsed = 0;
+        for (auto pAlloc : bigAllocs) delete[] pAlloc;
+        bigAllocs.clear();
+    }
+};
+
+struct Parser
+{
+    const char* pBegin;
+    const char* p;
+    const char* pEnd;
+    Arena arena;
+    std::string error;
+    bool speculative = false; // Failures are expected, don't report them
+    std::unique_ptr<Json::CharReader> jsonReader;
+};
+
+struct StringView
+{
+    const char* pStr;
+    size_t len;
+
+    bool operator==(const char* other) const
+    {
+        return strlen(other) == len && memcmp(pStr, other, len) == 0;
+    }
+};
+
+static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool fail(Parser& parser, const char* message)
+{
+    if (parser.speculative || !parser.error.empty()) return false;
+    int line = 1;
+    int column = 1;
+    for (auto p = parser.pBegin; p < parser.p && p < parser.pEnd; ++p)
+    {
+        if (*p == '\n')
+        {
+            ++line;
+            column = 1;
+        }
+        else ++column;
+    }
+    parser.error = std::string(message) + " (line " + std::to_string(line) + ", column " + std::to_string(column) + ")";
+    return false;
+}
+
+static void skipWhitespace(Parser& parser)
+{
+    auto p = parser.p;
+    while (p < parser.pEnd && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+    parser.p = p;
+}
+
+static bool expect(Parser& parser, char c)
+{
+    skipWhitespace(parser);
+    if (parser.p >= parser.pEnd || *parser.p != c)
+    {
+        char message[] = "Expected 'x'";
+        message[10] = c;
+        return fail(parser, message);
+    }
+    ++parser.p;
+    return true;
+}
+
+#if defined(JSONREADER_SSE2)
+static inline int countTrailingZeros(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// p points right after the opening quote. Returns the closing quote, or
+// pEnd if the string is not terminated. 16 bytes at a time when we can.
+static const char* findStringEnd(const char* p, const char* pEnd, bool* pHasEscapes)
+{
+#if defined(JSONREADER_SSE2)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    while (pEnd - p >= 16)
+    {
+        auto chunk = _mm_loadu_si128((const __m128i*)p);
+        auto mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(chunk, quote),
+            _mm_cmpeq_epi8(chunk, backslash)));
+        if (!mask)
+        {
+            p += 16;
+            continue;
+        }
+        p += countTrailingZeros(mask);
+        if (*p == '"') return p;
+        *pHasEscapes = true;
+        p += 2;
+    }
+#endif
+    while (p < pEnd)
+    {
+        if (*p == '"') return p;
+        if (*p == '\\')
+        {
+            *pHasEscapes = true;
+            p += 2;
+            continue;
+        }
+        ++p;
+    }
+    return pEnd;
+}
+
+// p points on an opening '{' or '['. Returns past the matching closing one,
+// nullptr if it's never closed.
+static const char* findContainerEnd(const char* p, const char* pEnd)
+{
+    int depth = 0;
+#if defined(JSONREADER_SSE2)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i openCurly = _mm_set1_epi8('{');
+    const __m128i closeCurly = _mm_set1_epi8('}');
+    const __m128i openSquare = _mm_set1_epi8('[');
+    const __m128i closeSquare = _mm_set1_epi8(']');
+    while (pEnd - p >= 16)
+    {
+        auto chunk = _mm_loadu_si128((const __m128i*)p);
+        auto structural = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, openCurly)),
+            _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, closeCurly), _mm_cmpeq_epi8(chunk, openSquare)),
+                _mm_cmpeq_epi8(chunk, closeSquare)));
+        auto mask = (uint32_t)_mm_movemask_epi8(structural);
+        auto pChunkEnd = p + 16;
+        while (mask)
+        {
+            auto pChar = p + countTrailingZeros(mask);
+            mask &= mask - 1;
+            switch (*pChar)
+            {
+            case '"':
+            {
+                bool hasEscapes = false;
+                auto pQuote = findStringEnd(pChar + 1, pEnd, &hasEscapes);
+                if (pQuote == pEnd) return nullptr;
+                pChunkEnd = pQuote + 1;
+                mask = 0; // Restart scanning after the string
+                break;
+            }
+            case '{':
+            case '[':
+                ++depth;
+                break;
+            default:
+                if (--depth == 0) return pChar + 1;
+                break;
+            }
+        }
+        p = pChunkEnd;
+    }
+#endif
+    while (p < pEnd)
+    {
+        switch (*p)
+        {
+        case '"':
+        {
+            bool hasEscapes = false;
+            p = findStringEnd(p + 1, pEnd, &hasEscapes);
+            if (p == pEnd) return nullptr;
+            break;
+        }
+        case '{':
+        case '[':
+            ++depth;
+            break;
+        case '}':
+        case ']':
+            if (--depth == 0) return p + 1;
+            break;
+        }
+        ++p;
+    }
+    return nullptr;
+}
+
+// Skips any value without validating it. Used to find the extent of values
+// we hand to jsoncpp, which does the validation.
+static bool skipValue(Parser& parser)
+{
+    skipWhitespace(parser);
+    if (parser.p >= parser.pEnd) return fail(parser, "Unexpected end of file");
+    switch (*parser.p)
+    {
+    case '"':
+    {
+        bool hasEscapes = false;
+        auto pQuote = findStringEnd(parser.p + 1, parser.pEnd, &hasEscapes);
+        if (pQuote == parser.pEnd) return fail(parser, "Unterminated string");
+        parser.p = pQuote + 1;
+        return true;
+    }
+    case '{':
+    case '[':
+    {
+        auto pClose = findContainerEnd(parser.p, parser.pEnd);
+        if (!pClose) return fail(parser, "Unterminated object or array");
+        parser.p = pClose;
+        return true;
+    }
+    default:
+    {
+        auto p = parser.p;
+        while (p < parser.pEnd && *p != ',' && *p != '}' && *p != ']' &&
+            *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t') ++p;
+        if (p == parser.p) return fail(parser, "Expected a value");
+        parser.p = p;
+        return true;
+    }
+    }
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool parseHex4(const char* p, const char* pEnd, uint32_t* pOut)
+{
+    if (pEnd - p < 4) return false;
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        auto digit = hexValue(p[i]);
+        if (digit < 0) return false;
+        value = (value << 4) | (uint32_t)digit;
+    }
+    *pOut = value;
+    return true;
+}
+
+static char* writeUtf8(char* pOut, uint32_t codepoint)
+{
+    if (codepoint < 0x80)
+    {
+        *pOut++ = (char)codepoint;
+    }
+    else if (codepoint < 0x800)
+    {
+        *pOut++ = (char)(0xC0 | (codepoint >> 6));
+        *pOut++ = (char)(0x80 | (codepoint & 0x3F));
+    }
+    else if (codepoint < 0x10000)
+    {
+        *pOut++ = (char)(0xE0 | (codepoint >> 12));
+        *pOut++ = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        *pOut++ = (char)(0x80 | (codepoint & 0x3F));
+    }
+    else
+    {
+        *pOut++ = (char)(0xF0 | (codepoint >> 18));
+        *pOut++ = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+        *pOut++ = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        *pOut++ = (char)(0x80 | (codepoint & 0x3F));
+    }
+    return pOut;
+}
+
+// Strings without escapes point straight into the source, others are
+// unescaped into the arena.
+static bool parseString(Parser& parser, StringView* pOut)
+{
+    if (!expect(parser, '"')) return false;
+
+    bool hasEscapes = false;
+    auto pQuote = findStringEnd(parser.p, parser.pEnd, &hasEscapes);
+    if (pQuote == parser.pEnd) return fail(parser, "Unterminated string");
+
+    if (!hasEscapes)
+    {
+        pOut->pStr = parser.p;
+        pOut->len = (size_t)(pQuote - parser.p);
+        parser.p = pQuote + 1;
+        return true;
+    }
+
+    // Unescaped is never longer than the escaped one
+    auto pStr = parser.arena.alloc((size_t)(pQuote - parser.p));
+    auto pOutChar = pStr;
+    auto p = parser.p;
+    while (p < pQuote)
+    {
+        if (*p != '\\')
+        {
+            *pOutChar++ = *p++;
+            continue;
+        }
+        ++p;
+        switch (*p++)
+        {
+        case '"': *pOutChar++ = '"'; break;
+        case '\\': *pOutChar++ = '\\'; break;
+        case '/': *pOutChar++ = '/'; break;
+        case 'b': *pOutChar++ = '\b'; break;
+        case 'f': *pOutChar++ = '\f'; break;
+        case 'n': *pOutChar++ = '\n'; break;
+        case 'r': *pOutChar++ = '\r'; break;
+        case 't': *pOutChar++ = '\t'; break;
+        case 'u':
+        {
+            uint32_t codepoint;
+            if (!parseHex4(p, pQuote, &codepoint)) return fail(parser, "Bad unicode escape");
+            p += 4;
+            if (codepoint >= 0xD800 && codepoint <= 0xDBFF)
+            {
+                uint32_t low;
+                if (pQuote - p < 6 || p[0] != '\\' || p[1] != 'u' || !parseHex4(p + 2, pQuote, &low) ||
+                    low < 0xDC00 || low > 0xDFFF)
+                {
+                    return fail(parser, "Bad unicode surrogate pair");
+                }
+                p += 6;
+                codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+            }
+            pOutChar = writeUtf8(pOutChar, codepoint);
+            break;
+        }
+        default:
+            return fail(parser, "Bad escape sequence");
+        }
+    }
+
+    pOut->pStr = pStr;
+    pOut->len = (size_t)(pOutChar - pStr);
+    parser.p = pQuote + 1;
+    return true;
+}
+
+static inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Exact for the common case (Clinger's fast path), falls back on strtod for
+// long mantissas and big exponents. strtod wants the locale's decimal point,
+// so a map reads the same under a locale that uses a comma.
+static bool parseNumber(Parser& parser, double* pValue, uint64_t* pUInt, bool* pIsUInt)
+{
+    skipWhitespace(parser);
+    auto pStart = parser.p;
+    auto p = pStart;
+    auto pEnd = parser.pEnd;
+
+    bool negative = false;
+    if (p < pEnd && *p == '-')
+    {
+        negative = true;
+        ++p;
+    }
+    if (p >= pEnd || !isDigit(*p)) return fail(parser, "Expected a number");
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exp10 = 0;
+    uint64_t uintValue = 0;
+    bool uintOverflow = false;
+
+    if (*p == '0')
+    {
+        ++p;
+    }
+    else
+    {
+        while (p < pEnd && isDigit(*p))
+        {
+            auto digit = (uint64_t)(*p - '0');
+            if (uintValue > (UINT64_MAX - digit) / 10) uintOverflow = true;
+            else uintValue = uintValue * 10 + digit;
+            mantissa = mantissa * 10 + digit;
+            ++digits;
+            ++p;
+        }
+    }
+
+    bool isInteger = true;
+    if (p < pEnd && *p == '.')
+    {
+        isInteger = false;
+        ++p;
+        if (p >= pEnd || !isDigit(*p)) return fail(parser, "Bad number");
+        while (p < pEnd && isDigit(*p))
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            ++digits;
+            --exp10;
+            ++p;
+        }
+    }
+    if (p < pEnd && (*p == 'e' || *p == 'E'))
+    {
+        isInteger = false;
+        ++p;
+        bool negativeExp = false;
+        if (p < pEnd && (*p == '+' || *p == '-'))
+        {
+            negativeExp = *p == '-';
+            ++p;
+        }
+        if (p >= pEnd || !isDigit(*p)) return fail(parser, "Bad number");
+        int exponent = 0;
+        while (p < pEnd && isDigit(*p))
+        {
+            if (exponent < 10000) exponent = exponent * 10 + (*p - '0');
+            ++p;
+        }
+        exp10 += negativeExp ? -exponent : exponent;
+    }
+    parser.p = p;
+
+    *pIsUInt = isInteger && !negative && !uintOverflow;
+    *pUInt = uintValue;
+
+    if (digits <= 19 && mantissa <= (1ull << 53) && exp10 >= -22 && exp10 <= 22)
+    {
+        auto value = (double)mantissa;
+        value = exp10 < 0 ? value / POW10[-exp10] : value * POW10[exp10];
+        *pValue = negative ? -value : value;
+    }
+    else
+    {
+        auto len = (size_t)(p - pStart);
+        auto pCopy = parser.arena.alloc(len + 1);
+        memcpy(pCopy, pStart, len);
+        pCopy[len] = '\0';
+        auto decimalPoint = localeconv()->decimal_point[0];
+        if (decimalPoint != '.')
+        {
+            auto pDot = (char*)memchr(pCopy, '.', len);
+            if (pDot) *pDot = decimalPoint;
+        }
+        *pValue = strtod(pCopy, nullptr);
+    }
+    return true;
+}
+
+static bool parseJsonSlice(Parser& parser, const char* pBegin, const char* pEnd, Json::Value& json)
+{
+    std::string errors;
+    if (!parser.jsonReader->parse(pBegin, pEnd, &json, &errors))
+    {
+        parser.p = pBegin;
+        return fail(parser, errors.c_str());
+    }
+    return true;
+}
+
+static std::string writeCompactJson(const Json::Value& json)
+{
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, json);
+}
+
+// {"x":, "y":, "z":} in any order, with "w" too if count is 4
+static bool parseAxes(Parser& parser, double* pValues, int count)
+{
+    if (!expect(parser, '{')) return false;
+    int axisMask = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        StringView axis;
+        if (!parseString(parser, &axis) || axis.len != 1 || !expect(parser, ':')) return false;
+        int axisIndex = axis.pStr[0] == 'w' ? 3 : axis.pStr[0] - 'x';
+        if (axisIndex < 0 || axisIndex >= count || (axisMask & (1 << axisIndex))) return false;
+        axisMask |= 1 << axisIndex;
+        uint64_t uintValue;
+        bool isUInt;
+        if (!parseNumber(parser, pValues + axisIndex, &uintValue, &isUInt)) return false;
+        if (!expect(parser, i == count - 1 ? '}' : ',')) return false;
+    }
+    return true;
+}
+
+static bool parseId(Parser& parser, uint32_t* pId)
+{
+    double value;
+    uint64_t uintValue;
+    bool isUInt;
+    if (!parseNumber(parser, &value, &uintValue, &isUInt) || !isUInt || uintValue > UINT32_MAX) return false;
+    *pId = (uint32_t)uintValue;
+    return true;
+}
+
+// Tries to decode an entity that fits the schema. Returns false without an
+// error if it doesn't, the caller then keeps it raw.
+static bool tryParseEntity(Parser& parser, EntityRow& row)
+{
+    if (!expect(parser, '{')) return false;
+
+    bool hasModelId = false;
+    bool hasPosition = false;
+    int otherMask = 0; // Optional members already seen
+    std::string extrasText;
+    row = EntityRow();
+
+    skipWhitespace(parser);
+    if (parser.p < parser.pEnd && *parser.p == '}')
+    {
+        ++parser.p;
+        return false;
+    }
+
+    while (true)
+    {
+        skipWhitespace(parser);
+        auto pKeyStart = parser.p;
+        StringView key;
+        if (!parseString(parser, &key)) return false;
+        auto pKeyEnd = parser.p;
+        if (!expect(parser, ':')) return false;
+
+        if (key == "modelId")
+        {
+            double value;
+            bool isUInt;
+            if (hasModelId || !parseNumber(parser, &value, &row.modelId, &isUInt) || !isUInt) return false;
+            hasModelId = true;
+        }
+        else if (key == "position")
+        {
+            if (hasPosition || !parseAxes(parser, row.position, 3)) return false;
+            hasPosition = true;
+        }
+        else if (key == "rotation")
+        {
+            double rotation[4];
+            if ((otherMask & 1) || !parseAxes(parser, rotation, 4)) return false;
+            for (int k = 0; k < 4; ++k) row.rotation[k] = (float)rotation[k];
+            otherMask |= 1;
+        }
+        else if (key == "scale")
+        {
+            double scale[3];
+            if ((otherMask & 2) || !parseAxes(parser, scale, 3)) return false;
+            for (int k = 0; k < 3; ++k) row.scale[k] = (float)scale[k];
+            otherMask |= 2;
+        }
+        else if (key == "id")
+        {
+            if ((otherMask & 4) || !parseId(parser, &row.id)) return false;
+            otherMask |= 4;
+        }
+        else if (key == "parent")
+        {
+            if ((otherMask & 8) || !parseId(parser, &row.parent)) return false;
+            otherMask |= 8;
+        }
+        else if (key == "layer")
+        {
+            uint32_t layer;
+            if ((otherMask & 16) || !parseId(parser, &layer) || layer >= ENTITY_MAX_LAYERS) return false;
+            row.layer = (uint8_t)layer;
+            otherMask |= 16;
+        }
+        else
+        {
+            auto pValueStart = parser.p;
+            if (!skipValue(parser)) return false;
+            extrasText += extrasText.empty() ? "{" : ",";
+            extrasText.append(pKeyStart, pKeyEnd);
+            extrasText += ':';
+            extrasText.append(pValueStart, parser.p);
+        }
+
+        skipWhitespace(parser);
+        if (parser.p >= parser.pEnd) return false;
+        if (*parser.p == ',')
+        {
+            ++parser.p;
+            continue;
+        }
+        if (*parser.p == '}')
+        {
+            ++parser.p;
+            break;
+        }
+        return false;
+    }
+
+    if (!hasModelId || !hasPosition) return false;
+
+    // Rare, let jsoncpp validate and compact it
+    if (!extrasText.empty())
+    {
+        extrasText += '}';
+        Json::Value jsonExtras;
+        if (!parseJsonSlice(parser, extrasText.data(), extrasText.data() + extrasText.size(), jsonExtras)) return false;
+        row.extras = writeCompactJson(jsonExtras);
+    }
+    return true;
+}
+
+static bool parseEntities(Parser& parser, Entities& entities)
+{
+    if (!expect(parser, '[')) return false;
+
+    skipWhitespace(parser);
+    if (parser.p < parser.pEnd && *parser.p == ']')
+    {
+        ++parser.p;
+        return true;
+    }
+
+    // Rough guess from what is left, entities are rarely under 64 bytes
+    entities_reserve(entities, entities_count(entities) + (size_t)(parser.pEnd - parser.p) / 64);
+
+    EntityRow row;
+    while (true)
+    {
+        skipWhitespace(parser);
+        auto pEntityStart = parser.p;
+
+        parser.speculative = true;
+        auto fitsSchema = tryParseEntity(parser, row);
+        parser.speculative = false;
+        if (!fitsSchema)
+        {
+            // Keep it as-is
+            parser.p = pEntityStart;
+            if (!skipValue(parser)) return false;
+            Json::Value jsonEntity;
+            if (!parseJsonSlice(parser, pEntityStart, parser.p, jsonEntity)) return false;
+            row = EntityRow();
+            row.flags = ENTITY_FLAG_RAW;
+            row.extras = writeCompactJson(jsonEntity);
+        }
+        entities_append(entities, row);
+        parser.arena.reset();
+
+        skipWhitespace(parser);
+        if (parser.p >= parser.pEnd) return fail(parser, "Unexpected end of file");
+        if (*parser.p == ',')
+        {
+            ++parser.p;
+            continue;
+        }
+        if (*parser.p == ']')
+        {
+            ++parser.p;
+            return true;
+        }
+        return fail(parser, "Expected ',' or ']'");
+    }
+}
+
+bool jsonReader_loadMap(const char* pData, size_t size, Json::Value& json, Entities& entities, std::string& error)
+{
+    Parser parser;
+    parser.pBegin = pData;
+    parser.p = pData;
+    parser.pEnd = pData + size;
+    Json::CharReaderBuilder builder;
+    parser.jsonReader.reset(builder.newCharReader());
+
+    json = Json::Value(Json::ValueType::objectValue);
+    entities_clear(entities);
+
+    // UTF-8 BOM
+    if (size >= 3 && memcmp(pData, "\xEF\xBB\xBF", 3) == 0) parser.p += 3;
+
+    bool ret = expect(parser, '{');
+    skipWhitespace(parser);
+    if (ret && parser.p < parser.pEnd && *parser.p == '}')
+    {
+        ++parser.p;
+    }
+    else while (ret)
+    {
+        StringView key;
+        if (!parseString(parser, &key) || !expect(parser, ':'))
+        {
+            ret = false;
+            break;
+        }
+
+        if (key == "map")
+        {
+            ret = parseEntities(parser, entities);
+        }
+        else
+        {
+            std::string name(key.pStr, key.len);
+            skipWhitespace(parser);
+            auto pValueStart = parser.p;
+            ret = skipValue(parser) && parseJsonSlice(parser, pValueStart, parser.p, json[name]);
+        }
+        if (!ret) break;
+
+        skipWhitespace(parser);
+        if (parser.p < parser.pEnd && *parser.p == ',')
+        {
+            ++parser.p;
+            continue;
+        }
+        ret = expect(parser, '}');
+        break;
+    }
+
+    if (ret)
+    {
+        skipWhitespace(parser);
+        if (parser.p != parser.pEnd) ret = fail(parser, "Unexpected data after the document");
+    }
+
+    if (!ret)
+    {
+        error = parser.error.empty() ? "Malformed JSON" : parser.error;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,15 @@
+#ifndef JSONREADER_H_INCLUDED
+#define JSONREADER_H_INCLUDED
+
+#include "entities.h"
+
+#include <json/json.h>
+
+#include <string>
+
+// Streaming reader for JSON maps. The "map" array is decoded straight into
+// entities without building a DOM, every other top level member is small and
+// handed to jsoncpp.
+bool jsonReader_loadMap(const char* pData, size_t size, Json::Value& json, Entities& entities, std::string& error);
+
+#endif
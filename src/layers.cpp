@@ -1,5 +1,118 @@
+#include "layers.h"
+#include "edit.h"
+#include "frame.h"
 #include "globals.h"
+#include "selection.h"
+#include "undo.h"
+
 #include <imgui.h>
+#include <string>
+#include <vector>
+
+#define LAYERS_NAME_SIZE 64
+
+static uint64_t visibleMask = ~(uint64_t)0;
+static uint64_t lockedMask = 0;
+static int activeLayer = 0;
+static uint32_t renameMergeKey = 0; // Typing a name is a single undo step
+
+static void updateMasks()
+{
+    const auto& jsonLayers = document.json["layers"];
+    visibleMask = ~(uint64_t)0;
+    lockedMask = 0;
+    for (int i = 0; i < (int)jsonLayers.size() && i < ENTITY_MAX_LAYERS; ++i)
+    {
+        if (!jsonLayers[i].get("visible", true).asBool()) visibleMask &= ~((uint64_t)1 << i);
+        if (jsonLayers[i].get("locked", false).asBool()) lockedMask |= (uint64_t)1 << i;
+    }
+}
+
+void layers_load()
+{
+    // There is always a first layer to put things on
+    auto& jsonLayers = document.json["layers"];
+    if (!jsonLayers.isArray() || jsonLayers.empty())
+    {
+        Json::Value jsonLayer;
+        jsonLayer["name"] = "Default";
+        jsonLayers = Json::Value(Json::arrayValue);
+        jsonLayers.append(jsonLayer);
+    }
+    activeLayer = 0;
+    updateMasks();
+}
+
+uint64_t layers_getVisibleMask()
+{
+    return visibleMask;
+}
+
+uint64_t layers_getSelectableMask()
+{
+    return visibleMask & ~lockedMask;
+}
+
+static void getLayers(const std::vector<uint32_t>& indices, std::vector<uint8_t>& out)
+{
+    out.clear();
+    entities_getValues(document.entities, EntityField::Layer, indices.data(), indices.size(), out);
+}
+
+// Hidden and locked entities can't stay selected
+static void deselectUnselectable()
+{
+    std::vector<uint32_t> indices;
+    selection_getIndices(indices);
+    std::vector<uint8_t> layers;
+    getLayers(indices, layers);
+    auto selectableMask = layers_getSelectableMask();
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        if (!((selectableMask >> layers[i]) & 1)) selection_set(indices[i], false);
+    }
+}
+
+void layers_onEdit()
+{
+    updateMasks();
+    deselectUnselectable();
+}
+
+static void setState(int layer, const char* key, bool value)
+{
+    auto layers = document.json["layers"];
+    layers[layer][key] = value;
+    edit_commit(edit_layers(layers));
+}
+
+static void moveSelection(int layer)
+{
+    std::vector<uint32_t> indices;
+    selection_getIndices(indices);
+    if (indices.empty()) return;
+    std::vector<uint8_t> values(indices.size(), (uint8_t)layer);
+    edit_commit(edit_set(EntityField::Layer, indices, values));
+    deselectUnselectable();
+}
+
+static void selectLayer(int layer)
+{
+    if (!((layers_getSelectableMask() >> layer) & 1)) return;
+    selection_clear();
+    const auto& entities = document.entities;
+    auto chunkCount = entities_getChunkCount(entities);
+    uint32_t index = 0;
+    for (size_t c = 0; c < chunkCount; ++c)
+    {
+        const auto& chunk = entities_getChunk(entities, c);
+        for (uint32_t i = 0; i < chunk.count; ++i, ++index)
+        {
+            if (chunk.layers[i] == layer) selection_set(index, true);
+        }
+    }
+    frame_invalidate(FrameReason::UI);
+}
 
 void layers_updateGUI()
 {
@@ -14,5 +127,54 @@ void layers_updateGUI()
         ImGuiWindowFlags_NoMove |
         ImGuiWindowFlags_NoResize |
         ImGuiWindowFlags_NoCollapse);
+
+    auto& jsonLayers = document.json["layers"];
+    auto layerCount = (int)jsonLayers.size();
+    if (activeLayer >= layerCount) activeLayer = 0;
+    for (int i = 0; i < layerCount; ++i)
+    {
+        // A copy, setState replaces the array
+        auto jsonLayer = jsonLayers[i];
+        ImGui::PushID(i);
+        auto isVisible = jsonLayer.get("visible", true).asBool();
+        if (ImGui::Checkbox("##visible", &isVisible)) setState(i, "visible", isVisible);
+        if (ImGui::IsItemHovered()) ImGui::SetTooltip("Visible");
+        ImGui::SameLine();
+        auto isLocked = jsonLayer.get("locked", false).asBool();
+        if (ImGui::Checkbox("##locked", &isLocked)) setState(i, "locked", isLocked);
+        if (ImGui::IsItemHovered()) ImGui::SetTooltip("Locked");
+        ImGui::SameLine();
+        auto name = jsonLayer["name"].asString();
+        if (ImGui::Selectable(name.empty() ? "(unnamed)" : name.c_str(), i == activeLayer)) activeLayer = i;
+        ImGui::PopID();
+    }
+
+    ImGui::Separator();
+    if (layerCount > 0)
+    {
+        char name[LAYERS_NAME_SIZE];
+        snprintf(name, sizeof(name), "%s", jsonLayers[activeLayer]["name"].asString().c_str());
+        if (ImGui::InputText("Name", name, sizeof(name)))
+        {
+            if (!renameMergeKey) renameMergeKey = undo_newMergeKey();
+            auto layers = jsonLayers;
+            layers[activeLayer]["name"] = name;
+            edit_commit(edit_layers(layers), renameMergeKey);
+        }
+        if (!ImGui::IsItemActive()) renameMergeKey = 0;
+        if (ImGui::Button("Move Selection Here")) moveSelection(activeLayer);
+        ImGui::SameLine();
+        if (ImGui::Button("Select All")) selectLayer(activeLayer);
+    }
+    if (layerCount < ENTITY_MAX_LAYERS && ImGui::Button("New Layer"))
+    {
+        Json::Value jsonLayer;
+        jsonLayer["name"] = "Layer " + std::to_string(layerCount);
+        auto layers = jsonLayers;
+        layers.append(jsonLayer);
+        edit_commit(edit_layers(layers));
+        activeLayer = layerCount;
+    }
+
     ImGui::End();
 }
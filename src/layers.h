@@ -1 +1,18 @@
+#ifndef LAYERS_H_INCLUDED
+#define LAYERS_H_INCLUDED
+
+#include <cinttypes>
+
+// Entities are on one layer each, EntityField::Layer. Names and states are
+// in the document's "layers" array; layers past its end are visible and
+// unlocked. The array only changes through edits, so it's journaled and
+// undone like the entities. The states are kept as masks, a bit per layer,
+// so the passes over the entities test a whole layer with one AND.
+void layers_load(); // After the document changed
+void layers_onEdit(); // After an edit changed them, see edit_layers
+uint64_t layers_getVisibleMask();
+uint64_t layers_getSelectableMask(); // Visible and not locked
+
 void layers_updateGUI();
+
+#endif
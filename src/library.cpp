@@ -1,6 +1,10 @@
 #include "library.h"
+#include "bvh.h"
+#include "frame.h"
 #include "globals.h"
 #include "rendering.h"
+#include "sectors.h"
+#include "shaders.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -13,15 +17,19 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 
-struct MeshVertex
-{
-    float position[3];
-    float normal[3];
-    float color[4];
-    float uv[2];
-};
+#define LIBRARY_PREFAB_MAX_DEPTH 8 // Prefabs in prefabs in...
+#define LIBRARY_LOADER_THREADS 2
+#define LIBRARY_MAX_IN_FLIGHT 4 // Models queued or being parsed
+#define LIBRARY_UPLOADS_PER_FRAME 2 // Parsed models made into GL objects per frame
+#define LIBRARY_DEFAULT_MEMORY_BUDGET ((size_t)1024 * 1024 * 1024)
+#define LIBRARY_DEFAULT_CACHE_BUDGET ((size_t)256 * 1024 * 1024)
 
 struct Thumbnail
 {
@@ -29,40 +37,134 @@ struct Thumbnail
     GLuint thumbnail;
 };
 
+struct LoadRequest
+{
+    uint64_t id;
+    uint64_t generation;
+    std::string path;
+    std::string filename; // For errors
+    float scale;
+};
+
+// Shared by the models using it, deleted with the last one
+struct Texture
+{
+    GLuint texture;
+    int refCount;
+    size_t bytes;
+};
+
+enum class ModelState : int
+{
+    Unloaded = 0,
+    Loading,
+    Resident,
+    Failed
+};
+
+// What streaming knows of a model from the library, loaded or not
+struct ModelSource
+{
+    std::string filename;
+    float scale;
+    ModelState state = ModelState::Unloaded;
+    bool isWanted = false;
+    bool hasBounds = false; // Kept once loaded, even after it's unloaded
+    float distance = 0.0f; // To the nearest camera, while wanted
+    uint64_t lastWanted = 0; // Last library_setWanted that wanted it
+    size_t gpuBytes = 0; // Vertex and index buffers, textures are counted on their own
+    size_t cpuBytes = 0; // Raycast triangles and the vertices kept for baking
+    std::vector<std::string> texturePaths; // References held while resident
+};
+
+// A parsed model kept after its upload, so it comes back from an eviction
+// without its file being parsed again. The BVH goes to the model while it
+// is resident and back here when it's unloaded.
+struct CachedModel
+{
+    LoadedModel loaded;
+    uint64_t lastUsed;
+    size_t bytes; // Meshes and images, the BVH is counted with the model
+};
+
 MeshShader meshShader;
 
 static bool initialized = false;
 static uint64_t nextId = 1;
-static std::unordered_map<std::string, GLuint> textures;
+static std::unordered_map<std::string, Texture> textures;
 static std::unordered_map<uint64_t, Model> models;
+static std::unordered_map<uint64_t, ModelSource> sources;
+static std::unordered_map<uint64_t, Prefab> prefabs;
 static std::vector<Thumbnail> thumbnails;
 static aiPropertyStore* propertyStore;
+static uint64_t revision = 0;
+static uint64_t residency = 0;
+static uint64_t generation = 0; // library_load count, loads from an older one are dropped
+static uint64_t wantedCount = 0;
+static size_t memoryBudget = LIBRARY_DEFAULT_MEMORY_BUDGET;
+static size_t memoryUsage = 0;
+static int inFlightCount = 0;
+static std::unordered_map<uint64_t, CachedModel> cache; // By model id
+static size_t cacheBudget = LIBRARY_DEFAULT_CACHE_BUDGET;
+static size_t cacheUsage = 0;
+static uint64_t cacheClock = 0;
+
+// Loader threads, guarded by the mutex
+static std::vector<std::thread> loaders;
+static std::mutex loaderMutex;
+static std::condition_variable loaderCondition;
+static std::deque<LoadRequest> requests;
+static std::vector<LoadedModel> results;
+static bool isQuitting = false;
 
 Model library_getModel(uint64_t id)
 {
     return models[id];
 }
 
-static void initialize()
+const Prefab* library_getPrefab(uint64_t id)
 {
-    propertyStore = aiCreatePropertyStore();
+    auto it = prefabs.find(id);
+    return it != prefabs.end() ? &it->second : nullptr;
+}
+
+uint64_t library_getRevision()
+{
+    return revision;
+}
+
+uint64_t library_getResidency()
+{
+    return residency;
+}
+
+uint64_t library_getLoadCount()
+{
+    return generation;
+}
 
-    meshShader.program = createShaderProgram(
-        "uniform mat4 WorldMtx;\n"
+void library_initShaders()
+{
+    static const char* MESH_ATTRIBUTES[] = { "Position", "Normal", "Color", "TexCoord", "Light", "WorldMtx" };
+    meshShader.program = shaders_create(
         "uniform mat4 ProjMtx;\n"
+        "in mat4 WorldMtx;\n"
         "in vec3 Position;\n"
         "in vec3 Normal;\n"
         "in vec4 Color;\n"
         "in vec2 TexCoord;\n"
+        "in float Light;\n" // Baked, negative if not
         "out vec3 Frag_Normal;\n"
         "out vec4 Frag_Color;\n"
         "out vec2 Frag_TexCoord;\n"
+        "out float Frag_Light;\n"
         "void main()\n"
         "{\n"
         "    mat3 normalMatrix = mat3(WorldMtx);\n"
         "    Frag_Normal = normalize(normalMatrix * Normal);\n"
         "    Frag_Color = Color;\n"
         "    Frag_TexCoord = TexCoord;\n"
+        "    Frag_Light = Light;\n"
         "    vec4 worldPos = WorldMtx * vec4(Position.xyz,1);\n"
         "    gl_Position = ProjMtx * worldPos;\n"
         "}\n"
@@ -71,60 +173,46 @@ static void initialize()
         "in vec3 Frag_Normal;\n"
         "in vec4 Frag_Color;\n"
         "in vec2 Frag_TexCoord;\n"
+        "in float Frag_Light;\n"
         "out vec4 Out_Color;\n"
         "void main()\n"
         "{\n"
-        "    float dirAO = abs(Frag_Normal.x);\n"
-        "    Out_Color = texture(Texture, Frag_TexCoord.st) * Frag_Color * mix(0.7, 1.0, Frag_Normal.z * 0.5 + 0.5) * mix(0.8, 1.0, abs(Frag_Normal.x));\n"
-        "}\n");
+        "    float light = Frag_Light >= 0.0 ? mix(0.35, 1.05, Frag_Light) : mix(0.7, 1.0, Frag_Normal.z * 0.5 + 0.5) * mix(0.8, 1.0, abs(Frag_Normal.x));\n"
+        "    Out_Color = texture(Texture, Frag_TexCoord.st) * Frag_Color * light;\n"
+        "}\n",
+        MESH_ATTRIBUTES, 6);
+}
+
+static void initialize()
+{
+    propertyStore = aiCreatePropertyStore();
+    initialized = true;
+
+    // Headless without a GL context, models are only listed
+    if (!meshShader.program) return;
+
     glUseProgram(meshShader.program);
     meshShader.uniform_texture = glGetUniformLocation(meshShader.program, "Texture");
-    meshShader.uniform_worldMtx = glGetUniformLocation(meshShader.program, "WorldMtx");
     meshShader.uniform_projMtx = glGetUniformLocation(meshShader.program, "ProjMtx");
     meshShader.attrib_position = glGetAttribLocation(meshShader.program, "Position");
     meshShader.attrib_normal = glGetAttribLocation(meshShader.program, "Normal");
     meshShader.attrib_color = glGetAttribLocation(meshShader.program, "Color");
     meshShader.attrib_texCoord = glGetAttribLocation(meshShader.program, "TexCoord");
-
-    initialized = true;
+    meshShader.attrib_light = glGetAttribLocation(meshShader.program, "Light");
+    meshShader.attrib_worldMtx = glGetAttribLocation(meshShader.program, "WorldMtx");
 }
 
-static GLuint loadTexture(const std::string& path)
-{
-    auto it = textures.find(path);
-    if (it != textures.end()) return it->second;
-
-    int w, h, bpp;
-    auto imageData = stbi_load(path.c_str(), &w, &h, &bpp, 4);
-    if (!imageData)
-    {
-        // Don't die, he will see while texture
-        // TODO: use checker board
-        return 0;
-    }
-
-    GLuint texture;
-    glGenTextures(1, &texture);
-    textures[path] = texture;
-
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageData);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-    stbi_image_free(imageData);
-
-    return texture;
-}
-
-static Model loadModel(const std::string& filename, float scale)
+// Loader thread side, the file and everything derived from it on the CPU.
+// Shallow, images are only listed and there is no BVH.
+static LoadedModel parseModel(const LoadRequest& request, bool isShallow)
 {
-    auto path = document.filename.substr(0, document.filename.find_last_of("/\\") + 1) + filename;
+    LoadedModel loaded;
+    loaded.id = request.id;
+    loaded.generation = request.generation;
 
     //aiSetImportPropertyFloat(propertyStore, AI_CONFIG_GLOBAL_SCALE_FACTOR_KEY, scale);
-    const aiScene* pScene = aiImportFile(path.c_str(),
+    const aiScene* pScene = aiImportFile(request.path.c_str(),
         aiProcess_CalcTangentSpace |
         aiProcess_Triangulate |
         aiProcess_GenNormals |
@@ -136,53 +224,68 @@ static Model loadModel(const std::string& filename, float scale)
 
     if (!pScene)
     {
-        tinyfd_messageBox("Loading Model", ("Failed to open model:\n" + filename + "\n" + aiGetErrorString()).c_str(), "ok", "error", 0);
-        return { 0 };
+        loaded.error = "Failed to open model:\n" + request.filename + "\n" + aiGetErrorString();
+        return loaded;
     }
 
-    Model model;
+    auto scale = request.scale;
+    std::vector<float> triangles;
 
-    // Materials
-    model.materialCount = (int)pScene->mNumMaterials;
-    model.materials = new Material[model.materialCount];
-    for (int i = 0; i < model.materialCount; ++i)
+    // Materials, each texture decoded once per model
+    std::unordered_map<std::string, int> imageIndices;
+    for (int i = 0; i < (int)pScene->mNumMaterials; ++i)
     {
-        auto pMaterial = model.materials + i;
         auto pAssMat = pScene->mMaterials[i];
 
         aiString texturePath;
         auto ret = pAssMat->GetTexture(aiTextureType::aiTextureType_DIFFUSE, 0, &texturePath);
-        if (ret == aiReturn_SUCCESS)
+        if (ret != aiReturn_SUCCESS)
         {
-            std::string texName = texturePath.C_Str();
-            texName = texName.substr(texName.find_last_of("\\/") + 1);
-            std::string strPath = path.substr(0, path.find_last_of("/\\") + 1) + texName;
-            pMaterial->diffuse = loadTexture(strPath);
+            //TODO: Use white texture
+            loaded.materialImages.push_back(-1);
+            continue;
         }
-        else
+
+        std::string texName = texturePath.C_Str();
+        texName = texName.substr(texName.find_last_of("\\/") + 1);
+        std::string strPath = request.path.substr(0, request.path.find_last_of("/\\") + 1) + texName;
+        auto it = imageIndices.find(strPath);
+        if (it == imageIndices.end())
         {
-            //TODO: Use white texture
+            it = imageIndices.insert({ strPath, (int)loaded.images.size() }).first;
+            LoadedImage image;
+            image.path = strPath;
+            int bpp;
+            auto imageData = isShallow ? nullptr : stbi_load(strPath.c_str(), &image.w, &image.h, &bpp, 4);
+            if (imageData)
+            {
+                image.pixels.assign(imageData, imageData + (size_t)image.w * image.h * 4);
+                stbi_image_free(imageData);
+            }
+            loaded.images.push_back(std::move(image));
         }
+        loaded.materialImages.push_back(it->second);
     }
 
     // Meshes
-    model.meshCount = (int)pScene->mNumMeshes;
-    model.meshes = new Mesh[model.meshCount];
-    for (int i = 0; i < model.meshCount; ++i)
+    loaded.meshes.resize(pScene->mNumMeshes);
+    for (int i = 0; i < (int)pScene->mNumMeshes; ++i)
     {
-        auto pMesh = model.meshes + i;
+        auto pMesh = &loaded.meshes[i];
         auto pAssMesh = pScene->mMeshes[i];
 
-        pMesh->pMaterial = model.materials + pAssMesh->mMaterialIndex;
+        pMesh->materialIndex = (int)pAssMesh->mMaterialIndex;
 
         if (pAssMesh->mNumVertices == 0)
         {
-            tinyfd_messageBox("Loading Model", ("A mesh has no vertices:\n" + filename).c_str(), "ok", "error", 0);
-            return { 0 };
+            aiReleaseImport(pScene);
+            loaded.error = "A mesh has no vertices:\n" + request.filename;
+            return loaded;
         }
 
         // Load from the file
-        MeshVertex* vertices = new MeshVertex[pAssMesh->mNumVertices];
+        pMesh->vertices.resize(pAssMesh->mNumVertices);
+        auto vertices = pMesh->vertices.data();
         for (int i = 0; i < (int)pAssMesh->mNumVertices; ++i)
         {
             auto pVertex = vertices + i;
@@ -224,13 +327,150 @@ static Model loadModel(const std::string& filename, float scale)
             }
         }
 
+        // Keep the triangles on the CPU for raycasts
+        for (int i = 0; i < (int)pAssMesh->mNumFaces && !isShallow; ++i)
+        {
+            const auto& face = pAssMesh->mFaces[i];
+            if (face.mNumIndices != 3) continue;
+            for (int j = 0; j < 3; ++j)
+            {
+                auto pPosition = vertices[face.mIndices[j]].position;
+                triangles.insert(triangles.end(), pPosition, pPosition + 3);
+            }
+        }
+
+        // Load faces
+        pMesh->indices.resize((size_t)pAssMesh->mNumFaces * 3);
+        for (int i = 0; i < (int)pAssMesh->mNumFaces; ++i)
+        {
+            pMesh->indices[i * 3 + 0] = (uint32_t)pAssMesh->mFaces[i].mIndices[0];
+            pMesh->indices[i * 3 + 1] = (uint32_t)pAssMesh->mFaces[i].mIndices[1];
+            pMesh->indices[i * 3 + 2] = (uint32_t)pAssMesh->mFaces[i].mIndices[2];
+        }
+    }
+
+    aiReleaseImport(pScene);
+    if (isShallow) return loaded;
+
+    loaded.pBvh = new MeshBvh();
+    bvh_buildMesh(*loaded.pBvh, triangles.data(), triangles.size() / 9);
+    return loaded;
+}
+
+static void runLoader()
+{
+    std::unique_lock<std::mutex> lock(loaderMutex);
+    while (true)
+    {
+        loaderCondition.wait(lock, [] { return isQuitting || !requests.empty(); });
+        if (isQuitting) return;
+        auto request = std::move(requests.front());
+        requests.pop_front();
+
+        lock.unlock();
+        auto loaded = parseModel(request, false);
+        lock.lock();
+
+        results.push_back(std::move(loaded));
+        frame_invalidate(FrameReason::AssetReady);
+    }
+}
+
+static GLuint acquireTexture(const LoadedImage& image)
+{
+    auto it = textures.find(image.path);
+    if (it != textures.end())
+    {
+        ++it->second.refCount;
+        return it->second.texture;
+    }
+
+    // Don't die, he will see while texture
+    // TODO: use checker board
+    Texture texture = { 0, 1, 0 };
+    if (!image.pixels.empty())
+    {
+        glGenTextures(1, &texture.texture);
+        glBindTexture(GL_TEXTURE_2D, texture.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.w, image.h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        texture.bytes = image.pixels.size();
+    }
+    textures[image.path] = texture;
+    memoryUsage += texture.bytes;
+    return texture.texture;
+}
+
+static void releaseTexture(const std::string& path)
+{
+    auto it = textures.find(path);
+    if (it == textures.end() || --it->second.refCount > 0) return;
+    if (it->second.texture) glDeleteTextures(1, &it->second.texture);
+    memoryUsage -= it->second.bytes;
+    textures.erase(it);
+}
+
+static size_t getBvhBytes(const MeshBvh& bvh)
+{
+    return bvh.bvh.nodes.size() * sizeof(BvhNode) + bvh.triangles.size() * sizeof(float);
+}
+
+// Main thread side, GL objects from what a loader thread parsed
+// Returns true if the model's bounds changed
+static bool uploadModel(LoadedModel& loaded, ModelSource& source)
+{
+    auto& model = models[loaded.id];
+    float oldBounds[6];
+    memcpy(oldBounds, model.min, sizeof(model.min));
+    memcpy(oldBounds + 3, model.max, sizeof(model.max));
+    model.pBvh = loaded.pBvh;
+    loaded.pBvh = nullptr;
+    source.gpuBytes = 0;
+    source.cpuBytes = getBvhBytes(*model.pBvh);
+
+    // Materials
+    source.texturePaths.clear();
+    model.materialCount = (int)loaded.materialImages.size();
+    model.materials = new Material[model.materialCount];
+    for (int i = 0; i < model.materialCount; ++i)
+    {
+        model.materials[i].diffuse = 0;
+        if (loaded.materialImages[i] < 0) continue;
+        const auto& image = loaded.images[loaded.materialImages[i]];
+        model.materials[i].diffuse = acquireTexture(image);
+        source.texturePaths.push_back(image.path);
+    }
+
+    // Meshes
+    model.meshCount = (int)loaded.meshes.size();
+    model.meshes = new Mesh[model.meshCount];
+    model.pVertices = new ModelVertices();
+    for (int i = 0; i < model.meshCount; ++i)
+    {
+        auto pMesh = model.meshes + i;
+        const auto& loadedMesh = loaded.meshes[i];
+
+        pMesh->pMaterial = model.materials + loadedMesh.materialIndex;
+
+        // Kept for baking
+        pMesh->firstVertex = (uint32_t)(model.pVertices->positions.size() / 3);
+        for (const auto& vertex : loadedMesh.vertices)
+        {
+            model.pVertices->positions.insert(model.pVertices->positions.end(), vertex.position, vertex.position + 3);
+            model.pVertices->normals.insert(model.pVertices->normals.end(), vertex.normal, vertex.normal + 3);
+        }
+        source.cpuBytes += loadedMesh.vertices.size() * sizeof(float) * 6;
+
         glGenVertexArrays(1, &pMesh->vao);
         glBindVertexArray(pMesh->vao);
 
         glGenBuffers(1, &pMesh->vbo);
         glBindBuffer(GL_ARRAY_BUFFER, pMesh->vbo);
-        glBufferData(GL_ARRAY_BUFFER, pAssMesh->mNumVertices * sizeof(MeshVertex), (const GLvoid*)vertices, GL_STATIC_DRAW);
-        delete[] vertices;
+        glBufferData(GL_ARRAY_BUFFER, loadedMesh.vertices.size() * sizeof(MeshVertex), (const GLvoid*)loadedMesh.vertices.data(), GL_STATIC_DRAW);
+        source.gpuBytes += loadedMesh.vertices.size() * sizeof(MeshVertex);
 
         glEnableVertexAttribArray(meshShader.attrib_position);
         glEnableVertexAttribArray(meshShader.attrib_normal);
@@ -241,43 +481,257 @@ static Model loadModel(const std::string& filename, float scale)
         glVertexAttribPointer(meshShader.attrib_color, 4, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (GLvoid*)IM_OFFSETOF(MeshVertex, color));
         glVertexAttribPointer(meshShader.attrib_texCoord, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (GLvoid*)IM_OFFSETOF(MeshVertex, uv));
 
-        // Load faces
-        pMesh->elementCount = (GLsizei)pAssMesh->mNumFaces * 3;
-        if (pAssMesh->mNumFaces * 3 > std::numeric_limits<uint16_t>::max())
+        // Faces
+        pMesh->elementCount = (GLsizei)loadedMesh.indices.size();
+        glGenBuffers(1, &pMesh->ibo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pMesh->ibo);
+        if (loadedMesh.indices.size() > std::numeric_limits<uint16_t>::max())
         {
-            uint32_t* indices = new uint32_t[pMesh->elementCount];
-            for (int i = 0; i < (int)pAssMesh->mNumFaces; ++i)
-            {
-                indices[i * 3 + 0] = (uint32_t)pAssMesh->mFaces[i].mIndices[0];
-                indices[i * 3 + 1] = (uint32_t)pAssMesh->mFaces[i].mIndices[1];
-                indices[i * 3 + 2] = (uint32_t)pAssMesh->mFaces[i].mIndices[2];
-            }
-            glGenBuffers(1, &pMesh->ibo);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pMesh->ibo);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * pMesh->elementCount, (const GLvoid*)indices, GL_STATIC_DRAW);
-            delete[] indices;
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * pMesh->elementCount, (const GLvoid*)loadedMesh.indices.data(), GL_STATIC_DRAW);
             pMesh->elementType = GL_UNSIGNED_INT;
+            source.gpuBytes += sizeof(uint32_t) * pMesh->elementCount;
         }
         else
         {
-            uint16_t* indices = new uint16_t[pMesh->elementCount];
-            for (int i = 0; i < (int)pAssMesh->mNumFaces; ++i)
+            std::vector<uint16_t> indices(loadedMesh.indices.begin(), loadedMesh.indices.end());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * pMesh->elementCount, (const GLvoid*)indices.data(), GL_STATIC_DRAW);
+            pMesh->elementType = GL_UNSIGNED_SHORT;
+            source.gpuBytes += sizeof(uint16_t) * pMesh->elementCount;
+        }
+    }
+
+    if (!model.pBvh->bvh.nodes.empty())
+    {
+        memcpy(model.min, model.pBvh->bvh.nodes[0].min, sizeof(model.min));
+        memcpy(model.max, model.pBvh->bvh.nodes[0].max, sizeof(model.max));
+        source.hasBounds = true;
+    }
+    else
+    {
+        memset(model.min, 0, sizeof(model.min));
+        memset(model.max, 0, sizeof(model.max));
+    }
+
+    source.state = ModelState::Resident;
+    memoryUsage += source.gpuBytes + source.cpuBytes;
+    return memcmp(oldBounds, model.min, sizeof(model.min)) || memcmp(oldBounds + 3, model.max, sizeof(model.max));
+}
+
+static void eraseCached(std::unordered_map<uint64_t, CachedModel>::iterator it)
+{
+    delete it->second.loaded.pBvh;
+    cacheUsage -= it->second.bytes;
+    cache.erase(it);
+}
+
+// Over its budget, the least recently used go first
+static void trimCache()
+{
+    if (cacheUsage <= cacheBudget) return;
+
+    std::vector<std::pair<uint64_t, uint64_t>> candidates; // Last used, id
+    for (const auto& kv : cache)
+    {
+        candidates.push_back({ kv.second.lastUsed, kv.first });
+    }
+    std::sort(candidates.begin(), candidates.end());
+    for (const auto& candidate : candidates)
+    {
+        if (cacheUsage <= cacheBudget) break;
+        eraseCached(cache.find(candidate.second));
+    }
+}
+
+// What was uploaded, without the BVH the model took
+static void addToCache(LoadedModel& loaded)
+{
+    size_t bytes = 0;
+    for (const auto& mesh : loaded.meshes)
+    {
+        bytes += mesh.vertices.size() * sizeof(MeshVertex) + mesh.indices.size() * sizeof(uint32_t);
+    }
+    for (const auto& image : loaded.images)
+    {
+        bytes += image.pixels.size();
+    }
+    if (bytes > cacheBudget) return;
+
+    auto it = cache.find(loaded.id);
+    if (it != cache.end()) eraseCached(it);
+    auto& cached = cache[loaded.id];
+    cached.loaded = std::move(loaded);
+    cached.lastUsed = ++cacheClock;
+    cached.bytes = bytes;
+    cacheUsage += bytes;
+    trimCache();
+}
+
+static void clearCache()
+{
+    while (!cache.empty()) eraseCached(cache.begin());
+}
+
+// Back to its bounds only
+static void unloadModel(uint64_t id, ModelSource& source)
+{
+    auto& model = models[id];
+    for (int i = 0; i < model.meshCount; ++i)
+    {
+        const auto& mesh = model.meshes[i];
+        glDeleteVertexArrays(1, &mesh.vao);
+        glDeleteBuffers(1, &mesh.vbo);
+        glDeleteBuffers(1, &mesh.ibo);
+    }
+    delete[] model.meshes;
+    delete[] model.materials;
+    delete model.pVertices;
+
+    // The BVH waits in the cache with the rest of the parsed model
+    auto it = cache.find(id);
+    if (it != cache.end() && !it->second.loaded.pBvh)
+    {
+        it->second.loaded.pBvh = model.pBvh;
+        it->second.bytes += getBvhBytes(*model.pBvh);
+        cacheUsage += getBvhBytes(*model.pBvh);
+    }
+    else
+    {
+        delete model.pBvh;
+    }
+
+    model.meshCount = 0;
+    model.meshes = nullptr;
+    model.materialCount = 0;
+    model.materials = nullptr;
+    model.pBvh = nullptr;
+    model.pVertices = nullptr;
+
+    for (const auto& path : source.texturePaths)
+    {
+        releaseTexture(path);
+    }
+    source.texturePaths.clear();
+    memoryUsage -= source.gpuBytes + source.cpuBytes;
+    source.gpuBytes = 0;
+    source.cpuBytes = 0;
+    source.state = ModelState::Unloaded;
+    trimCache();
+}
+
+
+static void readAxes(const Json::Value& json, int count, float* pOut)
+{
+    static const char* AXES[] = { "x", "y", "z", "w" };
+    for (int k = 0; k < count; ++k)
+    {
+        if (json.isMember(AXES[k])) pOut[k] = json[AXES[k]].asFloat();
+    }
+}
+
+// Parts are entities without ids, their transforms relative to the prefab.
+// visiting holds the prefabs being expanded, a part that is one of them is a
+// cycle and is dropped
+static void addPrefabParts(const std::unordered_map<uint64_t, const Json::Value*>& jsonPrefabs, const Json::Value& jsonParts, const mat4& parent, std::vector<uint64_t>& visiting, std::string& error, std::vector<PrefabPart>& out)
+{
+    // Locals all at once, through the batched kernel
+    auto partCount = (size_t)jsonParts.size();
+    std::vector<float> translations(partCount * 3, 0.0f);
+    std::vector<float> rotations(partCount * 4, 0.0f);
+    std::vector<float> scales(partCount * 3, 1.0f);
+    for (size_t i = 0; i < partCount; ++i)
+    {
+        const auto& jsonPart = jsonParts[(Json::ArrayIndex)i];
+        rotations[i * 4 + 3] = 1.0f;
+        readAxes(jsonPart["position"], 3, &translations[i * 3]);
+        readAxes(jsonPart["rotation"], 4, &rotations[i * 4]);
+        readAxes(jsonPart["scale"], 3, &scales[i * 3]);
+    }
+    std::vector<mat4> locals(partCount);
+    vectorMath_composeTrs(translations.data(), rotations.data(), scales.data(), locals.data(), partCount);
+
+    for (size_t i = 0; i < partCount; ++i)
+    {
+        const auto& jsonPart = jsonParts[(Json::ArrayIndex)i];
+        PrefabPart part;
+        part.local = mat4_mul(locals[i], parent);
+        part.modelId = jsonPart["modelId"].asUInt64();
+
+        auto it = jsonPrefabs.find(part.modelId);
+        if (it == jsonPrefabs.end())
+        {
+            out.push_back(part);
+        }
+        else if (std::find(visiting.begin(), visiting.end(), part.modelId) != visiting.end())
+        {
+            if (error.empty()) error = "Prefab " + std::to_string(visiting.front()) + " includes itself through prefab " + std::to_string(part.modelId);
+        }
+        else if (visiting.size() > LIBRARY_PREFAB_MAX_DEPTH)
+        {
+            if (error.empty()) error = "Prefab " + std::to_string(visiting.front()) + " nests more than " + std::to_string(LIBRARY_PREFAB_MAX_DEPTH) + " prefabs deep";
+        }
+        else
+        {
+            visiting.push_back(part.modelId);
+            addPrefabParts(jsonPrefabs, *it->second, part.local, visiting, error, out);
+            visiting.pop_back();
+        }
+    }
+}
+
+// A prefab's bounds are those of its parts, as far as they are known
+static void updatePrefabBounds()
+{
+    std::vector<mat4> locals;
+    std::vector<float> bounds;
+    for (const auto& kv : prefabs)
+    {
+        locals.clear();
+        bounds.clear();
+        for (const auto& part : kv.second.parts)
+        {
+            auto it = sources.find(part.modelId);
+            if (it == sources.end() || !it->second.hasBounds) continue;
+            const auto& partModel = models[part.modelId];
+            locals.push_back(part.local);
+            bounds.insert(bounds.end(), partModel.min, partModel.min + 3);
+            bounds.insert(bounds.end(), partModel.max, partModel.max + 3);
+        }
+        vectorMath_transformAabbsEach(locals.data(), bounds.data(), 6, bounds.data(), locals.size());
+
+        Model model = {};
+        for (size_t i = 0; i < locals.size(); ++i)
+        {
+            auto pPartBounds = &bounds[i * 6];
+            for (int k = 0; k < 3; ++k)
             {
-                indices[i * 3 + 0] = (uint16_t)pAssMesh->mFaces[i].mIndices[0];
-                indices[i * 3 + 1] = (uint16_t)pAssMesh->mFaces[i].mIndices[1];
-                indices[i * 3 + 2] = (uint16_t)pAssMesh->mFaces[i].mIndices[2];
+                model.min[k] = i == 0 ? pPartBounds[k] : std::min(model.min[k], pPartBounds[k]);
+                model.max[k] = i == 0 ? pPartBounds[3 + k] : std::max(model.max[k], pPartBounds[3 + k]);
             }
-            glGenBuffers(1, &pMesh->ibo);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pMesh->ibo);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * pMesh->elementCount, (const GLvoid*)indices, GL_STATIC_DRAW);
-            delete[] indices;
-            pMesh->elementType = GL_UNSIGNED_SHORT;
         }
+        models[kv.first] = model;
     }
+}
 
-    aiReleaseImport(pScene);
+static void loadPrefabs(const Json::Value& jsonLibrary)
+{
+    std::unordered_map<uint64_t, const Json::Value*> jsonPrefabs;
+    for (const auto& jsonModel : jsonLibrary)
+    {
+        if (jsonModel.isMember("prefab")) jsonPrefabs.insert({ jsonModel["id"].asUInt64(), &jsonModel["prefab"] });
+    }
 
-    return model;
+    std::vector<uint64_t> visiting;
+    for (const auto& kv : jsonPrefabs)
+    {
+        auto& prefab = prefabs[kv.first];
+        std::string error;
+        visiting.assign(1, kv.first);
+        addPrefabParts(jsonPrefabs, *kv.second, mat4_identity(), visiting, error, prefab.parts);
+        if (error.empty()) continue;
+        if (isHeadless) fprintf(stderr, "%s\n", error.c_str());
+        else tinyfd_messageBox("Loading Prefab", error.c_str(), "ok", "error", 0);
+    }
+    updatePrefabBounds();
 }
 
 void library_load()
@@ -287,19 +741,29 @@ void library_load()
 
     nextId = 1;
 
-    for (const auto& kv : textures)
+    // What's still being parsed was for the previous map, it's dropped
+    // once it comes back
+    ++generation;
     {
-        glDeleteTextures(1, &kv.second);
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        inFlightCount -= (int)requests.size();
+        requests.clear();
     }
-    textures.clear();
 
-    for (const auto& kv : models)
+    // Ids are the previous map's, so is the cache
+    clearCache();
+    for (auto& kv : sources)
     {
-        delete[] kv.second.materials;
-        delete[] kv.second.meshes;
+        if (kv.second.state == ModelState::Resident) unloadModel(kv.first, kv.second);
     }
     models.clear();
+    sources.clear();
+    prefabs.clear();
+    thumbnails.clear();
+    ++revision;
+    ++residency;
 
+    // Models are only listed here, sectors stream them in
     const auto& jsonLibrary = document.json["library"];
     for (int i = 0; i < (int)jsonLibrary.size(); ++i)
     {
@@ -312,10 +776,281 @@ void library_load()
         thumbnail.thumbnail = 0;
         thumbnails.push_back(thumbnail);
 
-        models[id] = loadModel(jsonModel["filename"].asString(), jsonModel["scale"].asFloat());
+        if (!jsonModel.isMember("prefab"))
+        {
+            auto& source = sources[id];
+            source.filename = jsonModel["filename"].asString();
+            source.scale = jsonModel["scale"].asFloat();
+            models[id] = {};
+        }
 
         nextId = std::max(nextId, id + 1);
     }
+    loadPrefabs(jsonLibrary);
+    frame_invalidate(FrameReason::AssetReady);
+}
+
+void library_shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        isQuitting = true;
+    }
+    loaderCondition.notify_all();
+    for (auto& loader : loaders)
+    {
+        loader.join();
+    }
+    loaders.clear();
+
+    for (auto& loaded : results)
+    {
+        delete loaded.pBvh;
+    }
+    results.clear();
+    requests.clear();
+    clearCache();
+}
+
+void library_setWanted(const uint64_t* pModelIds, const float* pDistances, size_t count)
+{
+    ++wantedCount;
+    for (auto& kv : sources)
+    {
+        kv.second.isWanted = false;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto it = sources.find(pModelIds[i]);
+        if (it == sources.end()) continue;
+        it->second.isWanted = true;
+        it->second.distance = pDistances[i];
+        it->second.lastWanted = wantedCount;
+    }
+    frame_invalidate(FrameReason::AssetReady);
+}
+
+// Over budget, unwanted models go first, the least recently wanted first.
+// Wanted ones stay, the farthest of those just don't get loaded.
+static void evict()
+{
+    if (memoryUsage <= memoryBudget) return;
+
+    std::vector<std::pair<uint64_t, uint64_t>> candidates; // Last wanted, id
+    for (const auto& kv : sources)
+    {
+        if (kv.second.state == ModelState::Resident && !kv.second.isWanted) candidates.push_back({ kv.second.lastWanted, kv.first });
+    }
+    std::sort(candidates.begin(), candidates.end());
+    for (const auto& candidate : candidates)
+    {
+        if (memoryUsage <= memoryBudget) break;
+        unloadModel(candidate.second, sources[candidate.second]);
+        ++residency;
+    }
+}
+
+// Nearest first, a few at a time so a camera move reorders what's left.
+// Cached ones are uploaded right away, within what's left of the frame's
+// uploads, the others go to the loader threads. Returns true if bounds
+// changed.
+static bool requestLoads(int uploadCount)
+{
+    if (memoryUsage >= memoryBudget) return false;
+
+    std::vector<std::pair<float, uint64_t>> wanted; // Distance, id
+    for (const auto& kv : sources)
+    {
+        if (kv.second.state == ModelState::Unloaded && kv.second.isWanted) wanted.push_back({ kv.second.distance, kv.first });
+    }
+    if (wanted.empty()) return false;
+    std::sort(wanted.begin(), wanted.end());
+
+    auto hasNewBounds = false;
+    std::vector<LoadRequest> newRequests;
+    auto directory = document.filename.substr(0, document.filename.find_last_of("/\\") + 1);
+    for (const auto& model : wanted)
+    {
+        if (memoryUsage >= memoryBudget) break;
+        auto& source = sources[model.second];
+        auto it = cache.find(model.second);
+        if (it != cache.end() && it->second.loaded.pBvh)
+        {
+            if (uploadCount >= LIBRARY_UPLOADS_PER_FRAME) continue;
+            ++uploadCount;
+            auto& cached = it->second;
+            cached.bytes -= getBvhBytes(*cached.loaded.pBvh);
+            cacheUsage -= getBvhBytes(*cached.loaded.pBvh);
+            cached.lastUsed = ++cacheClock;
+            if (uploadModel(cached.loaded, source)) hasNewBounds = true;
+            ++residency;
+            frame_invalidate(FrameReason::AssetReady);
+            continue;
+        }
+        if (inFlightCount + (int)newRequests.size() >= LIBRARY_MAX_IN_FLIGHT) continue;
+        source.state = ModelState::Loading;
+        newRequests.push_back({ model.second, generation, directory + source.filename, source.filename, source.scale });
+    }
+    if (newRequests.empty()) return hasNewBounds;
+
+    if (loaders.empty())
+    {
+        for (int i = 0; i < LIBRARY_LOADER_THREADS; ++i)
+        {
+            loaders.push_back(std::thread(runLoader));
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        std::move(newRequests.begin(), newRequests.end(), std::back_inserter(requests));
+        inFlightCount += (int)newRequests.size();
+    }
+    loaderCondition.notify_all();
+    return hasNewBounds;
+}
+
+void library_update()
+{
+    // A few uploads per frame, so a burst of loads doesn't hitch
+    std::vector<LoadedModel> finished;
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        auto count = std::min(results.size(), (size_t)LIBRARY_UPLOADS_PER_FRAME);
+        std::move(results.begin(), results.begin() + count, std::back_inserter(finished));
+        results.erase(results.begin(), results.begin() + count);
+        if (!results.empty()) frame_invalidate(FrameReason::AssetReady);
+    }
+
+    auto hasNewBounds = false;
+    for (auto& loaded : finished)
+    {
+        --inFlightCount;
+        auto it = sources.find(loaded.id);
+        if (loaded.generation != generation || it == sources.end())
+        {
+            delete loaded.pBvh;
+            continue;
+        }
+        auto& source = it->second;
+        if (!loaded.error.empty())
+        {
+            // Not retried, until the library is loaded again
+            source.state = ModelState::Failed;
+            if (isHeadless) fprintf(stderr, "%s\n", loaded.error.c_str());
+            else tinyfd_messageBox("Loading Model", loaded.error.c_str(), "ok", "error", 0);
+            continue;
+        }
+        if (uploadModel(loaded, source)) hasNewBounds = true;
+        addToCache(loaded);
+        ++residency;
+    }
+    if (!finished.empty()) frame_invalidate(FrameReason::AssetReady);
+
+    evict();
+    if (requestLoads((int)finished.size())) hasNewBounds = true;
+
+    // Streaming in and out only changes the residency, what depends on
+    // the bounds is invalidated when they change
+    if (hasNewBounds)
+    {
+        updatePrefabBounds();
+        ++revision;
+        ++residency;
+    }
+}
+
+bool library_getModelFile(uint64_t id, std::string* pFilename, float* pScale)
+{
+    auto it = sources.find(id);
+    if (it == sources.end()) return false;
+    *pFilename = it->second.filename;
+    *pScale = it->second.scale;
+    return true;
+}
+
+LoadedModel library_parseModelFile(const std::string& path, float scale)
+{
+    LoadRequest request = { 0, 0, path, path, scale };
+    return parseModel(request, true);
+}
+
+void library_setMemoryBudget(size_t bytes)
+{
+    memoryBudget = bytes;
+}
+
+size_t library_getMemoryBudget()
+{
+    return memoryBudget;
+}
+
+size_t library_getMemoryUsage()
+{
+    return memoryUsage;
+}
+
+void library_setCacheBudget(size_t bytes)
+{
+    cacheBudget = bytes;
+    trimCache();
+}
+
+size_t library_getCacheBudget()
+{
+    return cacheBudget;
+}
+
+void library_getMemoryStats(LibraryMemoryStats* pStats)
+{
+    *pStats = LibraryMemoryStats();
+    for (const auto& kv : sources)
+    {
+        ++pStats->modelCount;
+        if (kv.second.state != ModelState::Resident) continue;
+        ++pStats->residentCount;
+        pStats->meshBuffers += kv.second.gpuBytes;
+        pStats->modelData += kv.second.cpuBytes;
+    }
+    for (const auto& kv : textures)
+    {
+        pStats->textures += kv.second.bytes;
+    }
+    pStats->cache = cacheUsage;
+    pStats->cachedCount = (int)cache.size();
+    pStats->textureCount = (int)textures.size();
+}
+
+void library_getResidentModels(std::vector<LibraryModelMemory>& models)
+{
+    models.clear();
+    for (const auto& kv : sources)
+    {
+        if (kv.second.state != ModelState::Resident) continue;
+        LibraryModelMemory model;
+        model.id = kv.first;
+        model.filename = kv.second.filename;
+        model.gpuBytes = kv.second.gpuBytes;
+        model.cpuBytes = kv.second.cpuBytes;
+        model.isWanted = kv.second.isWanted;
+        models.push_back(model);
+    }
+    std::sort(models.begin(), models.end(), [](const LibraryModelMemory& a, const LibraryModelMemory& b)
+    {
+        return a.gpuBytes + a.cpuBytes > b.gpuBytes + b.cpuBytes;
+    });
+}
+
+size_t library_getPendingCount()
+{
+    // Over budget, those not started yet won't be
+    size_t count = 0;
+    for (const auto& kv : sources)
+    {
+        if (!kv.second.isWanted) continue;
+        if (kv.second.state == ModelState::Loading ||
+            (kv.second.state == ModelState::Unloaded && memoryUsage < memoryBudget)) ++count;
+    }
+    return count;
 }
 
 void library_updateGUI()
@@ -332,6 +1067,15 @@ void library_updateGUI()
         ImGuiWindowFlags_NoMove |
         ImGuiWindowFlags_NoResize |
         ImGuiWindowFlags_NoCollapse);
+    ImGui::Text("%u of %u sectors, %u of %u MB",
+        (unsigned)sectors_getActiveCount(), (unsigned)sectors_getCount(),
+        (unsigned)(memoryUsage / (1024 * 1024)), (unsigned)(memoryBudget / (1024 * 1024)));
+    if (inFlightCount > 0)
+    {
+        ImGui::SameLine();
+        ImGui::TextDisabled("Loading");
+    }
+    ImGui::Separator();
     ImGui::Columns(3, 0, false);
     for (const auto& thumbnail : thumbnails)
     {
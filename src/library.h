@@ -1,9 +1,15 @@
 #ifndef LIBRARY_H_INCLUDED
 #define LIBRARY_H_INCLUDED
 
+#include "vectorMath.h"
+
 #include <GL/gl3w.h>
 
 #include <cinttypes>
+#include <string>
+#include <vector>
+
+struct MeshBvh;
 
 struct Material
 {
@@ -14,12 +20,13 @@ struct MeshShader
 {
     GLuint program = 0;
     GLint uniform_texture = 0;
-    GLint uniform_worldMtx = 0;
+    GLint attrib_worldMtx = 0; // Per instance, 4 locations for the columns
     GLint uniform_projMtx = 0;
     GLint attrib_position = 0;
     GLint attrib_normal = 0;
     GLint attrib_color = 0;
     GLint attrib_texCoord = 0;
+    GLint attrib_light = 0;
 };
 
 struct Mesh
@@ -30,6 +37,14 @@ struct Mesh
     GLsizei elementCount = 0;
     GLuint elementType = GL_UNSIGNED_SHORT;
     Material* pMaterial;
+    uint32_t firstVertex = 0; // In the model's vertices
+};
+
+// Vertices of all the meshes one after the other, for baking
+struct ModelVertices
+{
+    std::vector<float> positions; // xyz
+    std::vector<float> normals; // xyz
 };
 
 struct Model
@@ -38,11 +53,117 @@ struct Model
     Mesh* meshes;
     int materialCount;
     Material* materials;
+    MeshBvh* pBvh; // Triangles of all the meshes, for raycasts
+    ModelVertices* pVertices;
+    float min[3]; // Bounds of all the meshes
+    float max[3];
+};
+
+struct MeshVertex
+{
+    float position[3];
+    float normal[3];
+    float color[4];
+    float uv[2];
+};
+
+// Decoded on a loader thread, made into a GL texture on the main thread
+struct LoadedImage
+{
+    std::string path;
+    int w = 0;
+    int h = 0;
+    std::vector<uint8_t> pixels; // RGBA, empty if it couldn't be read
+};
+
+struct LoadedMesh
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+    int materialIndex;
+};
+
+// A model parsed on a loader thread, nothing in there touches GL
+struct LoadedModel
+{
+    uint64_t id;
+    uint64_t generation;
+    std::vector<LoadedImage> images;
+    std::vector<int> materialImages; // Per material, -1 without a texture
+    std::vector<LoadedMesh> meshes;
+    MeshBvh* pBvh = nullptr;
+    std::string error;
 };
 
-void library_load();
+// A model of a group of models, placed as a single entity. Nested prefabs
+// are already expanded, parts only point at models.
+struct PrefabPart
+{
+    mat4 local; // In the prefab's space
+    uint64_t modelId;
+};
+
+struct Prefab
+{
+    std::vector<PrefabPart> parts;
+};
+
+void library_initShaders(); // At startup, before shaders_finish
+void library_load(); // Lists the models, they are streamed in as wanted
+void library_shutdown(); // Stops the loader threads
 void library_updateGUI();
-Model library_getModel(uint64_t id);
+Model library_getModel(uint64_t id); // For a prefab, no meshes and the bounds of its parts
+const Prefab* library_getPrefab(uint64_t id); // nullptr if id isn't a prefab
+uint64_t library_getRevision(); // Changes when models are listed again or their bounds change
+uint64_t library_getResidency(); // Changes when models are streamed in or out, and with the revision
+uint64_t library_getLoadCount(); // Changes on library_load only
+
+// Models are parsed on loader threads and uploaded on the main thread, the
+// nearest wanted first. Unloaded, a model has no meshes but keeps its bounds
+// once they are known. Over the memory budget, the least recently wanted
+// models that aren't wanted anymore are unloaded.
+void library_setWanted(const uint64_t* pModelIds, const float* pDistances, size_t count); // Distances to the nearest camera
+void library_update(); // Once per frame, on the main thread
+void library_setMemoryBudget(size_t bytes);
+size_t library_getMemoryBudget();
+size_t library_getMemoryUsage();
+size_t library_getPendingCount(); // Wanted models not in yet, 0 once streaming settled
+
+// Parsed models stay in RAM after their upload, so an evicted one comes
+// back without its file being read again, within their own budget.
+void library_setCacheBudget(size_t bytes);
+size_t library_getCacheBudget();
+
+struct LibraryMemoryStats
+{
+    size_t meshBuffers = 0; // GPU, vertices and indices
+    size_t textures = 0; // GPU
+    size_t modelData = 0; // CPU, raycast triangles and baking vertices
+    size_t cache = 0; // CPU, parsed models
+    int modelCount = 0; // Known to streaming, prefabs aside
+    int residentCount = 0;
+    int cachedCount = 0;
+    int textureCount = 0;
+};
+
+struct LibraryModelMemory
+{
+    uint64_t id;
+    std::string filename;
+    size_t gpuBytes; // Its textures aside, they can be shared
+    size_t cpuBytes;
+    bool isWanted;
+};
+
+void library_getMemoryStats(LibraryMemoryStats* pStats);
+void library_getResidentModels(std::vector<LibraryModelMemory>& models); // Largest first
+
+// For tools reading the models' files on their own, like the cook.
+// Filenames are relative to the map, false for prefabs and unknown ids.
+// Parsing can be done on any thread, in the same space streaming puts the
+// models in. Images are only listed, not decoded, and there's no BVH.
+bool library_getModelFile(uint64_t id, std::string* pFilename, float* pScale);
+LoadedModel library_parseModelFile(const std::string& path, float scale); // error set if it failed
 
 extern MeshShader meshShader;
 
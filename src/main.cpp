@@ -17,6 +17,12 @@
 
 #include "globals.h"
 #include "editor.h"
+#include "frame.h"
+#include "headless.h"
+#include "startup.h"
+
+#include <stdlib.h>
+#include <string.h>
 
 bool done = false;
 
@@ -27,9 +33,18 @@ int CALLBACK WinMain(
     _In_ LPSTR     lpCmdLine,
     _In_ int       nCmdShow)
 #else
-int main()
+int main(int argc, char** argv)
 #endif
 {
+#if defined(WIN32)
+    auto argc = __argc;
+    auto argv = __argv;
+#endif
+    if (argc > 1 && !strcmp(argv[1], "--headless")) return headless_run(argc - 2, argv + 2);
+
+    startup_init();
+    auto windowPhase = startup_beginPhase("Window and GL context");
+
     // Setup SDL
     if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER) != 0)
     {
@@ -64,6 +79,9 @@ int main()
     SDL_GLContext gl_context = SDL_GL_CreateContext(window);
     SDL_GL_SetSwapInterval(1); // Enable vsync
     gl3wInit();
+    frame_init();
+    startup_endPhase(windowPhase);
+    auto imguiPhase = startup_beginPhase("ImGui");
 
     // Setup Dear ImGui binding
     IMGUI_CHECKVERSION();
@@ -97,7 +115,10 @@ int main()
     bool show_another_window = false;
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
+    startup_endPhase(imguiPhase);
+
     editor_init();
+    frame_invalidate(FrameReason::UI); // First frame
 
     // Main loop
     while (!done)
@@ -108,14 +129,11 @@ int main()
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application.
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
         SDL_Event event;
-
-        int (*sdlEventCall)(SDL_Event * event) = SDL_WaitEvent;
-
-        if (updateNextFrame || updateEachFrame)
+        if (frame_wait(&event))
         {
-            if (updateNextFrame) --updateNextFrame;
-            while (SDL_PollEvent(&event))
+            do
             {
+                frame_onEvent(event);
                 ImGui_ImplSDL2_ProcessEvent(&event);
                 if (event.type == SDL_QUIT)
                     done = true;
@@ -126,22 +144,12 @@ int main()
                     width = event.window.data1;
                     height = event.window.data2;
                 }
-            }
-        }
-        else if (SDL_WaitEvent(&event))
-        {
-            ImGui_ImplSDL2_ProcessEvent(&event);
-            if (event.type == SDL_QUIT)
-                done = true;
-            if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE && event.window.windowID == SDL_GetWindowID(window))
-                done = true;
-            if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
-            {
-                width = event.window.data1;
-                height = event.window.data2;
-            }
+            } while (SDL_PollEvent(&event));
         }
 
+        // Nothing asked for a frame, back to sleep
+        if (!frame_begin()) continue;
+
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL2_NewFrame(window);
@@ -159,13 +167,14 @@ int main()
         glDepthMask(GL_TRUE);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-        // Draw viewports
+        frame_end();
 
         // Swap
         SDL_GL_SwapWindow(window);
+        startup_firstFrame();
     }
 
+    editor_shutdown();
     config_save();
 
     // Cleanup
@@ -0,0 +1,578 @@
+#include "mapFile.h"
+#include "globals.h"
+#include "jsonReader.h"
+#include "fileSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <locale.h>
+#include <memory>
+#include <unordered_map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Binary layout (little endian):
+//   MapFileHeader
+//   MapFileChunk[chunkCount]
+//   Chunks, each aligned to MAPFILE_ALIGN so columns can be used in place
+//
+// Entities are stored in columns, one chunk per field. Whatever doesn't fit
+// the known columns is kept as compact JSON in the string table so we can
+// always go back to the exact same JSON document.
+#define MAPFILE_MAGIC 0x4250414D // "MAPB"
+#define MAPFILE_ALIGN 16
+#define MAPFILE_CHUNK_ID(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+static const uint32_t CHUNK_META = MAPFILE_CHUNK_ID('M', 'E', 'T', 'A');           // JSON text of everything but "map"
+static const uint32_t CHUNK_STRINGS = MAPFILE_CHUNK_ID('S', 'T', 'R', 'S');        // u32 count, u32 offsets[count + 1], chars
+static const uint32_t CHUNK_ENTITY_FLAGS = MAPFILE_CHUNK_ID('E', 'F', 'L', 'G');   // u8[n]
+static const uint32_t CHUNK_ENTITY_MODELS = MAPFILE_CHUNK_ID('E', 'M', 'D', 'L');  // u64[n]
+static const uint32_t CHUNK_ENTITY_POSITIONS = MAPFILE_CHUNK_ID('E', 'P', 'O', 'S'); // double[n * 3]
+static const uint32_t CHUNK_ENTITY_EXTRAS = MAPFILE_CHUNK_ID('E', 'E', 'X', 'T');  // u32[n], string index
+static const uint32_t CHUNK_ENTITY_ROTATIONS = MAPFILE_CHUNK_ID('E', 'R', 'O', 'T'); // float[n * 4], since version 3
+static const uint32_t CHUNK_ENTITY_SCALES = MAPFILE_CHUNK_ID('E', 'S', 'C', 'L');  // float[n * 3], since version 3
+static const uint32_t CHUNK_ENTITY_IDS = MAPFILE_CHUNK_ID('E', 'I', 'D', 'S');     // u32[n], since version 3
+static const uint32_t CHUNK_ENTITY_PARENTS = MAPFILE_CHUNK_ID('E', 'P', 'A', 'R'); // u32[n], since version 3
+static const uint32_t CHUNK_ENTITY_LAYERS = MAPFILE_CHUNK_ID('E', 'L', 'A', 'Y');  // u8[n], since version 4
+
+struct MapFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunkCount;
+    uint32_t reserved;
+    uint64_t entityCount;
+};
+
+struct MapFileChunk
+{
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct StringTable
+{
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, uint32_t> indices;
+
+    StringTable()
+    {
+        strings.push_back("");
+        indices[""] = 0;
+    }
+
+    uint32_t add(const std::string& str)
+    {
+        auto it = indices.find(str);
+        if (it != indices.end()) return it->second;
+        auto index = (uint32_t)strings.size();
+        strings.push_back(str);
+        indices[str] = index;
+        return index;
+    }
+};
+
+bool mapFile_isBinary(const std::string& filename)
+{
+    static const size_t EXT_LEN = sizeof(MAP_BINARY_EXTENSION) - 1;
+    return filename.size() >= EXT_LEN &&
+        filename.compare(filename.size() - EXT_LEN, EXT_LEN, MAP_BINARY_EXTENSION) == 0;
+}
+
+static bool parseJson(const char* pBegin, const char* pEnd, Json::Value& json)
+{
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    std::string errors;
+    return reader->parse(pBegin, pEnd, &json, &errors);
+}
+
+static std::string writeCompactJson(const Json::Value& json)
+{
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, json);
+}
+
+static void beginChunk(std::vector<uint8_t>& out, std::vector<MapFileChunk>& chunks, uint32_t id)
+{
+    while (out.size() % MAPFILE_ALIGN) out.push_back(0);
+
+    MapFileChunk chunk;
+    chunk.id = id;
+    chunk.reserved = 0;
+    chunk.offset = (uint64_t)out.size();
+    chunk.size = 0;
+    chunks.push_back(chunk);
+}
+
+static void endChunk(std::vector<uint8_t>& out, std::vector<MapFileChunk>& chunks)
+{
+    chunks.back().size = (uint64_t)out.size() - chunks.back().offset;
+}
+
+static void writeChunk(std::vector<uint8_t>& out, std::vector<MapFileChunk>& chunks, uint32_t id, const void* pData, size_t size)
+{
+    beginChunk(out, chunks, id);
+    out.insert(out.end(), (const uint8_t*)pData, (const uint8_t*)pData + size);
+    endChunk(out, chunks);
+}
+
+// One column of all the entity chunks, back to back
+template<typename T, size_t N>
+static void writeColumnChunk(std::vector<uint8_t>& out, std::vector<MapFileChunk>& chunks, uint32_t id,
+                             const Entities& entities, T (EntityChunk::* pColumn)[N], size_t stride)
+{
+    beginChunk(out, chunks, id);
+    auto chunkCount = entities_getChunkCount(entities);
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        const auto& chunk = entities_getChunk(entities, i);
+        auto pData = (const uint8_t*)(chunk.*pColumn);
+        out.insert(out.end(), pData, pData + sizeof(T) * stride * chunk.count);
+    }
+    endChunk(out, chunks);
+}
+
+void mapFile_toBinary(const Json::Value& json, const Entities& entities, std::vector<uint8_t>& out)
+{
+    auto entityCount = entities_count(entities);
+
+    // Everything else goes in the meta as-is
+    Json::Value meta = json;
+    meta.removeMember("map");
+    auto metaText = writeCompactJson(meta);
+
+    // Only the extras need converting, other columns are written as-is
+    StringTable strings;
+    std::vector<uint32_t> extras;
+    extras.reserve(entityCount);
+    auto chunkCount = entities_getChunkCount(entities);
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        const auto& chunk = entities_getChunk(entities, i);
+        for (uint32_t j = 0; j < chunk.count; ++j)
+        {
+            extras.push_back(chunk.extras[j].empty() ? 0 : strings.add(chunk.extras[j]));
+        }
+    }
+
+    std::vector<uint8_t> stringsData;
+    {
+        auto count = (uint32_t)strings.strings.size();
+        std::vector<uint32_t> offsets;
+        offsets.reserve(count + 1);
+        uint32_t offset = 0;
+        for (const auto& str : strings.strings)
+        {
+            offsets.push_back(offset);
+            offset += (uint32_t)str.size();
+        }
+        offsets.push_back(offset);
+
+        stringsData.resize(sizeof(uint32_t) * (count + 2) + offset);
+        auto pData = stringsData.data();
+        memcpy(pData, &count, sizeof(uint32_t));
+        memcpy(pData + sizeof(uint32_t), offsets.data(), sizeof(uint32_t) * offsets.size());
+        pData += sizeof(uint32_t) * (count + 2);
+        for (const auto& str : strings.strings)
+        {
+            memcpy(pData, str.data(), str.size());
+            pData += str.size();
+        }
+    }
+
+    // Layout
+    static const uint32_t CHUNK_COUNT = 11;
+    MapFileHeader header;
+    header.magic = MAPFILE_MAGIC;
+    header.version = MAP_VERSION;
+    header.chunkCount = CHUNK_COUNT;
+    header.reserved = 0;
+    header.entityCount = (uint64_t)entityCount;
+
+    out.clear();
+    out.resize(sizeof(MapFileHeader) + sizeof(MapFileChunk) * CHUNK_COUNT, 0);
+
+    std::vector<MapFileChunk> chunks;
+    writeChunk(out, chunks, CHUNK_META, metaText.data(), metaText.size());
+    writeChunk(out, chunks, CHUNK_STRINGS, stringsData.data(), stringsData.size());
+    writeColumnChunk(out, chunks, CHUNK_ENTITY_FLAGS, entities, &EntityChunk::flags, 1);
+    writeColumnChunk(out, chunks, CHUNK_ENTITY_MODELS, entities, &EntityChunk::modelIds, 1);
+    writeColumnChunk(out, chunks, CHUNK_ENTITY_POSITIONS, entities, &EntityChunk::positions, 3);
+    writeChunk(out, chunks, CHUNK_ENTITY_EXTRAS, extras.data(), sizeof(uint32_t) * extras.size());
+    writeColumnChunk(out, chunks, CHUNK_ENTITY_ROTATIONS, entities, &EntityChunk::rotations, 4);
+    writeColumnChunk(out, chunks, CHUNK_ENTITY_SCALES, entities, &EntityChunk::scales, 3);
+    writeColumnChunk(out, chunks, CHUNK_ENTITY_IDS, entities, &EntityChunk::ids, 1);
+    writeColumnChunk(out, chunks, CHUNK_ENTITY_PARENTS, entities, &EntityChunk::parents, 1);
+    writeColumnChunk(out, chunks, CHUNK_ENTITY_LAYERS, entities, &EntityChunk::layers, 1);
+
+    memcpy(out.data(), &header, sizeof(MapFileHeader));
+    memcpy(out.data() + sizeof(MapFileHeader), chunks.data(), sizeof(MapFileChunk) * chunks.size());
+}
+
+static const MapFileChunk* findChunk(const MapFileChunk* pChunks, uint32_t count, uint32_t id, uint64_t expectedSize)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (pChunks[i].id == id)
+        {
+            if (expectedSize != (uint64_t)-1 && pChunks[i].size != expectedSize) return nullptr;
+            return pChunks + i;
+        }
+    }
+    return nullptr;
+}
+
+bool mapFile_fromBinary(const uint8_t* pData, size_t size, Json::Value& json, Entities& entities, std::string& error)
+{
+    if (size < sizeof(MapFileHeader))
+    {
+        error = "File is too small";
+        return false;
+    }
+
+    MapFileHeader header;
+    memcpy(&header, pData, sizeof(MapFileHeader));
+    if (header.magic != MAPFILE_MAGIC)
+    {
+        error = "Not a binary map file";
+        return false;
+    }
+    if (header.version < 2 || header.version > MAP_VERSION)
+    {
+        error = "Unsupported map version " + std::to_string(header.version);
+        return false;
+    }
+    if (sizeof(MapFileHeader) + (uint64_t)header.chunkCount * sizeof(MapFileChunk) > size)
+    {
+        error = "Corrupted chunk table";
+        return false;
+    }
+    auto pChunks = (const MapFileChunk*)(pData + sizeof(MapFileHeader));
+    for (uint32_t i = 0; i < header.chunkCount; ++i)
+    {
+        // Columns are read in place, they must be aligned like they are written
+        if (pChunks[i].offset > size || pChunks[i].size > size - pChunks[i].offset || pChunks[i].offset % MAPFILE_ALIGN)
+        {
+            error = "Corrupted chunk";
+            return false;
+        }
+    }
+
+    auto n = header.entityCount;
+    auto pMetaChunk = findChunk(pChunks, header.chunkCount, CHUNK_META, (uint64_t)-1);
+    auto pStringsChunk = findChunk(pChunks, header.chunkCount, CHUNK_STRINGS, (uint64_t)-1);
+    auto pFlagsChunk = findChunk(pChunks, header.chunkCount, CHUNK_ENTITY_FLAGS, n);
+    auto pModelsChunk = findChunk(pChunks, header.chunkCount, CHUNK_ENTITY_MODELS, n * sizeof(uint64_t));
+    auto pPositionsChunk = findChunk(pChunks, header.chunkCount, CHUNK_ENTITY_POSITIONS, n * sizeof(double) * 3);
+    auto pExtrasChunk = findChunk(pChunks, header.chunkCount, CHUNK_ENTITY_EXTRAS, n * sizeof(uint32_t));
+    if (!pMetaChunk || !pStringsChunk || !pFlagsChunk || !pModelsChunk || !pPositionsChunk || !pExtrasChunk)
+    {
+        error = "Missing or corrupted entity data";
+        return false;
+    }
+
+    // Transforms, version 2 maps are translation only
+    auto pRotationsChunk = findChunk(pChunks, header.chunkCount, CHUNK_ENTITY_ROTATIONS, n * sizeof(float) * 4);
+    auto pScalesChunk = findChunk(pChunks, header.chunkCount, CHUNK_ENTITY_SCALES, n * sizeof(float) * 3);
+    auto pIdsChunk = findChunk(pChunks, header.chunkCount, CHUNK_ENTITY_IDS, n * sizeof(uint32_t));
+    auto pParentsChunk = findChunk(pChunks, header.chunkCount, CHUNK_ENTITY_PARENTS, n * sizeof(uint32_t));
+    if (header.version >= 3 && (!pRotationsChunk || !pScalesChunk || !pIdsChunk || !pParentsChunk))
+    {
+        error = "Missing or corrupted entity transforms";
+        return false;
+    }
+
+    // Everything is on layer 0 before version 4
+    auto pLayersChunk = findChunk(pChunks, header.chunkCount, CHUNK_ENTITY_LAYERS, n);
+    if (header.version >= 4 && !pLayersChunk)
+    {
+        error = "Missing or corrupted entity layers";
+        return false;
+    }
+
+    // Meta
+    json = Json::Value();
+    auto pMetaText = (const char*)(pData + pMetaChunk->offset);
+    if (!parseJson(pMetaText, pMetaText + pMetaChunk->size, json) || !json.isObject())
+    {
+        error = "Corrupted meta data";
+        return false;
+    }
+
+    // String table
+    uint32_t stringCount = 0;
+    if (pStringsChunk->size < sizeof(uint32_t))
+    {
+        error = "Corrupted string table";
+        return false;
+    }
+    memcpy(&stringCount, pData + pStringsChunk->offset, sizeof(uint32_t));
+    auto headerSize = sizeof(uint32_t) * ((uint64_t)stringCount + 2);
+    if (headerSize > pStringsChunk->size)
+    {
+        error = "Corrupted string table";
+        return false;
+    }
+    auto pOffsets = (const uint32_t*)(pData + pStringsChunk->offset + sizeof(uint32_t));
+    auto pChars = (const char*)(pData + pStringsChunk->offset + headerSize);
+    auto charsSize = pStringsChunk->size - headerSize;
+    for (uint32_t s = 0; s < stringCount; ++s)
+    {
+        if (pOffsets[s] > pOffsets[s + 1] || pOffsets[s + 1] > charsSize)
+        {
+            error = "Corrupted string table";
+            return false;
+        }
+    }
+
+    // Entities, columns are copied as-is and extras resolved in a single pass
+    auto pExtras = (const uint32_t*)(pData + pExtrasChunk->offset);
+    entities_clear(entities);
+    entities_reserve(entities, (size_t)n);
+    EntityColumns columns;
+    columns.pFlags = pData + pFlagsChunk->offset;
+    columns.pModelIds = (const uint64_t*)(pData + pModelsChunk->offset);
+    columns.pPositions = (const double*)(pData + pPositionsChunk->offset);
+    if (pRotationsChunk) columns.pRotations = (const float*)(pData + pRotationsChunk->offset);
+    if (pScalesChunk) columns.pScales = (const float*)(pData + pScalesChunk->offset);
+    if (pIdsChunk) columns.pIds = (const uint32_t*)(pData + pIdsChunk->offset);
+    if (pParentsChunk) columns.pParents = (const uint32_t*)(pData + pParentsChunk->offset);
+    if (pLayersChunk) columns.pLayers = pData + pLayersChunk->offset;
+    entities_appendColumns(entities, (size_t)n, columns);
+    uint64_t i = 0;
+    auto chunkCount = entities_getChunkCount(entities);
+    for (size_t c = 0; c < chunkCount; ++c)
+    {
+        auto& chunk = entities_editChunk(entities, c);
+        for (uint32_t j = 0; j < chunk.count; ++j, ++i)
+        {
+            auto extrasIndex = pExtras[i];
+            if (extrasIndex >= stringCount || chunk.layers[j] >= ENTITY_MAX_LAYERS)
+            {
+                entities_clear(entities);
+                error = "Corrupted entity " + std::to_string(i);
+                return false;
+            }
+            if (extrasIndex)
+            {
+                chunk.extras[j].assign(pChars + pOffsets[extrasIndex], pChars + pOffsets[extrasIndex + 1]);
+            }
+        }
+    }
+
+    return true;
+}
+
+// snprintf writes the locale's decimal point, JSON's is always '.'
+static void fixDecimalPoint(char* pBuf)
+{
+    auto decimalPoint = localeconv()->decimal_point[0];
+    if (decimalPoint == '.') return;
+    auto pPoint = strchr(pBuf, decimalPoint);
+    if (pPoint) *pPoint = '.';
+}
+
+static std::string formatFloat(float value)
+{
+    // JSON has no NaN nor infinities, they would make the map unreadable
+    if (std::isnan(value)) value = 0.0f;
+    else if (std::isinf(value)) value = value > 0.0f ? FLT_MAX : -FLT_MAX;
+
+    // Shortest representation that reads back the same float
+    char buf[32];
+    for (int precision = 6; precision <= 9; ++precision)
+    {
+        snprintf(buf, sizeof(buf), "%.*g", precision, value);
+        if (strtof(buf, nullptr) == value) break;
+    }
+    fixDecimalPoint(buf);
+
+    std::string str = buf;
+    if (str.find_first_of(".eEn") == std::string::npos) str += ".0";
+    return str;
+}
+
+static std::string formatDouble(double value)
+{
+    // Clamped like in formatFloat
+    if (std::isnan(value)) value = 0.0;
+    else if (std::isinf(value)) value = value > 0.0 ? DBL_MAX : -DBL_MAX;
+
+    // Shortest representation that reads back the same
+    char buf[32];
+    for (int precision = 15; precision <= 17; ++precision)
+    {
+        snprintf(buf, sizeof(buf), "%.*g", precision, value);
+        if (strtod(buf, nullptr) == value) break;
+    }
+    fixDecimalPoint(buf);
+
+    // Keep it a real so it reads back with the same type
+    std::string str = buf;
+    if (str.find_first_of(".eEn") == std::string::npos) str += ".0";
+    return str;
+}
+
+void mapFile_toJson(const Json::Value& json, const Entities& entities, std::ostream& out, std::atomic<float>* pProgress)
+{
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "\t";
+
+    // Members are written in the same order jsoncpp would, "map" is streamed
+    // one entity per line so we never build a DOM for it.
+    auto names = json.getMemberNames();
+    names.push_back("map");
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    out << "{\n";
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        const auto& name = names[i];
+        out << "\t" << Json::valueToQuotedString(name.c_str()) << " : ";
+        if (name == "map")
+        {
+            auto entityCount = entities_count(entities);
+            auto chunkCount = entities_getChunkCount(entities);
+            size_t written = 0;
+            out << "\n\t[\n";
+            for (size_t c = 0; c < chunkCount; ++c)
+            {
+                if (pProgress) *pProgress = (float)written / (float)entityCount;
+                const auto& chunk = entities_getChunk(entities, c);
+                for (uint32_t j = 0; j < chunk.count; ++j)
+                {
+                    const auto& extras = chunk.extras[j];
+                    out << "\t\t";
+                    if (chunk.flags[j] & ENTITY_FLAG_RAW)
+                    {
+                        out << extras;
+                    }
+                    else
+                    {
+                        auto pPosition = &chunk.positions[j * 3];
+                        out << "{\"modelId\":" << chunk.modelIds[j] <<
+                            ",\"position\":{\"x\":" << formatDouble(pPosition[0]) <<
+                            ",\"y\":" << formatDouble(pPosition[1]) <<
+                            ",\"z\":" << formatDouble(pPosition[2]) << "}";
+
+                        // Transforms only when they differ from the defaults, older
+                        // maps stay the same. Rotations at double precision, so
+                        // what reads them as doubles gets the exact float.
+                        static const EntityRow DEFAULTS;
+                        auto pRotation = &chunk.rotations[j * 4];
+                        auto pScale = &chunk.scales[j * 3];
+                        if (memcmp(pRotation, DEFAULTS.rotation, sizeof(DEFAULTS.rotation)))
+                        {
+                            out << ",\"rotation\":{\"x\":" << formatDouble(pRotation[0]) <<
+                                ",\"y\":" << formatDouble(pRotation[1]) <<
+                                ",\"z\":" << formatDouble(pRotation[2]) <<
+                                ",\"w\":" << formatDouble(pRotation[3]) << "}";
+                        }
+                        if (memcmp(pScale, DEFAULTS.scale, sizeof(DEFAULTS.scale)))
+                        {
+                            out << ",\"scale\":{\"x\":" << formatFloat(pScale[0]) <<
+                                ",\"y\":" << formatFloat(pScale[1]) <<
+                                ",\"z\":" << formatFloat(pScale[2]) << "}";
+                        }
+                        out << ",\"id\":" << chunk.ids[j];
+                        if (chunk.parents[j] != ENTITY_NO_ID) out << ",\"parent\":" << chunk.parents[j];
+                        out << ",\"layer\":" << (int)chunk.layers[j];
+                        if (extras.size() > 2) out << "," << extras.substr(1);
+                        else out << "}";
+                    }
+                    out << (++written < entityCount ? ",\n" : "\n");
+                }
+            }
+            out << "\t]";
+        }
+        else
+        {
+            auto text = Json::writeString(builder, json[name]);
+            size_t pos = 0;
+            while ((pos = text.find('\n', pos)) != std::string::npos)
+            {
+                text.insert(pos + 1, "\t");
+                pos += 2;
+            }
+            out << text;
+        }
+        out << (i + 1 < names.size() ? ",\n" : "\n");
+    }
+    out << "}\n";
+}
+
+bool mapFile_load(const std::string& filename, Json::Value& json, Entities& entities, std::string& error)
+{
+    MappedFile mapped;
+    if (!fileSystem_map(filename, &mapped))
+    {
+        error = "Failed to open file:\n" + filename;
+        return false;
+    }
+
+    bool ret;
+    if (mapFile_isBinary(filename))
+    {
+        ret = mapFile_fromBinary(mapped.pData, mapped.size, json, entities, error);
+    }
+    else
+    {
+        ret = jsonReader_loadMap((const char*)mapped.pData, mapped.size, json, entities, error);
+        if (!ret) error = "Failed to parse file:\n" + filename + "\n" + error;
+    }
+    fileSystem_unmap(&mapped);
+    return ret;
+}
+
+bool mapFile_save(const std::string& filename, const Json::Value& json, const Entities& entities, std::string& error, std::atomic<float>* pProgress)
+{
+    // Written next to the target then swapped in, so a crash never leaves a
+    // half written map behind.
+    auto tmpFilename = filename + ".tmp";
+    {
+        std::ofstream file(tmpFilename, std::ios::binary);
+        if (!file.is_open())
+        {
+            error = "Failed to open/create file:\n" + tmpFilename;
+            return false;
+        }
+
+        if (mapFile_isBinary(filename))
+        {
+            std::vector<uint8_t> data;
+            mapFile_toBinary(json, entities, data);
+            if (pProgress) *pProgress = 0.5f;
+            file.write((const char*)data.data(), (std::streamsize)data.size());
+        }
+        else
+        {
+            mapFile_toJson(json, entities, file, pProgress);
+        }
+
+        file.close();
+        if (file.fail())
+        {
+            remove(tmpFilename.c_str());
+            error = "Failed to write file:\n" + tmpFilename;
+            return false;
+        }
+    }
+
+    if (!fileSystem_sync(tmpFilename) || !fileSystem_replace(tmpFilename, filename))
+    {
+        remove(tmpFilename.c_str());
+        error = "Failed to write file:\n" + filename;
+        return false;
+    }
+
+    if (pProgress) *pProgress = 1.0f;
+    return true;
+}
@@ -0,0 +1,34 @@
+#ifndef MAPFILE_H_INCLUDED
+#define MAPFILE_H_INCLUDED
+
+#include "entities.h"
+
+#include <json/json.h>
+
+#include <atomic>
+#include <cinttypes>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Binary maps use this extension, everything else is saved as JSON
+#define MAP_BINARY_EXTENSION ".map"
+#define MAP_JSON_EXTENSION ".json"
+
+bool mapFile_isBinary(const std::string& filename);
+
+// Load/Save a whole document, the format is picked from the extension. json
+// holds every top level member but "map", which lives in entities.
+// On failure, error is filled with a human readable message.
+// Saving goes through a temporary file that replaces the target once it is
+// fully on disk. pProgress, if set, goes from 0 to 1 and can be read from
+// another thread.
+bool mapFile_load(const std::string& filename, Json::Value& json, Entities& entities, std::string& error);
+bool mapFile_save(const std::string& filename, const Json::Value& json, const Entities& entities, std::string& error, std::atomic<float>* pProgress = nullptr);
+
+// In-memory conversions
+bool mapFile_fromBinary(const uint8_t* pData, size_t size, Json::Value& json, Entities& entities, std::string& error);
+void mapFile_toBinary(const Json::Value& json, const Entities& entities, std::vector<uint8_t>& out);
+void mapFile_toJson(const Json::Value& json, const Entities& entities, std::ostream& out, std::atomic<float>* pProgress = nullptr);
+
+#endif
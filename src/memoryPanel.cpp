@@ -0,0 +1,115 @@
+#include "memoryPanel.h"
+#include "bake.h"
+#include "globals.h"
+#include "frame.h"
+#include "library.h"
+#include "terrain.h"
+#include "undo.h"
+
+#include <imgui.h>
+
+#include <vector>
+
+#define MEMORY_PANEL_WIDTH 360.0f
+#define MEMORY_PANEL_HEIGHT 420.0f
+#define MEMORY_PANEL_TOP_MODELS 10
+#define MEMORY_PANEL_MB (1024.0f * 1024.0f)
+
+static void row(const char* name, size_t gpu, size_t cpu)
+{
+    ImGui::Text("%s", name);
+    ImGui::NextColumn();
+    if (gpu) ImGui::Text("%.1f", (float)gpu / MEMORY_PANEL_MB);
+    else ImGui::TextDisabled("-");
+    ImGui::NextColumn();
+    if (cpu) ImGui::Text("%.1f", (float)cpu / MEMORY_PANEL_MB);
+    else ImGui::TextDisabled("-");
+    ImGui::NextColumn();
+}
+
+// In MB, false if unchanged
+static bool inputBudget(const char* label, size_t* pBytes)
+{
+    auto mb = (int)(*pBytes / (1024 * 1024));
+    if (!ImGui::InputInt(label, &mb, 64, 256) || mb < 0) return false;
+    *pBytes = (size_t)mb * 1024 * 1024;
+    return true;
+}
+
+void memoryPanel_updateGUI()
+{
+    if (!isMemoryPanelVisible) return;
+
+    LibraryMemoryStats stats;
+    library_getMemoryStats(&stats);
+    size_t bakeGpu, bakeCpu;
+    bake_getMemoryUsage(&bakeGpu, &bakeCpu);
+    size_t terrainGpu, terrainCpu;
+    terrain_getMemoryUsage(&terrainGpu, &terrainCpu);
+
+    ImGui::SetNextWindowPos({ (float)width - PANEL_WIDTH - MEMORY_PANEL_WIDTH, 52 });
+    ImGui::SetNextWindowSize({ MEMORY_PANEL_WIDTH, MEMORY_PANEL_HEIGHT });
+    if (!ImGui::Begin("Memory", &isMemoryPanelVisible,
+        ImGuiWindowFlags_NoMove |
+        ImGuiWindowFlags_NoResize |
+        ImGuiWindowFlags_NoCollapse))
+    {
+        ImGui::End();
+        return;
+    }
+
+    // Budgets, streaming evicts to stay under them
+    auto budget = library_getMemoryBudget();
+    if (inputBudget("Models MB", &budget))
+    {
+        library_setMemoryBudget(budget);
+        frame_invalidate(FrameReason::UI);
+    }
+    ImGui::Text("%.0f MB used", (float)library_getMemoryUsage() / MEMORY_PANEL_MB);
+    auto cacheBudget = library_getCacheBudget();
+    if (inputBudget("Cache MB", &cacheBudget))
+    {
+        library_setCacheBudget(cacheBudget);
+        frame_invalidate(FrameReason::UI);
+    }
+    ImGui::Text("%.0f MB used, %i models", (float)stats.cache / MEMORY_PANEL_MB, stats.cachedCount);
+    ImGui::Separator();
+
+    // Categories
+    ImGui::Columns(3, "categories");
+    ImGui::Text("MB");
+    ImGui::NextColumn();
+    ImGui::Text("GPU");
+    ImGui::NextColumn();
+    ImGui::Text("CPU");
+    ImGui::NextColumn();
+    ImGui::Separator();
+    row("Meshes", stats.meshBuffers, stats.modelData);
+    row("Textures", stats.textures, 0);
+    row("Model cache", 0, stats.cache);
+    row("Bake", bakeGpu, bakeCpu);
+    row("Terrain", terrainGpu, terrainCpu);
+    row("Undo", 0, undo_getMemoryUsage());
+    ImGui::Columns(1);
+    ImGui::Text("%i of %i models resident, %i textures", stats.residentCount, stats.modelCount, stats.textureCount);
+    ImGui::Separator();
+
+    // Largest models, those not wanted anymore go first when over budget
+    static std::vector<LibraryModelMemory> models;
+    library_getResidentModels(models);
+    ImGui::Columns(3, "models");
+    for (int i = 0; i < (int)models.size() && i < MEMORY_PANEL_TOP_MODELS; ++i)
+    {
+        const auto& model = models[i];
+        if (model.isWanted) ImGui::Text("%s", model.filename.c_str());
+        else ImGui::TextDisabled("%s", model.filename.c_str());
+        ImGui::NextColumn();
+        ImGui::Text("%.1f", (float)model.gpuBytes / MEMORY_PANEL_MB);
+        ImGui::NextColumn();
+        ImGui::Text("%.1f", (float)model.cpuBytes / MEMORY_PANEL_MB);
+        ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+
+    ImGui::End();
+}
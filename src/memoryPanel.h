@@ -0,0 +1,9 @@
+#ifndef MEMORYPANEL_H_INCLUDED
+#define MEMORYPANEL_H_INCLUDED
+
+// Where the memory goes, GPU and CPU, per kind of asset and for the
+// largest models, with the budgets that streaming evicts against.
+// Shown while isMemoryPanelVisible.
+void memoryPanel_updateGUI();
+
+#endif
@@ -1,6 +1,13 @@
 #include "imgui.h"
+#include "bake.h"
+#include "cook.h"
 #include "globals.h"
 #include "editor.h"
+#include "frame.h"
+#include "saveQueue.h"
+#include "undo.h"
+#include "selection.h"
+#include "terrain.h"
 
 void editor_quit();
 
@@ -17,45 +24,60 @@ void menuBar_updateGUI()
 
         if (ImGui::BeginMenu("File"))
         {
-            if (ImGui::MenuItem("New Map", "CTRL + N")) { updateNextFrame++; editor_new(); }
+            if (ImGui::MenuItem("New Map", "CTRL + N")) { frame_invalidate(FrameReason::UI); editor_new(); }
             ImGui::Separator();
-            if (ImGui::MenuItem("Open Map", "CTRL + O")) { updateNextFrame++; editor_open(); }
+            if (ImGui::MenuItem("Open Map", "CTRL + O")) { frame_invalidate(FrameReason::UI); editor_open(); }
             if (ImGui::BeginMenu("Recent Maps"))
             {
                 for (const auto& recentPath : recentMaps)
                 {
                     if (!recentPath.empty())
                     {
-                        if (ImGui::MenuItem(recentPath.c_str())) { updateNextFrame++; editor_openRecent(recentPath); }
+                        if (ImGui::MenuItem(recentPath.c_str())) { frame_invalidate(FrameReason::UI); editor_openRecent(recentPath); }
                     }
                 }
                 ImGui::EndMenu();
             }
             ImGui::Separator();
-            if (ImGui::MenuItem("Save Map", "CTRL + S")) { updateNextFrame++; editor_save(); }
-            if (ImGui::MenuItem("Save Map As", "CTRL + SHIFT + S")) { updateNextFrame++; editor_saveAs(); }
+            if (ImGui::MenuItem("Save Map", "CTRL + S")) { frame_invalidate(FrameReason::UI); editor_save(); }
+            if (ImGui::MenuItem("Save Map As", "CTRL + SHIFT + S")) { frame_invalidate(FrameReason::UI); editor_saveAs(); }
             ImGui::Separator();
-            if (ImGui::MenuItem("Exit", "ALT + F4")) { updateNextFrame++; editor_quit(); }
+            if (ImGui::MenuItem("Import Heightmap...")) { frame_invalidate(FrameReason::UI); terrain_import(); }
+            if (ImGui::MenuItem("Cook Package...", nullptr, false, !editor_isOpening())) { frame_invalidate(FrameReason::UI); cook_export(); }
+            ImGui::Separator();
+            if (ImGui::MenuItem("Exit", "ALT + F4")) { frame_invalidate(FrameReason::UI); editor_quit(); }
             ImGui::EndMenu();
         }
 
         if (ImGui::BeginMenu("Edit"))
         {
-            if (ImGui::MenuItem("Undo", "CTRL + Z")) { updateNextFrame++; }
-            if (ImGui::MenuItem("Redo", "CTRL + SHIFT + Z", false, false)) { updateNextFrame++; }
+            if (ImGui::MenuItem("Undo", "CTRL + Z", false, undo_canUndo())) { undo_undo(); }
+            if (ImGui::MenuItem("Redo", "CTRL + SHIFT + Z", false, undo_canRedo())) { undo_redo(); }
+            ImGui::Separator();
+            if (ImGui::MenuItem("Cut", "CTRL + X")) { frame_invalidate(FrameReason::UI); }
+            if (ImGui::MenuItem("Copy", "CTRL + C")) { frame_invalidate(FrameReason::UI); }
+            if (ImGui::MenuItem("Paste", "CTRL + V")) { frame_invalidate(FrameReason::UI); }
+            ImGui::Separator();
+            if (ImGui::MenuItem("Drop to Surface", "END", false, selection_count() > 0)) { editor_dropToSurface(); }
+            auto isSnapping = document.json["editor"]["snap"].asBool();
+            if (ImGui::MenuItem("Snap to Geometry", nullptr, &isSnapping))
+            {
+                document.json["editor"]["snap"] = isSnapping;
+                document.dirty = true;
+                frame_invalidate(FrameReason::UI);
+            }
             ImGui::Separator();
-            if (ImGui::MenuItem("Cut", "CTRL + X")) { updateNextFrame++; }
-            if (ImGui::MenuItem("Copy", "CTRL + C")) { updateNextFrame++; }
-            if (ImGui::MenuItem("Paste", "CTRL + V")) { updateNextFrame++; }
+            if (ImGui::MenuItem("Bake Lighting", nullptr, false, !bake_isBusy())) { frame_invalidate(FrameReason::UI); bake_start(); }
             ImGui::EndMenu();
         }
 
         if (ImGui::BeginMenu("View"))
         {
-            if (ImGui::MenuItem("Left Panel", "B", &isLeftPanelVisible)) { updateNextFrame++; }
-            if (ImGui::MenuItem("Right Panel", "N", &isRightPanelVisible)) { updateNextFrame++; }
+            if (ImGui::MenuItem("Left Panel", "B", &isLeftPanelVisible)) { frame_invalidate(FrameReason::UI); }
+            if (ImGui::MenuItem("Right Panel", "N", &isRightPanelVisible)) { frame_invalidate(FrameReason::UI); }
             ImGui::Separator();
-            if (ImGui::MenuItem("Full View", "ALT + W", &isFullView)) { updateNextFrame++; }
+            if (ImGui::MenuItem("Full View", "ALT + W", &isFullView)) { frame_invalidate(FrameReason::UI); }
+            if (ImGui::MenuItem("Memory", nullptr, &isMemoryPanelVisible)) { frame_invalidate(FrameReason::UI); }
             ImGui::EndMenu();
         }
 
@@ -64,11 +86,33 @@ void menuBar_updateGUI()
             if (ImGui::MenuItem("About"))
             {
                 showAboutPopup = true;
-                updateNextFrame += 30;
+                frame_invalidate(FrameReason::UI, 3);
             }
             ImGui::EndMenu();
         }
 
+        const auto& frameStats = frame_getStats();
+        ImGui::Separator();
+        ImGui::Text("%.0f fps, %.1f%% CPU", frameStats.fps, frameStats.cpuUsage * 100.0f);
+
+        if (saveQueue_isBusy())
+        {
+            ImGui::Separator();
+            ImGui::Text("Saving... %i%%", (int)(saveQueue_getProgress() * 100.0f));
+        }
+
+        if (bake_isBusy())
+        {
+            ImGui::Separator();
+            ImGui::Text("Baking... %i%%", (int)(bake_getProgress() * 100.0f));
+        }
+
+        if (editor_isOpening())
+        {
+            ImGui::Separator();
+            ImGui::Text("Opening...");
+        }
+
         ImGui::EndMainMenuBar();
     }
 
@@ -84,7 +128,7 @@ void menuBar_updateGUI()
         if (ImGui::Button("Close"))
         {
             ImGui::CloseCurrentPopup();
-            updateNextFrame++;
+            frame_invalidate(FrameReason::UI);
         }
         ImGui::EndPopup();
     }
@@ -0,0 +1,289 @@
+#include "picking.h"
+#include "frame.h"
+#include "globals.h"
+#include "layers.h"
+#include "library.h"
+#include "rendering.h"
+#include "renderList.h"
+#include "shaders.h"
+
+#include <GL/gl3w.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+struct PickShader
+{
+    GLuint program = 0;
+    GLint uniform_worldMtx = 0;
+    GLint uniform_projMtx = 0;
+    GLint uniform_id = 0;
+};
+
+struct PickRequest
+{
+    int viewIndex = -1;
+    bool isRect = false;
+    float x0, y0, x1, y1;
+    int missedFrames = 0;
+};
+
+static PickShader pickShader;
+static GLuint fbo = 0;
+static GLuint idTexture = 0;
+static GLuint depthTexture = 0;
+static int targetWidth = 0;
+static int targetHeight = 0;
+static GLuint pbo = 0;
+static GLsync fence = nullptr;
+
+static PickRequest request;
+static bool hasRequest = false;
+static PickRequest inFlight;
+static int inFlightWidth = 0;
+static int inFlightHeight = 0;
+static bool isInFlight = false;
+static PickResult result;
+static bool hasResult = false;
+
+void picking_initShaders()
+{
+    // Draws the library's meshes, so Position is where theirs is
+    static const char* PICK_ATTRIBUTES[] = { "Position" };
+    pickShader.program = shaders_create(
+        "uniform mat4 WorldMtx;\n"
+        "uniform mat4 ProjMtx;\n"
+        "in vec3 Position;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_Position = ProjMtx * (WorldMtx * vec4(Position.xyz,1));\n"
+        "}\n"
+        ,
+        "uniform uint Id;\n"
+        "out uint Out_Id;\n"
+        "void main()\n"
+        "{\n"
+        "    Out_Id = Id;\n"
+        "}\n",
+        PICK_ATTRIBUTES, 1);
+}
+
+static void initialize()
+{
+    pickShader.uniform_worldMtx = glGetUniformLocation(pickShader.program, "WorldMtx");
+    pickShader.uniform_projMtx = glGetUniformLocation(pickShader.program, "ProjMtx");
+    pickShader.uniform_id = glGetUniformLocation(pickShader.program, "Id");
+
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(1, &idTexture);
+    glGenTextures(1, &depthTexture);
+    glGenBuffers(1, &pbo);
+}
+
+static void resizeTarget(int w, int h)
+{
+    if (w == targetWidth && h == targetHeight) return;
+    targetWidth = w;
+    targetHeight = h;
+
+    glBindTexture(GL_TEXTURE_2D, idTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, w, h, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, w, h, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, idTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+}
+
+void picking_requestPoint(int viewIndex, float x, float y)
+{
+    request = PickRequest();
+    request.viewIndex = viewIndex;
+    request.x0 = request.x1 = x;
+    request.y0 = request.y1 = y;
+    hasRequest = true;
+    frame_invalidate(FrameReason::UI);
+}
+
+void picking_requestRect(int viewIndex, float x0, float y0, float x1, float y1)
+{
+    request = PickRequest();
+    request.viewIndex = viewIndex;
+    request.isRect = true;
+    request.x0 = std::min(x0, x1);
+    request.y0 = std::min(y0, y1);
+    request.x1 = std::max(x0, x1);
+    request.y1 = std::max(y0, y1);
+    hasRequest = true;
+    frame_invalidate(FrameReason::UI);
+}
+
+bool picking_isRequested(int viewIndex)
+{
+    return hasRequest && request.viewIndex == viewIndex;
+}
+
+bool picking_isBusy()
+{
+    return hasRequest || isInFlight;
+}
+
+void picking_render(int viewIndex, const float viewProjMat[4][4], const double eye[3], float x, float y, float w, float h)
+{
+    if (!picking_isRequested(viewIndex) || isInFlight) return;
+    hasRequest = false;
+
+    // Pixels of the view covered by the request, GL has y up
+    auto viewWidth = (int)w;
+    auto viewHeight = (int)h;
+    auto left = std::max(0, (int)std::floor(request.x0 - x));
+    auto top = std::max(0, (int)std::floor(request.y0 - y));
+    auto right = std::min(viewWidth, (int)std::floor(request.x1 - x) + 1);
+    auto bottom = std::min(viewHeight, (int)std::floor(request.y1 - y) + 1);
+    if (left >= right || top >= bottom)
+    {
+        result = PickResult();
+        result.viewIndex = viewIndex;
+        hasResult = true;
+        return;
+    }
+    auto readX = left;
+    auto readY = viewHeight - bottom;
+    auto readWidth = right - left;
+    auto readHeight = bottom - top;
+
+    if (!pickShader.program) initialize();
+    resizeTarget(viewWidth, viewHeight);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, viewWidth, viewHeight);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(readX, readY, readWidth, readHeight);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+
+    // 0 is no entity
+    const GLuint clearId[4] = { 0, 0, 0, 0 };
+    const GLfloat clearDepth = 1.0f;
+    glClearBufferuiv(GL_COLOR, 0, clearId);
+    glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+
+    glUseProgram(pickShader.program);
+    glUniformMatrix4fv(pickShader.uniform_projMtx, 1, GL_FALSE, &viewProjMat[0][0]);
+
+    // Prefab parts pick as their entity. Locked layers are left out, what is
+    // behind them can be picked.
+    const auto& items = renderList_getItems();
+    auto pEyeMatrices = renderList_getEyeMatrices(eye);
+    auto selectableMask = layers_getSelectableMask();
+    for (const auto& batch : renderList_getBatches())
+    {
+        if (!((selectableMask >> batch.layer) & 1)) continue;
+        auto model = library_getModel(batch.modelId);
+        for (int j = 0; j < model.meshCount; ++j)
+        {
+            auto pMesh = model.meshes + j;
+            glBindVertexArray(pMesh->vao);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pMesh->ibo);
+            for (auto i = batch.first; i < batch.first + batch.count; ++i)
+            {
+                float world_matrix[4][4];
+                mat4_store(pEyeMatrices[i], world_matrix);
+                glUniformMatrix4fv(pickShader.uniform_worldMtx, 1, GL_FALSE, &world_matrix[0][0]);
+                glUniform1ui(pickShader.uniform_id, items[i].entity + 1);
+                glDrawElements(GL_TRIANGLES, pMesh->elementCount, pMesh->elementType, (const void*)(uintptr_t)(0));
+            }
+        }
+    }
+
+    // Queue the copy into the PBO, it is mapped next frame
+    auto idSize = (GLsizeiptr)sizeof(GLuint) * readWidth * readHeight;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, idSize + (GLsizeiptr)sizeof(GLfloat), nullptr, GL_STREAM_READ);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(readX, readY, readWidth, readHeight, GL_RED_INTEGER, GL_UNSIGNED_INT, (void*)0);
+    if (!request.isRect)
+    {
+        glReadPixels(readX, readY, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, (void*)(uintptr_t)idSize);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Without sync objects (GL < 3.2) a frame is usually enough anyway
+    if (glFenceSync) fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    inFlight = request;
+    inFlightWidth = readWidth;
+    inFlightHeight = readHeight;
+    isInFlight = true;
+}
+
+static void collect()
+{
+    if (fence)
+    {
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) return;
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    isInFlight = false;
+
+    auto pixelCount = (size_t)inFlightWidth * (size_t)inFlightHeight;
+    auto idSize = sizeof(GLuint) * pixelCount;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    auto pData = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)(idSize + sizeof(GLfloat)), GL_MAP_READ_BIT);
+    if (pData)
+    {
+        result = PickResult();
+        result.viewIndex = inFlight.viewIndex;
+        auto pIds = (const GLuint*)pData;
+        if (inFlight.isRect)
+        {
+            std::vector<uint32_t> ids(pIds, pIds + pixelCount);
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+            for (auto id : ids)
+            {
+                if (id) result.entities.push_back(id - 1);
+            }
+        }
+        else
+        {
+            if (pIds[0]) result.entity = pIds[0] - 1;
+            memcpy(&result.depth, pData + idSize, sizeof(GLfloat));
+        }
+        hasResult = true;
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void picking_update()
+{
+    if (isInFlight) collect();
+
+    // Requests render the frame they are made, or the next one if a readback
+    // was in the way. Drop those whose view didn't render at all.
+    if (hasRequest && request.missedFrames++ > 0 && !isInFlight) hasRequest = false;
+
+    if (picking_isBusy()) frame_invalidate(FrameReason::UI);
+}
+
+bool picking_getResult(int viewIndex, PickResult& out)
+{
+    if (!hasResult || result.viewIndex != viewIndex) return false;
+    out = std::move(result);
+    result = PickResult();
+    hasResult = false;
+    return true;
+}
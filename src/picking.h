@@ -0,0 +1,37 @@
+#ifndef PICKING_H_INCLUDED
+#define PICKING_H_INCLUDED
+
+#include <cinttypes>
+#include <vector>
+
+#define PICK_NONE 0xFFFFFFFF
+
+struct PickResult
+{
+    int viewIndex = -1;
+    uint32_t entity = PICK_NONE; // Point picks, entity index under the cursor
+    float depth = 1.0f; // Point picks, window depth [0, 1] under the cursor
+    std::vector<uint32_t> entities; // Rectangle picks, unique entity indices
+};
+
+// GPU picking. The view that owns a request renders entity IDs into an
+// offscreen R32UI target, the readback goes through a PBO and is collected
+// the next frame so we never wait on the GPU.
+// Coordinates are in screen pixels, like ImGui's mouse position.
+void picking_requestPoint(int viewIndex, float x, float y);
+void picking_requestRect(int viewIndex, float x0, float y0, float x1, float y1);
+bool picking_isRequested(int viewIndex);
+bool picking_isBusy();
+
+// From the view's draw callback, with the view's screen rect. viewProjMat
+// has its eye at the origin, eye is where that is in the world.
+void picking_render(int viewIndex, const float viewProjMat[4][4], const double eye[3], float x, float y, float w, float h);
+
+// Once per frame, before the views update
+void picking_update();
+void picking_initShaders(); // At startup, before shaders_finish
+
+// True once, when the result for that view came back
+bool picking_getResult(int viewIndex, PickResult& result);
+
+#endif
@@ -1,13 +1,271 @@
 #include "globals.h"
+#include "edit.h"
+#include "selection.h"
+#include "transforms.h"
+#include "undo.h"
+#include "vectorMath.h"
+
 #include <imgui.h>
+#include <string.h>
+
+// What the widgets show, from the first selected entity. Kept as is while a
+// widget is being dragged, so Euler angles don't jump between equivalent
+// rotations under the mouse.
+struct PanelValues
+{
+    float position[3];
+    double positionBase[3]; // What position was loaded from, it has the precision
+    float rotation[3]; // Degrees
+    float scale[3];
+    uint32_t id;
+    int parentId;
+};
+
+// The field a widget is dragging, applied to the document every frame and
+// committed as a single edit once released, from what it was before
+struct PropertyDrag
+{
+    EntityField field = EntityField::Position;
+    std::vector<uint32_t> indices;
+    std::vector<uint8_t> before;
+    bool isActive = false;
+};
+
+static PanelValues values;
+static PropertyDrag drag;
+
+static void load(uint32_t index)
+{
+    std::vector<uint8_t> field;
+    entities_getValues(document.entities, EntityField::Position, &index, 1, field);
+    memcpy(values.positionBase, field.data(), sizeof(values.positionBase));
+    for (int k = 0; k < 3; ++k) values.position[k] = (float)values.positionBase[k];
+
+    field.clear();
+    entities_getValues(document.entities, EntityField::Rotation, &index, 1, field);
+    float rotation[4];
+    memcpy(rotation, field.data(), sizeof(rotation));
+    quat_toEuler(rotation, values.rotation);
+
+    field.clear();
+    entities_getValues(document.entities, EntityField::Scale, &index, 1, field);
+    memcpy(values.scale, field.data(), sizeof(values.scale));
+
+    field.clear();
+    entities_getValues(document.entities, EntityField::Id, &index, 1, field);
+    memcpy(&values.id, field.data(), sizeof(values.id));
+
+    field.clear();
+    entities_getValues(document.entities, EntityField::Parent, &index, 1, field);
+    uint32_t parentId;
+    memcpy(&parentId, field.data(), sizeof(parentId));
+    values.parentId = (int)parentId;
+}
+
+static void beginDrag(EntityField field, const std::vector<uint32_t>& indices)
+{
+    drag.field = field;
+    drag.indices = indices;
+    drag.before.clear();
+    entities_getValues(document.entities, field, indices.data(), indices.size(), drag.before);
+    drag.isActive = true;
+}
+
+// Journaled and recorded for undo only here, from the start of the drag
+static void endDrag()
+{
+    if (!drag.isActive) return;
+    drag.isActive = false;
+    std::vector<uint8_t> after;
+    entities_getValues(document.entities, drag.field, drag.indices.data(), drag.indices.size(), after);
+    if (after != drag.before)
+    {
+        auto edit = edit_set(drag.field, drag.indices, after);
+        edit.before = std::move(drag.before);
+        edit_commit(std::move(edit));
+    }
+    drag.indices.clear();
+    drag.before.clear();
+}
+
+static void apply(EntityField field, const std::vector<uint32_t>& indices, const std::vector<uint8_t>& fieldValues)
+{
+    if (drag.isActive && drag.field == field) edit_applyToDocument(edit_set(field, indices, fieldValues), false);
+    else edit_commit(edit_set(field, indices, fieldValues));
+}
+
+// Only the components that changed, the others stay as each entity has them
+static void setPositions(const std::vector<uint32_t>& indices, const float before[3])
+{
+    std::vector<uint8_t> field;
+    entities_getValues(document.entities, EntityField::Position, indices.data(), indices.size(), field);
+    auto pPositions = (double*)field.data();
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            // The widget's change on top of the double, far out a float
+            // can't hold the position itself
+            if (values.position[k] != before[k]) pPositions[i * 3 + k] = values.positionBase[k] + ((double)values.position[k] - (float)values.positionBase[k]);
+        }
+    }
+    apply(EntityField::Position, indices, field);
+}
 
-float pos[3] = { 0, 0, 0 };
-float rot[3] = { 0, 0, 0 };
-float scale[3] = { 1, 1, 1 };
+static void setRotations(const std::vector<uint32_t>& indices, const float before[3])
+{
+    std::vector<uint8_t> field;
+    entities_getValues(document.entities, EntityField::Rotation, indices.data(), indices.size(), field);
+    auto pRotations = (float*)field.data();
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        float degrees[3];
+        quat_toEuler(&pRotations[i * 4], degrees);
+        for (int k = 0; k < 3; ++k)
+        {
+            if (i == 0 || values.rotation[k] != before[k]) degrees[k] = values.rotation[k];
+        }
+        quat_fromEuler(degrees, &pRotations[i * 4]);
+    }
+    apply(EntityField::Rotation, indices, field);
+}
+
+static void setScales(const std::vector<uint32_t>& indices, const float before[3])
+{
+    std::vector<uint8_t> field;
+    entities_getValues(document.entities, EntityField::Scale, indices.data(), indices.size(), field);
+    auto pScales = (float*)field.data();
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            if (values.scale[k] != before[k]) pScales[i * 3 + k] = values.scale[k];
+        }
+    }
+    apply(EntityField::Scale, indices, field);
+}
+
+// Ids for those without one, so they can be parents
+static void assignIds(const std::vector<uint32_t>& indices)
+{
+    std::vector<uint8_t> field;
+    entities_getValues(document.entities, EntityField::Id, indices.data(), indices.size(), field);
+    auto pIds = (uint32_t*)field.data();
+    auto id = transforms_newId();
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        if (pIds[i] == ENTITY_NO_ID) pIds[i] = id++;
+    }
+    edit_commit(edit_set(EntityField::Id, indices, field));
+}
+
+// Those that can't take it, the parent itself or its ancestors, are left out.
+// The others keep where they are in the world, their transform becomes
+// relative to the new parent.
+static void setParents(const std::vector<uint32_t>& indices, uint32_t parentId)
+{
+    auto parentIndex = TRANSFORMS_NONE;
+    if (parentId != ENTITY_NO_ID)
+    {
+        parentIndex = transforms_findId(parentId);
+        if (parentIndex == TRANSFORMS_NONE) return;
+    }
+
+    auto pWorldMatrices = transforms_getWorldMatrices();
+    auto pWorldPositions = transforms_getWorldPositions();
+    auto inverse = mat4_identity();
+    float inverseColumns[4][4];
+    if (parentIndex != TRANSFORMS_NONE && !mat4_inverseAffine(pWorldMatrices[parentIndex], inverse)) return;
+    mat4_store(inverse, inverseColumns);
+
+    std::vector<uint32_t> kept;
+    std::vector<uint8_t> parents, positions, rotations, scales;
+    for (auto index : indices)
+    {
+        if (parentIndex != TRANSFORMS_NONE && !transforms_canParent(index, parentIndex)) continue;
+        kept.push_back(index);
+        parents.insert(parents.end(), (const uint8_t*)&parentId, (const uint8_t*)&parentId + sizeof(parentId));
+
+        // The origin in doubles, like transforms does
+        double delta[3], position[3];
+        for (int k = 0; k < 3; ++k) delta[k] = pWorldPositions[index * 3 + k] - (parentIndex != TRANSFORMS_NONE ? pWorldPositions[parentIndex * 3 + k] : 0.0);
+        for (int k = 0; k < 3; ++k)
+        {
+            position[k] = (double)inverseColumns[0][k] * delta[0] + (double)inverseColumns[1][k] * delta[1] + (double)inverseColumns[2][k] * delta[2];
+        }
+        float rotation[4], scale[3];
+        mat4_decompose(mat4_mul(pWorldMatrices[index], inverse), rotation, scale);
+        positions.insert(positions.end(), (const uint8_t*)position, (const uint8_t*)position + sizeof(position));
+        rotations.insert(rotations.end(), (const uint8_t*)rotation, (const uint8_t*)rotation + sizeof(rotation));
+        scales.insert(scales.end(), (const uint8_t*)scale, (const uint8_t*)scale + sizeof(scale));
+    }
+    if (kept.empty()) return;
+
+    undo_beginStep();
+    edit_commit(edit_set(EntityField::Parent, kept, parents));
+    edit_commit(edit_set(EntityField::Position, kept, positions));
+    edit_commit(edit_set(EntityField::Rotation, kept, rotations));
+    edit_commit(edit_set(EntityField::Scale, kept, scales));
+    undo_endStep();
+}
+
+static void drawTransform()
+{
+    std::vector<uint32_t> indices;
+    selection_getIndices(indices);
+    if (indices.empty())
+    {
+        endDrag();
+        ImGui::TextDisabled("Nothing selected");
+        return;
+    }
+    if (!ImGui::IsAnyItemActive()) load(indices[0]);
+    if (indices.size() > 1) ImGui::Text("%u selected", (unsigned)indices.size());
+
+    // Before is captured as a widget activates, ahead of its first change
+    auto before = values;
+    auto isChanged = ImGui::DragFloat3("Position", values.position, 0.10f);
+    if (ImGui::IsItemActivated()) beginDrag(EntityField::Position, indices);
+    if (isChanged) setPositions(indices, before.position);
+    if (ImGui::IsItemDeactivated()) endDrag();
+    isChanged = ImGui::DragFloat3("Rotation", values.rotation, 1.0f);
+    if (ImGui::IsItemActivated()) beginDrag(EntityField::Rotation, indices);
+    if (isChanged) setRotations(indices, before.rotation);
+    if (ImGui::IsItemDeactivated()) endDrag();
+    isChanged = ImGui::DragFloat3("Scale", values.scale, 0.01f);
+    if (ImGui::IsItemActivated()) beginDrag(EntityField::Scale, indices);
+    if (isChanged) setScales(indices, before.scale);
+    if (ImGui::IsItemDeactivated()) endDrag();
+
+    ImGui::Separator();
+    if (values.id != ENTITY_NO_ID)
+    {
+        ImGui::Text("Id %u", values.id);
+    }
+    else
+    {
+        ImGui::TextDisabled("No id");
+        ImGui::SameLine();
+        if (ImGui::Button("Assign")) assignIds(indices);
+    }
+    if (ImGui::InputInt("Parent", &values.parentId, 0, 0, ImGuiInputTextFlags_EnterReturnsTrue) && values.parentId >= 0)
+    {
+        setParents(indices, (uint32_t)values.parentId);
+    }
+    if (values.parentId > 0 && transforms_findId((uint32_t)values.parentId) == TRANSFORMS_NONE)
+    {
+        ImGui::TextDisabled("No entity with that id");
+    }
+}
 
 void properties_updateGUI()
 {
-    if (!isLeftPanelVisible) return;
+    if (!isLeftPanelVisible)
+    {
+        // Hidden mid drag, what it did is still committed
+        endDrag();
+        return;
+    }
 
     auto totalH = (float)height - 52;
 
@@ -18,9 +276,7 @@ void properties_updateGUI()
             ImGuiWindowFlags_NoMove |
             ImGuiWindowFlags_NoResize |
             ImGuiWindowFlags_NoCollapse);
-        ImGui::DragFloat3("Position", pos, 0.10f);
-        ImGui::DragFloat3("Rotation", rot, 1.0f);
-        ImGui::DragFloat3("Scale", scale, 0.01f);
+        drawTransform();
         ImGui::End();
     }
 
@@ -0,0 +1,165 @@
+#include "raycast.h"
+#include "bvh.h"
+#include "globals.h"
+#include "jobs.h"
+#include "layers.h"
+#include "library.h"
+#include "renderList.h"
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+#define RAYCAST_PACKETS_PER_JOB 64
+
+// A model placed by an entity or by a part of its prefab, rays are brought
+// into the model's space
+struct RaycastInstance
+{
+    mat4 worldToModel;
+    const MeshBvh* pMesh;
+    uint32_t entity;
+    uint8_t layer;
+};
+
+static Bvh instanceBvh;
+static std::vector<RaycastInstance> instances;
+static uint64_t entitiesRevision = 0;
+static uint64_t libraryResidency = 0;
+static bool isBuilt = false;
+
+static void update()
+{
+    auto newEntitiesRevision = entities_getRevision(document.entities);
+    auto newLibraryResidency = library_getResidency();
+    if (isBuilt && newEntitiesRevision == entitiesRevision && newLibraryResidency == libraryResidency) return;
+    entitiesRevision = newEntitiesRevision;
+    libraryResidency = newLibraryResidency;
+    isBuilt = true;
+
+    // From the render list, so prefab parts are hit as their entity. Hidden
+    // layers stay in, they are skipped while tracing so toggling them is free.
+    instances.clear();
+    std::vector<float> bounds;
+    std::vector<float> batchBounds;
+    // Rays are in float world space, so are the matrices
+    const double worldOrigin[3] = { 0.0, 0.0, 0.0 };
+    const auto& items = renderList_getItems();
+    auto pWorldMatrices = renderList_getEyeMatrices(worldOrigin);
+    for (const auto& batch : renderList_getBatches())
+    {
+        auto pMesh = library_getModel(batch.modelId).pBvh;
+        if (!pMesh || pMesh->bvh.nodes.empty()) continue;
+        const auto& root = pMesh->bvh.nodes[0];
+        float modelBounds[6];
+        memcpy(modelBounds, root.min, sizeof(float) * 3);
+        memcpy(modelBounds + 3, root.max, sizeof(float) * 3);
+        batchBounds.resize(batch.count * 6);
+        vectorMath_transformAabbsEach(&pWorldMatrices[batch.first], modelBounds, 0, batchBounds.data(), batch.count);
+        for (uint32_t j = 0; j < batch.count; ++j)
+        {
+            // Flattened by a zero scale, nothing to hit
+            auto i = batch.first + j;
+            RaycastInstance instance;
+            if (!mat4_inverseAffine(pWorldMatrices[i], instance.worldToModel)) continue;
+            instance.pMesh = pMesh;
+            instance.entity = items[i].entity;
+            instance.layer = batch.layer;
+            bounds.insert(bounds.end(), &batchBounds[j * 6], &batchBounds[j * 6] + 6);
+            instances.push_back(instance);
+        }
+    }
+    bvh_build(instanceBvh, bounds.data(), instances.size());
+}
+
+uint32_t raycast_cast(const float origin[3], const float dir[3], float* pT, uint32_t ignore)
+{
+    update();
+
+    auto hit = (uint32_t)RAYCAST_NONE;
+    auto visibleMask = layers_getVisibleMask();
+    bvh_traverse(instanceBvh, origin, dir, pT, [&](uint32_t primitive)
+    {
+        const auto& instance = instances[primitive];
+        if (instance.entity == ignore || !((visibleMask >> instance.layer) & 1)) return;
+
+        // Not normalized, so t stays the same along both rays
+        float localOrigin[4], localDir[4];
+        float4_store(localOrigin, mat4_transformPoint(instance.worldToModel, float4_set(origin[0], origin[1], origin[2], 1.0f)));
+        float4_store(localDir, mat4_transformVector(instance.worldToModel, float4_set(dir[0], dir[1], dir[2], 0.0f)));
+        if (bvh_intersectMesh(*instance.pMesh, localOrigin, localDir, pT) != BVH_NONE) hit = instance.entity;
+    });
+    return hit;
+}
+
+static void castPacket(RaycastRay* pRays, size_t count, uint64_t visibleMask)
+{
+    BvhRay4 rays;
+    auto mask = 0;
+    for (int k = 0; k < 4; ++k)
+    {
+        // Unused lanes get a harmless ray, they are masked out anyway
+        const auto& ray = pRays[k < (int)count ? k : 0];
+        for (int a = 0; a < 3; ++a)
+        {
+            rays.origin[a][k] = ray.origin[a];
+            rays.dir[a][k] = ray.dir[a];
+        }
+        rays.t[k] = ray.t;
+        rays.hit[k] = RAYCAST_NONE;
+        if (k < (int)count) mask |= 1 << k;
+    }
+
+    bvh_traverse4(instanceBvh, rays, mask, [&](uint32_t primitive, int primitiveMask)
+    {
+        const auto& instance = instances[primitive];
+        if (!((visibleMask >> instance.layer) & 1)) return;
+        for (int k = 0; k < 4; ++k)
+        {
+            if ((primitiveMask & (1 << k)) && pRays[k].ignore == instance.entity) primitiveMask &= ~(1 << k);
+        }
+        if (!primitiveMask) return;
+
+        auto local = rays;
+        for (int k = 0; k < 4; ++k)
+        {
+            float origin[4], dir[4];
+            float4_store(origin, mat4_transformPoint(instance.worldToModel, float4_set(rays.origin[0][k], rays.origin[1][k], rays.origin[2][k], 1.0f)));
+            float4_store(dir, mat4_transformVector(instance.worldToModel, float4_set(rays.dir[0][k], rays.dir[1][k], rays.dir[2][k], 0.0f)));
+            for (int a = 0; a < 3; ++a)
+            {
+                local.origin[a][k] = origin[a];
+                local.dir[a][k] = dir[a];
+            }
+            local.hit[k] = BVH_NONE;
+        }
+        bvh_intersectMesh4(*instance.pMesh, local, primitiveMask);
+        for (int k = 0; k < 4; ++k)
+        {
+            if (local.hit[k] == BVH_NONE) continue;
+            rays.t[k] = local.t[k];
+            rays.hit[k] = instance.entity;
+        }
+    });
+
+    for (size_t k = 0; k < count; ++k)
+    {
+        pRays[k].t = rays.t[k];
+        pRays[k].entity = rays.hit[k];
+    }
+}
+
+void raycast_castBatch(RaycastRay* pRays, size_t count)
+{
+    update();
+
+    auto packetCount = (count + 3) / 4;
+    auto visibleMask = layers_getVisibleMask();
+    jobs_parallelFor(packetCount, RAYCAST_PACKETS_PER_JOB, [&](size_t begin, size_t end)
+    {
+        for (auto p = begin; p < end; ++p)
+        {
+            castPacket(pRays + p * 4, std::min(count - p * 4, (size_t)4), visibleMask);
+        }
+    });
+}
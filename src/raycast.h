@@ -0,0 +1,28 @@
+#ifndef RAYCAST_H_INCLUDED
+#define RAYCAST_H_INCLUDED
+
+#include <cinttypes>
+#include <cstddef>
+
+#define RAYCAST_NONE 0xFFFFFFFF
+
+struct RaycastRay
+{
+    float origin[3];
+    float dir[3];
+    float t; // In: max distance, out: distance to the hit
+    uint32_t ignore = RAYCAST_NONE; // Entity to go through, like the one being placed
+    uint32_t entity = RAYCAST_NONE; // Out: entity hit
+};
+
+// Rays against the triangles of the document's entities. Each model keeps a
+// BVH of its triangles, the entities go in a second BVH over their world
+// bounds that is rebuilt by the next query after the entities or the library
+// changed. Entities on hidden layers are gone through.
+// Returns the entity hit closer than *pT, and shortens *pT to the hit.
+uint32_t raycast_cast(const float origin[3], const float dir[3], float* pT, uint32_t ignore = RAYCAST_NONE);
+
+// Many rays at once, traced by packets of 4 on the job threads
+void raycast_castBatch(RaycastRay* pRays, size_t count);
+
+#endif
@@ -0,0 +1,151 @@
+#include "renderList.h"
+#include "globals.h"
+#include "jobs.h"
+#include "library.h"
+#include "transforms.h"
+
+#include <string.h>
+#include <unordered_map>
+
+#define RENDERLIST_JOB_SIZE 4096 // Items per job
+
+static std::vector<RenderItem> items;
+static std::vector<RenderBatch> batches;
+static std::vector<mat4> matrices; // Per item, translation from its origin
+static std::vector<double> origins; // Per item, xyz of the entity
+static std::vector<mat4> eyeMatrices;
+static double eye[3] = { 0.0, 0.0, 0.0 };
+static bool isEyeBuilt = false;
+static uint64_t entitiesRevision = 0;
+static uint64_t libraryResidency = 0;
+static bool isBuilt = false;
+
+static void update()
+{
+    auto newEntitiesRevision = entities_getRevision(document.entities);
+    auto newLibraryResidency = library_getResidency();
+    if (isBuilt && newEntitiesRevision == entitiesRevision && newLibraryResidency == libraryResidency) return;
+    entitiesRevision = newEntitiesRevision;
+    libraryResidency = newLibraryResidency;
+    isBuilt = true;
+    isEyeBuilt = false;
+
+    // Counted per batch first, then placed, so it's grouped without a sort
+    batches.clear();
+    std::unordered_map<uint64_t, uint32_t> batchIndices[ENTITY_MAX_LAYERS];
+    auto addToBatch = [&](uint64_t modelId, uint8_t layer)
+    {
+        auto& layerBatchIndices = batchIndices[layer];
+        auto it = layerBatchIndices.find(modelId);
+        if (it == layerBatchIndices.end())
+        {
+            if (library_getModel(modelId).meshCount == 0) return;
+            it = layerBatchIndices.insert({ modelId, (uint32_t)batches.size() }).first;
+            batches.push_back({ modelId, 0, 0, layer });
+        }
+        ++batches[it->second].count;
+    };
+
+    const auto& entities = document.entities;
+    auto chunkCount = entities_getChunkCount(entities);
+    for (size_t c = 0; c < chunkCount; ++c)
+    {
+        const auto& chunk = entities_getChunk(entities, c);
+        for (uint32_t i = 0; i < chunk.count; ++i)
+        {
+            if (chunk.flags[i] & ENTITY_FLAG_RAW) continue;
+            auto pPrefab = library_getPrefab(chunk.modelIds[i]);
+            if (!pPrefab)
+            {
+                addToBatch(chunk.modelIds[i], chunk.layers[i]);
+                continue;
+            }
+            for (const auto& part : pPrefab->parts) addToBatch(part.modelId, chunk.layers[i]);
+        }
+    }
+
+    uint32_t first = 0;
+    for (auto& batch : batches)
+    {
+        batch.first = first;
+        first += batch.count;
+        batch.count = 0;
+    }
+    items.resize(first);
+    matrices.resize(first);
+    origins.resize(first * 3);
+
+    auto pWorldMatrices = transforms_getWorldMatrices();
+    auto pWorldPositions = transforms_getWorldPositions();
+    auto add = [&](uint64_t modelId, uint8_t layer, const mat4& world, uint32_t entity)
+    {
+        auto it = batchIndices[layer].find(modelId);
+        if (it == batchIndices[layer].end()) return;
+        auto& batch = batches[it->second];
+        auto itemIndex = batch.first + batch.count++;
+        auto& item = items[itemIndex];
+        item.modelId = modelId;
+        item.entity = entity;
+        matrices[itemIndex] = world;
+        memcpy(&origins[itemIndex * 3], &pWorldPositions[entity * 3], sizeof(double) * 3);
+    };
+    uint32_t index = 0;
+    for (size_t c = 0; c < chunkCount; ++c)
+    {
+        const auto& chunk = entities_getChunk(entities, c);
+        for (uint32_t i = 0; i < chunk.count; ++i, ++index)
+        {
+            if (chunk.flags[i] & ENTITY_FLAG_RAW) continue;
+
+            // The translation is in the double origin
+            auto world = pWorldMatrices[index];
+            world.cols[3] = float4_set(0.0f, 0.0f, 0.0f, 1.0f);
+            auto pPrefab = library_getPrefab(chunk.modelIds[i]);
+            if (!pPrefab)
+            {
+                add(chunk.modelIds[i], chunk.layers[i], world, index);
+                continue;
+            }
+            for (const auto& part : pPrefab->parts) add(part.modelId, chunk.layers[i], mat4_mul(part.local, world), index);
+        }
+    }
+}
+
+const std::vector<RenderItem>& renderList_getItems()
+{
+    update();
+    return items;
+}
+
+const std::vector<RenderBatch>& renderList_getBatches()
+{
+    update();
+    return batches;
+}
+
+const mat4* renderList_getEyeMatrices(const double newEye[3])
+{
+    update();
+    if (isEyeBuilt && !memcmp(eye, newEye, sizeof(eye))) return eyeMatrices.data();
+    memcpy(eye, newEye, sizeof(eye));
+    isEyeBuilt = true;
+
+    eyeMatrices.resize(matrices.size());
+    jobs_parallelFor(matrices.size(), RENDERLIST_JOB_SIZE, [](size_t begin, size_t end)
+    {
+        vectorMath_relativeMatrices(&matrices[begin], &origins[begin * 3], eye, &eyeMatrices[begin], end - begin);
+    });
+    return eyeMatrices.data();
+}
+
+void renderList_getEyeBounds(const double newEye[3], std::vector<float>& out)
+{
+    auto pMatrices = renderList_getEyeMatrices(newEye);
+    out.resize(items.size() * 6);
+    for (const auto& batch : batches)
+    {
+        auto model = library_getModel(batch.modelId);
+        const float modelBounds[6] = { model.min[0], model.min[1], model.min[2], model.max[0], model.max[1], model.max[2] };
+        vectorMath_transformAabbsEach(pMatrices + batch.first, modelBounds, 0, &out[batch.first * 6], batch.count);
+    }
+}
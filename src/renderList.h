@@ -0,0 +1,43 @@
+#ifndef RENDERLIST_H_INCLUDED
+#define RENDERLIST_H_INCLUDED
+
+#include "vectorMath.h"
+
+#include <cinttypes>
+#include <vector>
+
+// One model to draw, an entity or a part of a prefab entity
+struct RenderItem
+{
+    uint64_t modelId;
+    uint32_t entity;
+};
+
+// Consecutive items of the same model and layer
+struct RenderBatch
+{
+    uint64_t modelId;
+    uint32_t first;
+    uint32_t count;
+    uint8_t layer;
+};
+
+// What the document looks like as models, prefabs expanded into their
+// parts so the document only holds one entity per placement. Items are
+// grouped by layer and model, hiding a layer skips its batches without
+// touching their items. Rebuilt by the next call after the entities or the
+// library changed, main thread only.
+const std::vector<RenderItem>& renderList_getItems();
+const std::vector<RenderBatch>& renderList_getBatches();
+
+// World matrices of the items with their translation from eye, for a view
+// matrix with its eye at the origin. Kept apart from the items' double
+// origins until then, so models far from the world origin don't jitter.
+// Computed again when eye or the list changed.
+const mat4* renderList_getEyeMatrices(const double eye[3]);
+
+// Per item, min xyz then max xyz around its model's bounds, in the space of
+// renderList_getEyeMatrices
+void renderList_getEyeBounds(const double eye[3], std::vector<float>& out);
+
+#endif
@@ -1,11 +1,5 @@
 #include "rendering.h"
 
-#include <imgui.h>
-#include <tinyfiledialogs.h>
-
-#include <stdio.h>
-#include <string>
-
 void saveGLStates(GLStates* pStates)
 {
     glGetIntegerv(GL_ACTIVE_TEXTURE, (GLint*)&pStates->last_active_texture);
@@ -54,63 +48,3 @@ void restoreGLStates(GLStates* pStates)
     glViewport(pStates->last_viewport[0], pStates->last_viewport[1], (GLsizei)pStates->last_viewport[2], (GLsizei)pStates->last_viewport[3]);
     glScissor(pStates->last_scissor_box[0], pStates->last_scissor_box[1], (GLsizei)pStates->last_scissor_box[2], (GLsizei)pStates->last_scissor_box[3]);
 }
-
-static bool CheckShader(GLuint handle, const char* desc)
-{
-    GLint status = 0, log_length = 0;
-    glGetShaderiv(handle, GL_COMPILE_STATUS, &status);
-    glGetShaderiv(handle, GL_INFO_LOG_LENGTH, &log_length);
-    if (status == GL_FALSE)
-        fprintf(stderr, "ERROR: view.cpp: failed to compile %s!\n", desc);
-    if (log_length > 0)
-    {
-        ImVector<char> buf;
-        buf.resize((int)(log_length + 1));
-        glGetShaderInfoLog(handle, log_length, NULL, (GLchar*)buf.begin());
-        fprintf(stderr, "%s\n", buf.begin());
-        tinyfd_messageBox("Check Shader", (std::string("Failed to build shader") + buf.begin()).c_str(), "ok", "error", 0);
-    }
-    return status == GL_TRUE;
-}
-
-static bool CheckProgram(GLuint handle, const char* desc)
-{
-    GLint status = 0, log_length = 0;
-    glGetProgramiv(handle, GL_LINK_STATUS, &status);
-    glGetProgramiv(handle, GL_INFO_LOG_LENGTH, &log_length);
-    if (status == GL_FALSE)
-        fprintf(stderr, "ERROR: view.cpp: failed to link %s!\n", desc);
-    if (log_length > 0)
-    {
-        ImVector<char> buf;
-        buf.resize((int)(log_length + 1));
-        glGetProgramInfoLog(handle, log_length, NULL, (GLchar*)buf.begin());
-        fprintf(stderr, "%s\n", buf.begin());
-        tinyfd_messageBox("Check Program", (std::string("Failed to build shader") + buf.begin()).c_str(), "ok", "error", 0);
-    }
-    return status == GL_TRUE;
-}
-
-GLuint createShaderProgram(const GLchar* vs, const GLchar* ps)
-{
-    // Create shaders
-    const GLchar* vertex_shader_with_version[2] = { "#version 130\n", vs };
-    auto vertHandle = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertHandle, 2, vertex_shader_with_version, NULL);
-    glCompileShader(vertHandle);
-    CheckShader(vertHandle, "vertex shader");
-
-    const GLchar* fragment_shader_with_version[2] = { "#version 130\n", ps };
-    auto fragHandle = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragHandle, 2, fragment_shader_with_version, NULL);
-    glCompileShader(fragHandle);
-    CheckShader(fragHandle, "fragment shader");
-
-    GLuint program = glCreateProgram();
-    glAttachShader(program, vertHandle);
-    glAttachShader(program, fragHandle);
-    glLinkProgram(program);
-    CheckProgram(program, "shader program");
-
-    return program;
-}
@@ -30,6 +30,5 @@ struct GLStates
 
 void saveGLStates(GLStates* pStates);
 void restoreGLStates(GLStates* pStates);
-GLuint createShaderProgram(const GLchar* vs, const GLchar* ps);
 
 #endif
@@ -0,0 +1,130 @@
+#include "saveQueue.h"
+#include "frame.h"
+#include "globals.h"
+#include "mapFile.h"
+#include "journal.h"
+
+#include <tinyfiledialogs.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+struct SaveJob
+{
+    std::string filename;
+    Json::Value json;
+    Entities entities;
+    JournalMark journalMark;
+    bool succeeded = false;
+    std::string error;
+};
+
+static std::thread worker;
+static SaveJob job;
+static std::atomic<bool> isRunning(false);
+static std::atomic<bool> isDone(false);
+static std::atomic<float> progress(0.0f);
+static bool hasPending = false;
+static SaveJob pending;
+
+static void run()
+{
+    job.succeeded = mapFile_save(job.filename, job.json, job.entities, job.error, &progress);
+    isDone = true;
+    frame_invalidate(FrameReason::JobProgress);
+}
+
+// Taken when the save is asked for, so a save waiting on another one still
+// writes the document as it was then, even if another map is opened
+// meanwhile. Entities are shared until edited so this doesn't copy the map.
+static void snapshot(SaveJob& out, const std::string& filename)
+{
+    out = SaveJob();
+    out.filename = filename;
+    out.journalMark = journal_mark();
+    out.json = document.json;
+    out.entities = document.entities;
+    document.dirty = false;
+}
+
+static void start()
+{
+    progress = 0.0f;
+    isDone = false;
+    isRunning = true;
+    worker = std::thread(run);
+}
+
+static void finish()
+{
+    worker.join();
+    isRunning = false;
+
+    if (!job.succeeded)
+    {
+        // Still not on disk
+        if (job.filename == document.filename) document.dirty = true;
+        journal_holdCompaction();
+        tinyfd_messageBox("Save", job.error.c_str(), "ok", "error", 0);
+    }
+    else
+    {
+        // What the journal had up to the snapshot is now in the map
+        journal_compact(job.filename, job.journalMark);
+    }
+    job = SaveJob();
+    frame_invalidate(FrameReason::UI);
+}
+
+static void startPending()
+{
+    hasPending = false;
+    job = std::move(pending);
+    pending = SaveJob();
+    start();
+}
+
+void saveQueue_push(const std::string& filename)
+{
+    if (isRunning)
+    {
+        // Replaces the one already waiting, if any
+        snapshot(pending, filename);
+        hasPending = true;
+        return;
+    }
+    snapshot(job, filename);
+    start();
+}
+
+void saveQueue_update()
+{
+    if (!isRunning) return;
+
+    // Keep drawing so the progress shows
+    frame_invalidate(FrameReason::JobProgress);
+
+    if (!isDone) return;
+    finish();
+    if (hasPending) startPending();
+}
+
+void saveQueue_wait()
+{
+    while (isRunning)
+    {
+        finish();
+        if (hasPending) startPending();
+    }
+}
+
+bool saveQueue_isBusy()
+{
+    return isRunning;
+}
+
+float saveQueue_getProgress()
+{
+    return progress;
+}
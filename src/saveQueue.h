@@ -0,0 +1,16 @@
+#ifndef SAVEQUEUE_H_INCLUDED
+#define SAVEQUEUE_H_INCLUDED
+
+#include <string>
+
+// Saves a snapshot of the document on a background thread. Saving again
+// while a save is running coalesces into a single pending save of the
+// latest snapshot, started once the current one is done. Snapshots are
+// taken when pushed, so opening another map doesn't change what's written.
+void saveQueue_push(const std::string& filename);
+void saveQueue_update(); // Call once per frame on the main thread
+void saveQueue_wait(); // Blocks until everything is written
+bool saveQueue_isBusy();
+float saveQueue_getProgress();
+
+#endif
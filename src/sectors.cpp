@@ -0,0 +1,278 @@
+#include "sectors.h"
+#include "globals.h"
+#include "library.h"
+#include "transforms.h"
+#include "view.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <string.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#define SECTORS_MAX_COORD 1000000000.0 // Sectors away, positions further out are clamped
+#define SECTORS_NONE 0xffffffff
+
+struct Sector
+{
+    int32_t coords[2];
+    std::vector<uint64_t> modelIds; // Prefabs are expanded to their parts
+    std::unordered_map<uint64_t, uint32_t> entityModels; // Model id of its entities, to how many use it
+    bool isActive;
+};
+
+static std::vector<Sector> sectors; // Emptied ones stay, until the next rebuild
+static std::unordered_map<uint64_t, uint32_t> sectorIndices; // By key
+static std::vector<uint32_t> entitySectors; // Per entity, SECTORS_NONE for raw ones
+static std::vector<uint64_t> entityModelIds; // Per entity, as counted in its sector
+static std::vector<uint32_t> dirty; // Entities edited since the last update
+static std::vector<ViewFocus> foci; // As last streamed for
+static uint64_t entitiesRevision = 0;
+static uint64_t libraryLoadCount = 0;
+static bool isBuilt = false;
+
+static uint64_t getKey(int32_t x, int32_t y)
+{
+    return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+}
+
+static int32_t getCoord(double position)
+{
+    auto coord = std::floor(position / SECTORS_SIZE);
+    return (int32_t)std::max(-SECTORS_MAX_COORD, std::min(SECTORS_MAX_COORD, coord));
+}
+
+// Counts the entity in the sector at its world position
+static void addEntity(uint32_t index, uint64_t modelId, const double* pWorldPositions)
+{
+    auto x = getCoord(pWorldPositions[index * 3 + 0]);
+    auto y = getCoord(pWorldPositions[index * 3 + 1]);
+    auto key = getKey(x, y);
+    auto it = sectorIndices.find(key);
+    if (it == sectorIndices.end())
+    {
+        it = sectorIndices.insert({ key, (uint32_t)sectors.size() }).first;
+        Sector sector;
+        sector.coords[0] = x;
+        sector.coords[1] = y;
+        sector.isActive = false;
+        sectors.push_back(std::move(sector));
+    }
+    ++sectors[it->second].entityModels[modelId];
+    entitySectors[index] = it->second;
+    entityModelIds[index] = modelId;
+}
+
+static void removeEntity(uint32_t index)
+{
+    auto s = entitySectors[index];
+    if (s == SECTORS_NONE) return;
+    auto& entityModels = sectors[s].entityModels;
+    auto it = entityModels.find(entityModelIds[index]);
+    if (--it->second == 0) entityModels.erase(it);
+    entitySectors[index] = SECTORS_NONE;
+}
+
+// From the entities' model ids to the models to stream
+static void updateModelIds(Sector& sector)
+{
+    auto& modelIds = sector.modelIds;
+    modelIds.clear();
+    for (const auto& kv : sector.entityModels)
+    {
+        auto pPrefab = library_getPrefab(kv.first);
+        if (!pPrefab)
+        {
+            modelIds.push_back(kv.first);
+            continue;
+        }
+        for (const auto& part : pPrefab->parts)
+        {
+            modelIds.push_back(part.modelId);
+        }
+    }
+    std::sort(modelIds.begin(), modelIds.end());
+    modelIds.erase(std::unique(modelIds.begin(), modelIds.end()), modelIds.end());
+}
+
+static void rebuild()
+{
+    // Those streamed in stay so, by their coordinates
+    std::unordered_set<uint64_t> activeKeys;
+    for (const auto& sector : sectors)
+    {
+        if (sector.isActive) activeKeys.insert(getKey(sector.coords[0], sector.coords[1]));
+    }
+
+    sectors.clear();
+    sectorIndices.clear();
+    dirty.clear();
+    auto pWorldPositions = transforms_getWorldPositions();
+    const auto& entities = document.entities;
+    entitySectors.assign(entities_count(entities), SECTORS_NONE);
+    entityModelIds.assign(entities_count(entities), 0);
+    auto chunkCount = entities_getChunkCount(entities);
+    uint32_t index = 0;
+    for (size_t c = 0; c < chunkCount; ++c)
+    {
+        const auto& chunk = entities_getChunk(entities, c);
+        for (uint32_t i = 0; i < chunk.count; ++i, ++index)
+        {
+            if (chunk.flags[i] & ENTITY_FLAG_RAW) continue;
+            addEntity(index, chunk.modelIds[i], pWorldPositions);
+        }
+    }
+
+    for (auto& sector : sectors)
+    {
+        sector.isActive = activeKeys.count(getKey(sector.coords[0], sector.coords[1])) != 0;
+        updateModelIds(sector);
+    }
+}
+
+// The edited entities and their descendants, which moved with them, are
+// taken out of their sectors and counted again where they are now
+static void updateDirty()
+{
+    std::vector<uint32_t> indices;
+    transforms_getDescendants(dirty, indices);
+    dirty.clear();
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+    std::vector<uint8_t> flags, modelIds;
+    entities_getValues(document.entities, EntityField::Flags, indices.data(), indices.size(), flags);
+    entities_getValues(document.entities, EntityField::ModelId, indices.data(), indices.size(), modelIds);
+
+    std::vector<uint32_t> touched;
+    auto pWorldPositions = transforms_getWorldPositions();
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        auto index = indices[i];
+        if (entitySectors[index] != SECTORS_NONE) touched.push_back(entitySectors[index]);
+        removeEntity(index);
+        if (flags[i] & ENTITY_FLAG_RAW) continue;
+        uint64_t modelId;
+        memcpy(&modelId, &modelIds[i * sizeof(uint64_t)], sizeof(uint64_t));
+        addEntity(index, modelId, pWorldPositions);
+        touched.push_back(entitySectors[index]);
+    }
+
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    for (auto s : touched)
+    {
+        updateModelIds(sectors[s]);
+    }
+}
+
+// From the edge of what the view shows to the sector, along x and y
+static float getDistance(const Sector& sector, const ViewFocus& focus)
+{
+    double distanceSq = 0.0;
+    for (int k = 0; k < 2; ++k)
+    {
+        auto min = sector.coords[k] * SECTORS_SIZE;
+        auto max = min + SECTORS_SIZE;
+        auto d = std::max(0.0, std::max(min - focus.center[k], focus.center[k] - max));
+        distanceSq += d * d;
+    }
+    return std::max(0.0f, (float)std::sqrt(distanceSq) - focus.radius);
+}
+
+// Sectors come in closer than SECTORS_LOAD_DISTANCE and only go out past
+// SECTORS_UNLOAD_DISTANCE, so a view moving along a border doesn't make them
+// flicker in and out
+static void stream()
+{
+    std::unordered_map<uint64_t, float> wanted; // Model id, distance
+    for (auto& sector : sectors)
+    {
+        auto distance = FLT_MAX;
+        for (const auto& focus : foci)
+        {
+            distance = std::min(distance, getDistance(sector, focus));
+        }
+        if (distance <= SECTORS_LOAD_DISTANCE) sector.isActive = true;
+        else if (distance > SECTORS_UNLOAD_DISTANCE) sector.isActive = false;
+        if (!sector.isActive) continue;
+
+        for (auto modelId : sector.modelIds)
+        {
+            auto it = wanted.find(modelId);
+            if (it == wanted.end()) wanted.insert({ modelId, distance });
+            else it->second = std::min(it->second, distance);
+        }
+    }
+
+    std::vector<uint64_t> modelIds;
+    std::vector<float> distances;
+    modelIds.reserve(wanted.size());
+    distances.reserve(wanted.size());
+    for (const auto& kv : wanted)
+    {
+        modelIds.push_back(kv.first);
+        distances.push_back(kv.second);
+    }
+    library_setWanted(modelIds.data(), distances.data(), modelIds.size());
+}
+
+void sectors_update()
+{
+    auto isDirty = false;
+    auto newEntitiesRevision = entities_getRevision(document.entities);
+    auto newLibraryLoadCount = library_getLoadCount();
+    if (!isBuilt || newEntitiesRevision != entitiesRevision || newLibraryLoadCount != libraryLoadCount)
+    {
+        rebuild();
+        entitiesRevision = newEntitiesRevision;
+        libraryLoadCount = newLibraryLoadCount;
+        isBuilt = true;
+        isDirty = true;
+    }
+    else if (!dirty.empty())
+    {
+        updateDirty();
+        isDirty = true;
+    }
+
+    // Only again once a view moved
+    std::vector<ViewFocus> newFoci;
+    view_getFoci(newFoci);
+    if (!isDirty && newFoci.size() == foci.size() &&
+        (foci.empty() || !memcmp(newFoci.data(), foci.data(), sizeof(ViewFocus) * foci.size()))) return;
+    foci.swap(newFoci);
+    stream();
+}
+
+size_t sectors_getCount()
+{
+    return (size_t)std::count_if(sectors.begin(), sectors.end(), [](const Sector& sector) { return !sector.entityModels.empty(); });
+}
+
+size_t sectors_getActiveCount()
+{
+    return (size_t)std::count_if(sectors.begin(), sectors.end(), [](const Sector& sector) { return sector.isActive; });
+}
+
+void sectors_beforeEdit(const Edit& edit)
+{
+    if (!isBuilt) return;
+    if (edit.type != EditType::Set || edit.field == EntityField::Id || entitiesRevision != entities_getRevision(document.entities))
+    {
+        // Indices shift or parents change everywhere, start over
+        isBuilt = false;
+    }
+}
+
+void sectors_afterEdit(const Edit& edit)
+{
+    if (!isBuilt) return;
+    if (edit.field != EntityField::Extras && edit.field != EntityField::Layer)
+    {
+        dirty.insert(dirty.end(), edit.indices.begin(), edit.indices.end());
+    }
+    entitiesRevision = entities_getRevision(document.entities);
+}
@@ -0,0 +1,24 @@
+#ifndef SECTORS_H_INCLUDED
+#define SECTORS_H_INCLUDED
+
+#include "edit.h"
+
+#include <cstddef>
+
+#define SECTORS_SIZE 256.0 // Meters along x and y
+#define SECTORS_LOAD_DISTANCE 512.0f // Meters from a view, a sector closer than that streams in
+#define SECTORS_UNLOAD_DISTANCE 768.0f // And only out again past this one
+
+// The map split along x and y on a grid of fixed size sectors, each with the
+// models its entities need. The sectors around the views ask the library for
+// their models, entities stay loaded.
+void sectors_update(); // Once per frame, before drawing
+size_t sectors_getCount(); // Those with entities
+size_t sectors_getActiveCount(); // Those streamed in
+
+// Called by edit_applyToDocument, so a move only updates the entities it
+// moved instead of all of them
+void sectors_beforeEdit(const Edit& edit);
+void sectors_afterEdit(const Edit& edit);
+
+#endif
@@ -0,0 +1,91 @@
+#include "selection.h"
+
+static std::vector<uint64_t> bits;
+static size_t selectedCount = 0;
+static uint64_t revision = 0;
+
+void selection_clear()
+{
+    if (selectedCount) ++revision;
+    bits.clear();
+    selectedCount = 0;
+}
+
+void selection_set(uint32_t index, bool selected)
+{
+    auto word = index / 64;
+    auto mask = (uint64_t)1 << (index % 64);
+    if (word >= bits.size())
+    {
+        if (!selected) return;
+        bits.resize(word + 1, 0);
+    }
+    if (((bits[word] & mask) != 0) == selected) return;
+    bits[word] ^= mask;
+    ++revision;
+    if (selected) ++selectedCount;
+    else --selectedCount;
+}
+
+void selection_toggle(uint32_t index)
+{
+    selection_set(index, !selection_isSelected(index));
+}
+
+bool selection_isSelected(uint32_t index)
+{
+    auto word = index / 64;
+    return word < bits.size() && (bits[word] & ((uint64_t)1 << (index % 64)));
+}
+
+size_t selection_count()
+{
+    return selectedCount;
+}
+
+void selection_getIndices(std::vector<uint32_t>& out)
+{
+    out.clear();
+    out.reserve(selectedCount);
+    for (size_t word = 0; word < bits.size(); ++word)
+    {
+        auto value = bits[word];
+        while (value)
+        {
+            auto bit = 0;
+            while (!(value & ((uint64_t)1 << bit))) ++bit;
+            out.push_back((uint32_t)(word * 64 + bit));
+            value &= value - 1;
+        }
+    }
+}
+
+uint64_t selection_getRevision()
+{
+    return revision;
+}
+
+// Rebuilds from the selected indices, remapped
+static void remap(uint32_t from, int64_t offset, uint32_t eraseEnd)
+{
+    std::vector<uint32_t> indices;
+    selection_getIndices(indices);
+    selection_clear();
+    for (auto index : indices)
+    {
+        if (index < from) selection_set(index, true);
+        else if (index >= eraseEnd) selection_set((uint32_t)((int64_t)index + offset), true);
+    }
+}
+
+void selection_onInsert(uint32_t at, uint32_t count)
+{
+    if (!selectedCount || !count) return;
+    remap(at, count, at);
+}
+
+void selection_onErase(uint32_t first, uint32_t count)
+{
+    if (!selectedCount || !count) return;
+    remap(first, -(int64_t)count, first + count);
+}
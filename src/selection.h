@@ -0,0 +1,21 @@
+#ifndef SELECTION_H_INCLUDED
+#define SELECTION_H_INCLUDED
+
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+// Selected entities, one bit per entity index. Edits that insert or erase
+// entities shift it so it keeps pointing at the same entities.
+void selection_clear();
+void selection_set(uint32_t index, bool selected);
+void selection_toggle(uint32_t index);
+bool selection_isSelected(uint32_t index);
+size_t selection_count();
+void selection_getIndices(std::vector<uint32_t>& out);
+uint64_t selection_getRevision(); // Changes whenever the selection does
+
+void selection_onInsert(uint32_t at, uint32_t count);
+void selection_onErase(uint32_t first, uint32_t count);
+
+#endif
@@ -0,0 +1,313 @@
+#include "shaders.h"
+#include "config.h"
+#include "fileSystem.h"
+#include "globals.h"
+#include "hash.h"
+#include "startup.h"
+
+#include <imgui.h>
+#include <tinyfiledialogs.h>
+
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#define SHADERS_CACHE_FILENAME "shaders.cache"
+#define SHADERS_CACHE_VERSION 1
+#define SHADERS_GLSL_VERSION "#version 130\n"
+
+struct CachedBinary
+{
+    GLenum format;
+    std::vector<uint8_t> data;
+};
+
+struct PendingProgram
+{
+    GLuint program;
+    GLuint vertHandle;
+    GLuint fragHandle;
+    uint64_t key;
+};
+
+static bool initialized = false;
+static bool canCache = false;
+static uint64_t driverKey = 0;
+static std::unordered_map<uint64_t, CachedBinary> cache;
+static std::unordered_set<uint64_t> usedKeys; // Only those are saved, the rest is from older sources
+static bool isCacheDirty = false;
+static std::vector<PendingProgram> pending;
+static int compilePhase = -1; // Startup phase of the pending programs
+
+static bool hasExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i)
+    {
+        auto extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+        if (extension && !strcmp(extension, name)) return true;
+    }
+    return false;
+}
+
+static std::string getCacheFilename()
+{
+    return config_getDirectory() + SHADERS_CACHE_FILENAME;
+}
+
+// "SHDC", version, driver key, count, then per program its key, format,
+// size and binary. Anything off and it is all dropped, programs are built
+// from their sources instead.
+static void loadCache()
+{
+    MappedFile file;
+    if (!fileSystem_map(getCacheFilename(), &file)) return; // None yet
+
+    auto pData = file.pData;
+    auto pEnd = file.pData + file.size;
+    auto read = [&](void* pOut, size_t size)
+    {
+        if ((size_t)(pEnd - pData) < size) return false;
+        memcpy(pOut, pData, size);
+        pData += size;
+        return true;
+    };
+
+    char magic[4];
+    uint32_t version = 0, count = 0;
+    uint64_t fileDriverKey = 0;
+    if (read(magic, 4) && !memcmp(magic, "SHDC", 4) &&
+        read(&version, sizeof(version)) && version == SHADERS_CACHE_VERSION &&
+        read(&fileDriverKey, sizeof(fileDriverKey)) && fileDriverKey == driverKey &&
+        read(&count, sizeof(count)))
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            uint64_t key;
+            uint32_t format, size;
+            if (!read(&key, sizeof(key)) || !read(&format, sizeof(format)) || !read(&size, sizeof(size))) break;
+            if ((size_t)(pEnd - pData) < size) break;
+            CachedBinary binary;
+            binary.format = (GLenum)format;
+            binary.data.assign(pData, pData + size);
+            pData += size;
+            cache[key] = std::move(binary);
+        }
+    }
+    fileSystem_unmap(&file);
+}
+
+static void saveCache()
+{
+    auto filename = getCacheFilename();
+    auto tempFilename = filename + ".tmp";
+    {
+        std::ofstream file(tempFilename, std::ios::binary);
+        uint32_t version = SHADERS_CACHE_VERSION;
+        uint32_t count = 0;
+        for (const auto& kv : cache)
+        {
+            if (usedKeys.count(kv.first)) ++count;
+        }
+        file.write("SHDC", 4);
+        file.write((const char*)&version, sizeof(version));
+        file.write((const char*)&driverKey, sizeof(driverKey));
+        file.write((const char*)&count, sizeof(count));
+        for (const auto& kv : cache)
+        {
+            if (!usedKeys.count(kv.first)) continue;
+            uint32_t format = (uint32_t)kv.second.format;
+            uint32_t size = (uint32_t)kv.second.data.size();
+            file.write((const char*)&kv.first, sizeof(kv.first));
+            file.write((const char*)&format, sizeof(format));
+            file.write((const char*)&size, sizeof(size));
+            file.write((const char*)kv.second.data.data(), size);
+        }
+        if (!file.good())
+        {
+            // Only slower next time
+            fprintf(stderr, "Failed to write the shader cache: %s\n", tempFilename.c_str());
+            return;
+        }
+    }
+    if (!fileSystem_replace(tempFilename, filename))
+    {
+        fprintf(stderr, "Failed to write the shader cache: %s\n", filename.c_str());
+    }
+}
+
+static void initialize()
+{
+    initialized = true;
+
+    // Binaries are only good for the driver that linked them
+    std::string driver;
+    const GLenum DRIVER_STRINGS[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+    for (auto name : DRIVER_STRINGS)
+    {
+        auto pString = (const char*)glGetString(name);
+        if (pString) driver += pString;
+        driver += '\n';
+    }
+    driverKey = hash_bytes(HASH_SEED, driver.data(), driver.size());
+
+    GLint formatCount = 0;
+    if (gl3wIsSupported(4, 1) || hasExtension("GL_ARB_get_program_binary"))
+    {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    }
+    canCache = formatCount > 0 && glProgramBinary && glGetProgramBinary && glProgramParameteri;
+    if (canCache) loadCache();
+
+    // As many compiler threads as the driver likes
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC pMaxShaderCompilerThreads = nullptr;
+    if (hasExtension("GL_KHR_parallel_shader_compile"))
+    {
+        pMaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)gl3wGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    }
+    else if (hasExtension("GL_ARB_parallel_shader_compile"))
+    {
+        pMaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)gl3wGetProcAddress("glMaxShaderCompilerThreadsARB");
+    }
+    if (pMaxShaderCompilerThreads)
+    {
+        pMaxShaderCompilerThreads(0xFFFFFFFF);
+    }
+}
+
+static bool CheckShader(GLuint handle, const char* desc)
+{
+    GLint status = 0, log_length = 0;
+    glGetShaderiv(handle, GL_COMPILE_STATUS, &status);
+    glGetShaderiv(handle, GL_INFO_LOG_LENGTH, &log_length);
+    if (status == GL_FALSE)
+        fprintf(stderr, "ERROR: shaders.cpp: failed to compile %s!\n", desc);
+    if (log_length > 0)
+    {
+        ImVector<char> buf;
+        buf.resize((int)(log_length + 1));
+        glGetShaderInfoLog(handle, log_length, NULL, (GLchar*)buf.begin());
+        fprintf(stderr, "%s\n", buf.begin());
+        if (!isHeadless) tinyfd_messageBox("Check Shader", (std::string("Failed to build shader") + buf.begin()).c_str(), "ok", "error", 0);
+    }
+    return status == GL_TRUE;
+}
+
+static bool CheckProgram(GLuint handle, const char* desc)
+{
+    GLint status = 0, log_length = 0;
+    glGetProgramiv(handle, GL_LINK_STATUS, &status);
+    glGetProgramiv(handle, GL_INFO_LOG_LENGTH, &log_length);
+    if (status == GL_FALSE)
+        fprintf(stderr, "ERROR: shaders.cpp: failed to link %s!\n", desc);
+    if (log_length > 0)
+    {
+        ImVector<char> buf;
+        buf.resize((int)(log_length + 1));
+        glGetProgramInfoLog(handle, log_length, NULL, (GLchar*)buf.begin());
+        fprintf(stderr, "%s\n", buf.begin());
+        if (!isHeadless) tinyfd_messageBox("Check Program", (std::string("Failed to build shader") + buf.begin()).c_str(), "ok", "error", 0);
+    }
+    return status == GL_TRUE;
+}
+
+GLuint shaders_create(const GLchar* vs, const GLchar* ps, const char* const* pAttributes, int attributeCount)
+{
+    if (!initialized) initialize();
+
+    // Everything that ends up in the binary, the nulls keep the parts apart
+    auto key = hash_bytes(HASH_SEED, SHADERS_GLSL_VERSION, strlen(SHADERS_GLSL_VERSION));
+    key = hash_bytes(key, vs, strlen(vs) + 1);
+    key = hash_bytes(key, ps, strlen(ps) + 1);
+    for (int i = 0; i < attributeCount; ++i)
+    {
+        key = hash_bytes(key, pAttributes[i], strlen(pAttributes[i]) + 1);
+    }
+    usedKeys.insert(key);
+
+    auto program = glCreateProgram();
+    for (int i = 0; i < attributeCount; ++i)
+    {
+        glBindAttribLocation(program, (GLuint)i, pAttributes[i]);
+    }
+    glBindFragDataLocation(program, 0, "Out_Color");
+    glBindFragDataLocation(program, 0, "Out_Id");
+
+    auto it = cache.find(key);
+    if (it != cache.end())
+    {
+        glProgramBinary(program, it->second.format, it->second.data.data(), (GLsizei)it->second.data.size());
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status == GL_TRUE) return program;
+
+        // Refused by the driver anyway, built again below
+        cache.erase(it);
+        isCacheDirty = true;
+    }
+
+    // Not waited on here, the driver may keep going while the next ones start
+    if (pending.empty()) compilePhase = startup_beginPhase("Shader compile");
+    PendingProgram pendingProgram;
+    pendingProgram.program = program;
+    pendingProgram.key = key;
+
+    const GLchar* vertex_shader_with_version[2] = { SHADERS_GLSL_VERSION, vs };
+    pendingProgram.vertHandle = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(pendingProgram.vertHandle, 2, vertex_shader_with_version, NULL);
+    glCompileShader(pendingProgram.vertHandle);
+
+    const GLchar* fragment_shader_with_version[2] = { SHADERS_GLSL_VERSION, ps };
+    pendingProgram.fragHandle = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(pendingProgram.fragHandle, 2, fragment_shader_with_version, NULL);
+    glCompileShader(pendingProgram.fragHandle);
+
+    glAttachShader(program, pendingProgram.vertHandle);
+    glAttachShader(program, pendingProgram.fragHandle);
+    if (canCache) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+
+    pending.push_back(pendingProgram);
+    return program;
+}
+
+void shaders_finish()
+{
+    for (const auto& pendingProgram : pending)
+    {
+        // Waits on this one only, the others carry on meanwhile
+        auto isCompiled = CheckShader(pendingProgram.vertHandle, "vertex shader");
+        isCompiled = CheckShader(pendingProgram.fragHandle, "fragment shader") && isCompiled;
+        auto isLinked = CheckProgram(pendingProgram.program, "shader program");
+        if (isCompiled && isLinked && canCache)
+        {
+            GLint length = 0;
+            glGetProgramiv(pendingProgram.program, GL_PROGRAM_BINARY_LENGTH, &length);
+            if (length > 0)
+            {
+                CachedBinary binary;
+                binary.data.resize((size_t)length);
+                glGetProgramBinary(pendingProgram.program, length, nullptr, &binary.format, binary.data.data());
+                cache[pendingProgram.key] = std::move(binary);
+                isCacheDirty = true;
+            }
+        }
+        glDetachShader(pendingProgram.program, pendingProgram.vertHandle);
+        glDetachShader(pendingProgram.program, pendingProgram.fragHandle);
+        glDeleteShader(pendingProgram.vertHandle);
+        glDeleteShader(pendingProgram.fragHandle);
+    }
+    if (!pending.empty()) startup_endPhase(compilePhase);
+    pending.clear();
+
+    if (isCacheDirty)
+    {
+        saveCache();
+        isCacheDirty = false;
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef SHADERS_H_INCLUDED
+#define SHADERS_H_INCLUDED
+
+#include <GL/gl3w.h>
+
+// Programs are all started at startup and finished together, so the first
+// frame doesn't compile anything. Linked binaries are cached on disk, keyed
+// by their sources and the driver, and read back when both still match. The
+// others compile on the driver's threads when it has some.
+//
+// Attributes are bound to locations in the order given, so programs drawing
+// the same vertex arrays agree on them. Out_Color or Out_Id, whichever the
+// fragment shader has, goes to draw buffer 0.
+GLuint shaders_create(const GLchar* vs, const GLchar* ps, const char* const* pAttributes = nullptr, int attributeCount = 0);
+
+// Waits on the programs created since the last call, reports failures and
+// caches the new binaries. Their compiles are the "Shader compile"
+// startup phase.
+void shaders_finish();
+
+#endif
@@ -0,0 +1,493 @@
+#include "snap.h"
+#include "bvh.h"
+#include "globals.h"
+#include "layers.h"
+#include "library.h"
+#include "transforms.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#include <unordered_map>
+
+#define SNAP_REGION_SIZE 16.0f
+#define SNAP_REGION_CELLS 32 // Per axis
+#define SNAP_CELL_SIZE (SNAP_REGION_SIZE / (float)SNAP_REGION_CELLS)
+#define SNAP_BIG_ENTITY_REGIONS 64 // Entities over more regions than this are kept aside
+
+struct SnapCandidate
+{
+    float position[3];
+    SnapKind kind;
+};
+
+// Model space, without duplicates
+struct ModelPoints
+{
+    std::vector<SnapCandidate> points;
+};
+
+struct SnapPoint
+{
+    float position[3];
+    uint32_t entity;
+    uint32_t cell; // x + y * SNAP_REGION_CELLS + z * SNAP_REGION_CELLS^2, in the region
+    SnapKind kind;
+    uint8_t layer; // Hidden ones are skipped by queries, the index stays as is
+};
+
+struct Region
+{
+    bool isDirty = true;
+    std::vector<uint32_t> entities; // May hold duplicates and entities that left, cleaned up on rebuild
+    std::vector<SnapPoint> points; // Sorted by cell
+};
+
+struct EntityState
+{
+    uint8_t flags;
+    uint64_t modelId;
+    uint8_t layer;
+};
+
+static std::unordered_map<uint64_t, ModelPoints> modelPoints;
+static std::unordered_map<uint64_t, Region> regions;
+static std::vector<uint32_t> bigEntities; // Looked at by every region
+static std::vector<uint32_t> ignored;
+static std::vector<uint64_t> ignoredBits;
+static uint64_t entitiesRevision = 0;
+static uint64_t libraryRevision = 0;
+static bool isIndexed = false;
+
+static void addTrianglePoints(uint64_t modelId, std::vector<SnapCandidate>& points)
+{
+    auto model = library_getModel(modelId);
+    if (!model.pBvh) return;
+
+    // Triangles are v0, v1 - v0, v2 - v0
+    const auto& triangles = model.pBvh->triangles;
+    points.reserve(points.size() + triangles.size() / 9 * 7);
+    for (size_t t = 0; t + 9 <= triangles.size(); t += 9)
+    {
+        float v[3][3];
+        for (int k = 0; k < 3; ++k)
+        {
+            v[0][k] = triangles[t + k];
+            v[1][k] = triangles[t + k] + triangles[t + 3 + k];
+            v[2][k] = triangles[t + k] + triangles[t + 6 + k];
+        }
+        SnapCandidate candidate;
+        for (int i = 0; i < 3; ++i)
+        {
+            candidate.kind = SnapKind::Vertex;
+            memcpy(candidate.position, v[i], sizeof(candidate.position));
+            points.push_back(candidate);
+
+            candidate.kind = SnapKind::Edge;
+            for (int k = 0; k < 3; ++k) candidate.position[k] = (v[i][k] + v[(i + 1) % 3][k]) * 0.5f;
+            points.push_back(candidate);
+        }
+        candidate.kind = SnapKind::Face;
+        for (int k = 0; k < 3; ++k) candidate.position[k] = (v[0][k] + v[1][k] + v[2][k]) / 3.0f;
+        points.push_back(candidate);
+    }
+}
+
+static const ModelPoints& getModelPoints(uint64_t modelId)
+{
+    auto it = modelPoints.find(modelId);
+    if (it != modelPoints.end()) return it->second;
+
+    // A prefab's are its parts', in its space
+    ModelPoints result;
+    auto& points = result.points;
+    auto pPrefab = library_getPrefab(modelId);
+    if (!pPrefab)
+    {
+        addTrianglePoints(modelId, points);
+    }
+    else
+    {
+        for (const auto& part : pPrefab->parts)
+        {
+            for (const auto& partPoint : getModelPoints(part.modelId).points)
+            {
+                auto pPosition = partPoint.position;
+                float position[4];
+                float4_store(position, mat4_transformPoint(part.local, float4_set(pPosition[0], pPosition[1], pPosition[2], 1.0f)));
+                SnapCandidate candidate;
+                memcpy(candidate.position, position, sizeof(candidate.position));
+                candidate.kind = partPoint.kind;
+                points.push_back(candidate);
+            }
+        }
+    }
+
+    // Shared vertices and edges come once, as the strongest kind
+    std::sort(points.begin(), points.end(), [](const SnapCandidate& a, const SnapCandidate& b)
+    {
+        auto order = memcmp(a.position, b.position, sizeof(a.position));
+        return order ? order < 0 : a.kind < b.kind;
+    });
+    points.erase(std::unique(points.begin(), points.end(), [](const SnapCandidate& a, const SnapCandidate& b)
+    {
+        return !memcmp(a.position, b.position, sizeof(a.position));
+    }), points.end());
+    points.shrink_to_fit();
+    return modelPoints[modelId] = std::move(result);
+}
+
+static bool isIgnored(uint32_t index)
+{
+    auto word = index / 64;
+    return word < ignoredBits.size() && (ignoredBits[word] & ((uint64_t)1 << (index % 64)));
+}
+
+static void getEntities(const std::vector<uint32_t>& indices, std::vector<EntityState>& out)
+{
+    out.resize(indices.size());
+    std::vector<uint8_t> values;
+    entities_getValues(document.entities, EntityField::Flags, indices.data(), indices.size(), values);
+    for (size_t i = 0; i < indices.size(); ++i) out[i].flags = values[i];
+    values.clear();
+    entities_getValues(document.entities, EntityField::ModelId, indices.data(), indices.size(), values);
+    for (size_t i = 0; i < indices.size(); ++i) memcpy(&out[i].modelId, &values[i * sizeof(uint64_t)], sizeof(uint64_t));
+    values.clear();
+    entities_getValues(document.entities, EntityField::Layer, indices.data(), indices.size(), values);
+    for (size_t i = 0; i < indices.size(); ++i) out[i].layer = values[i];
+}
+
+static void getBounds(uint32_t index, float min[3], float max[3])
+{
+    auto pBounds = &transforms_getWorldBounds()[index * 6];
+    memcpy(min, pBounds, sizeof(float) * 3);
+    memcpy(max, pBounds + 3, sizeof(float) * 3);
+}
+
+static int getRegionCoord(float value)
+{
+    return (int)std::floor(value / SNAP_REGION_SIZE);
+}
+
+static uint64_t getRegionKey(int x, int y, int z)
+{
+    const uint64_t OFFSET = 1 << 20;
+    const uint64_t MASK = (1 << 21) - 1;
+    return (((uint64_t)x + OFFSET) & MASK) << 42 | (((uint64_t)y + OFFSET) & MASK) << 21 | (((uint64_t)z + OFFSET) & MASK);
+}
+
+static void getRegionCoords(uint64_t key, int coords[3])
+{
+    const int64_t OFFSET = 1 << 20;
+    const uint64_t MASK = (1 << 21) - 1;
+    coords[0] = (int)((int64_t)((key >> 42) & MASK) - OFFSET);
+    coords[1] = (int)((int64_t)((key >> 21) & MASK) - OFFSET);
+    coords[2] = (int)((int64_t)(key & MASK) - OFFSET);
+}
+
+static bool isBig(const int from[3], const int to[3])
+{
+    int64_t count = 1;
+    for (int k = 0; k < 3; ++k) count *= (int64_t)(to[k] - from[k] + 1);
+    return count > SNAP_BIG_ENTITY_REGIONS;
+}
+
+// Marks the regions under the bounds for rebuild, and adds the entity to
+// them if index isn't SNAP_NONE
+static void touchRegions(const float min[3], const float max[3], uint32_t index)
+{
+    int from[3], to[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        from[k] = getRegionCoord(min[k]);
+        to[k] = getRegionCoord(max[k]);
+    }
+
+    if (isBig(from, to))
+    {
+        for (auto& it : regions)
+        {
+            int coords[3];
+            getRegionCoords(it.first, coords);
+            if (coords[0] >= from[0] && coords[0] <= to[0] &&
+                coords[1] >= from[1] && coords[1] <= to[1] &&
+                coords[2] >= from[2] && coords[2] <= to[2]) it.second.isDirty = true;
+        }
+        if (index != SNAP_NONE)
+        {
+            // Kept sorted for the binary searches
+            auto it = std::lower_bound(bigEntities.begin(), bigEntities.end(), index);
+            if (it == bigEntities.end() || *it != index) bigEntities.insert(it, index);
+        }
+        return;
+    }
+
+    for (auto z = from[2]; z <= to[2]; ++z)
+    {
+        for (auto y = from[1]; y <= to[1]; ++y)
+        {
+            for (auto x = from[0]; x <= to[0]; ++x)
+            {
+                auto key = getRegionKey(x, y, z);
+                if (index == SNAP_NONE)
+                {
+                    auto it = regions.find(key);
+                    if (it != regions.end()) it->second.isDirty = true;
+                    continue;
+                }
+                auto& region = regions[key];
+                region.isDirty = true;
+                region.entities.push_back(index);
+            }
+        }
+    }
+}
+
+// Dirties where the entities and their children are now, and adds them
+// there if isAdding
+static void touchEntities(const std::vector<uint32_t>& indices, bool isAdding)
+{
+    auto count = entities_count(document.entities);
+    std::vector<uint32_t> moved;
+    transforms_getDescendants(indices, moved);
+    std::vector<uint32_t> valid;
+    valid.reserve(moved.size());
+    for (auto index : moved)
+    {
+        if (index < count && !isIgnored(index)) valid.push_back(index);
+    }
+
+    std::vector<EntityState> states;
+    getEntities(valid, states);
+    for (size_t i = 0; i < valid.size(); ++i)
+    {
+        if (states[i].flags & ENTITY_FLAG_RAW) continue;
+        float min[3], max[3];
+        getBounds(valid[i], min, max);
+        touchRegions(min, max, isAdding ? valid[i] : SNAP_NONE);
+    }
+}
+
+static void index()
+{
+    modelPoints.clear();
+    regions.clear();
+    bigEntities.clear();
+
+    const auto& entities = document.entities;
+    auto chunkCount = entities_getChunkCount(entities);
+    uint32_t index = 0;
+    for (size_t c = 0; c < chunkCount; ++c)
+    {
+        const auto& chunk = entities_getChunk(entities, c);
+        for (uint32_t i = 0; i < chunk.count; ++i, ++index)
+        {
+            if ((chunk.flags[i] & ENTITY_FLAG_RAW) || isIgnored(index)) continue;
+            float min[3], max[3];
+            getBounds(index, min, max);
+            touchRegions(min, max, index);
+        }
+    }
+
+    entitiesRevision = entities_getRevision(document.entities);
+    libraryRevision = library_getRevision();
+    isIndexed = true;
+}
+
+static void build(uint64_t key, Region& region)
+{
+    int coords[3];
+    getRegionCoords(key, coords);
+    float regionMin[3], regionMax[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        regionMin[k] = (float)coords[k] * SNAP_REGION_SIZE;
+        regionMax[k] = regionMin[k] + SNAP_REGION_SIZE;
+    }
+
+    // Only the entities still overlapping, once each
+    auto& candidates = region.entities;
+    candidates.insert(candidates.end(), bigEntities.begin(), bigEntities.end());
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    auto count = entities_count(document.entities);
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](uint32_t index)
+    {
+        return index >= count || isIgnored(index);
+    }), candidates.end());
+
+    std::vector<EntityState> states;
+    getEntities(candidates, states);
+    auto pWorldMatrices = transforms_getWorldMatrices();
+    std::vector<uint32_t> kept;
+    region.points.clear();
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        const auto& state = states[i];
+        if (state.flags & ENTITY_FLAG_RAW) continue;
+        const auto& points = getModelPoints(state.modelId);
+        float min[3], max[3];
+        getBounds(candidates[i], min, max);
+        if (min[0] >= regionMax[0] || max[0] < regionMin[0] ||
+            min[1] >= regionMax[1] || max[1] < regionMin[1] ||
+            min[2] >= regionMax[2] || max[2] < regionMin[2]) continue;
+        kept.push_back(candidates[i]);
+
+        // Entities without a model snap by their origin
+        static const SnapCandidate ORIGIN = { { 0, 0, 0 }, SnapKind::Vertex };
+        auto pPoints = points.points.empty() ? &ORIGIN : points.points.data();
+        auto pointCount = points.points.empty() ? 1 : points.points.size();
+        const auto& world = pWorldMatrices[candidates[i]];
+        for (size_t p = 0; p < pointCount; ++p)
+        {
+            SnapPoint point;
+            auto pPosition = pPoints[p].position;
+            auto position = mat4_transformPoint(world, float4_set(pPosition[0], pPosition[1], pPosition[2], 1.0f));
+            int cell[3];
+            auto isInside = true;
+            for (int k = 0; k < 3 && isInside; ++k)
+            {
+                point.position[k] = float4_get(position, k);
+                cell[k] = (int)std::floor((point.position[k] - regionMin[k]) / SNAP_CELL_SIZE);
+                isInside = point.position[k] >= regionMin[k] && point.position[k] < regionMax[k];
+            }
+            if (!isInside) continue;
+            for (int k = 0; k < 3; ++k) cell[k] = std::max(0, std::min(SNAP_REGION_CELLS - 1, cell[k]));
+            point.cell = (uint32_t)(cell[0] + (cell[1] + cell[2] * SNAP_REGION_CELLS) * SNAP_REGION_CELLS);
+            point.entity = candidates[i];
+            point.kind = pPoints[p].kind;
+            point.layer = state.layer;
+            region.points.push_back(point);
+        }
+    }
+
+    std::sort(region.points.begin(), region.points.end(), [](const SnapPoint& a, const SnapPoint& b)
+    {
+        return a.cell < b.cell;
+    });
+
+    // Big entities are found again from their own list
+    kept.erase(std::remove_if(kept.begin(), kept.end(), [](uint32_t index)
+    {
+        return std::binary_search(bigEntities.begin(), bigEntities.end(), index);
+    }), kept.end());
+    region.entities.swap(kept);
+    region.isDirty = false;
+}
+
+bool snap_find(const float point[3], float radius, SnapResult& result)
+{
+    if (!isIndexed ||
+        entitiesRevision != entities_getRevision(document.entities) ||
+        libraryRevision != library_getRevision()) index();
+
+    radius = std::min(radius, SNAP_REGION_SIZE);
+    int from[3], to[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        from[k] = getRegionCoord(point[k] - radius);
+        to[k] = getRegionCoord(point[k] + radius);
+    }
+
+    auto bestDistance = radius * radius;
+    auto isFound = false;
+    auto visibleMask = layers_getVisibleMask();
+    for (auto z = from[2]; z <= to[2]; ++z)
+    {
+        for (auto y = from[1]; y <= to[1]; ++y)
+        {
+            for (auto x = from[0]; x <= to[0]; ++x)
+            {
+                auto key = getRegionKey(x, y, z);
+                Region* pRegion = nullptr;
+                if (bigEntities.empty())
+                {
+                    auto it = regions.find(key);
+                    if (it == regions.end()) continue;
+                    pRegion = &it->second;
+                }
+                else pRegion = &regions[key];
+                if (pRegion->isDirty) build(key, *pRegion);
+
+                const int coords[3] = { x, y, z };
+                int cellFrom[3], cellTo[3];
+                for (int k = 0; k < 3; ++k)
+                {
+                    auto regionMin = (float)coords[k] * SNAP_REGION_SIZE;
+                    cellFrom[k] = std::max(0, (int)std::floor((point[k] - radius - regionMin) / SNAP_CELL_SIZE));
+                    cellTo[k] = std::min(SNAP_REGION_CELLS - 1, (int)std::floor((point[k] + radius - regionMin) / SNAP_CELL_SIZE));
+                }
+
+                const auto& points = pRegion->points;
+                for (auto cz = cellFrom[2]; cz <= cellTo[2]; ++cz)
+                {
+                    for (auto cy = cellFrom[1]; cy <= cellTo[1]; ++cy)
+                    {
+                        // A row of cells is contiguous
+                        auto rowFirst = (uint32_t)(cellFrom[0] + (cy + cz * SNAP_REGION_CELLS) * SNAP_REGION_CELLS);
+                        auto rowLast = rowFirst + (uint32_t)(cellTo[0] - cellFrom[0]);
+                        auto it = std::lower_bound(points.begin(), points.end(), rowFirst, [](const SnapPoint& p, uint32_t cell)
+                        {
+                            return p.cell < cell;
+                        });
+                        for (; it != points.end() && it->cell <= rowLast; ++it)
+                        {
+                            auto dx = it->position[0] - point[0];
+                            auto dy = it->position[1] - point[1];
+                            auto dz = it->position[2] - point[2];
+                            auto distance = dx * dx + dy * dy + dz * dz;
+                            if (distance > bestDistance || !((visibleMask >> it->layer) & 1)) continue;
+                            bestDistance = distance;
+                            memcpy(result.position, it->position, sizeof(result.position));
+                            result.kind = it->kind;
+                            result.entity = it->entity;
+                            isFound = true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return isFound;
+}
+
+void snap_setIgnored(const std::vector<uint32_t>& indices)
+{
+    auto isInSync = isIndexed && entitiesRevision == entities_getRevision(document.entities);
+
+    // Back where they are now
+    auto previous = std::move(ignored);
+    ignored.clear();
+    ignoredBits.clear();
+    if (isInSync) touchEntities(previous, true);
+
+    // Out of where they are now, they stay out until put back
+    if (isInSync) touchEntities(indices, false);
+    ignored = indices;
+    for (auto index : ignored)
+    {
+        auto word = index / 64;
+        if (word >= ignoredBits.size()) ignoredBits.resize(word + 1, 0);
+        ignoredBits[word] |= (uint64_t)1 << (index % 64);
+    }
+}
+
+void snap_beforeEdit(const Edit& edit)
+{
+    if (!isIndexed) return;
+    if (edit.type != EditType::Set || entitiesRevision != entities_getRevision(document.entities))
+    {
+        // Indices shift, start over on the next query
+        isIndexed = false;
+        return;
+    }
+    if (edit.field == EntityField::Extras) return;
+    touchEntities(edit.indices, false);
+}
+
+void snap_afterEdit(const Edit& edit)
+{
+    if (!isIndexed) return;
+    if (edit.field != EntityField::Extras) touchEntities(edit.indices, true);
+    entitiesRevision = entities_getRevision(document.entities);
+}
@@ -0,0 +1,41 @@
+#ifndef SNAP_H_INCLUDED
+#define SNAP_H_INCLUDED
+
+#include "edit.h"
+
+#include <cinttypes>
+#include <vector>
+
+#define SNAP_NONE 0xFFFFFFFF
+
+enum class SnapKind : uint8_t
+{
+    Vertex = 0,
+    Edge, // Middle of a triangle edge
+    Face // Center of a triangle
+};
+
+struct SnapResult
+{
+    float position[3];
+    SnapKind kind;
+    uint32_t entity;
+};
+
+// Snap points of the document's entities (vertices, edge middles and face
+// centers of their models, in world space) bucketed in a spatial hash. The
+// world is cut in regions whose hash is built the first time a query reaches
+// them, and rebuilt only after an entity in them moved.
+// Closest snap point within radius of point. Returns false if none.
+bool snap_find(const float point[3], float radius, SnapResult& result);
+
+// Entities left out of the snap points, like the ones being dragged so they
+// don't snap to themselves. Pass an empty list when done.
+void snap_setIgnored(const std::vector<uint32_t>& indices);
+
+// Called by edit_applyToDocument around applying the edit, so only the
+// regions it touched are rebuilt
+void snap_beforeEdit(const Edit& edit);
+void snap_afterEdit(const Edit& edit);
+
+#endif
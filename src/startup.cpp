@@ -0,0 +1,100 @@
+#include "startup.h"
+
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct StartupPhase
+{
+    const char* name;
+    double begin;
+    double end;
+    int thread; // 0 for the one that called startup_init
+};
+
+static std::chrono::steady_clock::time_point startTime;
+static std::mutex mutex;
+static std::vector<StartupPhase> phases;
+static std::unordered_map<std::thread::id, int> threads;
+static double firstFrameTime = -1.0;
+static double loadedTime = -1.0;
+
+static double getTime()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+static int getThread()
+{
+    auto it = threads.find(std::this_thread::get_id());
+    if (it != threads.end()) return it->second;
+    auto index = (int)threads.size();
+    threads[std::this_thread::get_id()] = index;
+    return index;
+}
+
+static void report()
+{
+    printf("Startup:\n");
+    for (const auto& phase : phases)
+    {
+        char thread[16];
+        if (phase.thread) snprintf(thread, sizeof(thread), "thread %d", phase.thread);
+        else snprintf(thread, sizeof(thread), "main");
+        printf("  %-24s %8.1f - %8.1f ms  %s\n", phase.name, phase.begin, phase.end, thread);
+    }
+    printf("  First frame at %.1f ms, fully loaded at %.1f ms\n", firstFrameTime, loadedTime);
+    fflush(stdout);
+}
+
+void startup_init()
+{
+    startTime = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    getThread();
+}
+
+int startup_beginPhase(const char* name)
+{
+    auto time = getTime();
+    std::lock_guard<std::mutex> lock(mutex);
+    StartupPhase phase;
+    phase.name = name;
+    phase.begin = time;
+    phase.end = time;
+    phase.thread = getThread();
+    phases.push_back(phase);
+    return (int)phases.size() - 1;
+}
+
+void startup_endPhase(int phase)
+{
+    auto time = getTime();
+    std::lock_guard<std::mutex> lock(mutex);
+    phases[phase].end = time;
+}
+
+void startup_firstFrame()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (firstFrameTime >= 0.0) return;
+    firstFrameTime = getTime();
+    if (loadedTime >= 0.0) report();
+}
+
+void startup_loaded()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (loadedTime >= 0.0) return;
+    loadedTime = getTime();
+    if (firstFrameTime >= 0.0) report();
+}
+
+bool startup_isLoaded()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return loadedTime >= 0.0;
+}
@@ -0,0 +1,14 @@
+#ifndef STARTUP_H_INCLUDED
+#define STARTUP_H_INCLUDED
+
+// Timeline of startup, in milliseconds from startup_init. Phases can run on
+// any thread and overlap. Once fully loaded, the phases are printed with the
+// time to the first frame and the time to fully loaded apart.
+void startup_init(); // First thing in main
+int startup_beginPhase(const char* name); // name must outlive startup
+void startup_endPhase(int phase);
+void startup_firstFrame(); // After the first frame is swapped
+void startup_loaded(); // The map is open and the models its views want are in
+bool startup_isLoaded();
+
+#endif
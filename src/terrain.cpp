@@ -0,0 +1,744 @@
+#include "terrain.h"
+#include "fileSystem.h"
+#include "frame.h"
+#include "globals.h"
+#include "jobs.h"
+#include "rendering.h"
+#include "shaders.h"
+
+#include <stb_image.h>
+#include <tinyfiledialogs.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define TERRAIN_VERSION 1
+#define TERRAIN_TILE_SAMPLES (TERRAIN_TILE_QUADS + 1)
+#define TERRAIN_PATCH_SAMPLES (TERRAIN_PATCH_QUADS + 1)
+#define TERRAIN_OVERVIEW_QUADS 2048 // Per side at most, for the nodes bigger than a tile
+#define TERRAIN_MAX_TILE_TEXTURES 64
+#define TERRAIN_TILE_UPLOADS_PER_DRAW 4
+#define TERRAIN_LOD_RATIO 2.0f // A level's range, in sizes of its nodes
+#define TERRAIN_MORPH_START 0.7f // Of a level's range, where morphing to the next one starts
+#define TERRAIN_ORTHO_PIXELS 4.0f // Between vertices in 2D views, at least
+#define TERRAIN_NO_MORPH 1e30f
+
+struct TerrainFileHeader
+{
+    char magic[4]; // "TERR"
+    uint32_t version;
+    uint32_t tileQuads;
+    uint32_t tilesX;
+    uint32_t tilesY;
+};
+
+// Level 0 nodes are a patch of samples, each level up doubles them
+struct TerrainLevel
+{
+    uint32_t nodesX;
+    uint32_t nodesY;
+    std::vector<float> minMax; // Heights per node, in meters
+};
+
+struct TerrainNode
+{
+    int level;
+    uint32_t x;
+    uint32_t y;
+    int quadrants; // Bit per quadrant to draw, the others are drawn by children
+};
+
+struct TileTexture
+{
+    GLuint texture;
+    uint64_t lastUsed;
+};
+
+struct TerrainShader
+{
+    GLuint program = 0;
+    GLint uniform_projMtx = 0;
+    GLint uniform_nodeOffset = 0;
+    GLint uniform_nodeScale = 0;
+    GLint uniform_uvOffset = 0;
+    GLint uniform_uvScale = 0;
+    GLint uniform_texel = 0;
+    GLint uniform_morph = 0;
+    GLint uniform_height = 0;
+    GLint uniform_heights = 0;
+    GLint attrib_position = 0;
+};
+
+static TerrainShader terrainShader;
+static bool initialized = false;
+static GLuint patchVao = 0;
+static GLuint patchVbo = 0;
+static GLuint patchIbo = 0;
+
+static MappedFile mappedFile;
+static const uint16_t* pTiles = nullptr;
+static uint32_t tilesX = 0;
+static uint32_t tilesY = 0;
+static float spacing = 1.0f;
+static float heightMin = 0.0f;
+static float heightMax = 100.0f;
+static double origin[3] = { 0.0, 0.0, 0.0 };
+static std::vector<TerrainLevel> levels;
+static bool isLoaded = false;
+
+static uint32_t overviewStride = 1; // Samples per overview texel
+static uint32_t overviewSize[2] = { 0, 0 };
+static std::vector<uint16_t> overview;
+static GLuint overviewTexture = 0;
+static std::unordered_map<uint32_t, TileTexture> tileTextures;
+static uint64_t drawCount = 0;
+
+static uint16_t getSample(uint32_t x, uint32_t y)
+{
+    auto tx = std::min(x / TERRAIN_TILE_QUADS, tilesX - 1);
+    auto ty = std::min(y / TERRAIN_TILE_QUADS, tilesY - 1);
+    auto pTile = pTiles + ((size_t)ty * tilesX + tx) * TERRAIN_TILE_SAMPLES * TERRAIN_TILE_SAMPLES;
+    return pTile[(y - ty * TERRAIN_TILE_QUADS) * TERRAIN_TILE_SAMPLES + (x - tx * TERRAIN_TILE_QUADS)];
+}
+
+static float toMeters(uint16_t sample)
+{
+    return heightMin + (float)sample / 65535.0f * (heightMax - heightMin);
+}
+
+static void buildLevels()
+{
+    levels.clear();
+    auto quadsX = tilesX * TERRAIN_TILE_QUADS;
+    auto quadsY = tilesY * TERRAIN_TILE_QUADS;
+    for (uint32_t nodeQuads = TERRAIN_PATCH_QUADS; ; nodeQuads *= 2)
+    {
+        TerrainLevel level;
+        level.nodesX = (quadsX + nodeQuads - 1) / nodeQuads;
+        level.nodesY = (quadsY + nodeQuads - 1) / nodeQuads;
+        level.minMax.resize((size_t)level.nodesX * level.nodesY * 2);
+        levels.push_back(std::move(level));
+        if (levels.back().nodesX == 1 && levels.back().nodesY == 1) break;
+    }
+
+    // Leaves from the samples, their edges included
+    auto& leaves = levels[0];
+    jobs_parallelFor(leaves.nodesY, 1, [&](size_t begin, size_t end)
+    {
+        for (auto y = (uint32_t)begin; y < (uint32_t)end; ++y)
+        {
+            for (uint32_t x = 0; x < leaves.nodesX; ++x)
+            {
+                uint16_t low = 65535, high = 0;
+                for (uint32_t j = 0; j < TERRAIN_PATCH_SAMPLES; ++j)
+                {
+                    for (uint32_t i = 0; i < TERRAIN_PATCH_SAMPLES; ++i)
+                    {
+                        auto sample = getSample(x * TERRAIN_PATCH_QUADS + i, y * TERRAIN_PATCH_QUADS + j);
+                        low = std::min(low, sample);
+                        high = std::max(high, sample);
+                    }
+                }
+                auto pMinMax = &leaves.minMax[((size_t)y * leaves.nodesX + x) * 2];
+                pMinMax[0] = toMeters(low);
+                pMinMax[1] = toMeters(high);
+            }
+        }
+    });
+
+    // Then each level from its children, those past the edge don't exist
+    for (size_t l = 1; l < levels.size(); ++l)
+    {
+        const auto& children = levels[l - 1];
+        auto& level = levels[l];
+        for (uint32_t y = 0; y < level.nodesY; ++y)
+        {
+            for (uint32_t x = 0; x < level.nodesX; ++x)
+            {
+                auto pMinMax = &level.minMax[((size_t)y * level.nodesX + x) * 2];
+                pMinMax[0] = FLT_MAX;
+                pMinMax[1] = -FLT_MAX;
+                for (uint32_t c = 0; c < 4; ++c)
+                {
+                    auto cx = x * 2 + (c & 1);
+                    auto cy = y * 2 + (c >> 1);
+                    if (cx >= children.nodesX || cy >= children.nodesY) continue;
+                    auto pChild = &children.minMax[((size_t)cy * children.nodesX + cx) * 2];
+                    pMinMax[0] = std::min(pMinMax[0], pChild[0]);
+                    pMinMax[1] = std::max(pMinMax[1], pChild[1]);
+                }
+            }
+        }
+    }
+}
+
+// Point sampled, the nodes using it are far enough not to tell
+static void buildOverview()
+{
+    auto quadsX = tilesX * TERRAIN_TILE_QUADS;
+    auto quadsY = tilesY * TERRAIN_TILE_QUADS;
+    overviewStride = 1;
+    while (std::max(quadsX, quadsY) / overviewStride > TERRAIN_OVERVIEW_QUADS) overviewStride *= 2;
+    overviewSize[0] = (quadsX + overviewStride - 1) / overviewStride + 1;
+    overviewSize[1] = (quadsY + overviewStride - 1) / overviewStride + 1;
+    overview.resize((size_t)overviewSize[0] * overviewSize[1]);
+    jobs_parallelFor(overviewSize[1], 16, [&](size_t begin, size_t end)
+    {
+        for (auto y = (uint32_t)begin; y < (uint32_t)end; ++y)
+        {
+            for (uint32_t x = 0; x < overviewSize[0]; ++x)
+            {
+                overview[(size_t)y * overviewSize[0] + x] = getSample(std::min(x * overviewStride, quadsX), std::min(y * overviewStride, quadsY));
+            }
+        }
+    });
+}
+
+static size_t getTextureBytes(uint32_t w, uint32_t h)
+{
+    return (size_t)w * h * sizeof(uint16_t);
+}
+
+static void unload()
+{
+    for (const auto& kv : tileTextures)
+    {
+        glDeleteTextures(1, &kv.second.texture);
+    }
+    tileTextures.clear();
+    if (overviewTexture) glDeleteTextures(1, &overviewTexture);
+    overviewTexture = 0;
+    overview.clear();
+    levels.clear();
+    if (mappedFile.pData) fileSystem_unmap(&mappedFile);
+    mappedFile = MappedFile();
+    pTiles = nullptr;
+    isLoaded = false;
+}
+
+static std::string getDirectory()
+{
+    return document.filename.substr(0, document.filename.find_last_of("/\\") + 1);
+}
+
+void terrain_load()
+{
+    unload();
+
+    const auto& jsonTerrain = document.json["terrain"];
+    if (!jsonTerrain.isObject() || !jsonTerrain.isMember("filename")) return;
+    spacing = std::max(0.001f, jsonTerrain.get("spacing", 1.0).asFloat());
+    heightMin = jsonTerrain.get("heightMin", 0.0).asFloat();
+    heightMax = jsonTerrain.get("heightMax", 100.0).asFloat();
+    static const char* AXES[] = { "x", "y", "z" };
+    for (int k = 0; k < 3; ++k) origin[k] = jsonTerrain["origin"].get(AXES[k], 0.0).asDouble();
+
+    auto filename = jsonTerrain["filename"].asString();
+    if (!fileSystem_map(getDirectory() + filename, &mappedFile))
+    {
+        auto message = "Failed to open terrain:\n" + filename;
+        if (isHeadless) fprintf(stderr, "%s\n", message.c_str());
+        else tinyfd_messageBox("Terrain", message.c_str(), "ok", "error", 0);
+        return;
+    }
+
+    TerrainFileHeader header;
+    auto isValid = mappedFile.size >= sizeof(header);
+    if (isValid)
+    {
+        memcpy(&header, mappedFile.pData, sizeof(header));
+        isValid = !memcmp(header.magic, "TERR", 4) &&
+            header.version == TERRAIN_VERSION &&
+            header.tileQuads == TERRAIN_TILE_QUADS &&
+            header.tilesX > 0 && header.tilesY > 0 &&
+            mappedFile.size == sizeof(header) + (uint64_t)header.tilesX * header.tilesY * TERRAIN_TILE_SAMPLES * TERRAIN_TILE_SAMPLES * sizeof(uint16_t);
+    }
+    if (!isValid)
+    {
+        unload();
+        auto message = "Not a terrain, or a newer one:\n" + filename;
+        if (isHeadless) fprintf(stderr, "%s\n", message.c_str());
+        else tinyfd_messageBox("Terrain", message.c_str(), "ok", "error", 0);
+        return;
+    }
+
+    tilesX = header.tilesX;
+    tilesY = header.tilesY;
+    pTiles = (const uint16_t*)(mappedFile.pData + sizeof(header));
+    buildLevels();
+    buildOverview();
+    isLoaded = true;
+    frame_invalidate(FrameReason::AssetReady);
+}
+
+void terrain_import()
+{
+    if (document.filename.empty())
+    {
+        tinyfd_messageBox("Import Heightmap", "Save the map first, the terrain is written next to it.", "ok", "warning", 0);
+        return;
+    }
+
+    const char* filters[] = { "*.png", "*.tga", "*.bmp", "*.pgm" };
+    auto imagePath = tinyfd_openFileDialog("Import Heightmap", "", 4, filters, NULL, 0);
+    if (!imagePath) return;
+    std::string imageFilename = imagePath;
+
+    int w, h, channels;
+    auto pImage = stbi_load_16(imageFilename.c_str(), &w, &h, &channels, 1);
+    if (!pImage)
+    {
+        tinyfd_messageBox("Import Heightmap", ("Failed to open image:\n" + imageFilename + "\n" + stbi_failure_reason()).c_str(), "ok", "error", 0);
+        return;
+    }
+    if (w < 2 || h < 2)
+    {
+        stbi_image_free(pImage);
+        tinyfd_messageBox("Import Heightmap", "The image is too small to be a terrain.", "ok", "error", 0);
+        return;
+    }
+
+    auto pSpacing = tinyfd_inputBox("Import Heightmap", "Meters between samples", "1");
+    auto importSpacing = pSpacing ? atof(pSpacing) : 0.0;
+    auto pHeight = importSpacing > 0.0 ? tinyfd_inputBox("Import Heightmap", "Meters from the darkest to the brightest sample", "100") : nullptr;
+    if (!pHeight)
+    {
+        stbi_image_free(pImage);
+        return;
+    }
+    auto importHeight = atof(pHeight);
+
+    // Past the image's edges, its last samples repeat. The image's first row
+    // is its top, that's towards +y.
+    TerrainFileHeader header;
+    memcpy(header.magic, "TERR", 4);
+    header.version = TERRAIN_VERSION;
+    header.tileQuads = TERRAIN_TILE_QUADS;
+    header.tilesX = (uint32_t)(w - 1 + TERRAIN_TILE_QUADS - 1) / TERRAIN_TILE_QUADS;
+    header.tilesY = (uint32_t)(h - 1 + TERRAIN_TILE_QUADS - 1) / TERRAIN_TILE_QUADS;
+
+    auto baseName = imageFilename.substr(imageFilename.find_last_of("/\\") + 1);
+    baseName = baseName.substr(0, baseName.find_last_of('.'));
+    auto filename = baseName + TERRAIN_EXTENSION;
+    auto path = getDirectory() + filename;
+    auto tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary);
+        file.write((const char*)&header, sizeof(header));
+        std::vector<uint16_t> tile(TERRAIN_TILE_SAMPLES * TERRAIN_TILE_SAMPLES);
+        for (uint32_t ty = 0; ty < header.tilesY; ++ty)
+        {
+            for (uint32_t tx = 0; tx < header.tilesX; ++tx)
+            {
+                for (uint32_t j = 0; j < TERRAIN_TILE_SAMPLES; ++j)
+                {
+                    auto y = std::min(ty * TERRAIN_TILE_QUADS + j, (uint32_t)h - 1);
+                    auto pRow = pImage + (size_t)(h - 1 - y) * w;
+                    for (uint32_t i = 0; i < TERRAIN_TILE_SAMPLES; ++i)
+                    {
+                        tile[j * TERRAIN_TILE_SAMPLES + i] = pRow[std::min(tx * TERRAIN_TILE_QUADS + i, (uint32_t)w - 1)];
+                    }
+                }
+                file.write((const char*)tile.data(), tile.size() * sizeof(uint16_t));
+            }
+        }
+        if (!file.good())
+        {
+            stbi_image_free(pImage);
+            tinyfd_messageBox("Import Heightmap", ("Failed to write terrain:\n" + path).c_str(), "ok", "error", 0);
+            return;
+        }
+    }
+    stbi_image_free(pImage);
+    unload(); // It might be the file being replaced
+    if (!fileSystem_sync(tempPath) || !fileSystem_replace(tempPath, path))
+    {
+        tinyfd_messageBox("Import Heightmap", ("Failed to write terrain:\n" + path).c_str(), "ok", "error", 0);
+        terrain_load();
+        return;
+    }
+
+    Json::Value jsonTerrain;
+    jsonTerrain["filename"] = filename;
+    jsonTerrain["spacing"] = importSpacing;
+    jsonTerrain["heightMin"] = 0.0;
+    jsonTerrain["heightMax"] = importHeight;
+    jsonTerrain["origin"]["x"] = 0.0;
+    jsonTerrain["origin"]["y"] = 0.0;
+    jsonTerrain["origin"]["z"] = 0.0;
+    document.json["terrain"] = jsonTerrain;
+    document.dirty = true;
+    terrain_load();
+}
+
+void terrain_initShaders()
+{
+    terrainShader.program = shaders_create(
+        "uniform mat4 ProjMtx;\n"
+        "uniform vec3 NodeOffset;\n" // Node corner at height 0, from the eye
+        "uniform float NodeScale;\n" // Meters per grid unit
+        "uniform vec2 UvOffset;\n"
+        "uniform vec2 UvScale;\n" // Per grid unit
+        "uniform vec3 Texel;\n" // uv per texel, meters per texel
+        "uniform vec2 Morph;\n" // Distances where it starts and ends
+        "uniform vec2 Height;\n" // Min, max - min
+        "uniform sampler2D Heights;\n"
+        "in vec2 Position;\n"
+        "out vec3 Frag_Normal;\n"
+        "float getHeight(vec2 uv)\n"
+        "{\n"
+        "    return Height.x + textureLod(Heights, uv, 0.0).r * Height.y;\n"
+        "}\n"
+        "void main()\n"
+        "{\n"
+        "    vec2 grid = Position;\n"
+        "    vec3 position = NodeOffset + vec3(grid * NodeScale, getHeight(UvOffset + grid * UvScale));\n"
+        "    float k = clamp((length(position) - Morph.x) / (Morph.y - Morph.x), 0.0, 1.0);\n"
+        "    grid -= fract(grid * 0.5) * 2.0 * k;\n"
+        "    vec2 uv = UvOffset + grid * UvScale;\n"
+        "    position = NodeOffset + vec3(grid * NodeScale, getHeight(uv));\n"
+        "    float dx = getHeight(uv + vec2(Texel.x, 0.0)) - getHeight(uv - vec2(Texel.x, 0.0));\n"
+        "    float dy = getHeight(uv + vec2(0.0, Texel.y)) - getHeight(uv - vec2(0.0, Texel.y));\n"
+        "    Frag_Normal = normalize(vec3(-dx, -dy, 2.0 * Texel.z));\n"
+        "    gl_Position = ProjMtx * vec4(position, 1);\n"
+        "}\n"
+        ,
+        "in vec3 Frag_Normal;\n"
+        "out vec4 Out_Color;\n"
+        "void main()\n"
+        "{\n"
+        "    vec3 normal = normalize(Frag_Normal);\n"
+        "    vec3 color = mix(vec3(0.45, 0.42, 0.36), vec3(0.38, 0.52, 0.30), normal.z * normal.z);\n"
+        "    Out_Color = vec4(color * mix(0.7, 1.0, normal.z * 0.5 + 0.5) * mix(0.8, 1.0, abs(normal.x)), 1.0);\n"
+        "}\n");
+}
+
+static void initialize()
+{
+    glUseProgram(terrainShader.program);
+    terrainShader.uniform_projMtx = glGetUniformLocation(terrainShader.program, "ProjMtx");
+    terrainShader.uniform_nodeOffset = glGetUniformLocation(terrainShader.program, "NodeOffset");
+    terrainShader.uniform_nodeScale = glGetUniformLocation(terrainShader.program, "NodeScale");
+    terrainShader.uniform_uvOffset = glGetUniformLocation(terrainShader.program, "UvOffset");
+    terrainShader.uniform_uvScale = glGetUniformLocation(terrainShader.program, "UvScale");
+    terrainShader.uniform_texel = glGetUniformLocation(terrainShader.program, "Texel");
+    terrainShader.uniform_morph = glGetUniformLocation(terrainShader.program, "Morph");
+    terrainShader.uniform_height = glGetUniformLocation(terrainShader.program, "Height");
+    terrainShader.uniform_heights = glGetUniformLocation(terrainShader.program, "Heights");
+    terrainShader.attrib_position = glGetAttribLocation(terrainShader.program, "Position");
+
+    // The one patch, its indices a quadrant after the other so a node can
+    // draw only some of them
+    std::vector<float> vertices;
+    vertices.reserve(TERRAIN_PATCH_SAMPLES * TERRAIN_PATCH_SAMPLES * 2);
+    for (int y = 0; y < TERRAIN_PATCH_SAMPLES; ++y)
+    {
+        for (int x = 0; x < TERRAIN_PATCH_SAMPLES; ++x)
+        {
+            vertices.push_back((float)x);
+            vertices.push_back((float)y);
+        }
+    }
+    std::vector<uint16_t> indices;
+    indices.reserve(TERRAIN_PATCH_QUADS * TERRAIN_PATCH_QUADS * 6);
+    for (int quadrant = 0; quadrant < 4; ++quadrant)
+    {
+        auto x0 = (quadrant & 1) * TERRAIN_PATCH_QUADS / 2;
+        auto y0 = (quadrant >> 1) * TERRAIN_PATCH_QUADS / 2;
+        for (int y = y0; y < y0 + TERRAIN_PATCH_QUADS / 2; ++y)
+        {
+            for (int x = x0; x < x0 + TERRAIN_PATCH_QUADS / 2; ++x)
+            {
+                auto i = (uint16_t)(y * TERRAIN_PATCH_SAMPLES + x);
+                const uint16_t quad[6] = {
+                    i, (uint16_t)(i + 1), (uint16_t)(i + TERRAIN_PATCH_SAMPLES + 1),
+                    i, (uint16_t)(i + TERRAIN_PATCH_SAMPLES + 1), (uint16_t)(i + TERRAIN_PATCH_SAMPLES)
+                };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+    }
+
+    glGenVertexArrays(1, &patchVao);
+    glBindVertexArray(patchVao);
+    glGenBuffers(1, &patchVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, patchVbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), (const GLvoid*)vertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(terrainShader.attrib_position);
+    glVertexAttribPointer(terrainShader.attrib_position, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, (GLvoid*)0);
+    glGenBuffers(1, &patchIbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, patchIbo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), (const GLvoid*)indices.data(), GL_STATIC_DRAW);
+
+    initialized = true;
+}
+
+static GLuint createHeightTexture(const uint16_t* pData, uint32_t w, uint32_t h)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2); // Rows are an odd number of samples
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, (GLsizei)w, (GLsizei)h, 0, GL_RED, GL_UNSIGNED_SHORT, pData);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+// 0 if it can't be uploaded this draw, the overview stands in until then.
+// Past TERRAIN_MAX_TILE_TEXTURES, the one used the longest ago makes room.
+static GLuint getTileTexture(uint32_t tx, uint32_t ty, int* pUploads)
+{
+    auto key = ty * tilesX + tx;
+    auto it = tileTextures.find(key);
+    if (it != tileTextures.end())
+    {
+        it->second.lastUsed = drawCount;
+        return it->second.texture;
+    }
+    if (*pUploads >= TERRAIN_TILE_UPLOADS_PER_DRAW)
+    {
+        frame_invalidate(FrameReason::AssetReady);
+        return 0;
+    }
+    if (tileTextures.size() >= TERRAIN_MAX_TILE_TEXTURES)
+    {
+        auto oldest = tileTextures.begin();
+        for (auto it = tileTextures.begin(); it != tileTextures.end(); ++it)
+        {
+            if (it->second.lastUsed < oldest->second.lastUsed) oldest = it;
+        }
+        if (oldest->second.lastUsed == drawCount) return 0; // All on screen
+        glDeleteTextures(1, &oldest->second.texture);
+        tileTextures.erase(oldest);
+    }
+    ++*pUploads;
+    auto pTile = pTiles + ((size_t)ty * tilesX + tx) * TERRAIN_TILE_SAMPLES * TERRAIN_TILE_SAMPLES;
+    TileTexture tile;
+    tile.texture = createHeightTexture(pTile, TERRAIN_TILE_SAMPLES, TERRAIN_TILE_SAMPLES);
+    tile.lastUsed = drawCount;
+    tileTextures[key] = tile;
+    return tile.texture;
+}
+
+struct SelectContext
+{
+    float viewProj[4][4];
+    double eye[3];
+    std::vector<float> ranges; // Per level, distance within which its nodes are drawn
+    int minLevel;
+    std::vector<TerrainNode> nodes;
+};
+
+// Node box from the eye
+static void getNodeBox(const SelectContext& context, int level, uint32_t x, uint32_t y, float min[3], float max[3])
+{
+    auto nodeQuads = (uint32_t)TERRAIN_PATCH_QUADS << level;
+    auto quadsX = tilesX * TERRAIN_TILE_QUADS;
+    auto quadsY = tilesY * TERRAIN_TILE_QUADS;
+    auto pMinMax = &levels[level].minMax[((size_t)y * levels[level].nodesX + x) * 2];
+    min[0] = (float)(origin[0] + (double)x * nodeQuads * spacing - context.eye[0]);
+    min[1] = (float)(origin[1] + (double)y * nodeQuads * spacing - context.eye[1]);
+    min[2] = (float)(origin[2] + pMinMax[0] - context.eye[2]);
+    max[0] = (float)(origin[0] + (double)std::min((x + 1) * nodeQuads, quadsX) * spacing - context.eye[0]);
+    max[1] = (float)(origin[1] + (double)std::min((y + 1) * nodeQuads, quadsY) * spacing - context.eye[1]);
+    max[2] = (float)(origin[2] + pMinMax[1] - context.eye[2]);
+}
+
+static bool isInRange(const float min[3], const float max[3], float range)
+{
+    auto distanceSq = 0.0f;
+    for (int k = 0; k < 3; ++k)
+    {
+        auto d = std::max(0.0f, std::max(min[k], -max[k]));
+        distanceSq += d * d;
+    }
+    return distanceSq <= range * range;
+}
+
+// Outside if all the corners are past the same clip plane
+static bool isInFrustum(const float viewProj[4][4], const float min[3], const float max[3])
+{
+    int outside[6] = { 0, 0, 0, 0, 0, 0 };
+    for (int c = 0; c < 8; ++c)
+    {
+        const float p[3] = { (c & 1) ? max[0] : min[0], (c & 2) ? max[1] : min[1], (c & 4) ? max[2] : min[2] };
+        float clip[4];
+        for (int r = 0; r < 4; ++r)
+        {
+            clip[r] = viewProj[0][r] * p[0] + viewProj[1][r] * p[1] + viewProj[2][r] * p[2] + viewProj[3][r];
+        }
+        for (int a = 0; a < 3; ++a)
+        {
+            if (clip[a] < -clip[3]) ++outside[a * 2];
+            if (clip[a] > clip[3]) ++outside[a * 2 + 1];
+        }
+    }
+    for (int k = 0; k < 6; ++k)
+    {
+        if (outside[k] == 8) return false;
+    }
+    return true;
+}
+
+// The patch would stretch past the terrain's edge, only nodes bigger than a
+// tile can as the terrain is whole tiles
+static bool isPastEdge(int level, uint32_t x, uint32_t y)
+{
+    auto nodeQuads = (uint32_t)TERRAIN_PATCH_QUADS << level;
+    return (x + 1) * nodeQuads > tilesX * TERRAIN_TILE_QUADS || (y + 1) * nodeQuads > tilesY * TERRAIN_TILE_QUADS;
+}
+
+// False if the node is out of its level's range, its parent draws the area.
+// Nodes past the edge are split instead, their children then draw whatever
+// their range.
+static bool select(SelectContext& context, int level, uint32_t x, uint32_t y, bool isForced)
+{
+    float min[3], max[3];
+    getNodeBox(context, level, x, y, min, max);
+    if (!isForced && !isInRange(min, max, context.ranges[level])) return false;
+    if (!isInFrustum(context.viewProj, min, max)) return true;
+
+    auto isSplit = level > 0 && isPastEdge(level, x, y);
+    if (!isSplit && (level <= context.minLevel || !isInRange(min, max, context.ranges[level - 1])))
+    {
+        context.nodes.push_back({ level, x, y, 0xF });
+        return true;
+    }
+
+    auto quadrants = 0;
+    const auto& children = levels[level - 1];
+    for (int c = 0; c < 4; ++c)
+    {
+        auto cx = x * 2 + (c & 1);
+        auto cy = y * 2 + (c >> 1);
+        if (cx >= children.nodesX || cy >= children.nodesY) continue;
+        if (!select(context, level - 1, cx, cy, isSplit)) quadrants |= 1 << c;
+    }
+    if (quadrants) context.nodes.push_back({ level, x, y, quadrants });
+    return true;
+}
+
+void terrain_draw(const float viewProjMat[4][4], const double eye[3], bool isOrtho, float metersPerPixel)
+{
+    if (!isLoaded) return;
+    if (!initialized) initialize();
+    if (!overviewTexture) overviewTexture = createHeightTexture(overview.data(), overviewSize[0], overviewSize[1]);
+    ++drawCount;
+
+    // Perspective views go finer closer to the eye, 2D views are at one
+    // level for their zoom
+    auto topLevel = (int)levels.size() - 1;
+    SelectContext context;
+    memcpy(context.viewProj, viewProjMat, sizeof(context.viewProj));
+    memcpy(context.eye, eye, sizeof(context.eye));
+    context.ranges.resize(levels.size(), FLT_MAX);
+    context.minLevel = 0;
+    if (isOrtho)
+    {
+        auto level = (int)std::ceil(std::log2(TERRAIN_ORTHO_PIXELS * metersPerPixel / spacing));
+        context.minLevel = std::max(0, std::min(topLevel, level));
+    }
+    else
+    {
+        for (int l = 0; l < topLevel; ++l)
+        {
+            context.ranges[l] = TERRAIN_LOD_RATIO * (float)(TERRAIN_PATCH_QUADS << l) * spacing;
+        }
+    }
+    select(context, topLevel, 0, 0, false);
+    if (context.nodes.empty()) return;
+
+    glUseProgram(terrainShader.program);
+    glUniformMatrix4fv(terrainShader.uniform_projMtx, 1, GL_FALSE, &viewProjMat[0][0]);
+    glUniform2f(terrainShader.uniform_height, heightMin, heightMax - heightMin);
+    glUniform1i(terrainShader.uniform_heights, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(patchVao);
+    glBindBuffer(GL_ARRAY_BUFFER, patchVbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, patchIbo);
+
+    // Nodes within a tile read it at full resolution, bigger ones the overview
+    auto tileLevel = 0;
+    while ((TERRAIN_PATCH_QUADS << (tileLevel + 1)) <= TERRAIN_TILE_QUADS) ++tileLevel;
+    auto uploads = 0;
+    const auto quadrantIndices = TERRAIN_PATCH_QUADS * TERRAIN_PATCH_QUADS / 4 * 6;
+    for (const auto& node : context.nodes)
+    {
+        auto nodeQuads = (uint32_t)TERRAIN_PATCH_QUADS << node.level;
+        auto samplesPerUnit = (float)(1 << node.level);
+        auto x0 = node.x * nodeQuads;
+        auto y0 = node.y * nodeQuads;
+        GLuint texture = 0;
+        if (node.level <= tileLevel)
+        {
+            auto tx = x0 / TERRAIN_TILE_QUADS;
+            auto ty = y0 / TERRAIN_TILE_QUADS;
+            texture = getTileTexture(tx, ty, &uploads);
+            if (texture)
+            {
+                glUniform2f(terrainShader.uniform_uvOffset,
+                    ((float)(x0 - tx * TERRAIN_TILE_QUADS) + 0.5f) / TERRAIN_TILE_SAMPLES,
+                    ((float)(y0 - ty * TERRAIN_TILE_QUADS) + 0.5f) / TERRAIN_TILE_SAMPLES);
+                glUniform2f(terrainShader.uniform_uvScale, samplesPerUnit / TERRAIN_TILE_SAMPLES, samplesPerUnit / TERRAIN_TILE_SAMPLES);
+                glUniform3f(terrainShader.uniform_texel, 1.0f / TERRAIN_TILE_SAMPLES, 1.0f / TERRAIN_TILE_SAMPLES, spacing);
+            }
+        }
+        if (!texture)
+        {
+            texture = overviewTexture;
+            glUniform2f(terrainShader.uniform_uvOffset,
+                ((float)x0 / overviewStride + 0.5f) / overviewSize[0],
+                ((float)y0 / overviewStride + 0.5f) / overviewSize[1]);
+            glUniform2f(terrainShader.uniform_uvScale,
+                samplesPerUnit / overviewStride / overviewSize[0],
+                samplesPerUnit / overviewStride / overviewSize[1]);
+            glUniform3f(terrainShader.uniform_texel, 1.0f / overviewSize[0], 1.0f / overviewSize[1], spacing * overviewStride);
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+
+        glUniform3f(terrainShader.uniform_nodeOffset,
+            (float)(origin[0] + (double)x0 * spacing - eye[0]),
+            (float)(origin[1] + (double)y0 * spacing - eye[1]),
+            (float)(origin[2] - eye[2]));
+        glUniform1f(terrainShader.uniform_nodeScale, spacing * samplesPerUnit);
+
+        // Vertices morph into the next level's grid before its range ends
+        if (isOrtho || node.level == topLevel)
+        {
+            glUniform2f(terrainShader.uniform_morph, TERRAIN_NO_MORPH, TERRAIN_NO_MORPH * 2.0f);
+        }
+        else
+        {
+            auto range = context.ranges[node.level];
+            glUniform2f(terrainShader.uniform_morph, range * TERRAIN_MORPH_START, range);
+        }
+
+        for (int quadrant = 0; quadrant < 4; ++quadrant)
+        {
+            if (!(node.quadrants & (1 << quadrant))) continue;
+            glDrawElements(GL_TRIANGLES, quadrantIndices, GL_UNSIGNED_SHORT, (const void*)(uintptr_t)(quadrant * quadrantIndices * sizeof(uint16_t)));
+        }
+    }
+}
+
+void terrain_getMemoryUsage(size_t* pGpu, size_t* pCpu)
+{
+    *pGpu = tileTextures.size() * getTextureBytes(TERRAIN_TILE_SAMPLES, TERRAIN_TILE_SAMPLES);
+    if (overviewTexture) *pGpu += getTextureBytes(overviewSize[0], overviewSize[1]);
+    *pCpu = overview.size() * sizeof(uint16_t);
+    for (const auto& level : levels)
+    {
+        *pCpu += level.minMax.size() * sizeof(float);
+    }
+}
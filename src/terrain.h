@@ -0,0 +1,32 @@
+#ifndef TERRAIN_H_INCLUDED
+#define TERRAIN_H_INCLUDED
+
+#include <cinttypes>
+#include <cstddef>
+
+#define TERRAIN_EXTENSION ".terrain"
+#define TERRAIN_TILE_QUADS 256 // Tiles have one more sample per side, shared with the next tile
+#define TERRAIN_PATCH_QUADS 64 // Grid patch drawn for every node, quads per side
+
+// A heightfield of 16 bit samples next to the map, in tiles that are read
+// from a memory mapping as they are needed. Its settings are the document's
+// "terrain" member: filename, spacing (meters between samples), heightMin
+// and heightMax (meters at sample 0 and 65535), origin (x, y, z).
+//
+// Drawn as a quadtree of nodes that all use the same grid patch, displaced
+// in the vertex shader. Perspective views pick nodes by distance and morph
+// between levels, 2D views pick one level for their zoom. Either way the
+// node count depends on the view, not on the size of the terrain.
+void terrain_initShaders(); // At startup, before shaders_finish
+void terrain_load(); // After the document changed
+void terrain_import(); // Asks for a heightmap image and writes it as tiles
+
+// From a view's draw callback. viewProjMat has its eye at the origin, eye is
+// where that is in the world. metersPerPixel picks the level in 2D views.
+void terrain_draw(const float viewProjMat[4][4], const double eye[3], bool isOrtho, float metersPerPixel);
+
+// Bytes of the height textures, and of what's kept in RAM besides the
+// mapping, whose pages the system can drop
+void terrain_getMemoryUsage(size_t* pGpu, size_t* pCpu);
+
+#endif
@@ -0,0 +1,460 @@
+#include "transforms.h"
+#include "globals.h"
+#include "jobs.h"
+#include "library.h"
+
+#include <algorithm>
+#include <string.h>
+#include <unordered_map>
+
+#define TRANSFORMS_JOB_SIZE 4096 // Entities
+#define TRANSFORMS_EMPTY_EXTENT 0.25f // Half size of the bounds of entities without a model
+
+// Hierarchy
+static std::vector<uint32_t> parents;
+static std::vector<uint32_t> childStarts; // children of i are children[childStarts[i]] to children[childStarts[i + 1]]
+static std::vector<uint32_t> children;
+static std::unordered_map<uint32_t, uint32_t> idIndices;
+static uint32_t maxId = ENTITY_NO_ID;
+
+// Results
+static std::vector<mat4> worldMatrices;
+static std::vector<double> worldPositions;
+static std::vector<float> modelBounds; // Model space
+static std::vector<float> worldBounds;
+
+// Sync with the document
+static std::vector<uint32_t> dirty;
+static bool isHierarchyDirty = false;
+static bool isBuilt = false;
+static uint64_t entitiesRevision = 0;
+static uint64_t libraryRevision = 0;
+
+static void locate(uint32_t index, size_t* pChunkIndex, uint32_t* pLocal)
+{
+    const auto& firsts = document.entities.pTable->firsts;
+    auto chunkIndex = (size_t)(std::upper_bound(firsts.begin(), firsts.end(), (size_t)index) - firsts.begin()) - 1;
+    *pChunkIndex = chunkIndex;
+    *pLocal = (uint32_t)(index - firsts[chunkIndex]);
+}
+
+static void loadModelBounds(uint32_t index, uint64_t modelId, bool isRaw)
+{
+    auto pBounds = &modelBounds[index * 6];
+    Model model = {};
+    if (!isRaw) model = library_getModel(modelId);
+    for (int k = 0; k < 3; ++k)
+    {
+        auto isEmpty = !(model.max[k] > model.min[k]);
+        pBounds[k] = isEmpty ? -TRANSFORMS_EMPTY_EXTENT : model.min[k];
+        pBounds[3 + k] = isEmpty ? TRANSFORMS_EMPTY_EXTENT : model.max[k];
+    }
+}
+
+static void loadAllModelBounds()
+{
+    const auto& entities = document.entities;
+    auto chunkCount = entities_getChunkCount(entities);
+    uint32_t index = 0;
+    uint64_t lastModelId = 0;
+    auto lastIndex = TRANSFORMS_NONE; // Last one with a model, runs of the same model are common
+    for (size_t c = 0; c < chunkCount; ++c)
+    {
+        const auto& chunk = entities_getChunk(entities, c);
+        for (uint32_t i = 0; i < chunk.count; ++i, ++index)
+        {
+            auto isRaw = (chunk.flags[i] & ENTITY_FLAG_RAW) != 0;
+            if (!isRaw && lastIndex != TRANSFORMS_NONE && chunk.modelIds[i] == lastModelId)
+            {
+                memcpy(&modelBounds[index * 6], &modelBounds[lastIndex * 6], sizeof(float) * 6);
+                continue;
+            }
+            loadModelBounds(index, chunk.modelIds[i], isRaw);
+            if (isRaw) continue;
+            lastIndex = index;
+            lastModelId = chunk.modelIds[i];
+        }
+    }
+}
+
+// Parents from the ids, with the loops broken
+static void buildHierarchy()
+{
+    const auto& entities = document.entities;
+    auto count = entities_count(entities);
+    auto chunkCount = entities_getChunkCount(entities);
+
+    idIndices.clear();
+    maxId = ENTITY_NO_ID;
+    uint32_t index = 0;
+    for (size_t c = 0; c < chunkCount; ++c)
+    {
+        const auto& chunk = entities_getChunk(entities, c);
+        for (uint32_t i = 0; i < chunk.count; ++i, ++index)
+        {
+            auto id = chunk.ids[i];
+            if (id == ENTITY_NO_ID) continue;
+            idIndices.insert({ id, index }); // First one wins
+            maxId = std::max(maxId, id);
+        }
+    }
+
+    parents.assign(count, TRANSFORMS_NONE);
+    index = 0;
+    for (size_t c = 0; c < chunkCount; ++c)
+    {
+        const auto& chunk = entities_getChunk(entities, c);
+        for (uint32_t i = 0; i < chunk.count; ++i, ++index)
+        {
+            if (chunk.parents[i] == ENTITY_NO_ID) continue;
+            auto it = idIndices.find(chunk.parents[i]);
+            if (it != idIndices.end() && it->second != index) parents[index] = it->second;
+        }
+    }
+
+    // Walk up from each entity, a walk coming back on itself is a loop
+    enum : uint8_t { Unvisited = 0, OnPath, Done };
+    std::vector<uint8_t> states(count, Unvisited);
+    std::vector<uint32_t> path;
+    for (uint32_t i = 0; i < (uint32_t)count; ++i)
+    {
+        auto at = i;
+        while (at != TRANSFORMS_NONE && states[at] == Unvisited)
+        {
+            states[at] = OnPath;
+            path.push_back(at);
+            at = parents[at];
+        }
+        if (at != TRANSFORMS_NONE && states[at] == OnPath) parents[at] = TRANSFORMS_NONE;
+        for (auto visited : path) states[visited] = Done;
+        path.clear();
+    }
+
+    childStarts.assign(count + 1, 0);
+    for (auto parent : parents)
+    {
+        if (parent != TRANSFORMS_NONE) ++childStarts[parent + 1];
+    }
+    for (size_t i = 0; i < count; ++i) childStarts[i + 1] += childStarts[i];
+    children.resize(childStarts[count]);
+    std::vector<uint32_t> fill(childStarts.begin(), childStarts.end() - 1);
+    for (uint32_t i = 0; i < (uint32_t)count; ++i)
+    {
+        if (parents[i] != TRANSFORMS_NONE) children[fill[parents[i]]++] = i;
+    }
+
+    isHierarchyDirty = false;
+}
+
+// Breadth first from tops, levels[k] to levels[k + 1] is depth k
+static void collectLevels(const std::vector<uint32_t>& tops, std::vector<uint32_t>& order, std::vector<size_t>& levels)
+{
+    order = tops;
+    levels.assign(1, 0);
+    size_t levelStart = 0;
+    while (levelStart < order.size())
+    {
+        levels.push_back(order.size());
+        auto levelEnd = order.size();
+        for (auto i = levelStart; i < levelEnd; ++i)
+        {
+            auto index = order[i];
+            order.insert(order.end(), children.begin() + childStarts[index], children.begin() + childStarts[index + 1]);
+        }
+        levelStart = levelEnd;
+    }
+    levels.back() = order.size();
+}
+
+static void getTopmost(const std::vector<uint32_t>& indices, std::vector<uint32_t>& out)
+{
+    std::vector<uint64_t> bits((parents.size() + 63) / 64, 0);
+    auto isIn = [&](uint32_t index)
+    {
+        return (bits[index / 64] >> (index % 64)) & 1;
+    };
+    out.clear();
+    for (auto index : indices)
+    {
+        if (index >= parents.size() || isIn(index)) continue;
+        bits[index / 64] |= (uint64_t)1 << (index % 64);
+    }
+    for (auto index : indices)
+    {
+        if (index >= parents.size()) continue;
+        auto isTop = true;
+        for (auto at = parents[index]; at != TRANSFORMS_NONE && isTop; at = parents[at]) isTop = !isIn(at);
+        if (isTop) out.push_back(index);
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+// Local transform in the world arrays, the level passes turn it into the
+// world one
+static void loadLocal(const EntityChunk& chunk, uint32_t i, uint32_t index)
+{
+    auto pPosition = &chunk.positions[i * 3];
+    const float translation[3] = { (float)pPosition[0], (float)pPosition[1], (float)pPosition[2] };
+    vectorMath_composeTrs(translation, &chunk.rotations[i * 4], &chunk.scales[i * 3], &worldMatrices[index], 1);
+    memcpy(&worldPositions[index * 3], pPosition, sizeof(double) * 3);
+}
+
+static void computeWorld(uint32_t index)
+{
+    auto parent = parents[index];
+    if (parent != TRANSFORMS_NONE)
+    {
+        // The origin in doubles, so children of far away parents don't jitter
+        const auto& parentWorld = worldMatrices[parent];
+        auto pPosition = &worldPositions[index * 3];
+        auto pParentPosition = &worldPositions[parent * 3];
+        float columns[4][4];
+        mat4_store(parentWorld, columns);
+        double position[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            position[k] = pParentPosition[k] +
+                (double)columns[0][k] * pPosition[0] +
+                (double)columns[1][k] * pPosition[1] +
+                (double)columns[2][k] * pPosition[2];
+        }
+        memcpy(pPosition, position, sizeof(position));
+
+        auto& world = worldMatrices[index];
+        world = mat4_mul(world, parentWorld);
+        world.cols[3] = float4_set((float)position[0], (float)position[1], (float)position[2], 1.0f);
+    }
+}
+
+// World bounds of the entities first to end, through the batched kernel
+static void computeBounds(size_t first, size_t end)
+{
+    vectorMath_transformAabbsEach(&worldMatrices[first], &modelBounds[first * 6], 6, &worldBounds[first * 6], end - first);
+}
+
+// The same for a set of entities, a run of consecutive ones at a time
+static void computeBoundsOf(std::vector<uint32_t> indices)
+{
+    std::sort(indices.begin(), indices.end());
+    for (size_t i = 0; i < indices.size();)
+    {
+        auto end = i + 1;
+        while (end < indices.size() && indices[end] == indices[end - 1] + 1) ++end;
+        computeBounds(indices[i], indices[end - 1] + 1);
+        i = end;
+    }
+}
+
+// Levels one after the other, each spread on the job threads
+static void computeLevels(const std::vector<uint32_t>& order, const std::vector<size_t>& levels)
+{
+    for (size_t level = 0; level + 1 < levels.size(); ++level)
+    {
+        auto pLevel = order.data() + levels[level];
+        jobs_parallelFor(levels[level + 1] - levels[level], TRANSFORMS_JOB_SIZE, [&](size_t begin, size_t end)
+        {
+            for (auto i = begin; i < end; ++i) computeWorld(pLevel[i]);
+        });
+    }
+}
+
+static void rebuild()
+{
+    const auto& entities = document.entities;
+    auto count = entities_count(entities);
+    auto chunkCount = entities_getChunkCount(entities);
+    buildHierarchy();
+
+    worldMatrices.resize(count);
+    worldPositions.resize(count * 3);
+    modelBounds.resize(count * 6);
+    worldBounds.resize(count * 6);
+
+    // The library isn't thread safe, the model bounds are gathered here
+    loadAllModelBounds();
+
+    // Locals a chunk at a time, through the batched kernel
+    auto pTable = entities.pTable.get();
+    jobs_parallelFor(chunkCount, TRANSFORMS_JOB_SIZE / ENTITY_CHUNK_SIZE, [&](size_t begin, size_t end)
+    {
+        float translations[ENTITY_CHUNK_SIZE * 3];
+        for (auto c = begin; c < end; ++c)
+        {
+            const auto& chunk = *pTable->chunks[c];
+            auto first = pTable->firsts[c];
+            for (uint32_t i = 0; i < chunk.count * 3; ++i) translations[i] = (float)chunk.positions[i];
+            vectorMath_composeTrs(translations, chunk.rotations, chunk.scales, &worldMatrices[first], chunk.count);
+            memcpy(&worldPositions[first * 3], chunk.positions, sizeof(double) * 3 * chunk.count);
+        }
+    });
+
+    std::vector<uint32_t> roots;
+    for (uint32_t i = 0; i < (uint32_t)count; ++i)
+    {
+        if (parents[i] == TRANSFORMS_NONE) roots.push_back(i);
+    }
+    std::vector<uint32_t> order;
+    std::vector<size_t> levels;
+    collectLevels(roots, order, levels);
+    computeLevels(order, levels);
+    jobs_parallelFor(count, TRANSFORMS_JOB_SIZE, [](size_t begin, size_t end) { computeBounds(begin, end); });
+
+    dirty.clear();
+    isBuilt = true;
+}
+
+static void updateDirty()
+{
+    std::vector<uint32_t> tops;
+    getTopmost(dirty, tops);
+    dirty.clear();
+    std::vector<uint32_t> order;
+    std::vector<size_t> levels;
+    collectLevels(tops, order, levels);
+
+    const auto& entities = document.entities;
+    for (auto index : order)
+    {
+        size_t chunkIndex;
+        uint32_t i;
+        locate(index, &chunkIndex, &i);
+        const auto& chunk = entities_getChunk(entities, chunkIndex);
+        loadModelBounds(index, chunk.modelIds[i], (chunk.flags[i] & ENTITY_FLAG_RAW) != 0);
+        loadLocal(chunk, i, index);
+    }
+    computeLevels(order, levels);
+    computeBoundsOf(order);
+}
+
+static void updateBounds()
+{
+    loadAllModelBounds();
+    jobs_parallelFor(worldMatrices.size(), TRANSFORMS_JOB_SIZE, [](size_t begin, size_t end) { computeBounds(begin, end); });
+}
+
+static void update()
+{
+    auto newEntitiesRevision = entities_getRevision(document.entities);
+    auto newLibraryRevision = library_getRevision();
+    if (!isBuilt || newEntitiesRevision != entitiesRevision)
+    {
+        rebuild();
+    }
+    else
+    {
+        if (isHierarchyDirty)
+        {
+            // Breaking a loop can change the parent of entities that weren't edited
+            auto oldParents = std::move(parents);
+            buildHierarchy();
+            for (uint32_t i = 0; i < (uint32_t)parents.size(); ++i)
+            {
+                if (parents[i] != oldParents[i]) dirty.push_back(i);
+            }
+        }
+        if (!dirty.empty()) updateDirty();
+        if (newLibraryRevision != libraryRevision) updateBounds();
+    }
+    entitiesRevision = newEntitiesRevision;
+    libraryRevision = newLibraryRevision;
+}
+
+const mat4* transforms_getWorldMatrices()
+{
+    update();
+    return worldMatrices.data();
+}
+
+const double* transforms_getWorldPositions()
+{
+    update();
+    return worldPositions.data();
+}
+
+const float* transforms_getWorldBounds()
+{
+    update();
+    return worldBounds.data();
+}
+
+uint32_t transforms_getParent(uint32_t index)
+{
+    update();
+    return index < parents.size() ? parents[index] : TRANSFORMS_NONE;
+}
+
+uint32_t transforms_findId(uint32_t id)
+{
+    update();
+    auto it = idIndices.find(id);
+    return it != idIndices.end() ? it->second : TRANSFORMS_NONE;
+}
+
+uint32_t transforms_newId()
+{
+    update();
+    return maxId + 1;
+}
+
+bool transforms_canParent(uint32_t index, uint32_t parentIndex)
+{
+    update();
+    for (auto at = parentIndex; at != TRANSFORMS_NONE; at = parents[at])
+    {
+        if (at == index) return false;
+    }
+    return true;
+}
+
+void transforms_getDescendants(const std::vector<uint32_t>& indices, std::vector<uint32_t>& out)
+{
+    update();
+    std::vector<uint32_t> tops;
+    getTopmost(indices, tops);
+    std::vector<size_t> levels;
+    collectLevels(tops, out, levels);
+}
+
+void transforms_getTopmost(const std::vector<uint32_t>& indices, std::vector<uint32_t>& out)
+{
+    update();
+    getTopmost(indices, out);
+}
+
+void transforms_worldToParentDelta(uint32_t index, const double worldDelta[3], double out[3])
+{
+    memcpy(out, worldDelta, sizeof(double) * 3);
+    auto parent = transforms_getParent(index);
+    if (parent == TRANSFORMS_NONE) return;
+
+    mat4 inverse;
+    if (!mat4_inverseAffine(worldMatrices[parent], inverse)) return;
+    float columns[4][4];
+    mat4_store(inverse, columns);
+    for (int k = 0; k < 3; ++k)
+    {
+        out[k] = (double)columns[0][k] * worldDelta[0] + (double)columns[1][k] * worldDelta[1] + (double)columns[2][k] * worldDelta[2];
+    }
+}
+
+void transforms_beforeEdit(const Edit& edit)
+{
+    if (!isBuilt) return;
+    if (edit.type != EditType::Set || edit.field == EntityField::Id || entitiesRevision != entities_getRevision(document.entities))
+    {
+        // Indices shift or parents change everywhere, start over
+        isBuilt = false;
+    }
+}
+
+void transforms_afterEdit(const Edit& edit)
+{
+    if (!isBuilt) return;
+    if (edit.field != EntityField::Extras && edit.field != EntityField::Layer)
+    {
+        if (edit.field == EntityField::Parent) isHierarchyDirty = true;
+        dirty.insert(dirty.end(), edit.indices.begin(), edit.indices.end());
+    }
+    entitiesRevision = entities_getRevision(document.entities);
+}
@@ -0,0 +1,42 @@
+#ifndef TRANSFORMS_H_INCLUDED
+#define TRANSFORMS_H_INCLUDED
+
+#include "edit.h"
+#include "vectorMath.h"
+
+#include <cinttypes>
+#include <vector>
+
+#define TRANSFORMS_NONE 0xFFFFFFFF
+
+// World transforms of the document's entities, from their position, rotation
+// and scale relative to their parent. Kept in arrays indexed like the
+// entities, brought up to date by the getters: after a Set edit only the
+// edited entities and what is under them are recomputed. Anything else, like
+// a load, an insert or an erase, recomputes everything on the job threads.
+// Pointers are good until the next edit.
+const mat4* transforms_getWorldMatrices();
+const double* transforms_getWorldPositions(); // x, y, z per entity, the origins without float rounding
+const float* transforms_getWorldBounds(); // min xyz, max xyz per entity, around its model
+
+// Indices, TRANSFORMS_NONE if none. Parents that don't exist or would close
+// a loop are ignored, the entity is then a root.
+uint32_t transforms_getParent(uint32_t index);
+uint32_t transforms_findId(uint32_t id);
+uint32_t transforms_newId(); // Used by no entity
+bool transforms_canParent(uint32_t index, uint32_t parentIndex); // False if it would make a loop
+
+// The indices and all the entities under them, parents first and each once
+void transforms_getDescendants(const std::vector<uint32_t>& indices, std::vector<uint32_t>& out);
+
+// Those of the indices without an ancestor in them. Moving them moves the rest.
+void transforms_getTopmost(const std::vector<uint32_t>& indices, std::vector<uint32_t>& out);
+
+// A world space offset, in the space the entity's position is in
+void transforms_worldToParentDelta(uint32_t index, const double worldDelta[3], double out[3]);
+
+// Called by edit_applyToDocument around applying the edit
+void transforms_beforeEdit(const Edit& edit);
+void transforms_afterEdit(const Edit& edit);
+
+#endif
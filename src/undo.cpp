@@ -0,0 +1,200 @@
+#include "undo.h"
+#include "globals.h"
+#include "journal.h"
+
+#include <deque>
+#include <vector>
+
+struct UndoStep
+{
+    std::vector<Edit> edits;
+    uint32_t mergeKey = 0;
+    size_t memory = 0;
+};
+
+static std::deque<UndoStep> undoSteps;
+static std::vector<UndoStep> redoSteps;
+static size_t memoryUsage = 0;
+static size_t memoryBudget = UNDO_DEFAULT_MEMORY_BUDGET;
+static uint32_t nextMergeKey = 1;
+static int stepDepth = 0;
+static bool isStepOpen = false; // The back step still takes edits
+
+static size_t getMemory(const Edit& edit)
+{
+    return sizeof(Edit) +
+        edit.indices.capacity() * sizeof(uint32_t) +
+        edit.before.capacity() +
+        edit.after.capacity();
+}
+
+static void clearRedo()
+{
+    for (const auto& step : redoSteps) memoryUsage -= step.memory;
+    redoSteps.clear();
+}
+
+// Usage counts both stacks. Redo steps go first, the farthest from now
+// first, then the oldest undo steps.
+static void enforceBudget()
+{
+    auto dropCount = (size_t)0;
+    while (memoryUsage > memoryBudget && dropCount < redoSteps.size())
+    {
+        memoryUsage -= redoSteps[dropCount].memory;
+        ++dropCount;
+    }
+    redoSteps.erase(redoSteps.begin(), redoSteps.begin() + dropCount);
+
+    // Always keep the latest step, even if alone it is over
+    while (memoryUsage > memoryBudget && undoSteps.size() > 1)
+    {
+        memoryUsage -= undoSteps.front().memory;
+        undoSteps.pop_front();
+    }
+}
+
+// Same entities and field, or both the layers, the new edit fully overrides
+// the previous one
+static bool canMerge(const Edit& previous, const Edit& edit)
+{
+    if (previous.type == EditType::Layers && edit.type == EditType::Layers) return true;
+    return previous.type == EditType::Set &&
+        edit.type == EditType::Set &&
+        previous.field == edit.field &&
+        previous.indices == edit.indices;
+}
+
+void undo_record(Edit&& edit, uint32_t mergeKey)
+{
+    clearRedo();
+
+    auto isMerging = mergeKey && !undoSteps.empty() && undoSteps.back().mergeKey == mergeKey;
+    if (!isStepOpen && !isMerging)
+    {
+        undoSteps.push_back(UndoStep());
+        undoSteps.back().mergeKey = mergeKey;
+        isStepOpen = stepDepth > 0;
+    }
+
+    auto& step = undoSteps.back();
+    if (isMerging && !step.edits.empty() && canMerge(step.edits.back(), edit))
+    {
+        // Keep the oldest before, take the newest after
+        auto& previous = step.edits.back();
+        step.memory -= getMemory(previous);
+        memoryUsage -= getMemory(previous);
+        previous.after = std::move(edit.after);
+        step.memory += getMemory(previous);
+        memoryUsage += getMemory(previous);
+    }
+    else
+    {
+        auto memory = getMemory(edit);
+        step.edits.push_back(std::move(edit));
+        step.memory += memory;
+        memoryUsage += memory;
+    }
+
+    enforceBudget();
+}
+
+// Walks a step's edits, undoing in reverse order. The journal gets the
+// resulting edits too, it only ever replays forward.
+static bool applyStep(const UndoStep& step, bool reverse)
+{
+    auto count = step.edits.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto& edit = step.edits[reverse ? count - 1 - i : i];
+        if (!edit_applyToDocument(edit, reverse)) return false;
+        journal_append(edit, reverse);
+    }
+    document.dirty = true;
+    return true;
+}
+
+void undo_undo()
+{
+    if (undoSteps.empty() || stepDepth) return;
+    isStepOpen = false;
+
+    auto step = std::move(undoSteps.back());
+    undoSteps.pop_back();
+    if (!applyStep(step, true))
+    {
+        // The history doesn't match the document anymore
+        undo_clear();
+        return;
+    }
+
+    // Don't let a drag in progress merge into what's below
+    step.mergeKey = 0;
+    redoSteps.push_back(std::move(step));
+}
+
+void undo_redo()
+{
+    if (redoSteps.empty() || stepDepth) return;
+
+    auto step = std::move(redoSteps.back());
+    redoSteps.pop_back();
+    if (!applyStep(step, false))
+    {
+        undo_clear();
+        return;
+    }
+    undoSteps.push_back(std::move(step));
+}
+
+bool undo_canUndo()
+{
+    return !undoSteps.empty() && !stepDepth;
+}
+
+bool undo_canRedo()
+{
+    return !redoSteps.empty() && !stepDepth;
+}
+
+void undo_clear()
+{
+    undoSteps.clear();
+    redoSteps.clear();
+    memoryUsage = 0;
+    stepDepth = 0;
+    isStepOpen = false;
+}
+
+void undo_beginStep()
+{
+    if (stepDepth++ == 0) isStepOpen = false;
+}
+
+void undo_endStep()
+{
+    if (stepDepth > 0 && --stepDepth == 0) isStepOpen = false;
+}
+
+uint32_t undo_newMergeKey()
+{
+    auto key = nextMergeKey++;
+    if (!nextMergeKey) nextMergeKey = 1;
+    return key;
+}
+
+void undo_setMemoryBudget(size_t bytes)
+{
+    memoryBudget = bytes;
+    enforceBudget();
+}
+
+size_t undo_getMemoryBudget()
+{
+    return memoryBudget;
+}
+
+size_t undo_getMemoryUsage()
+{
+    return memoryUsage;
+}
@@ -0,0 +1,32 @@
+#ifndef UNDO_H_INCLUDED
+#define UNDO_H_INCLUDED
+
+#include "edit.h"
+
+#include <cinttypes>
+
+#define UNDO_DEFAULT_MEMORY_BUDGET (256 * 1024 * 1024)
+
+// History of the committed edits. A step is one or more edits undone
+// together, it only holds their deltas so undo/redo cost the size of the
+// change, not of the map. Oldest steps are dropped past the memory budget.
+void undo_record(Edit&& edit, uint32_t mergeKey); // Called by edit_commit
+void undo_undo();
+void undo_redo();
+bool undo_canUndo();
+bool undo_canRedo();
+void undo_clear();
+
+// Edits committed between begin and end form a single step
+void undo_beginStep();
+void undo_endStep();
+
+// Continuous edits (dragging a gizmo, a slider) take a key when they start
+// and pass it to every edit_commit, they collapse into one step.
+uint32_t undo_newMergeKey();
+
+void undo_setMemoryBudget(size_t bytes);
+size_t undo_getMemoryBudget();
+size_t undo_getMemoryUsage();
+
+#endif
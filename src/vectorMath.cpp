@@ -0,0 +1,628 @@
+#include "vectorMath.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(VECTORMATH_SSE) && defined(__AVX__)
+#define VECTORMATH_AVX
+#include <immintrin.h>
+#endif
+
+mat4 mat4_load(const float m[4][4])
+{
+    mat4 r;
+    for (int i = 0; i < 4; ++i) r.cols[i] = float4_load(m[i]);
+    return r;
+}
+
+void mat4_store(const mat4& m, float out[4][4])
+{
+    for (int i = 0; i < 4; ++i) float4_store(out[i], m.cols[i]);
+}
+
+mat4 mat4_identity()
+{
+    mat4 r;
+    r.cols[0] = float4_set(1.0f, 0.0f, 0.0f, 0.0f);
+    r.cols[1] = float4_set(0.0f, 1.0f, 0.0f, 0.0f);
+    r.cols[2] = float4_set(0.0f, 0.0f, 1.0f, 0.0f);
+    r.cols[3] = float4_set(0.0f, 0.0f, 0.0f, 1.0f);
+    return r;
+}
+
+bool mat4_inverseAffine(const mat4& m, mat4& out)
+{
+    float a[4][4];
+    mat4_store(m, a);
+
+    // Inverse of the 3x3 from its cofactors, a[col][row]
+    float c[3][3];
+    for (int col = 0; col < 3; ++col)
+    {
+        for (int row = 0; row < 3; ++row)
+        {
+            int c0 = (col + 1) % 3, c1 = (col + 2) % 3;
+            int r0 = (row + 1) % 3, r1 = (row + 2) % 3;
+            c[col][row] = a[c0][r0] * a[c1][r1] - a[c1][r0] * a[c0][r1];
+        }
+    }
+    auto det = a[0][0] * c[0][0] + a[1][0] * c[1][0] + a[2][0] * c[2][0];
+    if (std::fabs(det) < 1e-20f) return false;
+    auto invDet = 1.0f / det;
+
+    // Transposed cofactors over the determinant
+    float inv[4][4];
+    for (int col = 0; col < 3; ++col)
+    {
+        for (int row = 0; row < 3; ++row) inv[col][row] = c[row][col] * invDet;
+        inv[col][3] = 0.0f;
+    }
+    for (int row = 0; row < 3; ++row)
+    {
+        inv[3][row] = -(inv[0][row] * a[3][0] + inv[1][row] * a[3][1] + inv[2][row] * a[3][2]);
+    }
+    inv[3][3] = 1.0f;
+    out = mat4_load(inv);
+    return true;
+}
+
+void mat4_decompose(const mat4& m, float rotation[4], float scale[3])
+{
+    float cols[4][4];
+    mat4_store(m, cols);
+    for (int i = 0; i < 3; ++i)
+    {
+        scale[i] = std::sqrt(cols[i][0] * cols[i][0] + cols[i][1] * cols[i][1] + cols[i][2] * cols[i][2]);
+    }
+    auto determinant =
+        cols[0][0] * (cols[1][1] * cols[2][2] - cols[1][2] * cols[2][1]) -
+        cols[1][0] * (cols[0][1] * cols[2][2] - cols[0][2] * cols[2][1]) +
+        cols[2][0] * (cols[0][1] * cols[1][2] - cols[0][2] * cols[1][1]);
+    if (determinant < 0.0f) scale[0] = -scale[0];
+
+    // r[row][col] of the rotation, the columns without their scale
+    float r[3][3];
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int k = 0; k < 3; ++k) r[k][i] = scale[i] != 0.0f ? cols[i][k] / scale[i] : (float)(i == k);
+    }
+
+    // The largest of w, x, y, z first, it divides the others
+    auto trace = r[0][0] + r[1][1] + r[2][2];
+    auto& x = rotation[0];
+    auto& y = rotation[1];
+    auto& z = rotation[2];
+    auto& w = rotation[3];
+    if (trace > 0.0f)
+    {
+        auto s = std::sqrt(trace + 1.0f) * 2.0f;
+        w = 0.25f * s;
+        x = (r[2][1] - r[1][2]) / s;
+        y = (r[0][2] - r[2][0]) / s;
+        z = (r[1][0] - r[0][1]) / s;
+    }
+    else if (r[0][0] > r[1][1] && r[0][0] > r[2][2])
+    {
+        auto s = std::sqrt(std::max(0.0f, 1.0f + r[0][0] - r[1][1] - r[2][2])) * 2.0f;
+        w = (r[2][1] - r[1][2]) / s;
+        x = 0.25f * s;
+        y = (r[0][1] + r[1][0]) / s;
+        z = (r[0][2] + r[2][0]) / s;
+    }
+    else if (r[1][1] > r[2][2])
+    {
+        auto s = std::sqrt(std::max(0.0f, 1.0f + r[1][1] - r[0][0] - r[2][2])) * 2.0f;
+        w = (r[0][2] - r[2][0]) / s;
+        x = (r[0][1] + r[1][0]) / s;
+        y = 0.25f * s;
+        z = (r[1][2] + r[2][1]) / s;
+    }
+    else
+    {
+        auto s = std::sqrt(std::max(0.0f, 1.0f + r[2][2] - r[0][0] - r[1][1])) * 2.0f;
+        w = (r[1][0] - r[0][1]) / s;
+        x = (r[0][2] + r[2][0]) / s;
+        y = (r[1][2] + r[2][1]) / s;
+        z = 0.25f * s;
+    }
+    auto length = std::sqrt(x * x + y * y + z * z + w * w);
+    for (int k = 0; k < 4; ++k) rotation[k] /= length;
+}
+
+void quat_fromEuler(const float degrees[3], float out[4])
+{
+    float c[3], s[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        c[k] = std::cos(degrees[k] * TORAD * 0.5f);
+        s[k] = std::sin(degrees[k] * TORAD * 0.5f);
+    }
+    out[0] = s[0] * c[1] * c[2] - c[0] * s[1] * s[2];
+    out[1] = c[0] * s[1] * c[2] + s[0] * c[1] * s[2];
+    out[2] = c[0] * c[1] * s[2] - s[0] * s[1] * c[2];
+    out[3] = c[0] * c[1] * c[2] + s[0] * s[1] * s[2];
+}
+
+void quat_toEuler(const float q[4], float degrees[3])
+{
+    auto x = q[0], y = q[1], z = q[2], w = q[3];
+    auto sinY = std::max(-1.0f, std::min(1.0f, 2.0f * (w * y - z * x)));
+    degrees[0] = std::atan2(2.0f * (w * x + y * z), 1.0f - 2.0f * (x * x + y * y)) / TORAD;
+    degrees[1] = std::asin(sinY) / TORAD;
+    degrees[2] = std::atan2(2.0f * (w * z + x * y), 1.0f - 2.0f * (y * y + z * z)) / TORAD;
+}
+
+void createViewMatrix(const float position[3], float angleX, float angleZ, float out[4][4])
+{
+    // Normalized direction
+    float R2[3] = {
+        -std::sin(angleZ * TORAD) * std::cos(angleX * TORAD),
+        -std::cos(angleZ * TORAD) * std::cos(angleX * TORAD),
+        -std::sin(angleX * TORAD)
+    };
+
+    float R0[3] = {
+        -1 * R2[1],
+        1 * R2[0],
+        0
+    };
+    float len = std::sqrt(R0[0] * R0[0] + R0[1] * R0[1]);
+    R0[0] /= len;
+    R0[1] /= len;
+
+    float R1[3] = {
+        R2[1] * R0[2] - R2[2] * R0[1],
+        R2[2] * R0[0] - R2[0] * R0[2],
+        R2[0] * R0[1] - R2[1] * R0[0]
+    };
+
+    auto D0 = R0[0] * -position[0] + R0[1] * -position[1] + R0[2] * -position[2];
+    auto D1 = R1[0] * -position[0] + R1[1] * -position[1] + R1[2] * -position[2];
+    auto D2 = R2[0] * -position[0] + R2[1] * -position[1] + R2[2] * -position[2];
+
+    out[0][0] = R0[0];
+    out[0][1] = R1[0];
+    out[0][2] = R2[0];
+    out[0][3] = 0.0f;
+
+    out[1][0] = R0[1];
+    out[1][1] = R1[1];
+    out[1][2] = R2[1];
+    out[1][3] = 0.0f;
+
+    out[2][0] = R0[2];
+    out[2][1] = R1[2];
+    out[2][2] = R2[2];
+    out[2][3] = 0.0f;
+
+    out[3][0] = D0;
+    out[3][1] = D1;
+    out[3][2] = D2;
+    out[3][3] = 1.0f;
+}
+
+void createPerspectiveFieldOfView(float fov, float aspectRatio, float nearPlane, float farPlane, float out[4][4])
+{
+    float CosFov = std::cos(0.5f * fov * TORAD);
+    float SinFov = std::sin(0.5f * fov * TORAD);
+
+    float Height = CosFov / SinFov;
+    float Width = Height / aspectRatio;
+    float fRange = farPlane / (nearPlane - farPlane);
+
+    out[0][0] = Width;
+    out[0][1] = 0.0f;
+    out[0][2] = 0.0f;
+    out[0][3] = 0.0f;
+
+    out[1][0] = 0.0f;
+    out[1][1] = Height;
+    out[1][2] = 0.0f;
+    out[1][3] = 0.0f;
+
+    out[2][0] = 0.0f;
+    out[2][1] = 0.0f;
+    out[2][2] = fRange;
+    out[2][3] = -1.0f;
+
+    out[3][0] = 0.0f;
+    out[3][1] = 0.0f;
+    out[3][2] = fRange * nearPlane;
+    out[3][3] = 0.0f;
+}
+
+void mulMatrix(const float a[4][4], const float b[4][4], float out[4][4])
+{
+    // Both loaded before storing, out can be a or b
+    mat4_store(mat4_mul(mat4_load(a), mat4_load(b)), out);
+}
+
+//-----------------------------------------------------------------------------
+// 4 xyz in 3 registers to and from x, y and z registers
+
+#if defined(VECTORMATH_SSE)
+static inline void deinterleave3(__m128 a, __m128 b, __m128 c, __m128& x, __m128& y, __m128& z)
+{
+    // a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+    x = _mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 0, 0)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+    y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+static inline void interleave3(__m128 x, __m128 y, __m128 z, __m128& a, __m128& b, __m128& c)
+{
+    a = _mm_shuffle_ps(_mm_unpacklo_ps(x, y), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+    b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+    c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+#endif
+
+#if defined(VECTORMATH_AVX)
+// Same shuffles, 4 points in each 128 bit lane
+static inline void deinterleave3(__m256 a, __m256 b, __m256 c, __m256& x, __m256& y, __m256& z)
+{
+    x = _mm256_shuffle_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 0, 0)), _mm256_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+    y = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm256_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+static inline void interleave3(__m256 x, __m256 y, __m256 z, __m256& a, __m256& b, __m256& c)
+{
+    a = _mm256_shuffle_ps(_mm256_unpacklo_ps(x, y), _mm256_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+    b = _mm256_shuffle_ps(_mm256_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm256_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+    c = _mm256_shuffle_ps(_mm256_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm256_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+static inline __m256 load2(const float* pLo, const float* pHi)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pLo)), _mm_loadu_ps(pHi), 1);
+}
+
+static inline void store2(float* pLo, float* pHi, __m256 v)
+{
+    _mm_storeu_ps(pLo, _mm256_castps256_ps128(v));
+    _mm_storeu_ps(pHi, _mm256_extractf128_ps(v, 1));
+}
+
+static inline __m256 splat2(float4 v)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(v.m), v.m, 1);
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Points
+
+static void transformPointsScalar(const mat4& m, const float* pIn, float* pOut, size_t count)
+{
+    for (size_t i = 0; i < count; ++i, pIn += 3, pOut += 3)
+    {
+        auto p = mat4_transformPoint(m, float4_set(pIn[0], pIn[1], pIn[2], 1.0f));
+        alignas(16) float values[4];
+        float4_store(values, p);
+        pOut[0] = values[0];
+        pOut[1] = values[1];
+        pOut[2] = values[2];
+    }
+}
+
+void vectorMath_transformPoints(const mat4& m, const float* pIn, float* pOut, size_t count)
+{
+    size_t i = 0;
+#if defined(VECTORMATH_AVX)
+    {
+        // Matrix elements, each in all lanes
+        __m256 e[4][3];
+        for (int col = 0; col < 4; ++col)
+        {
+            e[col][0] = splat2(float4_broadcast<0>(m.cols[col]));
+            e[col][1] = splat2(float4_broadcast<1>(m.cols[col]));
+            e[col][2] = splat2(float4_broadcast<2>(m.cols[col]));
+        }
+        for (; i + 8 <= count; i += 8)
+        {
+            auto pSrc = pIn + i * 3;
+            auto pDst = pOut + i * 3;
+            __m256 x, y, z;
+            deinterleave3(load2(pSrc, pSrc + 12), load2(pSrc + 4, pSrc + 16), load2(pSrc + 8, pSrc + 20), x, y, z);
+            __m256 r[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                r[k] = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(e[0][k], x), _mm256_mul_ps(e[1][k], y)),
+                    _mm256_add_ps(_mm256_mul_ps(e[2][k], z), e[3][k]));
+            }
+            __m256 a, b, c;
+            interleave3(r[0], r[1], r[2], a, b, c);
+            store2(pDst, pDst + 12, a);
+            store2(pDst + 4, pDst + 16, b);
+            store2(pDst + 8, pDst + 20, c);
+        }
+    }
+#endif
+#if defined(VECTORMATH_SSE)
+    {
+        __m128 e[4][3];
+        for (int col = 0; col < 4; ++col)
+        {
+            e[col][0] = float4_broadcast<0>(m.cols[col]).m;
+            e[col][1] = float4_broadcast<1>(m.cols[col]).m;
+            e[col][2] = float4_broadcast<2>(m.cols[col]).m;
+        }
+        for (; i + 4 <= count; i += 4)
+        {
+            auto pSrc = pIn + i * 3;
+            auto pDst = pOut + i * 3;
+            __m128 x, y, z;
+            deinterleave3(_mm_loadu_ps(pSrc), _mm_loadu_ps(pSrc + 4), _mm_loadu_ps(pSrc + 8), x, y, z);
+            __m128 r[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                r[k] = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(e[0][k], x), _mm_mul_ps(e[1][k], y)),
+                    _mm_add_ps(_mm_mul_ps(e[2][k], z), e[3][k]));
+            }
+            __m128 a, b, c;
+            interleave3(r[0], r[1], r[2], a, b, c);
+            _mm_storeu_ps(pDst, a);
+            _mm_storeu_ps(pDst + 4, b);
+            _mm_storeu_ps(pDst + 8, c);
+        }
+    }
+#elif defined(VECTORMATH_NEON)
+    {
+        float32x4_t e[4][3];
+        for (int col = 0; col < 4; ++col)
+        {
+            e[col][0] = float4_broadcast<0>(m.cols[col]).m;
+            e[col][1] = float4_broadcast<1>(m.cols[col]).m;
+            e[col][2] = float4_broadcast<2>(m.cols[col]).m;
+        }
+        for (; i + 4 <= count; i += 4)
+        {
+            auto p = vld3q_f32(pIn + i * 3);
+            float32x4x3_t r;
+            for (int k = 0; k < 3; ++k)
+            {
+                r.val[k] = vmlaq_f32(vmlaq_f32(vmlaq_f32(e[3][k], e[0][k], p.val[0]), e[1][k], p.val[1]), e[2][k], p.val[2]);
+            }
+            vst3q_f32(pOut + i * 3, r);
+        }
+    }
+#endif
+    transformPointsScalar(m, pIn + i * 3, pOut + i * 3, count - i);
+}
+
+//-----------------------------------------------------------------------------
+// Boxes
+// From the center and half extents: the new center is the transformed
+// center, the new half extents the extents through the absolute 3x3.
+
+static inline void transformAabb(const mat4& m, const float4 absCols[3], const float* pSrc, float* pDst)
+{
+    auto half = float4_splat(0.5f);
+#if defined(VECTORMATH_SSE)
+    // Two overlapping loads to stay inside the box
+    float4 bmin, bmax;
+    bmin.m = _mm_loadu_ps(pSrc);
+    bmax.m = _mm_loadu_ps(pSrc + 2);
+    bmax.m = _mm_shuffle_ps(bmax.m, bmax.m, _MM_SHUFFLE(3, 3, 2, 1));
+#else
+    auto bmin = float4_set(pSrc[0], pSrc[1], pSrc[2], 0.0f);
+    auto bmax = float4_set(pSrc[3], pSrc[4], pSrc[5], 0.0f);
+#endif
+    auto center = (bmin + bmax) * half;
+    auto extent = (bmax - bmin) * half;
+    auto newCenter = mat4_transformPoint(m, center);
+    auto newExtent = absCols[0] * float4_broadcast<0>(extent) + absCols[1] * float4_broadcast<1>(extent) + absCols[2] * float4_broadcast<2>(extent);
+    auto newMin = newCenter - newExtent;
+    auto newMax = newCenter + newExtent;
+#if defined(VECTORMATH_SSE)
+    auto t = _mm_shuffle_ps(newMin.m, newMax.m, _MM_SHUFFLE(0, 0, 2, 2));
+    _mm_storeu_ps(pDst, _mm_shuffle_ps(newMin.m, t, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storel_pi((__m64*)(pDst + 4), _mm_shuffle_ps(newMax.m, newMax.m, _MM_SHUFFLE(2, 1, 2, 1)));
+#else
+    alignas(16) float values[8];
+    float4_store(values, newMin);
+    float4_store(values + 4, newMax);
+    pDst[0] = values[0]; pDst[1] = values[1]; pDst[2] = values[2];
+    pDst[3] = values[4]; pDst[4] = values[5]; pDst[5] = values[6];
+#endif
+}
+
+void vectorMath_transformAabbs(const mat4& m, const float* pIn, float* pOut, size_t count)
+{
+    float4 absCols[3] = { float4_abs(m.cols[0]), float4_abs(m.cols[1]), float4_abs(m.cols[2]) };
+    size_t i = 0;
+#if defined(VECTORMATH_AVX)
+    {
+        // A box in each 128 bit lane
+        __m256 cols[4] = { splat2(m.cols[0]), splat2(m.cols[1]), splat2(m.cols[2]), splat2(m.cols[3]) };
+        __m256 absCols2[3] = { splat2(absCols[0]), splat2(absCols[1]), splat2(absCols[2]) };
+        auto half2 = _mm256_set1_ps(0.5f);
+        for (; i + 2 <= count; i += 2)
+        {
+            auto pSrc = pIn + i * 6;
+            auto pDst = pOut + i * 6;
+            auto lo = load2(pSrc, pSrc + 6); // min xyz, max x
+            auto hi = load2(pSrc + 2, pSrc + 8); // min z, max xyz
+            auto bmin = lo;
+            auto bmax = _mm256_shuffle_ps(hi, hi, _MM_SHUFFLE(3, 3, 2, 1));
+            auto center = _mm256_mul_ps(_mm256_add_ps(bmin, bmax), half2);
+            auto extent = _mm256_mul_ps(_mm256_sub_ps(bmax, bmin), half2);
+
+            auto newCenter = _mm256_add_ps(
+                _mm256_add_ps(
+                    _mm256_mul_ps(cols[0], _mm256_shuffle_ps(center, center, _MM_SHUFFLE(0, 0, 0, 0))),
+                    _mm256_mul_ps(cols[1], _mm256_shuffle_ps(center, center, _MM_SHUFFLE(1, 1, 1, 1)))),
+                _mm256_add_ps(
+                    _mm256_mul_ps(cols[2], _mm256_shuffle_ps(center, center, _MM_SHUFFLE(2, 2, 2, 2))),
+                    cols[3]));
+            auto newExtent = _mm256_add_ps(
+                _mm256_add_ps(
+                    _mm256_mul_ps(absCols2[0], _mm256_shuffle_ps(extent, extent, _MM_SHUFFLE(0, 0, 0, 0))),
+                    _mm256_mul_ps(absCols2[1], _mm256_shuffle_ps(extent, extent, _MM_SHUFFLE(1, 1, 1, 1)))),
+                _mm256_mul_ps(absCols2[2], _mm256_shuffle_ps(extent, extent, _MM_SHUFFLE(2, 2, 2, 2))));
+            auto newMin = _mm256_sub_ps(newCenter, newExtent);
+            auto newMax = _mm256_add_ps(newCenter, newExtent);
+
+            // min xyz, max x then max yz, written over by the second box
+            auto t = _mm256_shuffle_ps(newMin, newMax, _MM_SHUFFLE(0, 0, 2, 2));
+            auto first = _mm256_shuffle_ps(newMin, t, _MM_SHUFFLE(2, 0, 1, 0));
+            auto rest = _mm256_shuffle_ps(newMax, newMax, _MM_SHUFFLE(2, 1, 2, 1));
+            _mm_storeu_ps(pDst, _mm256_castps256_ps128(first));
+            _mm_storel_pi((__m64*)(pDst + 4), _mm256_castps256_ps128(rest));
+            _mm_storeu_ps(pDst + 6, _mm256_extractf128_ps(first, 1));
+            _mm_storel_pi((__m64*)(pDst + 10), _mm256_extractf128_ps(rest, 1));
+        }
+    }
+#endif
+    for (; i < count; ++i) transformAabb(m, absCols, pIn + i * 6, pOut + i * 6);
+}
+
+void vectorMath_transformAabbsEach(const mat4* pMatrices, const float* pIn, size_t inStride, float* pOut, size_t count)
+{
+    size_t i = 0;
+#if defined(VECTORMATH_AVX)
+    {
+        // A box and its matrix in each 128 bit lane
+        auto signMask = _mm256_set1_ps(-0.0f);
+        auto half2 = _mm256_set1_ps(0.5f);
+        for (; i + 2 <= count; i += 2)
+        {
+            const auto& m0 = pMatrices[i];
+            const auto& m1 = pMatrices[i + 1];
+            __m256 cols[4];
+            for (int col = 0; col < 4; ++col) cols[col] = _mm256_insertf128_ps(_mm256_castps128_ps256(m0.cols[col].m), m1.cols[col].m, 1);
+            __m256 absCols2[3] = { _mm256_andnot_ps(signMask, cols[0]), _mm256_andnot_ps(signMask, cols[1]), _mm256_andnot_ps(signMask, cols[2]) };
+
+            auto pSrc = pIn + i * inStride;
+            auto pDst = pOut + i * 6;
+            auto lo = load2(pSrc, pSrc + inStride);
+            auto hi = load2(pSrc + 2, pSrc + inStride + 2);
+            auto bmin = lo;
+            auto bmax = _mm256_shuffle_ps(hi, hi, _MM_SHUFFLE(3, 3, 2, 1));
+            auto center = _mm256_mul_ps(_mm256_add_ps(bmin, bmax), half2);
+            auto extent = _mm256_mul_ps(_mm256_sub_ps(bmax, bmin), half2);
+
+            auto newCenter = _mm256_add_ps(
+                _mm256_add_ps(
+                    _mm256_mul_ps(cols[0], _mm256_shuffle_ps(center, center, _MM_SHUFFLE(0, 0, 0, 0))),
+                    _mm256_mul_ps(cols[1], _mm256_shuffle_ps(center, center, _MM_SHUFFLE(1, 1, 1, 1)))),
+                _mm256_add_ps(
+                    _mm256_mul_ps(cols[2], _mm256_shuffle_ps(center, center, _MM_SHUFFLE(2, 2, 2, 2))),
+                    cols[3]));
+            auto newExtent = _mm256_add_ps(
+                _mm256_add_ps(
+                    _mm256_mul_ps(absCols2[0], _mm256_shuffle_ps(extent, extent, _MM_SHUFFLE(0, 0, 0, 0))),
+                    _mm256_mul_ps(absCols2[1], _mm256_shuffle_ps(extent, extent, _MM_SHUFFLE(1, 1, 1, 1)))),
+                _mm256_mul_ps(absCols2[2], _mm256_shuffle_ps(extent, extent, _MM_SHUFFLE(2, 2, 2, 2))));
+            auto newMin = _mm256_sub_ps(newCenter, newExtent);
+            auto newMax = _mm256_add_ps(newCenter, newExtent);
+
+            auto t = _mm256_shuffle_ps(newMin, newMax, _MM_SHUFFLE(0, 0, 2, 2));
+            auto first = _mm256_shuffle_ps(newMin, t, _MM_SHUFFLE(2, 0, 1, 0));
+            auto rest = _mm256_shuffle_ps(newMax, newMax, _MM_SHUFFLE(2, 1, 2, 1));
+            _mm_storeu_ps(pDst, _mm256_castps256_ps128(first));
+            _mm_storel_pi((__m64*)(pDst + 4), _mm256_castps256_ps128(rest));
+            _mm_storeu_ps(pDst + 6, _mm256_extractf128_ps(first, 1));
+            _mm_storel_pi((__m64*)(pDst + 10), _mm256_extractf128_ps(rest, 1));
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        const auto& m = pMatrices[i];
+        float4 absCols[3] = { float4_abs(m.cols[0]), float4_abs(m.cols[1]), float4_abs(m.cols[2]) };
+        transformAabb(m, absCols, pIn + i * inStride, pOut + i * 6);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// TRS
+
+static mat4 composeTrs(const float* t, const float* q, const float* s)
+{
+    auto x = q[0], y = q[1], z = q[2], w = q[3];
+    mat4 r;
+    r.cols[0] = float4_set(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y), 0.0f) * float4_splat(s[0]);
+    r.cols[1] = float4_set(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x), 0.0f) * float4_splat(s[1]);
+    r.cols[2] = float4_set(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y), 0.0f) * float4_splat(s[2]);
+    r.cols[3] = float4_set(t[0], t[1], t[2], 1.0f);
+    return r;
+}
+
+void vectorMath_composeTrs(const float* pTranslations, const float* pRotations, const float* pScales, mat4* pOut, size_t count)
+{
+    size_t i = 0;
+#if defined(VECTORMATH_SSE)
+    // 4 at a time, one entity per lane
+    auto one = _mm_set1_ps(1.0f);
+    auto two = _mm_set1_ps(2.0f);
+    auto zero = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4)
+    {
+        auto qx = _mm_loadu_ps(pRotations + i * 4);
+        auto qy = _mm_loadu_ps(pRotations + i * 4 + 4);
+        auto qz = _mm_loadu_ps(pRotations + i * 4 + 8);
+        auto qw = _mm_loadu_ps(pRotations + i * 4 + 12);
+        _MM_TRANSPOSE4_PS(qx, qy, qz, qw);
+        __m128 tx, ty, tz, sx, sy, sz;
+        deinterleave3(_mm_loadu_ps(pTranslations + i * 3), _mm_loadu_ps(pTranslations + i * 3 + 4), _mm_loadu_ps(pTranslations + i * 3 + 8), tx, ty, tz);
+        deinterleave3(_mm_loadu_ps(pScales + i * 3), _mm_loadu_ps(pScales + i * 3 + 4), _mm_loadu_ps(pScales + i * 3 + 8), sx, sy, sz);
+
+        auto x2 = _mm_mul_ps(qx, two), y2 = _mm_mul_ps(qy, two), z2 = _mm_mul_ps(qz, two);
+        auto xx = _mm_mul_ps(qx, x2), yy = _mm_mul_ps(qy, y2), zz = _mm_mul_ps(qz, z2);
+        auto xy = _mm_mul_ps(qx, y2), xz = _mm_mul_ps(qx, z2), yz = _mm_mul_ps(qy, z2);
+        auto wx = _mm_mul_ps(qw, x2), wy = _mm_mul_ps(qw, y2), wz = _mm_mul_ps(qw, z2);
+
+        __m128 c0[4] = {
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx),
+            _mm_mul_ps(_mm_add_ps(xy, wz), sx),
+            _mm_mul_ps(_mm_sub_ps(xz, wy), sx),
+            zero
+        };
+        __m128 c1[4] = {
+            _mm_mul_ps(_mm_sub_ps(xy, wz), sy),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy),
+            _mm_mul_ps(_mm_add_ps(yz, wx), sy),
+            zero
+        };
+        __m128 c2[4] = {
+            _mm_mul_ps(_mm_add_ps(xz, wy), sz),
+            _mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz),
+            zero
+        };
+        __m128 c3[4] = { tx, ty, tz, one };
+        _MM_TRANSPOSE4_PS(c0[0], c0[1], c0[2], c0[3]);
+        _MM_TRANSPOSE4_PS(c1[0], c1[1], c1[2], c1[3]);
+        _MM_TRANSPOSE4_PS(c2[0], c2[1], c2[2], c2[3]);
+        _MM_TRANSPOSE4_PS(c3[0], c3[1], c3[2], c3[3]);
+        for (int k = 0; k < 4; ++k)
+        {
+            auto& out = pOut[i + k];
+            out.cols[0].m = c0[k];
+            out.cols[1].m = c1[k];
+            out.cols[2].m = c2[k];
+            out.cols[3].m = c3[k];
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        pOut[i] = composeTrs(pTranslations + i * 3, pRotations + i * 4, pScales + i * 3);
+    }
+}
+
+void vectorMath_relativeMatrices(const mat4* pMatrices, const double* pOrigins, const double eye[3], mat4* pOut, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto pOrigin = pOrigins + i * 3;
+        auto offset = float4_set((float)(pOrigin[0] - eye[0]), (float)(pOrigin[1] - eye[1]), (float)(pOrigin[2] - eye[2]), 0.0f);
+        auto m = pMatrices[i];
+        m.cols[3] = m.cols[3] + offset;
+        pOut[i] = m;
+    }
+}
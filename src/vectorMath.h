@@ -0,0 +1,249 @@
+#ifndef VECTORMATH_H_INCLUDED
+#define VECTORMATH_H_INCLUDED
+
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VECTORMATH_SSE
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VECTORMATH_NEON
+#include <arm_neon.h>
+#endif
+
+#define TORAD 0.01745329251994329576923690768489f
+
+// 4 floats in a SIMD register where there is one. Lanes are x, y, z, w.
+struct alignas(16) float4
+{
+#if defined(VECTORMATH_SSE)
+    __m128 m;
+#elif defined(VECTORMATH_NEON)
+    float32x4_t m;
+#else
+    float m[4];
+#endif
+};
+
+// Column major, same memory layout as the float[4][4] given to GL:
+// cols[3] is the translation.
+struct alignas(16) mat4
+{
+    float4 cols[4];
+};
+
+inline float4 float4_set(float x, float y, float z, float w)
+{
+    float4 r;
+#if defined(VECTORMATH_SSE)
+    r.m = _mm_set_ps(w, z, y, x);
+#elif defined(VECTORMATH_NEON)
+    const float values[4] = { x, y, z, w };
+    r.m = vld1q_f32(values);
+#else
+    r.m[0] = x; r.m[1] = y; r.m[2] = z; r.m[3] = w;
+#endif
+    return r;
+}
+
+inline float4 float4_splat(float value)
+{
+    float4 r;
+#if defined(VECTORMATH_SSE)
+    r.m = _mm_set1_ps(value);
+#elif defined(VECTORMATH_NEON)
+    r.m = vdupq_n_f32(value);
+#else
+    r.m[0] = r.m[1] = r.m[2] = r.m[3] = value;
+#endif
+    return r;
+}
+
+// Unaligned
+inline float4 float4_load(const float* p)
+{
+    float4 r;
+#if defined(VECTORMATH_SSE)
+    r.m = _mm_loadu_ps(p);
+#elif defined(VECTORMATH_NEON)
+    r.m = vld1q_f32(p);
+#else
+    r.m[0] = p[0]; r.m[1] = p[1]; r.m[2] = p[2]; r.m[3] = p[3];
+#endif
+    return r;
+}
+
+inline void float4_store(float* p, float4 a)
+{
+#if defined(VECTORMATH_SSE)
+    _mm_storeu_ps(p, a.m);
+#elif defined(VECTORMATH_NEON)
+    vst1q_f32(p, a.m);
+#else
+    p[0] = a.m[0]; p[1] = a.m[1]; p[2] = a.m[2]; p[3] = a.m[3];
+#endif
+}
+
+inline float4 operator+(float4 a, float4 b)
+{
+#if defined(VECTORMATH_SSE)
+    a.m = _mm_add_ps(a.m, b.m);
+#elif defined(VECTORMATH_NEON)
+    a.m = vaddq_f32(a.m, b.m);
+#else
+    for (int i = 0; i < 4; ++i) a.m[i] += b.m[i];
+#endif
+    return a;
+}
+
+inline float4 operator-(float4 a, float4 b)
+{
+#if defined(VECTORMATH_SSE)
+    a.m = _mm_sub_ps(a.m, b.m);
+#elif defined(VECTORMATH_NEON)
+    a.m = vsubq_f32(a.m, b.m);
+#else
+    for (int i = 0; i < 4; ++i) a.m[i] -= b.m[i];
+#endif
+    return a;
+}
+
+inline float4 operator*(float4 a, float4 b)
+{
+#if defined(VECTORMATH_SSE)
+    a.m = _mm_mul_ps(a.m, b.m);
+#elif defined(VECTORMATH_NEON)
+    a.m = vmulq_f32(a.m, b.m);
+#else
+    for (int i = 0; i < 4; ++i) a.m[i] *= b.m[i];
+#endif
+    return a;
+}
+
+inline float4 float4_min(float4 a, float4 b)
+{
+#if defined(VECTORMATH_SSE)
+    a.m = _mm_min_ps(a.m, b.m);
+#elif defined(VECTORMATH_NEON)
+    a.m = vminq_f32(a.m, b.m);
+#else
+    for (int i = 0; i < 4; ++i) a.m[i] = b.m[i] < a.m[i] ? b.m[i] : a.m[i];
+#endif
+    return a;
+}
+
+inline float4 float4_max(float4 a, float4 b)
+{
+#if defined(VECTORMATH_SSE)
+    a.m = _mm_max_ps(a.m, b.m);
+#elif defined(VECTORMATH_NEON)
+    a.m = vmaxq_f32(a.m, b.m);
+#else
+    for (int i = 0; i < 4; ++i) a.m[i] = b.m[i] > a.m[i] ? b.m[i] : a.m[i];
+#endif
+    return a;
+}
+
+inline float4 float4_abs(float4 a)
+{
+#if defined(VECTORMATH_SSE)
+    a.m = _mm_andnot_ps(_mm_set1_ps(-0.0f), a.m);
+#elif defined(VECTORMATH_NEON)
+    a.m = vabsq_f32(a.m);
+#else
+    for (int i = 0; i < 4; ++i) a.m[i] = a.m[i] < 0.0f ? -a.m[i] : a.m[i];
+#endif
+    return a;
+}
+
+// Lane i in all lanes
+template<int i>
+inline float4 float4_broadcast(float4 a)
+{
+#if defined(VECTORMATH_SSE)
+    a.m = _mm_shuffle_ps(a.m, a.m, _MM_SHUFFLE(i, i, i, i));
+#elif defined(VECTORMATH_NEON)
+    a.m = vdupq_n_f32(vgetq_lane_f32(a.m, i));
+#else
+    a.m[0] = a.m[1] = a.m[2] = a.m[3] = a.m[i];
+#endif
+    return a;
+}
+
+inline float float4_get(float4 a, int i)
+{
+    alignas(16) float values[4];
+    float4_store(values, a);
+    return values[i];
+}
+
+// m * (x, y, z, 1)
+inline float4 mat4_transformPoint(const mat4& m, float4 p)
+{
+    return m.cols[0] * float4_broadcast<0>(p) + m.cols[1] * float4_broadcast<1>(p) + m.cols[2] * float4_broadcast<2>(p) + m.cols[3];
+}
+
+// m * (x, y, z, 0), directions and offsets
+inline float4 mat4_transformVector(const mat4& m, float4 v)
+{
+    return m.cols[0] * float4_broadcast<0>(v) + m.cols[1] * float4_broadcast<1>(v) + m.cols[2] * float4_broadcast<2>(v);
+}
+
+// m * (x, y, z, w)
+inline float4 mat4_transform(const mat4& m, float4 p)
+{
+    return m.cols[0] * float4_broadcast<0>(p) + m.cols[1] * float4_broadcast<1>(p) + m.cols[2] * float4_broadcast<2>(p) + m.cols[3] * float4_broadcast<3>(p);
+}
+
+// a then b, that is b * a. Same order as mulMatrix(view, proj, viewProj).
+inline mat4 mat4_mul(const mat4& a, const mat4& b)
+{
+    mat4 r;
+    for (int i = 0; i < 4; ++i) r.cols[i] = mat4_transform(b, a.cols[i]);
+    return r;
+}
+
+mat4 mat4_load(const float m[4][4]);
+void mat4_store(const mat4& m, float out[4][4]);
+mat4 mat4_identity();
+
+// For matrices whose last row is 0, 0, 0, 1. Returns false if it can't be
+// inverted, like with a zero scale.
+bool mat4_inverseAffine(const mat4& m, mat4& out);
+
+// The upper 3x3 as a rotation and a scale, back to what composeTrs takes.
+// Shear, from non uniform scales under rotations, is lost. A mirror goes in
+// the x scale.
+void mat4_decompose(const mat4& m, float rotation[4], float scale[3]);
+
+// Quaternions are x, y, z, w. Euler angles are in degrees, applied around X,
+// then Y, then Z.
+void quat_fromEuler(const float degrees[3], float out[4]);
+void quat_toEuler(const float q[4], float degrees[3]);
+
+// Camera matrices, for the views
+void createViewMatrix(const float position[3], float angleX, float angleZ, float out[4][4]);
+void createPerspectiveFieldOfView(float fov, float aspectRatio, float nearPlane, float farPlane, float out[4][4]);
+void mulMatrix(const float a[4][4], const float b[4][4], float out[4][4]); // out = a then b
+
+// Batches. Arrays are tightly packed and may be the same for in and out.
+// Points are xyz.
+void vectorMath_transformPoints(const mat4& m, const float* pIn, float* pOut, size_t count);
+
+// Boxes are min xyz, max xyz. Out are the boxes around the transformed ones.
+void vectorMath_transformAabbs(const mat4& m, const float* pIn, float* pOut, size_t count);
+
+// Box i by matrix i. inStride is in floats between the boxes in, 6 for an
+// array of boxes, 0 for the same box by all the matrices.
+void vectorMath_transformAabbsEach(const mat4* pMatrices, const float* pIn, size_t inStride, float* pOut, size_t count);
+
+// World matrices from translation xyz, rotation quaternion xyzw (normalized)
+// and scale xyz
+void vectorMath_composeTrs(const float* pTranslations, const float* pRotations, const float* pScales, mat4* pOut, size_t count);
+
+// Matrices whose translation is from origins xyz, moved to be from eye
+// instead. The difference is taken in double, so far from the world origin
+// what's near the eye keeps its float precision.
+void vectorMath_relativeMatrices(const mat4* pMatrices, const double* pOrigins, const double eye[3], mat4* pOut, size_t count);
+
+#endif
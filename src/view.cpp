@@ -1,17 +1,40 @@
 #include "view.h"
+#include "bake.h"
 #include "globals.h"
-#include "math_helper.h"
+#include "vectorMath.h"
 #include "rendering.h"
+#include "edit.h"
+#include "entityGrid.h"
+#include "fileSystem.h"
+#include "frame.h"
+#include "layers.h"
 #include "library.h"
+#include "picking.h"
+#include "raycast.h"
+#include "renderList.h"
+#include "selection.h"
+#include "shaders.h"
+#include "snap.h"
+#include "terrain.h"
+#include "transforms.h"
 
 #include <imgui.h>
 #include <stdio.h>
+#include <fstream>
+#include <cfloat>
+#include <cmath>
 #include <cinttypes>
 #include <SDL.h>
 
 // Defs
 #define GRID_2D_SIZE 101
 #define GRIDMESH_MAX 4
+#define VIEW_ORTHO_DEPTH 10000.0f // World units in front and behind the 2D views
+#define SELECT_DRAG_THRESHOLD 3.0f // Pixels before a click becomes a marquee
+#define SELECT_CLICK_RADIUS 5.0f // Pixels around the cursor for 2D click selection
+#define SNAP_RADIUS 10.0f // Pixels
+#define VIEW_SAVE_DELAY 1000 // Milliseconds without camera changes before writing them
+#define VIEW_SIDECAR_EXTENSION ".user" // Next to the map, per user cameras
 
 // Types
 static const float ZOOM_LEVELS[] = {
@@ -72,12 +95,79 @@ struct Grid2DVertex
     float color[4];
 };
 
+struct ShaderHighlight
+{
+    GLuint program = 0;
+    GLint uniform_projMtx = 0;
+    GLint uniform_color = 0;
+    GLint attrib_position = 0;
+    GLint attrib_boxMin = 0;
+    GLint attrib_boxSize = 0;
+} shader_highlight;
+
+// Boxes around the selected entities, one instance each
+struct HighlightMesh
+{
+    GLuint vao = 0;
+    GLuint cubeVbo = 0;
+    GLuint instanceVbo = 0;
+    GLsizei count = 0;
+    uint64_t revisions[3] = { 0, 0, 0 }; // Selection, entities, library
+    std::vector<float> boxes; // min[3], size[3]
+};
+
+enum class SelectMode
+{
+    Replace,
+    Add,
+    Remove,
+    Toggle
+};
+
+// Left button held in a view. Becomes a marquee, or a lasso with Alt in the
+// 2D views, once the mouse moved far enough. Otherwise it's a click.
+struct SelectDrag
+{
+    int viewIndex = -1;
+    bool isDragging = false;
+    bool isLasso = false;
+    std::vector<ImVec2> points; // Screen space. Marquee uses the first 2 as corners
+};
+
+// Left button held on a selected entity, the selection follows the mouse.
+// Steps are only applied to the document, the drag is committed as a single
+// edit from where it started when it ends, so it's journaled once.
+struct MoveDrag
+{
+    int viewIndex = -1;
+    std::vector<uint32_t> indices;
+    std::vector<double> startPositions;
+    double anchor[3]; // Grabbed entity's position, it's what snaps
+    float grab[3]; // World point under the mouse when grabbed
+    double delta[3];
+};
+
+// How a 2D view maps world axes. u goes right, v goes down and depth goes
+// into the screen, each being sign * the world axis.
+struct ViewAxes
+{
+    int u, v, depth;
+    float signU, signV, signDepth;
+};
+
 // Private vars
 static GridMesh gridMeshes[GRIDMESH_MAX];
 static int draggingView = -1;
 static bool initialized = false;
-static float viewPosOnDragStart[2] = { 0, 0 };
+static double viewPosOnDragStart[2] = { 0, 0 };
 static int dragMouseX, dragMouseY;
+static SelectMode pickMode = SelectMode::Replace;
+static SelectDrag selectDrag;
+static MoveDrag moveDrag;
+static HighlightMesh highlightMesh;
+static GLuint worldMatrixVbo = 0; // The render list's eye matrices, per instance
+static bool isSavePending = false;
+static Uint32 cameraChangeTime = 0;
 
 // Public vars
 const char* VIEW_TYPE_TO_NAME[] = {
@@ -100,6 +190,398 @@ ViewInfo viewInfos[MAX_VIEWS] = {
 static void viewDrawCallback(const ImDrawList* parent_list, const ImDrawCmd* cmd);
 
 // Functions
+static void applySelection(const uint32_t* pIndices, size_t count, SelectMode mode)
+{
+    if (mode == SelectMode::Replace) selection_clear();
+    auto entityCount = entities_count(document.entities);
+    std::vector<uint32_t> indices;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (pIndices[i] < entityCount) indices.push_back(pIndices[i]);
+    }
+
+    // Hidden or locked ones can't be picked, like a locked entity under the
+    // mouse in the 3D view
+    std::vector<uint8_t> layers;
+    entities_getValues(document.entities, EntityField::Layer, indices.data(), indices.size(), layers);
+    auto selectableMask = layers_getSelectableMask();
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        auto index = indices[i];
+        if (mode != SelectMode::Remove && !((selectableMask >> layers[i]) & 1)) continue;
+        switch (mode)
+        {
+            case SelectMode::Replace:
+            case SelectMode::Add: selection_set(index, true); break;
+            case SelectMode::Remove: selection_set(index, false); break;
+            case SelectMode::Toggle: selection_toggle(index); break;
+        }
+    }
+    frame_invalidate(FrameReason::UI);
+}
+
+static ViewAxes getViewAxes(ViewType type)
+{
+    switch (type)
+    {
+        case ViewType::Top: return { 0, 1, 2, 1, -1, -1 };
+        case ViewType::Bottom: return { 0, 1, 2, 1, 1, 1 };
+        case ViewType::Front: return { 0, 2, 1, 1, -1, 1 };
+        case ViewType::Back: return { 0, 2, 1, -1, -1, -1 };
+        case ViewType::Left: return { 1, 2, 0, -1, -1, 1 };
+        default: return { 1, 2, 0, 1, -1, -1 };
+    }
+}
+
+// Where a view's render matrices have their origin. Models are drawn from
+// there so they keep their float precision far from the world origin.
+static void getEye(const ViewInfo* pView, double out[3])
+{
+    if (pView->type == ViewType::Perspective)
+    {
+        memcpy(out, pView->position, sizeof(double) * 3);
+        return;
+    }
+    auto axes = getViewAxes(pView->type);
+    out[axes.u] = pView->position[0] * axes.signU;
+    out[axes.v] = pView->position[1] * axes.signV;
+    out[axes.depth] = 0.0;
+}
+
+// Same mapping as the 2D grid: the view position is at the center of the
+// screen and ZOOM_LEVELS are pixels per meter. The eye is at the origin.
+static void createOrthoViewProj(const ViewInfo* pView, float W, float H, float out[4][4])
+{
+    auto axes = getViewAxes(pView->type);
+    auto zoom = ZOOM_LEVELS[pView->zoomLevel];
+    memset(out, 0, sizeof(float) * 16);
+    out[axes.u][0] = axes.signU * zoom * 2.0f / W;
+    out[axes.v][1] = -axes.signV * zoom * 2.0f / H;
+    out[axes.depth][2] = axes.signDepth / VIEW_ORTHO_DEPTH;
+    out[3][3] = 1.0f;
+}
+
+// For vertices in world space, from a view projection with its eye at the
+// origin. Only for what stays near the world origin, like the grid.
+static void createWorldViewProj(const float viewProjMat[4][4], const double eye[3], float out[4][4])
+{
+    float translation[4][4] =
+    {
+        { 1.0f, 0.0f, 0.0f, 0.0f },
+        { 0.0f, 1.0f, 0.0f, 0.0f },
+        { 0.0f, 0.0f, 1.0f, 0.0f },
+        { (float)-eye[0], (float)-eye[1], (float)-eye[2], 1.0f }
+    };
+    mulMatrix(translation, viewProjMat, out);
+}
+
+// Screen position to world coordinates along the view's u and v axes, in a
+// 2D view that was drawn
+static void getMouseWorld2D(const ViewInfo* pView, float x, float y, float out[2])
+{
+    auto axes = getViewAxes(pView->type);
+    auto zoom = ZOOM_LEVELS[pView->zoomLevel];
+    auto W = pView->clipRect[2] - pView->clipRect[0];
+    auto H = pView->clipRect[3] - pView->clipRect[1];
+    out[0] = (pView->position[0] + (x - pView->clipRect[0] - W / 2.0f) / zoom) * axes.signU;
+    out[1] = (pView->position[1] + (y - pView->clipRect[1] - H / 2.0f) / zoom) * axes.signV;
+}
+
+// World space ray under a screen position, in a perspective view that was drawn
+static bool getMouseRay(const ViewInfo* pView, float x, float y, float origin[3], float dir[3])
+{
+    auto W = pView->clipRect[2] - pView->clipRect[0];
+    auto H = pView->clipRect[3] - pView->clipRect[1];
+    if (W <= 0 || H <= 0) return false;
+
+    // Only the rotation is needed
+    const float eye[3] = { 0.0f, 0.0f, 0.0f };
+    float viewMat[4][4];
+    float projMat[4][4];
+    createViewMatrix(eye, pView->angleX, pView->angleZ, viewMat);
+    createPerspectiveFieldOfView(90, W / H, 0.1f, 1000.0f, projMat);
+
+    // View space direction, the camera looks down -Z
+    auto viewX = ((x - pView->clipRect[0]) / W * 2.0f - 1.0f) / projMat[0][0];
+    auto viewY = (1.0f - (y - pView->clipRect[1]) / H * 2.0f) / projMat[1][1];
+    for (int a = 0; a < 3; ++a)
+    {
+        origin[a] = (float)pView->position[a];
+        dir[a] = viewMat[a][0] * viewX + viewMat[a][1] * viewY - viewMat[a][2];
+    }
+    return true;
+}
+
+// Cameras go to the sidecar once they stopped moving for VIEW_SAVE_DELAY
+static void onCameraChanged()
+{
+    isSavePending = true;
+    cameraChangeTime = SDL_GetTicks();
+    frame_invalidate(FrameReason::Camera);
+    frame_invalidateIn(FrameReason::Camera, (float)VIEW_SAVE_DELAY / 1000.0f);
+}
+
+// Entity under the mouse and the world point grabbed on it, or ENTITYGRID_NONE
+static uint32_t getEntityUnderMouse(const ViewInfo* pView, float grab[3])
+{
+    ImGuiIO& io = ImGui::GetIO();
+    if (pView->type == ViewType::Perspective)
+    {
+        // Straight against the triangles
+        float origin[3], dir[3];
+        auto t = FLT_MAX;
+        if (!getMouseRay(pView, io.MousePos.x, io.MousePos.y, origin, dir)) return ENTITYGRID_NONE;
+        auto entity = raycast_cast(origin, dir, &t);
+        if (entity == RAYCAST_NONE) return ENTITYGRID_NONE;
+        for (int k = 0; k < 3; ++k) grab[k] = origin[k] + dir[k] * t;
+        return entity;
+    }
+
+    auto axes = getViewAxes(pView->type);
+    float point[2];
+    getMouseWorld2D(pView, io.MousePos.x, io.MousePos.y, point);
+    auto entity = entityGrid_queryNearest(axes.u, axes.v, point, SELECT_CLICK_RADIUS / ZOOM_LEVELS[pView->zoomLevel]);
+    if (entity == ENTITYGRID_NONE) return ENTITYGRID_NONE;
+
+    // The mouse on the view's plane, at the entity's depth
+    grab[axes.u] = point[0];
+    grab[axes.v] = point[1];
+    grab[axes.depth] = (float)transforms_getWorldPositions()[entity * 3 + axes.depth];
+    return entity;
+}
+
+static void beginMove(int viewIndex, uint32_t entity, const float grab[3])
+{
+    moveDrag.viewIndex = viewIndex;
+
+    // Children follow their parents, moving them too would move them twice
+    std::vector<uint32_t> selected;
+    selection_getIndices(selected);
+    transforms_getTopmost(selected, moveDrag.indices);
+
+    std::vector<uint8_t> values;
+    entities_getValues(document.entities, EntityField::Position, moveDrag.indices.data(), moveDrag.indices.size(), values);
+    moveDrag.startPositions.resize(moveDrag.indices.size() * 3);
+    memcpy(moveDrag.startPositions.data(), values.data(), values.size());
+
+    memcpy(moveDrag.anchor, &transforms_getWorldPositions()[entity * 3], sizeof(moveDrag.anchor));
+    memcpy(moveDrag.grab, grab, sizeof(moveDrag.grab));
+    memset(moveDrag.delta, 0, sizeof(moveDrag.delta));
+
+    // So they don't snap onto themselves, nor onto what moves with them
+    std::vector<uint32_t> moving;
+    transforms_getDescendants(moveDrag.indices, moving);
+    snap_setIgnored(moving);
+}
+
+static void updateMove(const ViewInfo* pView)
+{
+    ImGuiIO& io = ImGui::GetIO();
+    bool isAxisFree[3] = { true, true, true };
+    float target[3];
+    float snapRadius;
+    if (pView->type == ViewType::Perspective)
+    {
+        // Slides on the horizontal plane through the grabbed point
+        float origin[3], dir[3];
+        if (!getMouseRay(pView, io.MousePos.x, io.MousePos.y, origin, dir)) return;
+        if (std::fabs(dir[2]) < 0.0001f) return;
+        auto t = (moveDrag.grab[2] - origin[2]) / dir[2];
+        if (t <= 0.0f) return;
+        for (int k = 0; k < 3; ++k) target[k] = origin[k] + dir[k] * t;
+
+        // Pixel size at that distance, the vertical field of view is 90
+        auto H = pView->clipRect[3] - pView->clipRect[1];
+        auto distance = t * std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+        snapRadius = SNAP_RADIUS * 2.0f * distance / H;
+    }
+    else
+    {
+        auto axes = getViewAxes(pView->type);
+        float point[2];
+        getMouseWorld2D(pView, io.MousePos.x, io.MousePos.y, point);
+        memcpy(target, moveDrag.grab, sizeof(target));
+        target[axes.u] = point[0];
+        target[axes.v] = point[1];
+        isAxisFree[axes.depth] = false;
+        snapRadius = SNAP_RADIUS / ZOOM_LEVELS[pView->zoomLevel];
+    }
+
+    double delta[3];
+    for (int k = 0; k < 3; ++k) delta[k] = (double)target[k] - (double)moveDrag.grab[k];
+
+    if (document.json["editor"]["snap"].asBool())
+    {
+        // 2D views keep the depth, snapping to what is around it
+        float point[3];
+        for (int k = 0; k < 3; ++k) point[k] = (float)(moveDrag.anchor[k] + delta[k]);
+        SnapResult snapResult;
+        if (snap_find(point, snapRadius, snapResult))
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                if (isAxisFree[k]) delta[k] = (double)snapResult.position[k] - moveDrag.anchor[k];
+            }
+        }
+    }
+
+    if (!memcmp(delta, moveDrag.delta, sizeof(delta))) return;
+    memcpy(moveDrag.delta, delta, sizeof(delta));
+
+    // The delta is in world space, positions are relative to the parents
+    std::vector<uint8_t> values(moveDrag.startPositions.size() * sizeof(double));
+    auto pPositions = (double*)values.data();
+    for (size_t i = 0; i < moveDrag.indices.size(); ++i)
+    {
+        double localDelta[3];
+        transforms_worldToParentDelta(moveDrag.indices[i], delta, localDelta);
+        for (int k = 0; k < 3; ++k) pPositions[i * 3 + k] = moveDrag.startPositions[i * 3 + k] + localDelta[k];
+    }
+    edit_applyToDocument(edit_set(EntityField::Position, moveDrag.indices, values), false);
+}
+
+static void endMove()
+{
+    static const double ZERO[3] = { 0.0, 0.0, 0.0 };
+    if (memcmp(moveDrag.delta, ZERO, sizeof(ZERO)))
+    {
+        // From where the drag started to where it ended
+        std::vector<uint8_t> values;
+        entities_getValues(document.entities, EntityField::Position, moveDrag.indices.data(), moveDrag.indices.size(), values);
+        auto edit = edit_set(EntityField::Position, moveDrag.indices, values);
+        memcpy(edit.before.data(), moveDrag.startPositions.data(), edit.before.size());
+        edit_commit(std::move(edit));
+    }
+
+    snap_setIgnored({});
+    moveDrag.viewIndex = -1;
+    moveDrag.indices.clear();
+    moveDrag.startPositions.clear();
+}
+
+// Left button released over the view that got the press
+static void finishSelectDrag(const ViewInfo* pView)
+{
+    ImGuiIO& io = ImGui::GetIO();
+    auto pointCount = selectDrag.points.size();
+    std::vector<uint32_t> indices;
+
+    if (!selectDrag.isDragging)
+    {
+        auto mode = (io.KeyShift || io.KeyCtrl) ? SelectMode::Toggle : SelectMode::Replace;
+        float grab[3];
+        auto entity = getEntityUnderMouse(pView, grab);
+        applySelection(&entity, 1, mode);
+        return;
+    }
+
+    auto mode = io.KeyShift ? SelectMode::Add : io.KeyCtrl ? SelectMode::Remove : SelectMode::Replace;
+    if (pView->type == ViewType::Perspective)
+    {
+        // What is visible inside the rectangle, a frame later
+        pickMode = mode;
+        picking_requestRect(pView->index, selectDrag.points[0].x, selectDrag.points[0].y, selectDrag.points[1].x, selectDrag.points[1].y);
+        return;
+    }
+
+    auto axes = getViewAxes(pView->type);
+    if (selectDrag.isLasso)
+    {
+        if (pointCount < 3) return;
+        std::vector<float> polygon(pointCount * 2);
+        for (size_t i = 0; i < pointCount; ++i)
+        {
+            getMouseWorld2D(pView, selectDrag.points[i].x, selectDrag.points[i].y, &polygon[i * 2]);
+        }
+        entityGrid_queryPolygon(axes.u, axes.v, polygon.data(), pointCount, indices);
+    }
+    else
+    {
+        float corners[2][2];
+        getMouseWorld2D(pView, selectDrag.points[0].x, selectDrag.points[0].y, corners[0]);
+        getMouseWorld2D(pView, selectDrag.points[1].x, selectDrag.points[1].y, corners[1]);
+        const float min[2] = { std::min(corners[0][0], corners[1][0]), std::min(corners[0][1], corners[1][1]) };
+        const float max[2] = { std::max(corners[0][0], corners[1][0]), std::max(corners[0][1], corners[1][1]) };
+        entityGrid_queryRect(axes.u, axes.v, min, max, indices);
+    }
+    applySelection(indices.data(), indices.size(), mode);
+}
+
+static void updateSelectDrag(int viewIndex)
+{
+    ImGuiIO& io = ImGui::GetIO();
+    auto pView = viewInfos + viewIndex;
+
+    if (ImGui::IsMouseClicked(0) && ImGui::IsMouseHoveringWindow())
+    {
+        // On a selected entity it moves the selection, modifiers always select
+        float grab[3];
+        auto entity = (io.KeyShift || io.KeyCtrl || io.KeyAlt) ? ENTITYGRID_NONE : getEntityUnderMouse(pView, grab);
+        if (entity != ENTITYGRID_NONE && selection_isSelected(entity))
+        {
+            beginMove(viewIndex, entity, grab);
+            return;
+        }
+
+        selectDrag.viewIndex = viewIndex;
+        selectDrag.isDragging = false;
+        selectDrag.isLasso = io.KeyAlt && pView->type != ViewType::Perspective;
+        selectDrag.points.assign(2, io.MousePos);
+    }
+    if (moveDrag.viewIndex == viewIndex)
+    {
+        if (ImGui::IsMouseDown(0)) updateMove(pView);
+        else endMove();
+        return;
+    }
+    if (selectDrag.viewIndex != viewIndex) return;
+
+    if (ImGui::IsMouseDown(0))
+    {
+        auto pLast = &selectDrag.points.back();
+        if (!selectDrag.isDragging)
+        {
+            auto dx = io.MousePos.x - selectDrag.points[0].x;
+            auto dy = io.MousePos.y - selectDrag.points[0].y;
+            selectDrag.isDragging = dx * dx + dy * dy > SELECT_DRAG_THRESHOLD * SELECT_DRAG_THRESHOLD;
+        }
+        if (!selectDrag.isLasso)
+        {
+            *pLast = io.MousePos;
+        }
+        else if (std::fabs(io.MousePos.x - pLast->x) + std::fabs(io.MousePos.y - pLast->y) >= 2.0f)
+        {
+            selectDrag.points.push_back(io.MousePos);
+        }
+        if (selectDrag.isDragging) frame_invalidate(FrameReason::UI);
+    }
+    else if (ImGui::IsMouseReleased(0))
+    {
+        finishSelectDrag(pView);
+        selectDrag.viewIndex = -1;
+        selectDrag.points.clear();
+    }
+}
+
+// Marquee or lasso outline over the view
+static void drawSelectDrag(int viewIndex)
+{
+    if (selectDrag.viewIndex != viewIndex || !selectDrag.isDragging) return;
+
+    auto pDrawList = ImGui::GetWindowDrawList();
+    if (selectDrag.isLasso)
+    {
+        pDrawList->AddPolyline(selectDrag.points.data(), (int)selectDrag.points.size(), IM_COL32(255, 160, 30, 255), true, 1.0f);
+    }
+    else
+    {
+        ImVec2 min(std::min(selectDrag.points[0].x, selectDrag.points[1].x), std::min(selectDrag.points[0].y, selectDrag.points[1].y));
+        ImVec2 max(std::max(selectDrag.points[0].x, selectDrag.points[1].x), std::max(selectDrag.points[0].y, selectDrag.points[1].y));
+        pDrawList->AddRectFilled(min, max, IM_COL32(255, 160, 30, 40));
+        pDrawList->AddRect(min, max, IM_COL32(255, 160, 30, 255));
+    }
+}
+
 void view_updateGUI(ViewType type, ViewLayout layout, int viewIndex)
 {
     auto x = 0.0f;
@@ -131,6 +613,16 @@ void view_updateGUI(ViewType type, ViewLayout layout, int viewIndex)
         ImGuiWindowFlags_NoResize |
         ImGuiWindowFlags_NoCollapse);
 
+    // GPU picks come back a frame after they were asked for
+    PickResult pickResult;
+    if (picking_getResult(viewIndex, pickResult))
+    {
+        if (pickResult.entity != PICK_NONE) applySelection(&pickResult.entity, 1, pickMode);
+        else applySelection(pickResult.entities.data(), pickResult.entities.size(), pickMode);
+    }
+
+    updateSelectDrag(viewIndex);
+
     if (ImGui::IsMouseHoveringWindow())
     {
         ImGuiIO& io = ImGui::GetIO();
@@ -141,16 +633,14 @@ void view_updateGUI(ViewType type, ViewLayout layout, int viewIndex)
                 pView->zoomLevel =
                     std::max(0, pView->zoomLevel - 1);
 
-                document.json["editor"]["views"][VIEW_TYPE_TO_NAME[viewIndex]]["zoom"] = pView->zoomLevel;
-                document.dirty = true;
+                onCameraChanged();
             }
             else if (io.MouseWheel > 0.1f)
             {
                 pView->zoomLevel =
                     std::min(MAX_ZOOM_LEVELS - 1, pView->zoomLevel + 1);
 
-                document.json["editor"]["views"][VIEW_TYPE_TO_NAME[viewIndex]]["zoom"] = pView->zoomLevel;
-                document.dirty = true;
+                onCameraChanged();
             }
         }
 
@@ -161,7 +651,7 @@ void view_updateGUI(ViewType type, ViewLayout layout, int viewIndex)
             {
                 ImGui::SetMouseCursor(ImGuiMouseCursor_None);
                 SDL_GetMouseState(&dragMouseX, &dragMouseY);
-                updateEachFrame = true;
+                frame_beginContinuous(FrameReason::Camera);
             }
             else
             {
@@ -177,7 +667,7 @@ void view_updateGUI(ViewType type, ViewLayout layout, int viewIndex)
         if (pView->type == ViewType::Perspective)
         {
             ImGui::SetMouseCursor(ImGuiMouseCursor_Arrow);
-            updateEachFrame = false;
+            frame_endContinuous(FrameReason::Camera);
         }
     }
 
@@ -245,17 +735,7 @@ void view_updateGUI(ViewType type, ViewLayout layout, int viewIndex)
                 dirty = true;
             }
 
-            if (dirty)
-            {
-                document.json["editor"]["views"][VIEW_TYPE_TO_NAME[viewIndex]]["position"]["x"] = pView->position[0];
-                document.json["editor"]["views"][VIEW_TYPE_TO_NAME[viewIndex]]["position"]["y"] = pView->position[1];
-                document.json["editor"]["views"][VIEW_TYPE_TO_NAME[viewIndex]]["position"]["z"] = pView->position[2];
-
-                document.json["editor"]["views"][VIEW_TYPE_TO_NAME[viewIndex]]["angleX"] = pView->angleX;
-                document.json["editor"]["views"][VIEW_TYPE_TO_NAME[viewIndex]]["angleZ"] = pView->angleZ;
-
-                document.dirty = true;
-            }
+            if (dirty) onCameraChanged();
 
             SDL_WarpMouseInWindow(NULL, dragMouseX, dragMouseY);
             ImGui::SetMouseCursor(ImGuiMouseCursor_None);
@@ -268,13 +748,7 @@ void view_updateGUI(ViewType type, ViewLayout layout, int viewIndex)
             pView->position[0] = viewPosOnDragStart[0] - dragDelta.x / ZOOM_LEVELS[pView->zoomLevel];
             pView->position[1] = viewPosOnDragStart[1] - dragDelta.y / ZOOM_LEVELS[pView->zoomLevel];
 
-            if (dirty)
-            {
-                document.json["editor"]["views"][VIEW_TYPE_TO_NAME[viewIndex]]["position"]["x"] = pView->position[0];
-                document.json["editor"]["views"][VIEW_TYPE_TO_NAME[viewIndex]]["position"]["y"] = pView->position[1];
-
-                document.dirty = true;
-            }
+            if (dirty) onCameraChanged();
         }
     }
 
@@ -286,32 +760,131 @@ void view_updateGUI(ViewType type, ViewLayout layout, int viewIndex)
     pView->index = viewIndex;
 
     ImGui::GetWindowDrawList()->AddCallback(viewDrawCallback, pView);
+    drawSelectDrag(viewIndex);
     ImGui::Text("%0.2f, %0.2f, %i", pView->position[0], pView->position[1], pView->zoomLevel);
 
     ImGui::End();
 }
 
+static void readViews(const Json::Value& views)
+{
+    for (int i = 0; i < MAX_VIEWS; ++i)
+    {
+        auto pView = viewInfos + i;
+        const auto& view = views[VIEW_TYPE_TO_NAME[i]];
+
+        pView->position[0] = view["position"]["x"].asDouble();
+        pView->position[1] = view["position"]["y"].asDouble();
+        pView->position[2] = view["position"]["z"].asDouble();
+        pView->angleX = view["angleX"].asFloat();
+        pView->angleZ = view["angleZ"].asFloat();
+        pView->zoomLevel = std::max(0, std::min(MAX_ZOOM_LEVELS - 1, view["zoom"].asInt()));
+    }
+}
+
+static std::string getSidecarFilename()
+{
+    return document.filename + VIEW_SIDECAR_EXTENSION;
+}
+
 void view_load()
+{
+    isSavePending = false;
+
+    // The user's own cameras if they opened this map before, otherwise the
+    // ones saved in the map
+    if (!document.filename.empty())
+    {
+        Json::Value sidecar;
+        std::ifstream file(getSidecarFilename());
+        if (file.is_open())
+        {
+            Json::CharReaderBuilder builder;
+            std::string error;
+            if (Json::parseFromStream(builder, file, &sidecar, &error) && sidecar["views"].isObject())
+            {
+                readViews(sidecar["views"]);
+                return;
+            }
+        }
+    }
+    readViews(document.json["editor"]["views"]);
+}
+
+void view_toJson(Json::Value& views)
 {
     for (int i = 0; i < MAX_VIEWS; ++i)
     {
         auto pView = viewInfos + i;
+        auto& view = views[VIEW_TYPE_TO_NAME[i]];
+
+        view["position"]["x"] = pView->position[0];
+        view["position"]["y"] = pView->position[1];
+        view["position"]["z"] = pView->position[2];
+        view["angleX"] = pView->angleX;
+        view["angleZ"] = pView->angleZ;
+        view["zoom"] = pView->zoomLevel;
+    }
+}
 
-        pView->position[0] = document.json["editor"]["views"][VIEW_TYPE_TO_NAME[i]]["position"]["x"].asFloat();
-        pView->position[1] = document.json["editor"]["views"][VIEW_TYPE_TO_NAME[i]]["position"]["y"].asFloat();
-        pView->position[2] = document.json["editor"]["views"][VIEW_TYPE_TO_NAME[i]]["position"]["z"].asFloat();
-        pView->angleX = document.json["editor"]["views"][VIEW_TYPE_TO_NAME[i]]["angleX"].asFloat();
-        pView->angleZ = document.json["editor"]["views"][VIEW_TYPE_TO_NAME[i]]["angleZ"].asFloat();
-        pView->zoomLevel = document.json["editor"]["views"][VIEW_TYPE_TO_NAME[i]]["zoom"].asInt();
+void view_flush()
+{
+    // Maps never saved have nowhere to put it yet, it waits for a filename
+    if (!isSavePending || document.filename.empty()) return;
+    isSavePending = false;
+
+    Json::Value sidecar;
+    view_toJson(sidecar["views"]);
+
+    auto filename = getSidecarFilename();
+    auto tempFilename = filename + ".tmp";
+    {
+        std::ofstream file(tempFilename);
+        if (!file.is_open()) return; // Only cameras, not worth a message
+        file << sidecar;
     }
+    fileSystem_replace(tempFilename, filename);
 }
 
-static void initialize()
+void view_update()
 {
-    initialized = true;
+    if (isSavePending && SDL_GetTicks() - cameraChangeTime >= VIEW_SAVE_DELAY) view_flush();
+}
 
+void view_getFoci(std::vector<ViewFocus>& out)
+{
+    out.clear();
+    auto count = isFullView ? 1 : MAX_VIEWS;
+    for (int i = 0; i < count; ++i)
+    {
+        const auto& view = viewInfos[i];
+        ViewFocus focus;
+        if (view.type == ViewType::Perspective)
+        {
+            for (int k = 0; k < 3; ++k) focus.center[k] = (float)view.position[k];
+            focus.radius = 0.0f;
+            out.push_back(focus);
+            continue;
+        }
+
+        // A 2D view sees through the whole map, it takes the depth of the
+        // perspective camera rather than streaming all of it
+        auto axes = getViewAxes(view.type);
+        auto zoom = ZOOM_LEVELS[view.zoomLevel];
+        auto W = view.clipRect[2] - view.clipRect[0];
+        auto H = view.clipRect[3] - view.clipRect[1];
+        for (int k = 0; k < 3; ++k) focus.center[k] = (float)viewInfos[0].position[k];
+        focus.center[axes.u] = (float)(view.position[0] * axes.signU);
+        focus.center[axes.v] = (float)(view.position[1] * axes.signV);
+        focus.radius = sqrtf(W * W + H * H) * 0.5f / zoom;
+        out.push_back(focus);
+    }
+}
+
+void view_initShaders()
+{
     // 2D Grid
-    shader_grid2D.program = createShaderProgram(
+    shader_grid2D.program = shaders_create(
         "uniform mat4 WorldMtx;\n"
         "uniform mat4 ProjMtx;\n"
         "in vec2 Position;\n"
@@ -330,14 +903,9 @@ static void initialize()
         "{\n"
         "    Out_Color = Frag_Color;\n"
         "}\n");
-    glUseProgram(shader_grid2D.program);
-    shader_grid2D.uniform_worldMtx = glGetUniformLocation(shader_grid2D.program, "WorldMtx");
-    shader_grid2D.uniform_projMtx = glGetUniformLocation(shader_grid2D.program, "ProjMtx");
-    shader_grid2D.attrib_position = glGetAttribLocation(shader_grid2D.program, "Position");
-    shader_grid2D.attrib_color = glGetAttribLocation(shader_grid2D.program, "Color");
-    
+
     // 3D grid
-    shader_grid3D.program = createShaderProgram(
+    shader_grid3D.program = shaders_create(
         "uniform mat4 ProjMtx;\n"
         "in vec2 Position;\n"
         "in vec4 Color;\n"
@@ -354,6 +922,38 @@ static void initialize()
         "{\n"
         "    Out_Color = Frag_Color;\n"
         "}\n");
+
+    // Selection boxes
+    shader_highlight.program = shaders_create(
+        "uniform mat4 ProjMtx;\n"
+        "in vec3 Position;\n"
+        "in vec3 BoxMin;\n"
+        "in vec3 BoxSize;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_Position = ProjMtx * vec4(BoxMin + Position * BoxSize,1);\n"
+        "}\n"
+        ,
+        "uniform vec4 Color;\n"
+        "out vec4 Out_Color;\n"
+        "void main()\n"
+        "{\n"
+        "    Out_Color = Color;\n"
+        "}\n");
+}
+
+static void initialize()
+{
+    initialized = true;
+
+    // 2D Grid
+    glUseProgram(shader_grid2D.program);
+    shader_grid2D.uniform_worldMtx = glGetUniformLocation(shader_grid2D.program, "WorldMtx");
+    shader_grid2D.uniform_projMtx = glGetUniformLocation(shader_grid2D.program, "ProjMtx");
+    shader_grid2D.attrib_position = glGetAttribLocation(shader_grid2D.program, "Position");
+    shader_grid2D.attrib_color = glGetAttribLocation(shader_grid2D.program, "Color");
+    
+    // 3D grid
     glUseProgram(shader_grid3D.program);
     shader_grid3D.uniform_projMtx = glGetUniformLocation(shader_grid3D.program, "ProjMtx");
     shader_grid3D.attrib_position = glGetAttribLocation(shader_grid3D.program, "Position");
@@ -428,11 +1028,203 @@ static void initialize()
         scale *= 10.0f;
     }
 
+    // Selection boxes
+    glUseProgram(shader_highlight.program);
+    shader_highlight.uniform_projMtx = glGetUniformLocation(shader_highlight.program, "ProjMtx");
+    shader_highlight.uniform_color = glGetUniformLocation(shader_highlight.program, "Color");
+    shader_highlight.attrib_position = glGetAttribLocation(shader_highlight.program, "Position");
+    shader_highlight.attrib_boxMin = glGetAttribLocation(shader_highlight.program, "BoxMin");
+    shader_highlight.attrib_boxSize = glGetAttribLocation(shader_highlight.program, "BoxSize");
+
+    // The 12 edges of a unit cube
+    float cubeEdges[24 * 3];
+    auto pEdge = cubeEdges;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (int corner = 0; corner < 4; ++corner)
+        {
+            for (int end = 0; end < 2; ++end)
+            {
+                pEdge[axis] = (float)end;
+                pEdge[(axis + 1) % 3] = (float)(corner & 1);
+                pEdge[(axis + 2) % 3] = (float)(corner >> 1);
+                pEdge += 3;
+            }
+        }
+    }
+
+    glGenBuffers(1, &worldMatrixVbo);
+
+    glGenVertexArrays(1, &highlightMesh.vao);
+    glBindVertexArray(highlightMesh.vao);
+
+    glGenBuffers(1, &highlightMesh.cubeVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, highlightMesh.cubeVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeEdges), (const GLvoid*)cubeEdges, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(shader_highlight.attrib_position);
+    glVertexAttribPointer(shader_highlight.attrib_position, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, (GLvoid*)0);
+
+    glGenBuffers(1, &highlightMesh.instanceVbo);
+    if (glVertexAttribDivisor && glDrawArraysInstanced)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, highlightMesh.instanceVbo);
+        glEnableVertexAttribArray(shader_highlight.attrib_boxMin);
+        glEnableVertexAttribArray(shader_highlight.attrib_boxSize);
+        glVertexAttribPointer(shader_highlight.attrib_boxMin, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (GLvoid*)0);
+        glVertexAttribPointer(shader_highlight.attrib_boxSize, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (GLvoid*)(sizeof(float) * 3));
+        glVertexAttribDivisor(shader_highlight.attrib_boxMin, 1);
+        glVertexAttribDivisor(shader_highlight.attrib_boxSize, 1);
+    }
+
     //glGenBuffers(1, &mesh_grid.ibo);
     //glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_grid.ibo);
     //glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(gridIndices), (const GLvoid*)gridIndices, GL_STATIC_DRAW);
 }
 
+static void drawEntities(const float viewProjMat[4][4], const double eye[3])
+{
+    glUseProgram(meshShader.program);
+    glUniformMatrix4fv(meshShader.uniform_projMtx, 1, GL_FALSE, &viewProjMat[0][0]);
+    glUniform1i(meshShader.uniform_texture, 0);
+#ifdef GL_SAMPLER_BINDING
+    glBindSampler(0, 0); // We use combined texture/sampler state. Applications using GL 3.3 may set that otherwise.
+#endif
+
+    // A mesh's state is set once for all the items of its model, their
+    // matrices are instance attributes. Baked light starts at each item's
+    // offset, lit items are drawn one at a time and runs of unlit ones in
+    // one draw.
+    auto pLightOffsets = bake_getItemOffsets();
+    auto lightBuffer = bake_getBuffer();
+    auto pEyeMatrices = renderList_getEyeMatrices(eye);
+    auto visibleMask = layers_getVisibleMask();
+    auto isInstanced = glVertexAttribDivisor && glDrawElementsInstanced;
+    if (isInstanced)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, worldMatrixVbo);
+        glBufferData(GL_ARRAY_BUFFER, renderList_getItems().size() * sizeof(mat4), (const GLvoid*)pEyeMatrices, GL_STREAM_DRAW);
+    }
+    for (const auto& batch : renderList_getBatches())
+    {
+        if (!((visibleMask >> batch.layer) & 1)) continue;
+        auto model = library_getModel(batch.modelId);
+        for (int j = 0; j < model.meshCount; ++j)
+        {
+            auto pMesh = model.meshes + j;
+            glBindTexture(GL_TEXTURE_2D, pMesh->pMaterial->diffuse);
+            glBindVertexArray(pMesh->vao);
+            glBindBuffer(GL_ARRAY_BUFFER, pMesh->vbo);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pMesh->ibo);
+            for (int k = 0; k < 4 && isInstanced; ++k)
+            {
+                glEnableVertexAttribArray(meshShader.attrib_worldMtx + k);
+                glVertexAttribDivisor(meshShader.attrib_worldMtx + k, 1);
+            }
+            auto end = batch.first + batch.count;
+            for (auto i = batch.first; i < end;)
+            {
+                auto runEnd = i + 1;
+                if (pLightOffsets[i] >= 0)
+                {
+                    glBindBuffer(GL_ARRAY_BUFFER, lightBuffer);
+                    glEnableVertexAttribArray(meshShader.attrib_light);
+                    glVertexAttribPointer(meshShader.attrib_light, 1, GL_UNSIGNED_BYTE, GL_TRUE, 1, (GLvoid*)(uintptr_t)(pLightOffsets[i] + pMesh->firstVertex));
+                }
+                else
+                {
+                    glDisableVertexAttribArray(meshShader.attrib_light);
+                    glVertexAttrib1f(meshShader.attrib_light, -1.0f);
+                    while (isInstanced && runEnd < end && pLightOffsets[runEnd] < 0) ++runEnd;
+                }
+
+                if (isInstanced)
+                {
+                    glBindBuffer(GL_ARRAY_BUFFER, worldMatrixVbo);
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        glVertexAttribPointer(meshShader.attrib_worldMtx + k, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (GLvoid*)(uintptr_t)(i * sizeof(mat4) + k * sizeof(float4)));
+                    }
+                    glDrawElementsInstanced(GL_TRIANGLES, pMesh->elementCount, pMesh->elementType, (const void*)(uintptr_t)(0), (GLsizei)(runEnd - i));
+                }
+                else
+                {
+                    // Without instancing, the matrix goes in constant attributes
+                    float world_matrix[4][4];
+                    mat4_store(pEyeMatrices[i], world_matrix);
+                    for (int k = 0; k < 4; ++k) glVertexAttrib4fv(meshShader.attrib_worldMtx + k, world_matrix[k]);
+                    glDrawElements(GL_TRIANGLES, pMesh->elementCount, pMesh->elementType, (const void*)(uintptr_t)(0));
+                }
+                i = runEnd;
+            }
+            glDisableVertexAttribArray(meshShader.attrib_light);
+            for (int k = 0; k < 4 && isInstanced; ++k)
+            {
+                glVertexAttribDivisor(meshShader.attrib_worldMtx + k, 0);
+                glDisableVertexAttribArray(meshShader.attrib_worldMtx + k);
+            }
+        }
+    }
+}
+
+// Gathers the boxes again only when something they depend on changed
+static void updateHighlight()
+{
+    const uint64_t revisions[3] = {
+        selection_getRevision(),
+        entities_getRevision(document.entities),
+        library_getRevision()
+    };
+    if (!memcmp(revisions, highlightMesh.revisions, sizeof(revisions))) return;
+    memcpy(highlightMesh.revisions, revisions, sizeof(revisions));
+
+    highlightMesh.boxes.clear();
+    highlightMesh.boxes.reserve(selection_count() * 6);
+
+    // World boxes, rotated entities get the box around their rotated model
+    std::vector<uint32_t> indices;
+    selection_getIndices(indices);
+    auto pWorldBounds = transforms_getWorldBounds();
+    for (auto index : indices)
+    {
+        auto pBounds = &pWorldBounds[index * 6];
+        float size[3];
+        for (int k = 0; k < 3; ++k) size[k] = pBounds[3 + k] - pBounds[k];
+        highlightMesh.boxes.insert(highlightMesh.boxes.end(), pBounds, pBounds + 3);
+        highlightMesh.boxes.insert(highlightMesh.boxes.end(), size, size + 3);
+    }
+    highlightMesh.count = (GLsizei)(highlightMesh.boxes.size() / 6);
+
+    glBindBuffer(GL_ARRAY_BUFFER, highlightMesh.instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, highlightMesh.boxes.size() * sizeof(float), (const GLvoid*)highlightMesh.boxes.data(), GL_DYNAMIC_DRAW);
+}
+
+// Selected entities' boxes, drawn over everything
+static void drawHighlight(const float viewProjMat[4][4])
+{
+    updateHighlight();
+    if (!highlightMesh.count) return;
+
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(shader_highlight.program);
+    glUniformMatrix4fv(shader_highlight.uniform_projMtx, 1, GL_FALSE, &viewProjMat[0][0]);
+    glUniform4f(shader_highlight.uniform_color, 1.0f, 0.6f, 0.1f, 1.0f);
+    glBindVertexArray(highlightMesh.vao);
+
+    if (glVertexAttribDivisor && glDrawArraysInstanced)
+    {
+        glDrawArraysInstanced(GL_LINES, 0, 24, highlightMesh.count);
+        return;
+    }
+
+    // Without instancing, the box goes in constant attributes
+    for (GLsizei i = 0; i < highlightMesh.count; ++i)
+    {
+        glVertexAttrib3fv(shader_highlight.attrib_boxMin, &highlightMesh.boxes[i * 6]);
+        glVertexAttrib3fv(shader_highlight.attrib_boxSize, &highlightMesh.boxes[i * 6 + 3]);
+        glDrawArrays(GL_LINES, 0, 24);
+    }
+}
+
 static void viewDrawCallback(const ImDrawList* parent_list, const ImDrawCmd* cmd)
 {
     auto pViewInfo = (ViewInfo*)cmd->UserCallbackData;
@@ -456,16 +1248,26 @@ static void viewDrawCallback(const ImDrawList* parent_list, const ImDrawCmd* cmd
 
     float W = cmd->ClipRect.z - cmd->ClipRect.x;
     float H = cmd->ClipRect.w - cmd->ClipRect.y;
+    pViewInfo->clipRect[0] = cmd->ClipRect.x;
+    pViewInfo->clipRect[1] = cmd->ClipRect.y;
+    pViewInfo->clipRect[2] = cmd->ClipRect.z;
+    pViewInfo->clipRect[3] = cmd->ClipRect.w;
 
     if (pViewInfo->type == ViewType::Perspective)
     {
         float viewMat[4][4];
         float projMat[4][4];
         float viewProjMat[4][4];
+        float worldViewProjMat[4][4];
 
-        createViewMatrix(pViewInfo->position, pViewInfo->angleX, pViewInfo->angleZ, viewMat);
+        // Built around the eye, the models are moved to it in double
+        const float origin[3] = { 0.0f, 0.0f, 0.0f };
+        double eye[3];
+        getEye(pViewInfo, eye);
+        createViewMatrix(origin, pViewInfo->angleX, pViewInfo->angleZ, viewMat);
         createPerspectiveFieldOfView(90, W / H, 0.1f, 1000.0f, projMat);
         mulMatrix(viewMat, projMat, viewProjMat);
+        createWorldViewProj(viewProjMat, eye, worldViewProjMat);
 
         // Draw 3D models
         glEnable(GL_DEPTH_TEST);
@@ -473,37 +1275,8 @@ static void viewDrawCallback(const ImDrawList* parent_list, const ImDrawCmd* cmd
         glEnable(GL_CULL_FACE);
         glCullFace(GL_BACK);
         
-        glUseProgram(meshShader.program);
-        glUniformMatrix4fv(meshShader.uniform_projMtx, 1, GL_FALSE, &viewProjMat[0][0]);
-
-        for (int i = 0; i < (int)document.json["map"].size(); ++i)
-        {
-            auto jsonObj = document.json["map"][i];
-            auto model = library_getModel(jsonObj["modelId"].asUInt64());
-
-            const float world_matrix[4][4] = {
-                { 1, 0, 0, 0 },
-                { 0, 1, 0, 0 },
-                { 0, 0, 1, 0 },
-                { jsonObj["position"]["x"].asFloat(), jsonObj["position"]["y"].asFloat(), jsonObj["position"]["z"].asFloat(), 1 }
-            };
-            glUniformMatrix4fv(meshShader.uniform_worldMtx, 1, GL_FALSE, &world_matrix[0][0]);
-
-            for (int j = 0; j < model.meshCount; ++j)
-            {
-                auto pMesh = model.meshes + j;
-
-                glUniform1i(meshShader.uniform_texture, 0);
-#ifdef GL_SAMPLER_BINDING
-                glBindSampler(0, 0); // We use combined texture/sampler state. Applications using GL 3.3 may set that otherwise.
-#endif
-                glBindTexture(GL_TEXTURE_2D, pMesh->pMaterial->diffuse);
-                glBindVertexArray(pMesh->vao);
-                glBindBuffer(GL_ARRAY_BUFFER, pMesh->vbo);
-                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pMesh->ibo);
-                glDrawElements(GL_TRIANGLES, pMesh->elementCount, pMesh->elementType, (const void*)(uintptr_t)(0));
-            }
-        }
+        terrain_draw(viewProjMat, eye, false, 0.0f);
+        drawEntities(viewProjMat, eye);
 
         // Draw Grid
         glEnable(GL_DEPTH_TEST);
@@ -511,12 +1284,17 @@ static void viewDrawCallback(const ImDrawList* parent_list, const ImDrawCmd* cmd
         glDisable(GL_CULL_FACE);
 
         glUseProgram(shader_grid3D.program);
-        glUniformMatrix4fv(shader_grid3D.uniform_projMtx, 1, GL_FALSE, &viewProjMat[0][0]);
+        glUniformMatrix4fv(shader_grid3D.uniform_projMtx, 1, GL_FALSE, &worldViewProjMat[0][0]);
 
         // Zoomed-in grid
         glBindVertexArray(gridMeshes[0].vao);
         glBindBuffer(GL_ARRAY_BUFFER, gridMeshes[0].vbo);
         glDrawArrays(GL_LINES, 0, GRID_2D_SIZE * 2 * 2);
+
+        drawHighlight(worldViewProjMat);
+
+        // Entity IDs, only when this view has a pick pending
+        picking_render(pViewInfo->index, viewProjMat, eye, cmd->ClipRect.x, cmd->ClipRect.y, W, H);
     }
     else
     {
@@ -534,8 +1312,8 @@ static void viewDrawCallback(const ImDrawList* parent_list, const ImDrawCmd* cmd
         };
 
         float Zoom = ZOOM_LEVELS[pViewInfo->zoomLevel];
-        float X = pViewInfo->position[0];
-        float Y = pViewInfo->position[1];
+        auto X = (float)pViewInfo->position[0];
+        auto Y = (float)pViewInfo->position[1];
         const float world_matrix[4][4] =
         {
             { Zoom,  0.0f,  0.0f,  0.0f },
@@ -574,7 +1352,40 @@ static void viewDrawCallback(const ImDrawList* parent_list, const ImDrawCmd* cmd
         glBindVertexArray(gridMeshes[3].vao);
         glBindBuffer(GL_ARRAY_BUFFER, gridMeshes[3].vbo);
         glDrawArrays(GL_LINES, 0, GRID_2D_SIZE * 2 * 2);
+
+        // Models over the grid, seen from their side of the world
+        float viewProjMat[4][4];
+        float worldViewProjMat[4][4];
+        double eye[3];
+        getEye(pViewInfo, eye);
+        createOrthoViewProj(pViewInfo, W, H, viewProjMat);
+        createWorldViewProj(viewProjMat, eye, worldViewProjMat);
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+        terrain_draw(viewProjMat, eye, true, 1.0f / Zoom);
+        drawEntities(viewProjMat, eye);
+        drawHighlight(worldViewProjMat);
     }
 
     restoreGLStates(&glStates);
 }
+
+void view_drawTop(const double center[2], float halfSize, int size)
+{
+    // Like the top 2D view, the eye on the ground below the center
+    const double eye[3] = { center[0], center[1], 0.0 };
+    float viewProjMat[4][4];
+    memset(viewProjMat, 0, sizeof(viewProjMat));
+    viewProjMat[0][0] = 1.0f / halfSize;
+    viewProjMat[1][1] = 1.0f / halfSize;
+    viewProjMat[2][2] = -1.0f / VIEW_ORTHO_DEPTH;
+    viewProjMat[3][3] = 1.0f;
+
+    glDisable(GL_BLEND);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_SCISSOR_TEST);
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    terrain_draw(viewProjMat, eye, true, halfSize * 2.0f / (float)size);
+    drawEntities(viewProjMat, eye);
+}
@@ -1,6 +1,9 @@
 #ifndef VIEW_H_INCLUDED
 #define VIEW_H_INCLUDED
 
+#include <json/json.h>
+#include <vector>
+
 #define MAX_VIEWS 4
 
 enum class ViewType : int
@@ -22,7 +25,7 @@ enum class ViewLayout : int
 
 struct ViewInfo
 {
-    float position[3] = { 0, 0, 0 };
+    double position[3] = { 0, 0, 0 }; // Double, so cameras far out don't step
     int zoomLevel = 18;
     float angleX = 0.0f;
     float angleZ = 0.0f;
@@ -30,12 +33,32 @@ struct ViewInfo
     float x, y;
     float w, h;
     int index;
+    float clipRect[4] = { 0, 0, 0, 0 }; // Screen rect last drawn into, x0 y0 x1 y1
+};
+
+// Where a view looks in world space, and how far around that it shows
+struct ViewFocus
+{
+    float center[3];
+    float radius;
 };
 
 extern const char* VIEW_TYPE_TO_NAME[];
 extern ViewInfo viewInfos[MAX_VIEWS];
 
 void view_updateGUI(ViewType type, ViewLayout layout, int viewIndex);
-void view_load();
+
+// ViewInfo is the live camera state. It is written to a sidecar next to the
+// map a moment after the cameras stop moving, not to the map itself.
+void view_initShaders(); // At startup, before shaders_finish
+void view_load(); // From the sidecar, or the map's defaults
+void view_update(); // Once per frame, writes the sidecar when due
+void view_flush(); // Writes the sidecar now if cameras changed
+void view_toJson(Json::Value& views);
+void view_getFoci(std::vector<ViewFocus>& out); // Views on screen only
+
+// The terrain and models seen from above, halfSize meters around center,
+// into the bound framebuffer's viewport of size pixels. For thumbnails.
+void view_drawTop(const double center[2], float halfSize, int size);
 
 #endif
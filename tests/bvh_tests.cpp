@@ -0,0 +1,318 @@
+// Checks the BVH queries against brute force over every primitive: box
+// traversal, single rays and packets of 4 against triangles. Then times
+// rays through the BVH against brute force.
+//   bvh_tests [triangle count]
+// 20k triangles by default. Returns 1 if a query is off.
+
+#include "bvh.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#define TESTS_PRIMITIVES 3000
+#define TESTS_RAYS 2000
+#define TESTS_TOLERANCE 1e-4f // Relative, between distances to the same triangle
+#define TESTS_BOX_MARGIN 1e-3f // Boxes the ray only grazes may go either way
+#define BENCH_RAYS 20000
+#define BENCH_RUNS 5 // Best of
+
+static int failureCount = 0;
+
+static double getTime()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static float randomFloat(float min, float max)
+{
+    return min + (max - min) * (float)rand() / (float)RAND_MAX;
+}
+
+static void fail(const char* name, size_t ray, const char* what)
+{
+    if (failureCount < 20) printf("FAILED %s, ray %u: %s\n", name, (unsigned)ray, what);
+    ++failureCount;
+}
+
+// Small triangles scattered in a cube, v0, v1, v2 xyz
+static void randomTriangles(std::vector<float>& triangles, size_t count)
+{
+    triangles.resize(count * 9);
+    for (size_t i = 0; i < count; ++i)
+    {
+        float center[3] = { randomFloat(-100.0f, 100.0f), randomFloat(-100.0f, 100.0f), randomFloat(-100.0f, 100.0f) };
+        for (int v = 0; v < 3; ++v)
+        {
+            for (int a = 0; a < 3; ++a) triangles[i * 9 + v * 3 + a] = center[a] + randomFloat(-5.0f, 5.0f);
+        }
+    }
+}
+
+// From inside or around the cube towards a point in it, dir normalized
+static void randomRay(float origin[3], float dir[3])
+{
+    float target[3], length = 0.0f;
+    for (int a = 0; a < 3; ++a)
+    {
+        origin[a] = randomFloat(-150.0f, 150.0f);
+        target[a] = randomFloat(-100.0f, 100.0f);
+        dir[a] = target[a] - origin[a];
+        length += dir[a] * dir[a];
+    }
+    length = std::sqrt(std::max(length, 1e-6f));
+    for (int a = 0; a < 3; ++a) dir[a] /= length;
+}
+
+//-----------------------------------------------------------------------------
+// References, every primitive one after the other
+
+// Slab test in doubles, grown or shrunk by margin
+static bool refHitsBox(const float* pBox, const float origin[3], const float dir[3], float t, float margin)
+{
+    double tMin = 0.0, tMax = t;
+    for (int a = 0; a < 3; ++a)
+    {
+        double min = pBox[a] - margin, max = pBox[3 + a] + margin;
+        if (std::fabs(dir[a]) < 1e-12f)
+        {
+            if (origin[a] < min || origin[a] > max) return false;
+            continue;
+        }
+        auto t0 = (min - origin[a]) / dir[a];
+        auto t1 = (max - origin[a]) / dir[a];
+        tMin = std::max(tMin, std::min(t0, t1));
+        tMax = std::min(tMax, std::max(t0, t1));
+    }
+    return tMin <= tMax;
+}
+
+// Same Möller-Trumbore as the BVH, on v0, e1, e2
+static bool refIntersectTriangle(const float* pTriangle, const float origin[3], const float dir[3], float* pT)
+{
+    auto pV0 = pTriangle;
+    auto pE1 = pTriangle + 3;
+    auto pE2 = pTriangle + 6;
+    const float p[3] = { dir[1] * pE2[2] - dir[2] * pE2[1], dir[2] * pE2[0] - dir[0] * pE2[2], dir[0] * pE2[1] - dir[1] * pE2[0] };
+    auto det = pE1[0] * p[0] + pE1[1] * p[1] + pE1[2] * p[2];
+    if (std::fabs(det) < 1e-20f) return false;
+    auto inv = 1.0f / det;
+    const float s[3] = { origin[0] - pV0[0], origin[1] - pV0[1], origin[2] - pV0[2] };
+    auto u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+    if (u < 0 || u > 1) return false;
+    const float q[3] = { s[1] * pE1[2] - s[2] * pE1[1], s[2] * pE1[0] - s[0] * pE1[2], s[0] * pE1[1] - s[1] * pE1[0] };
+    auto v = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) * inv;
+    if (v < 0 || u + v > 1) return false;
+    auto t = (pE2[0] * q[0] + pE2[1] * q[1] + pE2[2] * q[2]) * inv;
+    if (t < 0 || t >= *pT) return false;
+    *pT = t;
+    return true;
+}
+
+static uint32_t refIntersectMesh(const MeshBvh& mesh, const float origin[3], const float dir[3], float* pT)
+{
+    auto hit = (uint32_t)BVH_NONE;
+    auto triangleCount = mesh.triangles.size() / 9;
+    for (size_t i = 0; i < triangleCount; ++i)
+    {
+        if (refIntersectTriangle(&mesh.triangles[i * 9], origin, dir, pT)) hit = (uint32_t)i;
+    }
+    return hit;
+}
+
+// Same hit, or another one as close
+static bool isSameHit(uint32_t hit, float t, uint32_t expectedHit, float expectedT)
+{
+    if (hit == BVH_NONE || expectedHit == BVH_NONE) return hit == expectedHit;
+    return std::fabs(t - expectedT) <= TESTS_TOLERANCE * std::max(1.0f, expectedT);
+}
+
+//-----------------------------------------------------------------------------
+// Tests
+
+// Every box the ray clearly goes through is visited, whatever the order
+static void testTraverse()
+{
+    std::vector<float> bounds(TESTS_PRIMITIVES * 6);
+    for (size_t i = 0; i < TESTS_PRIMITIVES; ++i)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            auto center = randomFloat(-100.0f, 100.0f);
+            auto extent = randomFloat(0.0f, 8.0f);
+            bounds[i * 6 + a] = center - extent;
+            bounds[i * 6 + 3 + a] = center + extent;
+        }
+    }
+    Bvh bvh;
+    bvh_build(bvh, bounds.data(), TESTS_PRIMITIVES);
+    if (bvh.primitives.size() != TESTS_PRIMITIVES) fail("build", 0, "primitives lost");
+
+    std::vector<uint8_t> visited(TESTS_PRIMITIVES);
+    for (size_t r = 0; r < TESTS_RAYS; ++r)
+    {
+        float origin[3], dir[3];
+        randomRay(origin, dir);
+        auto t = randomFloat(10.0f, 400.0f);
+        std::fill(visited.begin(), visited.end(), 0);
+        bvh_traverse(bvh, origin, dir, &t, [&](uint32_t primitive) { visited[primitive] = 1; });
+        for (size_t i = 0; i < TESTS_PRIMITIVES; ++i)
+        {
+            if (visited[i] || !refHitsBox(&bounds[i * 6], origin, dir, t, -TESTS_BOX_MARGIN)) continue;
+            fail("traverse", r, "box the ray goes through not visited");
+            break;
+        }
+    }
+}
+
+static void testIntersectMesh(const MeshBvh& mesh)
+{
+    auto hitCount = 0;
+    for (size_t r = 0; r < TESTS_RAYS; ++r)
+    {
+        float origin[3], dir[3];
+        randomRay(origin, dir);
+        auto t = FLT_MAX, expectedT = FLT_MAX;
+        auto hit = bvh_intersectMesh(mesh, origin, dir, &t);
+        auto expectedHit = refIntersectMesh(mesh, origin, dir, &expectedT);
+        if (!isSameHit(hit, t, expectedHit, expectedT)) fail("intersectMesh", r, "not the closest triangle");
+        if (expectedHit != BVH_NONE) ++hitCount;
+    }
+    if (hitCount == 0) fail("intersectMesh", 0, "no ray hit anything, the test is off");
+}
+
+// Packets against single rays, with some lanes masked out
+static void testIntersectMesh4(const MeshBvh& mesh)
+{
+    for (size_t r = 0; r < TESTS_RAYS; r += 4)
+    {
+        BvhRay4 rays;
+        float origins[4][3], dirs[4][3];
+        for (int k = 0; k < 4; ++k)
+        {
+            randomRay(origins[k], dirs[k]);
+            for (int a = 0; a < 3; ++a)
+            {
+                rays.origin[a][k] = origins[k][a];
+                rays.dir[a][k] = dirs[k][a];
+            }
+            rays.t[k] = FLT_MAX;
+            rays.hit[k] = BVH_NONE;
+        }
+        auto mask = (int)(r / 4 % 15) + 1;
+        bvh_intersectMesh4(mesh, rays, mask);
+        for (int k = 0; k < 4; ++k)
+        {
+            if (!(mask & (1 << k)))
+            {
+                if (rays.hit[k] != BVH_NONE || rays.t[k] != FLT_MAX) fail("intersectMesh4", r + k, "masked out ray changed");
+                continue;
+            }
+            auto t = FLT_MAX;
+            auto hit = bvh_intersectMesh(mesh, origins[k], dirs[k], &t);
+            if (!isSameHit(rays.hit[k], rays.t[k], hit, t)) fail("intersectMesh4", r + k, "differs from the single ray");
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Timings
+
+template<typename Fn>
+static double bestOf(Fn fn)
+{
+    auto best = 1e30;
+    for (int run = 0; run < BENCH_RUNS; ++run)
+    {
+        auto start = getTime();
+        fn();
+        best = std::min(best, getTime() - start);
+    }
+    return best;
+}
+
+static volatile uint32_t sink; // So the loops aren't optimized out
+
+static void bench(size_t triangleCount)
+{
+    std::vector<float> triangles;
+    randomTriangles(triangles, triangleCount);
+    MeshBvh mesh;
+    auto build = bestOf([&] { bvh_buildMesh(mesh, triangles.data(), triangleCount); });
+
+    std::vector<float> rays(BENCH_RAYS * 6);
+    for (size_t r = 0; r < BENCH_RAYS; ++r) randomRay(&rays[r * 6], &rays[r * 6 + 3]);
+    auto single = bestOf([&]
+    {
+        for (size_t r = 0; r < BENCH_RAYS; ++r)
+        {
+            auto t = FLT_MAX;
+            sink = bvh_intersectMesh(mesh, &rays[r * 6], &rays[r * 6 + 3], &t);
+        }
+    });
+    auto packets = bestOf([&]
+    {
+        for (size_t r = 0; r + 4 <= BENCH_RAYS; r += 4)
+        {
+            BvhRay4 packet;
+            for (int k = 0; k < 4; ++k)
+            {
+                for (int a = 0; a < 3; ++a)
+                {
+                    packet.origin[a][k] = rays[(r + k) * 6 + a];
+                    packet.dir[a][k] = rays[(r + k) * 6 + 3 + a];
+                }
+                packet.t[k] = FLT_MAX;
+                packet.hit[k] = BVH_NONE;
+            }
+            bvh_intersectMesh4(mesh, packet, 0xF);
+            sink = packet.hit[0];
+        }
+    });
+    // Brute force on a slice only, it's that slow
+    auto bruteRays = std::max((size_t)1, BENCH_RAYS * (size_t)1000 / std::max((size_t)1000, triangleCount) / 10);
+    auto brute = bestOf([&]
+    {
+        for (size_t r = 0; r < bruteRays; ++r)
+        {
+            auto t = FLT_MAX;
+            sink = refIntersectMesh(mesh, &rays[r * 6], &rays[r * 6 + 3], &t);
+        }
+    });
+
+    auto toNs = [](double ms, size_t count) { return ms * 1e6 / (double)count; };
+    printf("%u triangles, built in %.1f ms, ns per ray:\n", (unsigned)triangleCount, build);
+    printf("  intersectMesh        %8.1f\n", toNs(single, BENCH_RAYS));
+    printf("  intersectMesh4       %8.1f\n", toNs(packets, BENCH_RAYS / 4 * 4));
+    printf("  brute force          %8.1f\n", toNs(brute, bruteRays));
+}
+
+int main(int argc, char** argv)
+{
+    srand(1);
+    jobs_init(); // Big builds split on the job threads, that path is tested too
+
+    testTraverse();
+    std::vector<float> triangles;
+    randomTriangles(triangles, TESTS_PRIMITIVES);
+    MeshBvh mesh;
+    bvh_buildMesh(mesh, triangles.data(), TESTS_PRIMITIVES);
+    testIntersectMesh(mesh);
+    testIntersectMesh4(mesh);
+    if (failureCount)
+    {
+        printf("%i failed\n", failureCount);
+        jobs_shutdown();
+        return 1;
+    }
+    printf("All passed\n");
+
+    bench(argc > 1 ? (size_t)atoi(argv[1]) : 20000);
+    jobs_shutdown();
+    return 0;
+}
@@ -0,0 +1,626 @@
+// Checks the caches built over the document's entities against brute force
+// on the entities themselves: world transforms through parents, the 2D
+// selection grid and the snap hash. Each is checked again after Set edits,
+// which only update what they touched.
+//   document_tests [entity count]
+// 5000 entities by default. Returns 1 if a cache is off.
+// The modules that need a window (library, layers) are replaced by the
+// stand-ins below.
+
+#include "entityGrid.h"
+#include "globals.h"
+#include "jobs.h"
+#include "bvh.h"
+#include "layers.h"
+#include "library.h"
+#include "snap.h"
+#include "transforms.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define TESTS_CUBE_MODEL 1 // Unit cube around the origin
+#define TESTS_PREFAB_MODEL 2 // Two cubes side by side
+#define TESTS_HIDDEN_LAYER 2
+#define TESTS_LOCKED_LAYER 3
+#define TESTS_QUERIES 300
+#define TESTS_EDITS 20 // Batches of Set edits between checks
+#define TESTS_TOLERANCE 1e-3 // Relative to the magnitude of what's compared
+#define TESTS_EDGE_MARGIN 1e-3f // Points that close to a polygon edge may go either way
+
+static int failureCount = 0;
+static uint32_t entityCount = 0;
+
+static float randomFloat(float min, float max)
+{
+    return min + (max - min) * (float)rand() / (float)RAND_MAX;
+}
+
+static void fail(const char* name, int query, const char* what)
+{
+    if (failureCount < 20) printf("FAILED %s, query %i: %s\n", name, query, what);
+    ++failureCount;
+}
+
+static bool isClose(double value, double expected)
+{
+    return std::fabs(value - expected) <= TESTS_TOLERANCE * std::max(1.0, std::fabs(expected));
+}
+
+//-----------------------------------------------------------------------------
+// Stand-ins
+
+static MeshBvh cubeBvh;
+static std::vector<float> cubeTriangles; // v0, v1, v2 xyz
+static Prefab prefab;
+
+static void initModels()
+{
+    // Two triangles per face, on the faces of [-0.5, 0.5]^3
+    static const int FACES[6][4] = {
+        { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 }
+    };
+    for (const auto& face : FACES)
+    {
+        const int corners[6] = { face[0], face[1], face[2], face[0], face[2], face[3] };
+        for (auto corner : corners)
+        {
+            for (int k = 0; k < 3; ++k) cubeTriangles.push_back((corner >> k) & 1 ? 0.5f : -0.5f);
+        }
+    }
+    bvh_buildMesh(cubeBvh, cubeTriangles.data(), cubeTriangles.size() / 9);
+
+    for (int p = 0; p < 2; ++p)
+    {
+        const float t[3] = { p ? 0.75f : -0.75f, 0.0f, 0.0f };
+        const float q[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        const float s[3] = { 0.5f, 0.5f, 0.5f };
+        PrefabPart part;
+        vectorMath_composeTrs(t, q, s, &part.local, 1);
+        part.modelId = TESTS_CUBE_MODEL;
+        prefab.parts.push_back(part);
+    }
+}
+
+Model library_getModel(uint64_t id)
+{
+    Model model = {};
+    if (id == TESTS_CUBE_MODEL) model.pBvh = &cubeBvh;
+    if (id == TESTS_CUBE_MODEL || id == TESTS_PREFAB_MODEL)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            model.min[k] = k == 0 && id == TESTS_PREFAB_MODEL ? -1.0f : -0.5f;
+            model.max[k] = k == 0 && id == TESTS_PREFAB_MODEL ? 1.0f : 0.5f;
+        }
+    }
+    return model;
+}
+
+const Prefab* library_getPrefab(uint64_t id)
+{
+    return id == TESTS_PREFAB_MODEL ? &prefab : nullptr;
+}
+
+uint64_t library_getRevision()
+{
+    return 1;
+}
+
+uint64_t layers_getVisibleMask()
+{
+    return ~((uint64_t)1 << TESTS_HIDDEN_LAYER);
+}
+
+uint64_t layers_getSelectableMask()
+{
+    return layers_getVisibleMask() & ~((uint64_t)1 << TESTS_LOCKED_LAYER);
+}
+
+//-----------------------------------------------------------------------------
+// Document
+
+static void randomRotation(float q[4])
+{
+    double d[4], length = 0.0;
+    for (int k = 0; k < 4; ++k)
+    {
+        d[k] = randomFloat(-1.0f, 1.0f);
+        length += d[k] * d[k];
+    }
+    length = std::sqrt(std::max(length, 1e-12));
+    for (int k = 0; k < 4; ++k) q[k] = (float)(d[k] / length);
+}
+
+// Ids are index + 1, parents come before their children but for a few that
+// point nowhere and a loop at the end
+static void createDocument(uint32_t count)
+{
+    entities_clear(document.entities);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        EntityRow row;
+        auto kind = rand() % 10;
+        row.modelId = kind < 6 ? TESTS_CUBE_MODEL : kind < 8 ? TESTS_PREFAB_MODEL : 0;
+        row.flags = rand() % 50 ? 0 : ENTITY_FLAG_RAW;
+        row.id = i + 1;
+        auto hasParent = i > 0 && rand() % 4 == 0;
+        row.parent = hasParent ? (rand() % 20 ? (uint32_t)(rand() % i) + 1 : count + 1000) : ENTITY_NO_ID;
+        for (int k = 0; k < 3; ++k)
+        {
+            row.position[k] = hasParent ? randomFloat(-5.0f, 5.0f) : randomFloat(-100.0f, 100.0f);
+            row.scale[k] = randomFloat(0.5f, 2.0f);
+        }
+        randomRotation(row.rotation);
+        row.layer = (uint8_t)(rand() % 5);
+        if (i + 2 == count) row.parent = count;
+        if (i + 1 == count) row.parent = count - 1;
+        entities_append(document.entities, row);
+    }
+    entityCount = count;
+}
+
+static EntityRow getRow(uint32_t index)
+{
+    size_t c = 0;
+    auto first = index;
+    while (first >= entities_getChunk(document.entities, c).count) first -= entities_getChunk(document.entities, c++).count;
+    const auto& chunk = entities_getChunk(document.entities, c);
+    EntityRow row;
+    row.flags = chunk.flags[first];
+    row.modelId = chunk.modelIds[first];
+    memcpy(row.position, &chunk.positions[first * 3], sizeof(row.position));
+    memcpy(row.rotation, &chunk.rotations[first * 4], sizeof(row.rotation));
+    memcpy(row.scale, &chunk.scales[first * 3], sizeof(row.scale));
+    row.id = chunk.ids[first];
+    row.parent = chunk.parents[first];
+    row.layer = chunk.layers[first];
+    return row;
+}
+
+// Like edit_applyToDocument, with the hooks of the modules under test
+static void setValues(EntityField field, const std::vector<uint32_t>& indices, const std::vector<uint8_t>& values)
+{
+    Edit edit;
+    edit.type = EditType::Set;
+    edit.field = field;
+    edit.indices = indices;
+    edit.after = values;
+    snap_beforeEdit(edit);
+    transforms_beforeEdit(edit);
+    auto pData = values.data();
+    if (!entities_setValues(document.entities, field, indices.data(), indices.size(), &pData, pData + values.size())) fail("setValues", 0, "rejected");
+    transforms_afterEdit(edit);
+    snap_afterEdit(edit);
+}
+
+template<typename T>
+static void appendValues(std::vector<uint8_t>& values, const T* pValues, size_t count)
+{
+    values.insert(values.end(), (const uint8_t*)pValues, (const uint8_t*)(pValues + count));
+}
+
+// Moves, turns and reparents a few entities, parents included
+static void randomEdits()
+{
+    for (int e = 0; e < TESTS_EDITS; ++e)
+    {
+        std::vector<uint32_t> indices;
+        std::vector<uint8_t> values;
+        auto count = 1 + rand() % 8;
+        for (int i = 0; i < count; ++i) indices.push_back((uint32_t)(rand() % entityCount));
+        std::sort(indices.begin(), indices.end());
+        indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+        auto field = rand() % 4;
+        for (auto index : indices)
+        {
+            if (field == 0)
+            {
+                const double position[3] = { randomFloat(-100.0f, 100.0f), randomFloat(-100.0f, 100.0f), randomFloat(-100.0f, 100.0f) };
+                appendValues(values, position, 3);
+            }
+            else if (field == 1)
+            {
+                float rotation[4];
+                randomRotation(rotation);
+                appendValues(values, rotation, 4);
+            }
+            else if (field == 2)
+            {
+                const float scale[3] = { randomFloat(0.5f, 2.0f), randomFloat(0.5f, 2.0f), randomFloat(0.5f, 2.0f) };
+                appendValues(values, scale, 3);
+            }
+            else
+            {
+                // Anywhere, loops included, they are broken the same way
+                auto parent = rand() % 3 ? (uint32_t)(rand() % entityCount) + 1 : ENTITY_NO_ID;
+                appendValues(values, &parent, 1);
+                (void)index;
+            }
+        }
+        static const EntityField FIELDS[4] = { EntityField::Position, EntityField::Rotation, EntityField::Scale, EntityField::Parent };
+        setValues(FIELDS[field], indices, values);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Transforms
+
+struct RefTransform
+{
+    double axes[3][3]; // Columns, scaled
+    double position[3];
+};
+
+static void refLocal(const EntityRow& row, RefTransform& out)
+{
+    double x = row.rotation[0], y = row.rotation[1], z = row.rotation[2], w = row.rotation[3];
+    const double rotation[3][3] = {
+        { 1 - 2 * (y * y + z * z), 2 * (x * y + w * z), 2 * (x * z - w * y) },
+        { 2 * (x * y - w * z), 1 - 2 * (x * x + z * z), 2 * (y * z + w * x) },
+        { 2 * (x * z + w * y), 2 * (y * z - w * x), 1 - 2 * (x * x + y * y) }
+    };
+    for (int c = 0; c < 3; ++c)
+    {
+        for (int r = 0; r < 3; ++r) out.axes[c][r] = rotation[c][r] * row.scale[c];
+        out.position[c] = row.position[c];
+    }
+}
+
+// Parents resolved from the ids, the loops broken where the walk from the
+// lowest index finds them
+static void refParents(std::vector<uint32_t>& parents)
+{
+    std::vector<EntityRow> rows(entityCount);
+    for (uint32_t i = 0; i < entityCount; ++i) rows[i] = getRow(i);
+    parents.assign(entityCount, TRANSFORMS_NONE);
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        if (rows[i].parent == ENTITY_NO_ID) continue;
+        for (uint32_t j = 0; j < entityCount; ++j)
+        {
+            if (rows[j].id != rows[i].parent) continue;
+            if (j != i) parents[i] = j;
+            break;
+        }
+    }
+    std::vector<uint8_t> states(entityCount, 0);
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        std::vector<uint32_t> path;
+        auto at = i;
+        while (at != TRANSFORMS_NONE && states[at] == 0)
+        {
+            states[at] = 1;
+            path.push_back(at);
+            at = parents[at];
+        }
+        if (at != TRANSFORMS_NONE && states[at] == 1) parents[at] = TRANSFORMS_NONE;
+        for (auto visited : path) states[visited] = 2;
+    }
+}
+
+static void refWorld(uint32_t index, const std::vector<uint32_t>& parents, std::vector<RefTransform>& worlds, std::vector<uint8_t>& isDone)
+{
+    if (isDone[index]) return;
+    RefTransform local;
+    refLocal(getRow(index), local);
+    auto& world = worlds[index];
+    world = local;
+    auto parent = parents[index];
+    if (parent != TRANSFORMS_NONE)
+    {
+        refWorld(parent, parents, worlds, isDone);
+        const auto& parentWorld = worlds[parent];
+        for (int r = 0; r < 3; ++r)
+        {
+            world.position[r] = parentWorld.position[r];
+            for (int k = 0; k < 3; ++k) world.position[r] += parentWorld.axes[k][r] * local.position[k];
+            for (int c = 0; c < 3; ++c)
+            {
+                world.axes[c][r] = 0.0;
+                for (int k = 0; k < 3; ++k) world.axes[c][r] += parentWorld.axes[k][r] * local.axes[c][k];
+            }
+        }
+    }
+    isDone[index] = 1;
+}
+
+static void checkTransforms(const char* name)
+{
+    std::vector<uint32_t> parents;
+    refParents(parents);
+    std::vector<RefTransform> worlds(entityCount);
+    std::vector<uint8_t> isDone(entityCount, 0);
+    auto pMatrices = transforms_getWorldMatrices();
+    auto pPositions = transforms_getWorldPositions();
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        if (transforms_getParent(i) != parents[i])
+        {
+            fail(name, (int)i, "wrong parent");
+            continue;
+        }
+        refWorld(i, parents, worlds, isDone);
+        float columns[4][4];
+        mat4_store(pMatrices[i], columns);
+        auto isRight = true;
+        for (int r = 0; r < 3; ++r)
+        {
+            isRight = isRight && isClose(pPositions[i * 3 + r], worlds[i].position[r]) && isClose(columns[3][r], worlds[i].position[r]);
+            for (int c = 0; c < 3; ++c) isRight = isRight && isClose(columns[c][r], worlds[i].axes[c][r]);
+        }
+        if (!isRight) fail(name, (int)i, "wrong world transform");
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Entity grid
+
+static const int PLANES[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+
+static bool isGridEntity(uint32_t index)
+{
+    auto row = getRow(index);
+    return !(row.flags & ENTITY_FLAG_RAW) && ((layers_getSelectableMask() >> row.layer) & 1);
+}
+
+static void getPlanePoint(uint32_t index, int plane, float out[2])
+{
+    auto pPositions = transforms_getWorldPositions();
+    out[0] = (float)pPositions[index * 3 + PLANES[plane][0]];
+    out[1] = (float)pPositions[index * 3 + PLANES[plane][1]];
+}
+
+// Distance to the closest edge, to leave out the points on the outline
+static float getEdgeDistance(const float* pPoints, size_t pointCount, const float p[2])
+{
+    auto best = 1e30f;
+    for (size_t i = 0, j = pointCount - 1; i < pointCount; j = i++)
+    {
+        float d[2] = { pPoints[i * 2] - pPoints[j * 2], pPoints[i * 2 + 1] - pPoints[j * 2 + 1] };
+        float v[2] = { p[0] - pPoints[j * 2], p[1] - pPoints[j * 2 + 1] };
+        auto t = std::max(0.0f, std::min(1.0f, (v[0] * d[0] + v[1] * d[1]) / std::max(1e-12f, d[0] * d[0] + d[1] * d[1])));
+        auto dx = v[0] - d[0] * t, dy = v[1] - d[1] * t;
+        best = std::min(best, std::sqrt(dx * dx + dy * dy));
+    }
+    return best;
+}
+
+static bool refIsInside(const float* pPoints, size_t pointCount, const float p[2])
+{
+    auto isInside = false;
+    for (size_t i = 0, j = pointCount - 1; i < pointCount; j = i++)
+    {
+        auto ai = pPoints[i * 2], bi = pPoints[i * 2 + 1];
+        auto aj = pPoints[j * 2], bj = pPoints[j * 2 + 1];
+        if ((bi > p[1]) != (bj > p[1]) && p[0] < (aj - ai) * (p[1] - bi) / (bj - bi) + ai) isInside = !isInside;
+    }
+    return isInside;
+}
+
+static void checkGrid(const char* name)
+{
+    std::vector<uint32_t> found;
+    std::vector<uint8_t> isFound(entityCount);
+    for (int q = 0; q < TESTS_QUERIES; ++q)
+    {
+        auto plane = q % 3;
+        float point[2];
+        auto isRect = q % 3 != 2;
+
+        // A rectangle, or a star that is concave, around a random spot
+        float center[2] = { randomFloat(-110.0f, 110.0f), randomFloat(-110.0f, 110.0f) };
+        float size = randomFloat(1.0f, 60.0f);
+        std::vector<float> polygon;
+        float min[2] = { center[0] - size, center[1] - size * 0.5f };
+        float max[2] = { center[0] + size, center[1] + size * 0.5f };
+        found.clear();
+        if (isRect)
+        {
+            entityGrid_queryRect(PLANES[plane][0], PLANES[plane][1], min, max, found);
+        }
+        else
+        {
+            for (int p = 0; p < 10; ++p)
+            {
+                auto angle = (float)p * 6.2831853f / 10.0f;
+                auto radius = p & 1 ? size * 0.4f : size;
+                polygon.push_back(center[0] + std::cos(angle) * radius);
+                polygon.push_back(center[1] + std::sin(angle) * radius);
+            }
+            entityGrid_queryPolygon(PLANES[plane][0], PLANES[plane][1], polygon.data(), polygon.size() / 2, found);
+        }
+
+        std::fill(isFound.begin(), isFound.end(), 0);
+        for (auto index : found)
+        {
+            if (index >= entityCount || isFound[index]) fail(name, q, "entity out of range or found twice");
+            else isFound[index] = 1;
+        }
+        for (uint32_t i = 0; i < entityCount; ++i)
+        {
+            getPlanePoint(i, plane, point);
+            bool isExpected;
+            if (isRect)
+            {
+                isExpected = point[0] >= min[0] && point[0] <= max[0] && point[1] >= min[1] && point[1] <= max[1];
+            }
+            else
+            {
+                if (getEdgeDistance(polygon.data(), polygon.size() / 2, point) < TESTS_EDGE_MARGIN) continue;
+                isExpected = refIsInside(polygon.data(), polygon.size() / 2, point);
+            }
+            isExpected = isExpected && isGridEntity(i);
+            if (isExpected != (isFound[i] != 0))
+            {
+                fail(name, q, isExpected ? (isRect ? "rect missed an entity" : "polygon missed an entity") : "selected an entity outside or not selectable");
+                break;
+            }
+        }
+
+        // Nearest, the closest selectable one within radius
+        float radius = randomFloat(0.5f, 20.0f);
+        auto nearest = entityGrid_queryNearest(PLANES[plane][0], PLANES[plane][1], center, radius);
+        auto bestDistance = radius * radius;
+        auto expected = (uint32_t)ENTITYGRID_NONE;
+        for (uint32_t i = 0; i < entityCount; ++i)
+        {
+            if (!isGridEntity(i)) continue;
+            getPlanePoint(i, plane, point);
+            auto distance = (point[0] - center[0]) * (point[0] - center[0]) + (point[1] - center[1]) * (point[1] - center[1]);
+            if (distance > bestDistance) continue;
+            bestDistance = distance;
+            expected = i;
+        }
+        if ((nearest == ENTITYGRID_NONE) != (expected == ENTITYGRID_NONE))
+        {
+            fail(name, q, "nearest found or missed wrongly");
+        }
+        else if (nearest != ENTITYGRID_NONE && nearest != expected)
+        {
+            getPlanePoint(nearest, plane, point);
+            auto distance = (point[0] - center[0]) * (point[0] - center[0]) + (point[1] - center[1]) * (point[1] - center[1]);
+            if (!isClose(distance, bestDistance) || !isGridEntity(nearest)) fail(name, q, "not the nearest entity");
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Snap
+
+// Every point of the model, in model space, duplicates and all
+static void refModelPoints(uint64_t modelId, std::vector<float>& out)
+{
+    auto pPrefab = library_getPrefab(modelId);
+    if (pPrefab)
+    {
+        for (const auto& part : pPrefab->parts)
+        {
+            std::vector<float> partPoints;
+            refModelPoints(part.modelId, partPoints);
+            for (size_t p = 0; p < partPoints.size(); p += 3)
+            {
+                float position[4];
+                float4_store(position, mat4_transformPoint(part.local, float4_set(partPoints[p], partPoints[p + 1], partPoints[p + 2], 1.0f)));
+                out.insert(out.end(), position, position + 3);
+            }
+        }
+        return;
+    }
+    if (modelId != TESTS_CUBE_MODEL)
+    {
+        out.insert(out.end(), 3, 0.0f); // Snaps by its origin
+        return;
+    }
+    for (size_t t = 0; t < cubeTriangles.size(); t += 9)
+    {
+        auto v = &cubeTriangles[t];
+        for (int i = 0; i < 3; ++i)
+        {
+            out.insert(out.end(), v + i * 3, v + i * 3 + 3);
+            for (int k = 0; k < 3; ++k) out.push_back((v[i * 3 + k] + v[(i + 1) % 3 * 3 + k]) * 0.5f);
+        }
+        for (int k = 0; k < 3; ++k) out.push_back((v[k] + v[3 + k] + v[6 + k]) / 3.0f);
+    }
+}
+
+static void checkSnap(const char* name, const std::vector<uint32_t>& ignored)
+{
+    std::vector<uint8_t> isIgnored(entityCount, 0);
+    for (auto index : ignored) isIgnored[index] = 1;
+
+    // All the snap points in world space
+    std::vector<float> points;
+    std::vector<uint32_t> pointEntities;
+    std::vector<float> modelPoints;
+    auto pMatrices = transforms_getWorldMatrices();
+    for (uint32_t i = 0; i < entityCount; ++i)
+    {
+        auto row = getRow(i);
+        if ((row.flags & ENTITY_FLAG_RAW) || isIgnored[i] || !((layers_getVisibleMask() >> row.layer) & 1)) continue;
+        modelPoints.clear();
+        refModelPoints(row.modelId, modelPoints);
+        for (size_t p = 0; p < modelPoints.size(); p += 3)
+        {
+            float position[4];
+            float4_store(position, mat4_transformPoint(pMatrices[i], float4_set(modelPoints[p], modelPoints[p + 1], modelPoints[p + 2], 1.0f)));
+            points.insert(points.end(), position, position + 3);
+            pointEntities.push_back(i);
+        }
+    }
+
+    for (int q = 0; q < TESTS_QUERIES; ++q)
+    {
+        // Near an entity most of the time, so there is something to find
+        float point[3];
+        auto near = (size_t)rand() % pointEntities.size();
+        for (int k = 0; k < 3; ++k) point[k] = points[near * 3 + k] + randomFloat(-2.0f, 2.0f);
+        auto radius = randomFloat(0.1f, 3.0f);
+
+        SnapResult result;
+        auto isFound = snap_find(point, radius, result);
+        auto bestDistance = radius * radius;
+        auto isExpected = false;
+        for (size_t p = 0; p < pointEntities.size(); ++p)
+        {
+            auto dx = points[p * 3] - point[0], dy = points[p * 3 + 1] - point[1], dz = points[p * 3 + 2] - point[2];
+            auto distance = dx * dx + dy * dy + dz * dz;
+            if (distance > bestDistance) continue;
+            bestDistance = distance;
+            isExpected = true;
+        }
+        if (isFound != isExpected)
+        {
+            fail(name, q, isExpected ? "missed a snap point" : "found a point out of reach or left out");
+            continue;
+        }
+        if (!isFound) continue;
+        auto dx = result.position[0] - point[0], dy = result.position[1] - point[1], dz = result.position[2] - point[2];
+        if (!isClose(dx * dx + dy * dy + dz * dz, bestDistance)) fail(name, q, "not the closest snap point");
+        if (result.entity >= entityCount || isIgnored[result.entity]) fail(name, q, "point of an ignored entity");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    srand(1);
+    jobs_init();
+    initModels();
+    createDocument(argc > 1 ? (uint32_t)std::max(16, atoi(argv[1])) : 5000);
+
+    checkTransforms("transforms");
+    checkGrid("entityGrid");
+    checkSnap("snap", {});
+    for (int round = 0; round < 5; ++round)
+    {
+        randomEdits();
+        checkTransforms("transforms after edits");
+        checkGrid("entityGrid after edits");
+        checkSnap("snap after edits", {});
+    }
+
+    // Left out while dragged, then back once done
+    std::vector<uint32_t> ignored;
+    for (int i = 0; i < 50; ++i) ignored.push_back((uint32_t)(rand() % entityCount));
+    std::sort(ignored.begin(), ignored.end());
+    ignored.erase(std::unique(ignored.begin(), ignored.end()), ignored.end());
+    snap_setIgnored(ignored);
+    checkSnap("snap with ignored", ignored);
+    snap_setIgnored({});
+    checkSnap("snap after ignored", {});
+
+    jobs_shutdown();
+    if (failureCount)
+    {
+        printf("%i failed\n", failureCount);
+        return 1;
+    }
+    printf("All passed\n");
+    return 0;
+}
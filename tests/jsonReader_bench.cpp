@@ -0,0 +1,144 @@
+// Parses a map with jsonReader and with jsoncpp, checks they agree on the
+// entities and prints how long each took.
+//   jsonReader_bench [map.json | entity count]
+// Without a map, one is generated with that many entities, 100k by default.
+// Returns 1 if the readers disagree.
+
+#include "jsonReader.h"
+#include "fileSystem.h"
+
+#include <json/json.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <locale.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#define BENCH_RUNS 3 // Best of
+
+static double getTime()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string generateMap(int count)
+{
+    std::string text = "{\"version\":4,\"editor\":{\"snap\":false},\"library\":[{\"id\":1,\"filename\":\"a.fbx\",\"scale\":1.0}],\"map\":[\n";
+    char entity[512];
+    srand(1);
+    for (int i = 0; i < count; ++i)
+    {
+        auto x = (double)rand() / RAND_MAX * 10000.0 - 5000.0;
+        auto y = (double)rand() / RAND_MAX * 10000.0 - 5000.0;
+        auto z = (double)(rand() % 1000) / 8.0;
+        snprintf(entity, sizeof(entity),
+            "{\"modelId\":%i,\"position\":{\"x\":%.17g,\"y\":%.17g,\"z\":%.3f},\"rotation\":{\"x\":0.0,\"y\":0.0,\"z\":0.38268343,\"w\":0.92387953},\"scale\":{\"x\":1.0,\"y\":1.0,\"z\":1.5},\"id\":%i,\"layer\":%i}%s\n",
+            1 + i % 16, x, y, z, i + 1, i % 4, i + 1 < count ? "," : "");
+        text += entity;
+    }
+    text += "]}\n";
+    return text;
+}
+
+// Sum of the positions, to compare what both readers decoded
+static double sumEntities(const Entities& entities)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < entities_getChunkCount(entities); ++i)
+    {
+        const auto& chunk = entities_getChunk(entities, i);
+        for (uint32_t j = 0; j < chunk.count * 3; ++j) sum += chunk.positions[j];
+    }
+    return sum;
+}
+
+static double sumJson(const Json::Value& jsonMap)
+{
+    double sum = 0.0;
+    for (const auto& jsonEntity : jsonMap)
+    {
+        const auto& jsonPosition = jsonEntity["position"];
+        sum += jsonPosition["x"].asDouble() + jsonPosition["y"].asDouble() + jsonPosition["z"].asDouble();
+    }
+    return sum;
+}
+
+int main(int argc, char** argv)
+{
+    // Numbers must read the same whatever the locale
+    setlocale(LC_ALL, "");
+
+    std::string text;
+    MappedFile mappedFile;
+    const char* pData;
+    size_t size;
+    if (argc > 1 && strspn(argv[1], "0123456789") != strlen(argv[1]))
+    {
+        if (!fileSystem_map(argv[1], &mappedFile))
+        {
+            fprintf(stderr, "Can't read %s\n", argv[1]);
+            return 1;
+        }
+        pData = (const char*)mappedFile.pData;
+        size = mappedFile.size;
+    }
+    else
+    {
+        text = generateMap(argc > 1 ? atoi(argv[1]) : 100000);
+        pData = text.data();
+        size = text.size();
+    }
+
+    double readerTime = 1e30;
+    Json::Value json;
+    Entities entities;
+    for (int run = 0; run < BENCH_RUNS; ++run)
+    {
+        std::string error;
+        auto start = getTime();
+        if (!jsonReader_loadMap(pData, size, json, entities, error))
+        {
+            fprintf(stderr, "jsonReader: %s\n", error.c_str());
+            return 1;
+        }
+        readerTime = std::min(readerTime, getTime() - start);
+    }
+
+    double jsoncppTime = 1e30;
+    Json::Value jsoncppJson;
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> pReader(builder.newCharReader());
+    for (int run = 0; run < BENCH_RUNS; ++run)
+    {
+        std::string errors;
+        auto start = getTime();
+        if (!pReader->parse(pData, pData + size, &jsoncppJson, &errors))
+        {
+            fprintf(stderr, "jsoncpp: %s\n", errors.c_str());
+            return 1;
+        }
+        jsoncppTime = std::min(jsoncppTime, getTime() - start);
+    }
+
+    auto count = entities_count(entities);
+    printf("%.1f MB, %u entities\n", (double)size / (1024.0 * 1024.0), (unsigned)count);
+    printf("  jsoncpp     %8.1f ms\n", jsoncppTime);
+    printf("  jsonReader  %8.1f ms  (%.1fx)\n", readerTime, jsoncppTime / readerTime);
+
+    const auto& jsonMap = jsoncppJson["map"];
+    auto sum = sumEntities(entities);
+    auto expected = sumJson(jsonMap);
+    if (count != jsonMap.size() || std::abs(sum - expected) > std::abs(expected) * 1e-12)
+    {
+        fprintf(stderr, "The readers disagree: %u entities, sum %.17g, jsoncpp %u, sum %.17g\n",
+            (unsigned)count, sum, (unsigned)jsonMap.size(), expected);
+        return 1;
+    }
+    if (mappedFile.pData) fileSystem_unmap(&mappedFile);
+    return 0;
+}
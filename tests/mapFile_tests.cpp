@@ -0,0 +1,273 @@
+// Saves maps and reads them back, in both formats, and checks every entity
+// comes back the same. Then feeds the binary reader truncated and corrupted
+// maps, which it must refuse or read without going out of bounds.
+//   mapFile_tests [entity count]
+// 3000 entities by default. Returns 1 if a map doesn't read back.
+
+#include "mapFile.h"
+#include "globals.h"
+#include "jsonReader.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define TESTS_CORRUPT_ENTITIES 3 // Every byte of a map that small is corrupted in turn
+
+static int failureCount = 0;
+
+static float randomFloat(float min, float max)
+{
+    return min + (max - min) * (float)rand() / (float)RAND_MAX;
+}
+
+static void fail(const char* name, const std::string& what)
+{
+    if (failureCount < 20) printf("FAILED %s: %s\n", name, what.c_str());
+    ++failureCount;
+}
+
+static EntityRow getRow(const Entities& entities, size_t index)
+{
+    size_t c = 0;
+    while (index >= entities_getChunk(entities, c).count) index -= entities_getChunk(entities, c++).count;
+    const auto& chunk = entities_getChunk(entities, c);
+    EntityRow row;
+    row.flags = chunk.flags[index];
+    row.modelId = chunk.modelIds[index];
+    memcpy(row.position, &chunk.positions[index * 3], sizeof(row.position));
+    memcpy(row.rotation, &chunk.rotations[index * 4], sizeof(row.rotation));
+    memcpy(row.scale, &chunk.scales[index * 3], sizeof(row.scale));
+    row.id = chunk.ids[index];
+    row.parent = chunk.parents[index];
+    row.layer = chunk.layers[index];
+    row.extras = chunk.extras[index];
+    return row;
+}
+
+// A bit of everything: default and random transforms, ids and layers of 0,
+// extras and entities kept raw
+static void createMap(size_t count, Json::Value& json, Entities& entities)
+{
+    json = Json::Value();
+    json["version"] = MAP_VERSION;
+    json["editor"]["snap"] = true;
+    json["layers"][0]["name"] = "Default";
+    json["layers"][1]["name"] = "Props";
+    json["layers"][1]["locked"] = true;
+
+    entities_clear(entities);
+    for (size_t i = 0; i < count; ++i)
+    {
+        EntityRow row;
+        auto kind = i % 7;
+        if (kind == 6)
+        {
+            row.flags = ENTITY_FLAG_RAW;
+            row.extras = "{\"modelId\":\"rock\",\"note\":[1,2," + std::to_string(i) + "]}";
+            entities_append(entities, row);
+            continue;
+        }
+        row.modelId = (uint64_t)(rand() % 100) + (kind == 5 ? ((uint64_t)1 << 40) : 0);
+        for (int k = 0; k < 3; ++k) row.position[k] = (double)randomFloat(-1e5f, 1e5f) + (double)rand() / RAND_MAX * 1e-7;
+        if (kind > 1)
+        {
+            double length = 0.0;
+            for (int k = 0; k < 4; ++k)
+            {
+                row.rotation[k] = randomFloat(-1.0f, 1.0f);
+                length += (double)row.rotation[k] * row.rotation[k];
+            }
+            for (int k = 0; k < 4; ++k) row.rotation[k] = (float)(row.rotation[k] / std::sqrt(std::max(length, 1e-12)));
+            for (int k = 0; k < 3; ++k) row.scale[k] = randomFloat(0.1f, 10.0f);
+        }
+        row.id = kind == 0 ? ENTITY_NO_ID : (uint32_t)i + 1;
+        row.parent = kind == 3 && i > 0 ? (uint32_t)i : ENTITY_NO_ID;
+        row.layer = (uint8_t)(kind == 4 ? rand() % ENTITY_MAX_LAYERS : 0);
+        if (kind == 2) row.extras = "{\"tag\":\"t" + std::to_string(i % 5) + "\"}";
+        entities_append(entities, row);
+    }
+}
+
+static bool isSameRow(const EntityRow& a, const EntityRow& b)
+{
+    return a.flags == b.flags && a.modelId == b.modelId &&
+        !memcmp(a.position, b.position, sizeof(a.position)) &&
+        !memcmp(a.rotation, b.rotation, sizeof(a.rotation)) &&
+        !memcmp(a.scale, b.scale, sizeof(a.scale)) &&
+        a.id == b.id && a.parent == b.parent && a.layer == b.layer && a.extras == b.extras;
+}
+
+static void checkSame(const char* name, const Json::Value& json, const Entities& entities, const Json::Value& loadedJson, const Entities& loaded)
+{
+    if (loadedJson != json) fail(name, "other members differ");
+    if (entities_count(loaded) != entities_count(entities))
+    {
+        fail(name, "entity count differs");
+        return;
+    }
+    for (size_t i = 0; i < entities_count(entities); ++i)
+    {
+        if (isSameRow(getRow(loaded, i), getRow(entities, i))) continue;
+        fail(name, "entity " + std::to_string(i) + " differs");
+        return;
+    }
+}
+
+static void testBinary(const Json::Value& json, const Entities& entities)
+{
+    std::vector<uint8_t> data;
+    mapFile_toBinary(json, entities, data);
+    Json::Value loadedJson;
+    Entities loaded;
+    std::string error;
+    if (!mapFile_fromBinary(data.data(), data.size(), loadedJson, loaded, error)) fail("binary", error);
+    else checkSame("binary", json, entities, loadedJson, loaded);
+}
+
+static void testJson(const Json::Value& json, const Entities& entities)
+{
+    std::ostringstream out;
+    mapFile_toJson(json, entities, out);
+    auto text = out.str();
+    Json::Value loadedJson;
+    Entities loaded;
+    std::string error;
+    if (!jsonReader_loadMap(text.data(), text.size(), loadedJson, loaded, error)) fail("json", error);
+    else checkSame("json", json, entities, loadedJson, loaded);
+
+    // Every entity has its id and layer, even when 0
+    Json::Value parsed;
+    Json::CharReaderBuilder builder;
+    std::istringstream in(text);
+    if (!Json::parseFromStream(builder, in, &parsed, &error))
+    {
+        fail("json", "not valid JSON: " + error);
+        return;
+    }
+    for (Json::ArrayIndex i = 0; i < parsed["map"].size(); ++i)
+    {
+        const auto& entity = parsed["map"][i];
+        if (entity["modelId"].isString()) continue; // Raw, written as it was
+        if (entity.isMember("id") && entity.isMember("layer")) continue;
+        fail("json", "entity " + std::to_string(i) + " without its id or layer");
+        break;
+    }
+}
+
+// JSON has no NaN nor infinities, they are written clamped
+static void testNonFinite()
+{
+    Json::Value json;
+    json["version"] = MAP_VERSION;
+    Entities entities;
+    EntityRow row;
+    row.position[0] = std::numeric_limits<double>::quiet_NaN();
+    row.position[1] = std::numeric_limits<double>::infinity();
+    row.position[2] = -std::numeric_limits<double>::infinity();
+    row.rotation[0] = std::numeric_limits<float>::quiet_NaN();
+    row.scale[0] = std::numeric_limits<float>::infinity();
+    row.scale[1] = -std::numeric_limits<float>::infinity();
+    entities_append(entities, row);
+
+    std::ostringstream out;
+    mapFile_toJson(json, entities, out);
+    auto text = out.str();
+    auto lower = text;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](char c) { return (char)tolower(c); });
+    if (lower.find("nan") != std::string::npos || lower.find("inf") != std::string::npos) fail("non finite", "written as is");
+
+    Json::Value loadedJson;
+    Entities loaded;
+    std::string error;
+    if (!jsonReader_loadMap(text.data(), text.size(), loadedJson, loaded, error))
+    {
+        fail("non finite", "unreadable: " + error);
+        return;
+    }
+    auto loadedRow = getRow(loaded, 0);
+    if (loadedRow.position[0] != 0.0 || loadedRow.position[1] != DBL_MAX || loadedRow.position[2] != -DBL_MAX) fail("non finite", "position not clamped");
+    if (loadedRow.rotation[0] != 0.0f) fail("non finite", "rotation not clamped");
+    if (loadedRow.scale[0] != FLT_MAX || loadedRow.scale[1] != -FLT_MAX) fail("non finite", "scale not clamped");
+}
+
+// Cut short anywhere or with any byte changed, the reader refuses the map or
+// reads something. Run under a sanitizer, it also never reads out of bounds.
+static void testCorrupt()
+{
+    Json::Value json;
+    Entities entities;
+    createMap(TESTS_CORRUPT_ENTITIES, json, entities);
+    std::vector<uint8_t> data;
+    mapFile_toBinary(json, entities, data);
+
+    Json::Value loadedJson;
+    Entities loaded;
+    std::string error;
+    for (size_t size = 0; size < data.size(); ++size)
+    {
+        // A copy of that size, so reads past it are caught
+        std::vector<uint8_t> truncated(data.begin(), data.begin() + size);
+        if (mapFile_fromBinary(truncated.data(), truncated.size(), loadedJson, loaded, error))
+        {
+            fail("truncated", "read at " + std::to_string(size) + " bytes out of " + std::to_string(data.size()));
+            break;
+        }
+    }
+
+    static const uint8_t VALUES[] = { 0x00, 0x01, 0x7F, 0xFF };
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        for (auto value : VALUES)
+        {
+            auto corrupted = data;
+            if (corrupted[i] == value) continue;
+            corrupted[i] = value;
+            if (!mapFile_fromBinary(corrupted.data(), corrupted.size(), loadedJson, loaded, error)) continue;
+            if (entities_count(loaded) > (size_t)TESTS_CORRUPT_ENTITIES * 1024) fail("corrupted", "entity count not checked against the data");
+        }
+    }
+}
+
+// Through the files, the format from the extension
+static void testFiles(const Json::Value& json, const Entities& entities)
+{
+    static const char* FILENAMES[] = { "mapFile_tests" MAP_BINARY_EXTENSION, "mapFile_tests" MAP_JSON_EXTENSION };
+    for (auto pFilename : FILENAMES)
+    {
+        std::string error;
+        Json::Value loadedJson;
+        Entities loaded;
+        if (!mapFile_save(pFilename, json, entities, error)) fail(pFilename, error);
+        else if (!mapFile_load(pFilename, loadedJson, loaded, error)) fail(pFilename, error);
+        else checkSame(pFilename, json, entities, loadedJson, loaded);
+        remove(pFilename);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    srand(1);
+    Json::Value json;
+    Entities entities;
+    createMap(argc > 1 ? (size_t)std::max(1, atoi(argv[1])) : 3000, json, entities);
+    testBinary(json, entities);
+    testJson(json, entities);
+    testFiles(json, entities);
+    testNonFinite();
+    testCorrupt();
+    if (failureCount)
+    {
+        printf("%i failed\n", failureCount);
+        return 1;
+    }
+    printf("All passed\n");
+    return 0;
+}
@@ -0,0 +1,498 @@
+// Checks the vectorMath kernels against plain double precision references,
+// for odd counts and in place calls, then times both.
+//   vectorMath_tests [item count]
+// 100k items by default. Returns 1 if a kernel is off.
+
+#include "vectorMath.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define TESTS_MAX_COUNT 37 // Odd counts up to this, so every tail is hit
+#define TESTS_TOLERANCE 1e-4 // Relative to the magnitude of what's compared
+#define BENCH_RUNS 20 // Best of
+
+static int failureCount = 0;
+
+static double getTime()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static float randomFloat(float min, float max)
+{
+    return min + (max - min) * (float)rand() / (float)RAND_MAX;
+}
+
+static void check(const char* name, size_t count, const float* pValues, const double* pExpected, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto tolerance = TESTS_TOLERANCE * std::max(1.0, std::fabs(pExpected[i]));
+        if (std::fabs((double)pValues[i] - pExpected[i]) <= tolerance) continue;
+        printf("FAILED %s, count %u: [%u] is %.9g, expected %.9g\n", name, (unsigned)count, (unsigned)i, pValues[i], pExpected[i]);
+        ++failureCount;
+        return;
+    }
+}
+
+static void randomQuaternion(float q[4])
+{
+    double d[4], length = 0.0;
+    for (int k = 0; k < 4; ++k)
+    {
+        d[k] = randomFloat(-1.0f, 1.0f);
+        length += d[k] * d[k];
+    }
+    length = std::sqrt(std::max(length, 1e-12));
+    for (int k = 0; k < 4; ++k) q[k] = (float)(d[k] / length);
+}
+
+// Rotation, non uniform scale and translation
+static mat4 randomAffine()
+{
+    float t[3] = { randomFloat(-100.0f, 100.0f), randomFloat(-100.0f, 100.0f), randomFloat(-100.0f, 100.0f) };
+    float q[4];
+    randomQuaternion(q);
+    float s[3] = { randomFloat(0.2f, 4.0f), randomFloat(0.2f, 4.0f), randomFloat(0.2f, 4.0f) };
+    mat4 m;
+    vectorMath_composeTrs(t, q, s, &m, 1);
+    return m;
+}
+
+//-----------------------------------------------------------------------------
+// References, one item at a time in doubles, m[col][row]
+
+static void refTransformPoint(const float m[4][4], const float* p, double* pOut)
+{
+    for (int row = 0; row < 3; ++row)
+    {
+        pOut[row] = (double)m[0][row] * p[0] + (double)m[1][row] * p[1] + (double)m[2][row] * p[2] + (double)m[3][row];
+    }
+}
+
+// Around the 8 transformed corners
+static void refTransformAabb(const float m[4][4], const float* pBox, double* pOut)
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        pOut[k] = 1e300;
+        pOut[3 + k] = -1e300;
+    }
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        const float p[3] = { pBox[(corner & 1) ? 3 : 0], pBox[(corner & 2) ? 4 : 1], pBox[(corner & 4) ? 5 : 2] };
+        double q[3];
+        refTransformPoint(m, p, q);
+        for (int k = 0; k < 3; ++k)
+        {
+            pOut[k] = std::min(pOut[k], q[k]);
+            pOut[3 + k] = std::max(pOut[3 + k], q[k]);
+        }
+    }
+}
+
+static void refComposeTrs(const float* t, const float* q, const float* s, double out[16])
+{
+    double x = q[0], y = q[1], z = q[2], w = q[3];
+    const double r[3][3] = {
+        { 1.0 - 2.0 * (y * y + z * z), 2.0 * (x * y + w * z), 2.0 * (x * z - w * y) },
+        { 2.0 * (x * y - w * z), 1.0 - 2.0 * (x * x + z * z), 2.0 * (y * z + w * x) },
+        { 2.0 * (x * z + w * y), 2.0 * (y * z - w * x), 1.0 - 2.0 * (x * x + y * y) }
+    };
+    for (int col = 0; col < 3; ++col)
+    {
+        for (int row = 0; row < 3; ++row) out[col * 4 + row] = r[col][row] * s[col];
+        out[col * 4 + 3] = 0.0;
+    }
+    for (int row = 0; row < 3; ++row) out[12 + row] = t[row];
+    out[15] = 1.0;
+}
+
+// Gauss-Jordan on the whole 4x4, with partial pivoting
+static bool refInverse(const float m[4][4], double out[16])
+{
+    double a[4][8];
+    for (int row = 0; row < 4; ++row)
+    {
+        for (int col = 0; col < 4; ++col)
+        {
+            a[row][col] = m[col][row];
+            a[row][4 + col] = row == col ? 1.0 : 0.0;
+        }
+    }
+    for (int col = 0; col < 4; ++col)
+    {
+        auto pivot = col;
+        for (int row = col + 1; row < 4; ++row)
+        {
+            if (std::fabs(a[row][col]) > std::fabs(a[pivot][col])) pivot = row;
+        }
+        if (std::fabs(a[pivot][col]) < 1e-12) return false;
+        for (int k = 0; k < 8; ++k) std::swap(a[col][k], a[pivot][k]);
+        auto scale = 1.0 / a[col][col];
+        for (int k = 0; k < 8; ++k) a[col][k] *= scale;
+        for (int row = 0; row < 4; ++row)
+        {
+            if (row == col) continue;
+            auto factor = a[row][col];
+            for (int k = 0; k < 8; ++k) a[row][k] -= factor * a[col][k];
+        }
+    }
+    for (int col = 0; col < 4; ++col)
+    {
+        for (int row = 0; row < 4; ++row) out[col * 4 + row] = a[row][4 + col];
+    }
+    return true;
+}
+
+static void toDoubles(const mat4& m, double out[16])
+{
+    float values[4][4];
+    mat4_store(m, values);
+    for (int i = 0; i < 16; ++i) out[i] = values[i / 4][i % 4];
+}
+
+static void toFloats(const mat4* pMatrices, size_t count, std::vector<float>& out)
+{
+    out.resize(count * 16);
+    for (size_t i = 0; i < count; ++i) mat4_store(pMatrices[i], (float(*)[4])&out[i * 16]);
+}
+
+//-----------------------------------------------------------------------------
+// Tests
+
+static void testTransformPoints()
+{
+    for (size_t count = 0; count <= TESTS_MAX_COUNT; ++count)
+    {
+        auto m = randomAffine();
+        float columns[4][4];
+        mat4_store(m, columns);
+        std::vector<float> points(count * 3), out(count * 3);
+        for (auto& value : points) value = randomFloat(-50.0f, 50.0f);
+        std::vector<double> expected(count * 3);
+        for (size_t i = 0; i < count; ++i) refTransformPoint(columns, &points[i * 3], &expected[i * 3]);
+
+        vectorMath_transformPoints(m, points.data(), out.data(), count);
+        check("transformPoints", count, out.data(), expected.data(), expected.size());
+        vectorMath_transformPoints(m, points.data(), points.data(), count);
+        check("transformPoints in place", count, points.data(), expected.data(), expected.size());
+    }
+}
+
+static void randomBoxes(std::vector<float>& boxes, size_t count)
+{
+    boxes.resize(count * 6);
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            auto a = randomFloat(-50.0f, 50.0f), b = randomFloat(-50.0f, 50.0f);
+            boxes[i * 6 + k] = std::min(a, b);
+            boxes[i * 6 + 3 + k] = std::max(a, b);
+        }
+    }
+}
+
+static void testTransformAabbs()
+{
+    for (size_t count = 0; count <= TESTS_MAX_COUNT; ++count)
+    {
+        auto m = randomAffine();
+        float columns[4][4];
+        mat4_store(m, columns);
+        std::vector<float> boxes, out(count * 6);
+        randomBoxes(boxes, count);
+        std::vector<double> expected(count * 6);
+        for (size_t i = 0; i < count; ++i) refTransformAabb(columns, &boxes[i * 6], &expected[i * 6]);
+
+        vectorMath_transformAabbs(m, boxes.data(), out.data(), count);
+        check("transformAabbs", count, out.data(), expected.data(), expected.size());
+        vectorMath_transformAabbs(m, boxes.data(), boxes.data(), count);
+        check("transformAabbs in place", count, boxes.data(), expected.data(), expected.size());
+    }
+}
+
+static void testTransformAabbsEach()
+{
+    for (size_t count = 0; count <= TESTS_MAX_COUNT; ++count)
+    {
+        std::vector<mat4> matrices(count);
+        for (auto& m : matrices) m = randomAffine();
+        std::vector<float> columns;
+        toFloats(matrices.data(), count, columns);
+        std::vector<float> boxes, out(count * 6);
+        randomBoxes(boxes, count);
+
+        std::vector<double> expected(count * 6);
+        for (size_t i = 0; i < count; ++i) refTransformAabb((const float(*)[4])&columns[i * 16], &boxes[i * 6], &expected[i * 6]);
+        vectorMath_transformAabbsEach(matrices.data(), boxes.data(), 6, out.data(), count);
+        check("transformAabbsEach", count, out.data(), expected.data(), expected.size());
+
+        // The first box by all the matrices
+        for (size_t i = 0; i < count; ++i) refTransformAabb((const float(*)[4])&columns[i * 16], boxes.data(), &expected[i * 6]);
+        vectorMath_transformAabbsEach(matrices.data(), boxes.data(), 0, out.data(), count);
+        check("transformAabbsEach shared box", count, out.data(), expected.data(), expected.size());
+    }
+}
+
+static void testComposeTrs()
+{
+    for (size_t count = 0; count <= TESTS_MAX_COUNT; ++count)
+    {
+        std::vector<float> translations(count * 3), rotations(count * 4), scales(count * 3);
+        for (auto& value : translations) value = randomFloat(-100.0f, 100.0f);
+        for (size_t i = 0; i < count; ++i) randomQuaternion(&rotations[i * 4]);
+        for (auto& value : scales) value = randomFloat(-4.0f, 4.0f);
+        std::vector<mat4> out(count);
+        vectorMath_composeTrs(translations.data(), rotations.data(), scales.data(), out.data(), count);
+
+        std::vector<float> values;
+        toFloats(out.data(), count, values);
+        std::vector<double> expected(count * 16);
+        for (size_t i = 0; i < count; ++i) refComposeTrs(&translations[i * 3], &rotations[i * 4], &scales[i * 3], &expected[i * 16]);
+        check("composeTrs", count, values.data(), expected.data(), expected.size());
+    }
+}
+
+// Composed back, the matrix is the same: the quaternion's sign doesn't matter
+static void testDecompose()
+{
+    for (size_t i = 0; i < TESTS_MAX_COUNT; ++i)
+    {
+        float t[3] = { randomFloat(-100.0f, 100.0f), randomFloat(-100.0f, 100.0f), randomFloat(-100.0f, 100.0f) };
+        float q[4];
+        randomQuaternion(q);
+        float s[3] = { randomFloat(0.2f, 4.0f), randomFloat(0.2f, 4.0f), randomFloat(0.2f, 4.0f) };
+        if (i & 1) s[0] = -s[0];
+        mat4 m;
+        vectorMath_composeTrs(t, q, s, &m, 1);
+
+        float rotation[4], scale[3];
+        mat4_decompose(m, rotation, scale);
+        mat4 composed;
+        vectorMath_composeTrs(t, rotation, scale, &composed, 1);
+        std::vector<float> values;
+        toFloats(&composed, 1, values);
+        double expected[16];
+        toDoubles(m, expected);
+        check("decompose", i, values.data(), expected, 16);
+    }
+}
+
+static void testRelativeMatrices()
+{
+    for (size_t count = 0; count <= TESTS_MAX_COUNT; ++count)
+    {
+        std::vector<mat4> matrices(count);
+        std::vector<double> origins(count * 3);
+        for (auto& m : matrices) m = randomAffine();
+        for (auto& value : origins) value = (double)randomFloat(-1e6f, 1e6f) + 0.25;
+        const double eye[3] = { 123456.5, -654321.25, 42.0 };
+
+        std::vector<double> expected(count * 16);
+        for (size_t i = 0; i < count; ++i)
+        {
+            toDoubles(matrices[i], &expected[i * 16]);
+            for (int k = 0; k < 3; ++k) expected[i * 16 + 12 + k] += origins[i * 3 + k] - eye[k];
+        }
+        std::vector<float> values;
+        vectorMath_relativeMatrices(matrices.data(), origins.data(), eye, matrices.data(), count);
+        toFloats(matrices.data(), count, values);
+        check("relativeMatrices in place", count, values.data(), expected.data(), expected.size());
+    }
+}
+
+static void testInverseAffine()
+{
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto m = randomAffine();
+        float columns[4][4];
+        mat4_store(m, columns);
+        double expected[16];
+        mat4 inverse;
+        if (!refInverse(columns, expected) || !mat4_inverseAffine(m, inverse))
+        {
+            printf("FAILED inverseAffine: an invertible matrix wasn't inverted\n");
+            ++failureCount;
+            return;
+        }
+        float values[16];
+        mat4_store(inverse, (float(*)[4])values);
+        check("inverseAffine", 1, values, expected, 16);
+    }
+
+    // A zero scale flattens it
+    const float t[3] = { 1.0f, 2.0f, 3.0f }, q[4] = { 0.0f, 0.0f, 0.0f, 1.0f }, s[3] = { 1.0f, 0.0f, 1.0f };
+    mat4 flat, inverse;
+    vectorMath_composeTrs(t, q, s, &flat, 1);
+    if (mat4_inverseAffine(flat, inverse))
+    {
+        printf("FAILED inverseAffine: a flattened matrix was inverted\n");
+        ++failureCount;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Timings, against the references in float
+
+template<typename Fn>
+static double bestOf(Fn fn)
+{
+    auto best = 1e30;
+    for (int run = 0; run < BENCH_RUNS; ++run)
+    {
+        auto start = getTime();
+        fn();
+        best = std::min(best, getTime() - start);
+    }
+    return best;
+}
+
+static volatile float sink; // So the reference loops aren't optimized out
+
+static void bench(size_t count)
+{
+    std::vector<mat4> matrices(count);
+    for (auto& m : matrices) m = randomAffine();
+    std::vector<float> columns;
+    toFloats(matrices.data(), count, columns);
+    const auto& m = matrices[0];
+    float m0[4][4];
+    mat4_store(m, m0);
+    std::vector<float> points(count * 3), boxes, out(count * 16);
+    for (auto& value : points) value = randomFloat(-50.0f, 50.0f);
+    randomBoxes(boxes, count);
+    std::vector<float> translations(count * 3), rotations(count * 4), scales(count * 3);
+    for (auto& value : translations) value = randomFloat(-100.0f, 100.0f);
+    for (size_t i = 0; i < count; ++i) randomQuaternion(&rotations[i * 4]);
+    for (auto& value : scales) value = randomFloat(0.2f, 4.0f);
+    std::vector<mat4> outMatrices(count);
+    std::vector<double> origins(count * 3, 1000.0);
+    const double eye[3] = { 10.0, 20.0, 30.0 };
+
+    auto toNs = [count](double ms) { return ms * 1e6 / (double)count; };
+    printf("%u items, ns per item, kernel vs scalar reference:\n", (unsigned)count);
+
+    auto kernel = bestOf([&] { vectorMath_transformPoints(m, points.data(), out.data(), count); });
+    auto reference = bestOf([&]
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto p = &points[i * 3];
+            for (int row = 0; row < 3; ++row) out[i * 3 + row] = m0[0][row] * p[0] + m0[1][row] * p[1] + m0[2][row] * p[2] + m0[3][row];
+        }
+        sink = out[0];
+    });
+    printf("  transformPoints      %6.2f vs %6.2f\n", toNs(kernel), toNs(reference));
+
+    auto corners = [&](const float (*pM)[4], const float* pBox, float* pOut)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            pOut[k] = 1e30f;
+            pOut[3 + k] = -1e30f;
+        }
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            const float p[3] = { pBox[(corner & 1) ? 3 : 0], pBox[(corner & 2) ? 4 : 1], pBox[(corner & 4) ? 5 : 2] };
+            for (int row = 0; row < 3; ++row)
+            {
+                auto value = pM[0][row] * p[0] + pM[1][row] * p[1] + pM[2][row] * p[2] + pM[3][row];
+                pOut[row] = std::min(pOut[row], value);
+                pOut[3 + row] = std::max(pOut[3 + row], value);
+            }
+        }
+    };
+    kernel = bestOf([&] { vectorMath_transformAabbs(m, boxes.data(), out.data(), count); });
+    reference = bestOf([&]
+    {
+        for (size_t i = 0; i < count; ++i) corners(m0, &boxes[i * 6], &out[i * 6]);
+        sink = out[0];
+    });
+    printf("  transformAabbs       %6.2f vs %6.2f\n", toNs(kernel), toNs(reference));
+
+    kernel = bestOf([&] { vectorMath_transformAabbsEach(matrices.data(), boxes.data(), 6, out.data(), count); });
+    auto single = bestOf([&]
+    {
+        for (size_t i = 0; i < count; ++i) vectorMath_transformAabbs(matrices[i], &boxes[i * 6], &out[i * 6], 1);
+    });
+    reference = bestOf([&]
+    {
+        for (size_t i = 0; i < count; ++i) corners((const float(*)[4])&columns[i * 16], &boxes[i * 6], &out[i * 6]);
+        sink = out[0];
+    });
+    printf("  transformAabbsEach   %6.2f vs %6.2f (%.2f one call per box)\n", toNs(kernel), toNs(reference), toNs(single));
+
+    kernel = bestOf([&] { vectorMath_composeTrs(translations.data(), rotations.data(), scales.data(), outMatrices.data(), count); });
+    reference = bestOf([&]
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto q = &rotations[i * 4];
+            auto s = &scales[i * 3];
+            auto t = &translations[i * 3];
+            auto x = q[0], y = q[1], z = q[2], w = q[3];
+            auto pOut = &out[(i % (out.size() / 16)) * 16];
+            pOut[0] = (1.0f - 2.0f * (y * y + z * z)) * s[0]; pOut[1] = 2.0f * (x * y + w * z) * s[0]; pOut[2] = 2.0f * (x * z - w * y) * s[0]; pOut[3] = 0.0f;
+            pOut[4] = 2.0f * (x * y - w * z) * s[1]; pOut[5] = (1.0f - 2.0f * (x * x + z * z)) * s[1]; pOut[6] = 2.0f * (y * z + w * x) * s[1]; pOut[7] = 0.0f;
+            pOut[8] = 2.0f * (x * z + w * y) * s[2]; pOut[9] = 2.0f * (y * z - w * x) * s[2]; pOut[10] = (1.0f - 2.0f * (x * x + y * y)) * s[2]; pOut[11] = 0.0f;
+            pOut[12] = t[0]; pOut[13] = t[1]; pOut[14] = t[2]; pOut[15] = 1.0f;
+        }
+        sink = out[0];
+    });
+    printf("  composeTrs           %6.2f vs %6.2f\n", toNs(kernel), toNs(reference));
+
+    kernel = bestOf([&] { vectorMath_relativeMatrices(matrices.data(), origins.data(), eye, outMatrices.data(), count); });
+    reference = bestOf([&]
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto pOut = &out[i * 16];
+            memcpy(pOut, &columns[i * 16], sizeof(float) * 16);
+            for (int k = 0; k < 3; ++k) pOut[12 + k] += (float)(origins[i * 3 + k] - eye[k]);
+        }
+        sink = out[0];
+    });
+    printf("  relativeMatrices     %6.2f vs %6.2f\n", toNs(kernel), toNs(reference));
+
+    kernel = bestOf([&]
+    {
+        for (size_t i = 0; i < count; ++i) mat4_inverseAffine(matrices[i], outMatrices[i]);
+    });
+    reference = bestOf([&]
+    {
+        double inverse[16];
+        for (size_t i = 0; i < count; ++i) refInverse((const float(*)[4])&columns[i * 16], inverse);
+        sink = (float)inverse[0];
+    });
+    printf("  inverseAffine        %6.2f vs %6.2f (4x4 Gauss-Jordan)\n", toNs(kernel), toNs(reference));
+}
+
+int main(int argc, char** argv)
+{
+    srand(1);
+    testTransformPoints();
+    testTransformAabbs();
+    testTransformAabbsEach();
+    testComposeTrs();
+    testDecompose();
+    testRelativeMatrices();
+    testInverseAffine();
+    if (failureCount)
+    {
+        printf("%i failed\n", failureCount);
+        return 1;
+    }
+    printf("All passed\n");
+
+    bench(argc > 1 ? (size_t)atoi(argv[1]) : 100000);
+    return 0;
+}